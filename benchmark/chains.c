@@ -0,0 +1,78 @@
+// SPDX-FileCopyrightText: 2024 Erin Catto
+// SPDX-License-Identifier: MIT
+
+#include "box2d/box2d.h"
+#include "box2d/geometry.h"
+#include "box2d/math_functions.h"
+
+#include <stdlib.h>
+
+// Circles and capsules rolling over long chain terrain. Each chain is made of many smooth segments.
+
+#ifdef NDEBUG
+#define CHAIN_POINT_COUNT 20000
+#define CHAIN_BODY_COUNT 2000
+#else
+#define CHAIN_POINT_COUNT 2000
+#define CHAIN_BODY_COUNT 100
+#endif
+
+b2WorldId Chains(b2WorldDef* worldDef)
+{
+	b2WorldId worldId = b2CreateWorld(worldDef);
+
+	float spacing = 0.25f;
+	float width = spacing * (CHAIN_POINT_COUNT - 1);
+	float x0 = -0.5f * width;
+
+	{
+		b2Vec2* points = malloc(CHAIN_POINT_COUNT * sizeof(b2Vec2));
+
+		// Rolling hills with a smaller ripple. The chain runs right to left so the solid side is below.
+		for (int i = 0; i < CHAIN_POINT_COUNT; ++i)
+		{
+			float x = x0 + spacing * (CHAIN_POINT_COUNT - 1 - i);
+			float y = 4.0f * sinf(0.05f * x) + 0.5f * sinf(0.7f * x);
+			points[i] = (b2Vec2){x, y};
+		}
+
+		b2BodyDef bodyDef = b2DefaultBodyDef();
+		b2BodyId groundId = b2CreateBody(worldId, &bodyDef);
+
+		b2ChainDef chainDef = b2DefaultChainDef();
+		chainDef.points = points;
+		chainDef.count = CHAIN_POINT_COUNT;
+		b2CreateChain(groundId, &chainDef);
+
+		free(points);
+	}
+
+	{
+		b2BodyDef bodyDef = b2DefaultBodyDef();
+		bodyDef.type = b2_dynamicBody;
+
+		b2ShapeDef shapeDef = b2DefaultShapeDef();
+		shapeDef.friction = 0.3f;
+
+		b2Circle circle = {{0.0f, 0.0f}, 0.5f};
+		b2Capsule capsule = {{-0.4f, 0.0f}, {0.4f, 0.0f}, 0.3f};
+
+		float bodySpacing = width / CHAIN_BODY_COUNT;
+		for (int i = 0; i < CHAIN_BODY_COUNT; ++i)
+		{
+			bodyDef.position = (b2Vec2){x0 + bodySpacing * (i + 0.5f), 8.0f};
+			b2BodyId bodyId = b2CreateBody(worldId, &bodyDef);
+
+			if (i & 1)
+			{
+				b2CreateCapsuleShape(bodyId, &shapeDef, &capsule);
+			}
+			else
+			{
+				b2CreateCircleShape(bodyId, &shapeDef, &circle);
+			}
+		}
+	}
+
+	return worldId;
+}
@@ -0,0 +1,405 @@
+// SPDX-FileCopyrightText: 2024 Erin Catto
+// SPDX-License-Identifier: MIT
+
+// Microbenchmarks for the narrow phase, distance and hull kernels. Each kernel is run over a set of randomized
+// shape pairs that is reproducible from the seed. Pairs are grouped into cases so changes can be compared on
+// separated, touching, deeply overlapping and arbitrarily rotated configurations.
+
+#include "box2d/collision.h"
+#include "box2d/distance.h"
+#include "box2d/geometry.h"
+#include "box2d/math_functions.h"
+#include "box2d/timer.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARRAY_COUNT(A) (int)(sizeof(A) / sizeof(A[0]))
+
+// Gap used for touching pairs, roughly the linear slop
+#define TOUCHING_GAP 0.005f
+
+typedef enum PairCase
+{
+	e_separated,
+	e_touching,
+	e_deep,
+	e_rotated,
+	e_caseCount
+} PairCase;
+
+static const char* caseNames[e_caseCount] = {"separated", "touching", "deep", "rotated"};
+
+// Shape A is always at the origin so the ray cast can work in the local space of polygon A
+typedef struct PairConfig
+{
+	b2Polygon polygonA;
+	b2Polygon polygonB;
+	b2Transform polygonTransformB;
+	b2Vec2 polygonDirection;
+
+	b2Capsule capsuleA;
+	b2Capsule capsuleB;
+	b2Transform capsuleTransformB;
+
+	b2SmoothSegment smoothSegment;
+	b2Transform smoothTransformB;
+
+	b2Vec2 cloud[b2_maxPolygonVertices];
+} PairConfig;
+
+// Returns the iteration count for kernels that report one, otherwise something that depends on the result
+typedef int KernelFcn(const PairConfig* config);
+
+typedef struct Kernel
+{
+	const char* name;
+	KernelFcn* fcn;
+	bool hasIterations;
+	bool usesCases;
+} Kernel;
+
+static uint32_t randomState;
+
+static uint32_t RandomInt(void)
+{
+	// xorshift32
+	uint32_t x = randomState;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	randomState = x;
+	return x;
+}
+
+static float RandomFloat(float lo, float hi)
+{
+	float r = (float)(RandomInt() & 0xFFFFFF) / (float)0xFFFFFF;
+	return lo + r * (hi - lo);
+}
+
+static b2Polygon RandomPolygon(void)
+{
+	float hx = RandomFloat(0.25f, 1.0f);
+	float hy = RandomFloat(0.25f, 1.0f);
+
+	b2Vec2 points[b2_maxPolygonVertices];
+	for (int i = 0; i < b2_maxPolygonVertices; ++i)
+	{
+		points[i] = (b2Vec2){RandomFloat(-hx, hx), RandomFloat(-hy, hy)};
+	}
+
+	float radius = (RandomInt() & 3) == 0 ? RandomFloat(0.02f, 0.1f) : 0.0f;
+
+	b2Hull hull = b2ComputeHull(points, b2_maxPolygonVertices);
+	if (hull.count == 0)
+	{
+		return b2MakeRoundedBox(hx, hy, radius);
+	}
+
+	return b2MakePolygon(&hull, radius);
+}
+
+static b2Capsule RandomCapsule(void)
+{
+	float h = RandomFloat(0.1f, 1.0f);
+	return (b2Capsule){{-h, 0.0f}, {h, 0.0f}, RandomFloat(0.1f, 0.5f)};
+}
+
+// Find the transform of shape B along a direction from the origin so that the distance to shape A matches the
+// gap. The distance is monotonic along the ray so bisection is robust.
+static b2Transform PlaceShape(const b2DistanceProxy* proxyA, const b2DistanceProxy* proxyB, b2Vec2 direction, b2Rot q,
+							  float gap)
+{
+	b2DistanceInput input;
+	input.proxyA = *proxyA;
+	input.proxyB = *proxyB;
+	input.transformA = b2Transform_identity;
+	input.transformB.q = q;
+	input.useRadii = true;
+
+	float lower = 0.0f;
+	float upper = 10.0f + gap;
+	for (int i = 0; i < 30; ++i)
+	{
+		float t = 0.5f * (lower + upper);
+		input.transformB.p = b2MulSV(t, direction);
+
+		b2DistanceCache cache = b2_emptyDistanceCache;
+		b2DistanceOutput output = b2ShapeDistance(&cache, &input);
+		if (output.distance > gap)
+		{
+			upper = t;
+		}
+		else
+		{
+			lower = t;
+		}
+	}
+
+	return (b2Transform){b2MulSV(upper, direction), q};
+}
+
+static void MakePair(PairConfig* config, PairCase pairCase)
+{
+	config->polygonA = RandomPolygon();
+	config->polygonB = RandomPolygon();
+	config->capsuleA = RandomCapsule();
+	config->capsuleB = RandomCapsule();
+
+	// The solid side of the smooth segment faces up
+	float hx = RandomFloat(0.5f, 2.0f);
+	config->smoothSegment = (b2SmoothSegment){
+		{2.0f * hx, RandomFloat(-0.5f, 0.0f)}, {{hx, 0.0f}, {-hx, 0.0f}}, {-2.0f * hx, RandomFloat(-0.5f, 0.0f)}, 0};
+
+	for (int i = 0; i < b2_maxPolygonVertices; ++i)
+	{
+		config->cloud[i] = (b2Vec2){RandomFloat(-1.0f, 1.0f), RandomFloat(-1.0f, 1.0f)};
+	}
+
+	float angle = RandomFloat(-b2_pi, b2_pi);
+	b2Vec2 direction = {cosf(angle), sinf(angle)};
+	float upAngle = RandomFloat(0.25f * b2_pi, 0.75f * b2_pi);
+	b2Vec2 upDirection = {cosf(upAngle), sinf(upAngle)};
+
+	// Nearly aligned unless the case asks for arbitrary rotation, so faces produce two point manifolds
+	float angleB = pairCase == e_rotated ? RandomFloat(-b2_pi, b2_pi) : RandomFloat(-0.05f, 0.05f);
+	b2Rot q = b2MakeRot(angleB);
+
+	b2DistanceProxy polygonProxyA = b2MakeProxy(config->polygonA.vertices, config->polygonA.count, config->polygonA.radius);
+	b2DistanceProxy polygonProxyB = b2MakeProxy(config->polygonB.vertices, config->polygonB.count, config->polygonB.radius);
+	b2DistanceProxy capsuleProxyA = b2MakeProxy(&config->capsuleA.center1, 2, config->capsuleA.radius);
+	b2DistanceProxy capsuleProxyB = b2MakeProxy(&config->capsuleB.center1, 2, config->capsuleB.radius);
+	b2DistanceProxy segmentProxy = b2MakeProxy(&config->smoothSegment.segment.point1, 2, 0.0f);
+
+	config->polygonDirection = direction;
+
+	if (pairCase == e_deep)
+	{
+		float depth = RandomFloat(0.0f, 0.25f);
+		config->polygonTransformB = (b2Transform){b2MulSV(depth, direction), q};
+		config->capsuleTransformB = (b2Transform){b2MulSV(depth, direction), q};
+		config->smoothTransformB = (b2Transform){b2MulSV(depth, upDirection), q};
+		return;
+	}
+
+	float gap = pairCase == e_separated ? RandomFloat(0.5f, 2.0f) : RandomFloat(0.0f, 2.0f * TOUCHING_GAP);
+	config->polygonTransformB = PlaceShape(&polygonProxyA, &polygonProxyB, direction, q, gap);
+	config->capsuleTransformB = PlaceShape(&capsuleProxyA, &capsuleProxyB, direction, q, gap);
+	config->smoothTransformB = PlaceShape(&segmentProxy, &polygonProxyB, upDirection, q, gap);
+}
+
+static int CollidePolygons(const PairConfig* config)
+{
+	b2DistanceCache cache = b2_emptyDistanceCache;
+	b2Manifold manifold =
+		b2CollidePolygons(&config->polygonA, b2Transform_identity, &config->polygonB, config->polygonTransformB, &cache);
+	return manifold.pointCount;
+}
+
+static int CollideCapsules(const PairConfig* config)
+{
+	b2DistanceCache cache = b2_emptyDistanceCache;
+	b2Manifold manifold =
+		b2CollideCapsules(&config->capsuleA, b2Transform_identity, &config->capsuleB, config->capsuleTransformB, &cache);
+	return manifold.pointCount;
+}
+
+static int CollideSmoothSegmentAndPolygon(const PairConfig* config)
+{
+	b2DistanceCache cache = b2_emptyDistanceCache;
+	b2Manifold manifold = b2CollideSmoothSegmentAndPolygon(&config->smoothSegment, b2Transform_identity, &config->polygonB,
+														   config->smoothTransformB, &cache);
+	return manifold.pointCount;
+}
+
+static int ShapeDistance(const PairConfig* config)
+{
+	b2DistanceInput input;
+	input.proxyA = b2MakeProxy(config->polygonA.vertices, config->polygonA.count, config->polygonA.radius);
+	input.proxyB = b2MakeProxy(config->polygonB.vertices, config->polygonB.count, config->polygonB.radius);
+	input.transformA = b2Transform_identity;
+	input.transformB = config->polygonTransformB;
+	input.useRadii = true;
+
+	b2DistanceCache cache = b2_emptyDistanceCache;
+	b2DistanceOutput output = b2ShapeDistance(&cache, &input);
+	return output.iterations;
+}
+
+// Polygon B starts one unit further out and moves through polygon A
+static int ShapeCast(const PairConfig* config)
+{
+	b2ShapeCastPairInput input;
+	input.proxyA = b2MakeProxy(config->polygonA.vertices, config->polygonA.count, config->polygonA.radius);
+	input.proxyB = b2MakeProxy(config->polygonB.vertices, config->polygonB.count, config->polygonB.radius);
+	input.transformA = b2Transform_identity;
+	input.transformB = config->polygonTransformB;
+	input.transformB.p = b2MulAdd(input.transformB.p, 1.0f, config->polygonDirection);
+	input.translationB = b2MulSV(-2.0f, config->polygonDirection);
+	input.maxFraction = 1.0f;
+
+	b2CastOutput output = b2ShapeCast(&input);
+	return output.iterations;
+}
+
+// Polygon B sweeps through polygon A while rotating
+static int TimeOfImpact(const PairConfig* config)
+{
+	b2Transform xf = config->polygonTransformB;
+	float angle = b2Rot_GetAngle(xf.q);
+
+	b2TOIInput input;
+	input.proxyA = b2MakeProxy(config->polygonA.vertices, config->polygonA.count, config->polygonA.radius);
+	input.proxyB = b2MakeProxy(config->polygonB.vertices, config->polygonB.count, config->polygonB.radius);
+	input.sweepA = (b2Sweep){b2Vec2_zero, b2Vec2_zero, b2Vec2_zero, b2Rot_identity, b2Rot_identity};
+	input.sweepB = (b2Sweep){b2Vec2_zero, b2MulAdd(xf.p, 1.0f, config->polygonDirection),
+							 b2MulSub(xf.p, 1.0f, config->polygonDirection), b2MakeRot(angle - 0.25f),
+							 b2MakeRot(angle + 0.25f)};
+	input.tMax = 1.0f;
+
+	b2TOIOutput output = b2TimeOfImpact(&input);
+	return output.iterations;
+}
+
+static int ComputeHull(const PairConfig* config)
+{
+	b2Hull hull = b2ComputeHull(config->cloud, b2_maxPolygonVertices);
+	return hull.count;
+}
+
+// The ray starts at the center of polygon B and passes through polygon A
+static int RayCastPolygon(const PairConfig* config)
+{
+	b2Vec2 origin = config->polygonTransformB.p;
+	b2RayCastInput input = {origin, b2MulSV(-2.0f, origin), 1.0f};
+	b2CastOutput output = b2RayCastPolygon(&input, &config->polygonA);
+	return output.hit ? 1 : 0;
+}
+
+int main(int argc, char** argv)
+{
+	int pairCount = 1000;
+	int repeatCount = 200;
+	uint32_t seed = 12345;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+		if (strncmp(arg, "-n=", 3) == 0)
+		{
+			pairCount = b2MaxInt(1, atoi(arg + 3));
+		}
+		else if (strncmp(arg, "-r=", 3) == 0)
+		{
+			repeatCount = b2MaxInt(1, atoi(arg + 3));
+		}
+		else if (strncmp(arg, "-s=", 3) == 0)
+		{
+			seed = (uint32_t)strtoul(arg + 3, NULL, 10);
+		}
+		else if (strcmp(arg, "-h") == 0)
+		{
+			printf("Usage\n"
+				   "-n=<pair count>: the number of shape pairs per case\n"
+				   "-r=<repeat count>: the number of timed passes over the pairs\n"
+				   "-s=<seed>: the random seed used to generate the pairs\n");
+			return 0;
+		}
+	}
+
+	// xorshift has a fixed point at zero
+	randomState = seed != 0 ? seed : 1;
+
+	PairConfig* configs[e_caseCount];
+	for (int caseIndex = 0; caseIndex < e_caseCount; ++caseIndex)
+	{
+		configs[caseIndex] = malloc(pairCount * sizeof(PairConfig));
+		for (int i = 0; i < pairCount; ++i)
+		{
+			MakePair(configs[caseIndex] + i, (PairCase)caseIndex);
+		}
+	}
+
+	Kernel kernels[] = {
+		{"b2CollidePolygons", CollidePolygons, false, true},
+		{"b2CollideCapsules", CollideCapsules, false, true},
+		{"b2CollideSmoothSegmentAndPolygon", CollideSmoothSegmentAndPolygon, false, true},
+		{"b2ShapeDistance", ShapeDistance, true, true},
+		{"b2ShapeCast", ShapeCast, true, true},
+		{"b2TimeOfImpact", TimeOfImpact, true, true},
+		{"b2ComputeHull", ComputeHull, false, false},
+		{"b2RayCastPolygon", RayCastPolygon, false, true},
+	};
+
+	int kernelCount = ARRAY_COUNT(kernels);
+
+	printf("Starting Box2D collision benchmarks\n");
+	printf("pairs per case = %d, repeats = %d, seed = %u\n", pairCount, repeatCount, seed);
+	printf("======================================\n");
+	printf("%-34s %-10s %10s %10s %10s\n", "kernel", "case", "ns/call", "avg iters", "max iters");
+
+	// Keeps the optimizer from discarding kernel results
+	volatile int sink = 0;
+
+	for (int kernelIndex = 0; kernelIndex < kernelCount; ++kernelIndex)
+	{
+		Kernel* kernel = kernels + kernelIndex;
+		int caseCount = kernel->usesCases ? e_caseCount : 1;
+
+		for (int caseIndex = 0; caseIndex < caseCount; ++caseIndex)
+		{
+			const PairConfig* pairs = configs[caseIndex];
+
+			// Iteration counts come from an untimed pass
+			int64_t iterationSum = 0;
+			int maxIterations = 0;
+			for (int i = 0; i < pairCount; ++i)
+			{
+				int result = kernel->fcn(pairs + i);
+				iterationSum += result;
+				maxIterations = b2MaxInt(maxIterations, result);
+			}
+
+			int total = 0;
+			b2Timer timer = b2CreateTimer();
+			for (int repeat = 0; repeat < repeatCount; ++repeat)
+			{
+				for (int i = 0; i < pairCount; ++i)
+				{
+					total += kernel->fcn(pairs + i);
+				}
+			}
+			float ms = b2GetMilliseconds(&timer);
+			sink = total;
+
+			float nsPerCall = 1000000.0f * ms / ((float)pairCount * (float)repeatCount);
+			const char* caseName = kernel->usesCases ? caseNames[caseIndex] : "random";
+
+			if (kernel->hasIterations)
+			{
+				printf("%-34s %-10s %10.1f %10.2f %10d\n", kernel->name, caseName, nsPerCall,
+					   (double)iterationSum / pairCount, maxIterations);
+			}
+			else
+			{
+				printf("%-34s %-10s %10.1f %10s %10s\n", kernel->name, caseName, nsPerCall, "-", "-");
+			}
+		}
+	}
+
+	(void)sink;
+
+	for (int caseIndex = 0; caseIndex < e_caseCount; ++caseIndex)
+	{
+		free(configs[caseIndex]);
+	}
+
+	printf("======================================\n");
+	printf("All Box2D collision benchmarks complete!\n");
+
+	return 0;
+}
@@ -0,0 +1,56 @@
+// SPDX-FileCopyrightText: 2024 Erin Catto
+// SPDX-License-Identifier: MIT
+
+#include "box2d/box2d.h"
+#include "box2d/geometry.h"
+#include "box2d/math_functions.h"
+
+// Many short box columns. The stages are small so the solver spends much of its time synchronizing workers.
+b2WorldId Contention(b2WorldDef* worldDef)
+{
+	// Keep the staged solver with more than one worker even though this world is small
+	worldDef->serialSolveThreshold = 0;
+
+	b2WorldId worldId = b2CreateWorld(worldDef);
+
+	{
+		b2BodyDef bodyDef = b2DefaultBodyDef();
+		b2BodyId groundId = b2CreateBody(worldId, &bodyDef);
+
+		b2Segment segment = {{-100.0f, 0.0f}, {100.0f, 0.0f}};
+		b2ShapeDef shapeDef = b2DefaultShapeDef();
+		b2CreateSegmentShape(groundId, &shapeDef, &segment);
+	}
+
+#ifdef NDEBUG
+	int columnCount = 100;
+#else
+	int columnCount = 10;
+#endif
+
+	int rowCount = 8;
+	float a = 0.25f;
+
+	b2Polygon box = b2MakeSquare(a);
+	b2ShapeDef shapeDef = b2DefaultShapeDef();
+	shapeDef.density = 1.0f;
+
+	b2BodyDef bodyDef = b2DefaultBodyDef();
+	bodyDef.type = b2_dynamicBody;
+	bodyDef.enableSleep = false;
+
+	float spacing = 1.5f;
+	float x0 = -0.5f * spacing * (columnCount - 1);
+
+	for (int i = 0; i < columnCount; ++i)
+	{
+		for (int j = 0; j < rowCount; ++j)
+		{
+			bodyDef.position = (b2Vec2){x0 + spacing * i, a + 2.0f * a * j};
+			b2BodyId bodyId = b2CreateBody(worldId, &bodyDef);
+			b2CreatePolygonShape(bodyId, &shapeDef, &box);
+		}
+	}
+
+	return worldId;
+}
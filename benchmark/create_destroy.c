@@ -0,0 +1,93 @@
+// SPDX-FileCopyrightText: 2024 Erin Catto
+// SPDX-License-Identifier: MIT
+
+#include "box2d/box2d.h"
+#include "box2d/geometry.h"
+#include "box2d/math_functions.h"
+
+// A pyramid that is destroyed and created again every step. This is the CreateDestroy sample.
+
+#ifdef NDEBUG
+#define CREATE_DESTROY_BASE_COUNT 100
+#else
+#define CREATE_DESTROY_BASE_COUNT 20
+#endif
+
+#define CREATE_DESTROY_BODY_COUNT (CREATE_DESTROY_BASE_COUNT * (CREATE_DESTROY_BASE_COUNT + 1) / 2)
+
+static b2BodyId createDestroyIds[CREATE_DESTROY_BODY_COUNT];
+
+static void CreatePyramid(b2WorldId worldId)
+{
+	for (int i = 0; i < CREATE_DESTROY_BODY_COUNT; ++i)
+	{
+		if (B2_IS_NON_NULL(createDestroyIds[i]))
+		{
+			b2DestroyBody(createDestroyIds[i]);
+			createDestroyIds[i] = b2_nullBodyId;
+		}
+	}
+
+	int count = CREATE_DESTROY_BASE_COUNT;
+	float rad = 0.5f;
+	float shift = rad * 2.0f;
+	float centerx = shift * count / 2.0f;
+	float centery = shift / 2.0f + 1.0f;
+
+	b2BodyDef bodyDef = b2DefaultBodyDef();
+	bodyDef.type = b2_dynamicBody;
+
+	b2ShapeDef shapeDef = b2DefaultShapeDef();
+	shapeDef.density = 1.0f;
+	shapeDef.friction = 0.5f;
+
+	float h = 0.5f;
+	b2Polygon box = b2MakeRoundedBox(h, h, 0.0f);
+
+	int index = 0;
+
+	for (int i = 0; i < count; ++i)
+	{
+		float y = i * shift + centery;
+
+		for (int j = i; j < count; ++j)
+		{
+			float x = 0.5f * i * shift + (j - i) * shift - centerx;
+			bodyDef.position = (b2Vec2){x, y};
+
+			createDestroyIds[index] = b2CreateBody(worldId, &bodyDef);
+			b2CreatePolygonShape(createDestroyIds[index], &shapeDef, &box);
+
+			index += 1;
+		}
+	}
+}
+
+b2WorldId CreateDestroy(b2WorldDef* worldDef)
+{
+	b2WorldId worldId = b2CreateWorld(worldDef);
+
+	float groundSize = 100.0f;
+
+	b2BodyDef bodyDef = b2DefaultBodyDef();
+	b2BodyId groundId = b2CreateBody(worldId, &bodyDef);
+
+	b2Polygon box = b2MakeBox(groundSize, 1.0f);
+	b2ShapeDef shapeDef = b2DefaultShapeDef();
+	b2CreatePolygonShape(groundId, &shapeDef, &box);
+
+	for (int i = 0; i < CREATE_DESTROY_BODY_COUNT; ++i)
+	{
+		createDestroyIds[i] = b2_nullBodyId;
+	}
+
+	CreatePyramid(worldId);
+
+	return worldId;
+}
+
+void CreateDestroyStep(b2WorldId worldId, int stepIndex)
+{
+	(void)stepIndex;
+	CreatePyramid(worldId);
+}
@@ -12,6 +12,8 @@
 #include <assert.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 #if defined(_WIN64)
 	#include <windows.h>
@@ -27,9 +29,20 @@
 #define MAYBE_UNUSED(x) ((void)(x))
 
 typedef b2WorldId CreateBenchmarkFcn(b2WorldDef* worldDef);
+typedef void StepBenchmarkFcn(b2WorldId worldId, int stepIndex);
+extern b2WorldId Chains(b2WorldDef* worldDef);
+extern b2WorldId Contention(b2WorldDef* worldDef);
+extern b2WorldId CreateDestroy(b2WorldDef* worldDef);
+extern void CreateDestroyStep(b2WorldId worldId, int stepIndex);
 extern b2WorldId JointGrid(b2WorldDef* worldDef);
 extern b2WorldId LargePyramid(b2WorldDef* worldDef);
 extern b2WorldId ManyPyramids(b2WorldDef* worldDef);
+extern b2WorldId Queries(b2WorldDef* worldDef);
+extern void QueriesStep(b2WorldId worldId, int stepIndex);
+extern b2WorldId Sensors(b2WorldDef* worldDef);
+extern void SensorsStep(b2WorldId worldId, int stepIndex);
+extern b2WorldId SleepWake(b2WorldDef* worldDef);
+extern void SleepWakeStep(b2WorldId worldId, int stepIndex);
 extern b2WorldId Smash(b2WorldDef* worldDef);
 extern b2WorldId Tumbler(b2WorldDef* worldDef);
 
@@ -38,10 +51,13 @@ typedef struct Benchmark
 	const char* name;
 	CreateBenchmarkFcn* createFcn;
 	int stepCount;
+
+	// Optional work done before every measured step, such as queries or creating bodies
+	StepBenchmarkFcn* stepFcn;
 } Benchmark;
 
 #define MAX_TASKS 128
-#define THREAD_LIMIT 32
+#define THREAD_LIMIT 128
 
 typedef struct TaskData
 {
@@ -54,6 +70,69 @@ enkiTaskSet* tasks[MAX_TASKS];
 TaskData taskData[MAX_TASKS];
 int taskCount;
 
+// Profile fields written to the result files, averaged over the measured steps
+#define PROFILE_FIELDS(X)                                                                                                      \
+	X(step)                                                                                                                    \
+	X(pairs)                                                                                                                   \
+	X(collide)                                                                                                                 \
+	X(solve)                                                                                                                   \
+	X(buildIslands)                                                                                                            \
+	X(solveConstraints)                                                                                                        \
+	X(prepareTasks)                                                                                                            \
+	X(solverTasks)                                                                                                             \
+	X(prepareConstraints)                                                                                                      \
+	X(integrateVelocities)                                                                                                     \
+	X(warmStart)                                                                                                               \
+	X(solveVelocities)                                                                                                         \
+	X(integratePositions)                                                                                                      \
+	X(relaxVelocities)                                                                                                         \
+	X(applyRestitution)                                                                                                        \
+	X(storeImpulses)                                                                                                           \
+	X(finalizeBodies)                                                                                                          \
+	X(splitIslands)                                                                                                            \
+	X(sleepIslands)                                                                                                            \
+	X(hitEvents)                                                                                                               \
+	X(broadphase)                                                                                                              \
+	X(continuous)
+
+// Counters written to the result files, taken at the end of each run
+#define COUNTER_FIELDS(X)                                                                                                      \
+	X(staticBodyCount)                                                                                                         \
+	X(bodyCount)                                                                                                               \
+	X(shapeCount)                                                                                                              \
+	X(contactCount)                                                                                                            \
+	X(jointCount)                                                                                                              \
+	X(islandCount)                                                                                                             \
+	X(stackUsed)                                                                                                               \
+	X(stackHeapAllocationCount)                                                                                                \
+	X(staticTreeHeight)                                                                                                        \
+	X(treeHeight)                                                                                                              \
+	X(byteCount)                                                                                                               \
+	X(taskCount)
+
+typedef enum OutputFormat
+{
+	e_outputNone,
+	e_outputCsv,
+	e_outputJson,
+} OutputFormat;
+
+// Results of one run of one benchmark at one thread count. Times are in milliseconds.
+typedef struct RunResult
+{
+	const char* benchmarkName;
+	int threadCount;
+	int runIndex;
+	int stepCount;
+	float totalTime;
+	float meanStep;
+	float medianStep;
+	float p95Step;
+	float p99Step;
+	b2Profile profile;
+	b2Counters counters;
+} RunResult;
+
 int GetNumberOfCores()
 {
 #if defined(_WIN64)
@@ -133,14 +212,110 @@ static void FinishTask(void* userTask, void* userContext)
 	enkiWaitForTaskSet(scheduler, task);
 }
 
+static int CompareFloats(const void* a, const void* b)
+{
+	float fa = *(const float*)a;
+	float fb = *(const float*)b;
+	return (fa > fb) - (fa < fb);
+}
+
+// Nearest rank percentile of sorted values
+static float GetPercentile(const float* sortedValues, int count, float percent)
+{
+	int rank = (int)(percent * count / 100.0f + 0.999f);
+	int index = b2ClampInt(rank - 1, 0, count - 1);
+	return sortedValues[index];
+}
+
+static void WriteCsvHeader(FILE* file)
+{
+	fprintf(file, "benchmark,threads,run,steps,total_ms,fps,mean_ms,median_ms,p95_ms,p99_ms");
+
+#define X(name) fprintf(file, ",profile_" #name);
+	PROFILE_FIELDS(X)
+#undef X
+
+#define X(name) fprintf(file, ",counter_" #name);
+	COUNTER_FIELDS(X)
+#undef X
+
+	for (int i = 0; i < ARRAY_COUNT(((b2Counters*)NULL)->colorCounts); ++i)
+	{
+		fprintf(file, ",counter_color%d", i);
+	}
+
+	fprintf(file, "\n");
+}
+
+static void WriteCsvRow(FILE* file, const RunResult* result)
+{
+	fprintf(file, "%s,%d,%d,%d,%g,%g,%g,%g,%g,%g", result->benchmarkName, result->threadCount, result->runIndex,
+			result->stepCount, result->totalTime, 1000.0f * result->stepCount / result->totalTime, result->meanStep,
+			result->medianStep, result->p95Step, result->p99Step);
+
+#define X(name) fprintf(file, ",%g", result->profile.name);
+	PROFILE_FIELDS(X)
+#undef X
+
+#define X(name) fprintf(file, ",%lld", (long long)result->counters.name);
+	COUNTER_FIELDS(X)
+#undef X
+
+	for (int i = 0; i < ARRAY_COUNT(result->counters.colorCounts); ++i)
+	{
+		fprintf(file, ",%d", result->counters.colorCounts[i]);
+	}
+
+	fprintf(file, "\n");
+}
+
+static void WriteJsonRun(FILE* file, const RunResult* result, bool first)
+{
+	fprintf(file, "%s\n    {\n", first ? "" : ",");
+	fprintf(file, "      \"benchmark\": \"%s\",\n", result->benchmarkName);
+	fprintf(file, "      \"threads\": %d,\n", result->threadCount);
+	fprintf(file, "      \"run\": %d,\n", result->runIndex);
+	fprintf(file, "      \"steps\": %d,\n", result->stepCount);
+	fprintf(file, "      \"totalMs\": %g,\n", result->totalTime);
+	fprintf(file, "      \"fps\": %g,\n", 1000.0f * result->stepCount / result->totalTime);
+	fprintf(file, "      \"stepMs\": {\"mean\": %g, \"median\": %g, \"p95\": %g, \"p99\": %g},\n", result->meanStep,
+			result->medianStep, result->p95Step, result->p99Step);
+
+	const char* separator = "";
+	fprintf(file, "      \"profile\": {");
+#define X(name)                                                                                                                \
+	fprintf(file, "%s\"" #name "\": %g", separator, result->profile.name);                                                     \
+	separator = ", ";
+	PROFILE_FIELDS(X)
+#undef X
+	fprintf(file, "},\n");
+
+	separator = "";
+	fprintf(file, "      \"counters\": {");
+#define X(name)                                                                                                                \
+	fprintf(file, "%s\"" #name "\": %lld", separator, (long long)result->counters.name);                                       \
+	separator = ", ";
+	COUNTER_FIELDS(X)
+#undef X
+
+	fprintf(file, ", \"colorCounts\": [");
+	for (int i = 0; i < ARRAY_COUNT(result->counters.colorCounts); ++i)
+	{
+		fprintf(file, "%s%d", i == 0 ? "" : ", ", result->counters.colorCounts[i]);
+	}
+	fprintf(file, "]}\n    }");
+}
+
 int main(int argc, char** argv)
 {
 	int maxThreadCount = GetNumberOfCores();
 	int runCount = 4;
 	b2Counters counters = {0};
 	bool enableContinuous = true;
+	const char* outputPath = NULL;
+	OutputFormat outputFormat = e_outputNone;
 
-	assert(maxThreadCount <= THREAD_LIMIT);
+	maxThreadCount = b2MinInt(maxThreadCount, THREAD_LIMIT);
 
 	for (int i = 1; i < argc; ++i)
 	{
@@ -150,19 +325,62 @@ int main(int argc, char** argv)
 			int threadCount = atoi(arg + 3);
 			maxThreadCount = b2MinInt(maxThreadCount, threadCount);
 		}
+		else if (strncmp(arg, "-r=", 3) == 0)
+		{
+			runCount = b2MaxInt(1, atoi(arg + 3));
+		}
+		else if (strncmp(arg, "-o=", 3) == 0)
+		{
+			outputPath = arg + 3;
+			size_t length = strlen(outputPath);
+			bool isJson = length >= 5 && strcmp(outputPath + length - 5, ".json") == 0;
+			outputFormat = isJson ? e_outputJson : e_outputCsv;
+		}
 		else if (strcmp(arg, "-h") == 0)
 		{
 			printf("Usage\n"
-				   "-t=<thread count>: the maximum number of threads to use\n");
+				   "-t=<thread count>: the maximum number of threads to use\n"
+				   "-r=<run count>: the number of runs per thread count\n"
+				   "-o=<file>: write every run to a file, JSON if the name ends with .json and CSV otherwise\n");
+		}
+	}
+
+	FILE* outputFile = NULL;
+	if (outputFormat != e_outputNone)
+	{
+		outputFile = fopen(outputPath, "w");
+		if (outputFile == NULL)
+		{
+			printf("failed to open %s\n", outputPath);
+			return 1;
+		}
+
+		if (outputFormat == e_outputJson)
+		{
+			b2Version version = b2GetVersion();
+			fprintf(outputFile, "{\n  \"version\": \"%d.%d.%d\",\n", version.major, version.minor, version.revision);
+			fprintf(outputFile, "  \"maxThreads\": %d,\n  \"runs\": %d,\n  \"results\": [", maxThreadCount, runCount);
+		}
+		else
+		{
+			WriteCsvHeader(outputFile);
 		}
 	}
 
+	bool firstResult = true;
+
 	Benchmark benchmarks[] = {
-		{"joint_grid", JointGrid, 500},
-		{"large_pyramid", LargePyramid, 500},
-		{"many_pyramids", ManyPyramids, 200},
-		{"smash", Smash, 300},
-		{"tumbler", Tumbler, 750},
+		{"chains", Chains, 500, NULL},
+		{"contention", Contention, 1000, NULL},
+		{"create_destroy", CreateDestroy, 50, CreateDestroyStep},
+		{"joint_grid", JointGrid, 500, NULL},
+		{"large_pyramid", LargePyramid, 500, NULL},
+		{"many_pyramids", ManyPyramids, 200, NULL},
+		{"queries", Queries, 300, QueriesStep},
+		{"sensors", Sensors, 500, SensorsStep},
+		{"sleep_wake", SleepWake, 200, SleepWakeStep},
+		{"smash", Smash, 300, NULL},
+		{"tumbler", Tumbler, 750, NULL},
 	};
 
 	int benchmarkCount = ARRAY_COUNT(benchmarks);
@@ -179,6 +397,7 @@ int main(int argc, char** argv)
 #endif
 
 		bool countersAcquired = false;
+		float* stepTimes = malloc(stepCount * sizeof(float));
 
 		printf("benchmark: %s, steps = %d\n", benchmarks[benchmarkIndex].name, stepCount);
 
@@ -215,18 +434,72 @@ int main(int argc, char** argv)
 				// Initial step can be expensive and skew benchmark
 				b2World_Step(worldId, timeStep, subStepCount);
 
+				RunResult result = {0};
 				b2Timer timer = b2CreateTimer();
+				b2Timer stepTimer = b2CreateTimer();
+
+				StepBenchmarkFcn* stepFcn = benchmarks[benchmarkIndex].stepFcn;
 
 				for (int step = 0; step < stepCount; ++step)
 				{
+					if (stepFcn != NULL)
+					{
+						stepFcn(worldId, step);
+					}
+
 					b2World_Step(worldId, timeStep, subStepCount);
 					taskCount = 0;
+
+					stepTimes[step] = b2GetMillisecondsAndReset(&stepTimer);
+
+					b2Profile profile = b2World_GetProfile(worldId);
+#define X(name) result.profile.name += profile.name;
+					PROFILE_FIELDS(X)
+#undef X
 				}
 
 				float ms = b2GetMilliseconds(&timer);
 				float fps = 1000.0f * stepCount / ms;
 				printf("run %d : %g (ms), %g (fps)\n", runIndex, ms, fps);
 
+				if (outputFile != NULL)
+				{
+					result.benchmarkName = benchmarks[benchmarkIndex].name;
+					result.threadCount = threadCount;
+					result.runIndex = runIndex;
+					result.stepCount = stepCount;
+					result.totalTime = ms;
+
+					float sum = 0.0f;
+					for (int step = 0; step < stepCount; ++step)
+					{
+						sum += stepTimes[step];
+					}
+
+					qsort(stepTimes, stepCount, sizeof(float), CompareFloats);
+					result.meanStep = sum / stepCount;
+					result.medianStep = GetPercentile(stepTimes, stepCount, 50.0f);
+					result.p95Step = GetPercentile(stepTimes, stepCount, 95.0f);
+					result.p99Step = GetPercentile(stepTimes, stepCount, 99.0f);
+
+#define X(name) result.profile.name /= stepCount;
+					PROFILE_FIELDS(X)
+#undef X
+
+					result.counters = b2World_GetCounters(worldId);
+
+					if (outputFormat == e_outputJson)
+					{
+						WriteJsonRun(outputFile, &result, firstResult);
+					}
+					else
+					{
+						WriteCsvRow(outputFile, &result);
+					}
+
+					firstResult = false;
+				}
+
 				maxFps[threadCount - 1] = b2MaxFloat(maxFps[threadCount - 1], fps);
 
 				if (countersAcquired == false)
@@ -249,6 +522,8 @@ int main(int argc, char** argv)
 			}
 		}
 
+		free(stepTimes);
+
 		printf("body %d / shape %d / contact %d / joint %d / stack %d\n\n", counters.bodyCount, counters.shapeCount,
 			   counters.contactCount, counters.jointCount, counters.stackUsed);
 
@@ -269,6 +544,17 @@ int main(int argc, char** argv)
 		fclose(file);
 	}
 
+	if (outputFile != NULL)
+	{
+		if (outputFormat == e_outputJson)
+		{
+			fprintf(outputFile, "\n  ]\n}\n");
+		}
+
+		fclose(outputFile);
+		printf("results written to %s\n", outputPath);
+	}
+
 	printf("======================================\n");
 	printf("All Box2D benchmarks complete!\n");
 
@@ -0,0 +1,141 @@
+// SPDX-FileCopyrightText: 2024 Erin Catto
+// SPDX-License-Identifier: MIT
+
+#include "box2d/box2d.h"
+#include "box2d/geometry.h"
+#include "box2d/math_functions.h"
+
+// Ray casts and overlap tests against a large static world while compound bodies fall onto it.
+// The world is the Compound sample.
+
+#ifdef NDEBUG
+#define GROUND_SIZE 200
+#define RAY_COUNT 1000
+#define OVERLAP_COUNT 200
+#else
+#define GROUND_SIZE 50
+#define RAY_COUNT 100
+#define OVERLAP_COUNT 20
+#endif
+
+static int queryHitCount;
+
+static bool CountOverlap(b2ShapeId shapeId, void* context)
+{
+	(void)shapeId;
+	int* count = context;
+	*count += 1;
+	return true;
+}
+
+b2WorldId Queries(b2WorldDef* worldDef)
+{
+	b2WorldId worldId = b2CreateWorld(worldDef);
+
+	float grid = 1.0f;
+	int height = GROUND_SIZE;
+	int width = GROUND_SIZE;
+
+	{
+		b2BodyDef bodyDef = b2DefaultBodyDef();
+		b2BodyId groundId = b2CreateBody(worldId, &bodyDef);
+		b2ShapeDef shapeDef = b2DefaultShapeDef();
+
+		for (int i = 0; i < height; ++i)
+		{
+			float y = grid * i;
+			for (int j = i; j < width; ++j)
+			{
+				float x = grid * j;
+				b2Polygon square = b2MakeOffsetBox(0.5f * grid, 0.5f * grid, (b2Vec2){x, y}, 0.0f);
+				b2CreatePolygonShape(groundId, &shapeDef, &square);
+			}
+		}
+
+		for (int i = 0; i < height; ++i)
+		{
+			float y = grid * i;
+			for (int j = i; j < width; ++j)
+			{
+				float x = -grid * j;
+				b2Polygon square = b2MakeOffsetBox(0.5f * grid, 0.5f * grid, (b2Vec2){x, y}, 0.0f);
+				b2CreatePolygonShape(groundId, &shapeDef, &square);
+			}
+		}
+	}
+
+	{
+#ifdef NDEBUG
+		int span = 20;
+#else
+		int span = 5;
+#endif
+		int count = 5;
+
+		b2BodyDef bodyDef = b2DefaultBodyDef();
+		bodyDef.type = b2_dynamicBody;
+		// defer mass properties to avoid n-squared mass computations
+		bodyDef.automaticMass = false;
+		b2ShapeDef shapeDef = b2DefaultShapeDef();
+
+		for (int m = 0; m < count; ++m)
+		{
+			float ybody = (0.5f * height + m * span) * grid;
+
+			for (int n = 0; n < count; ++n)
+			{
+				float xbody = -0.5f * grid * count * span + n * span * grid;
+				bodyDef.position = (b2Vec2){xbody, ybody};
+				b2BodyId bodyId = b2CreateBody(worldId, &bodyDef);
+
+				for (int i = 0; i < span; ++i)
+				{
+					float y = i * grid;
+					for (int j = 0; j < span; ++j)
+					{
+						float x = j * grid;
+						b2Polygon square = b2MakeOffsetBox(0.5f * grid, 0.5f * grid, (b2Vec2){x, y}, 0.0f);
+						b2CreatePolygonShape(bodyId, &shapeDef, &square);
+					}
+				}
+
+				b2Body_ApplyMassFromShapes(bodyId);
+			}
+		}
+	}
+
+	queryHitCount = 0;
+
+	return worldId;
+}
+
+void QueriesStep(b2WorldId worldId, int stepIndex)
+{
+	b2QueryFilter filter = b2DefaultQueryFilter();
+	float extent = (float)GROUND_SIZE;
+
+	// Rays fan down from above the world and sweep sideways over time
+	float shift = 0.37f * (stepIndex % 100);
+	for (int i = 0; i < RAY_COUNT; ++i)
+	{
+		float x = -extent + 2.0f * extent * i / RAY_COUNT + shift;
+		b2Vec2 origin = {x, 1.5f * extent};
+		b2Vec2 translation = {0.25f * extent * ((i % 7) - 3) / 3.0f, -2.0f * extent};
+		b2RayResult result = b2World_CastRayClosest(worldId, origin, translation, filter);
+		queryHitCount += result.hit ? 1 : 0;
+	}
+
+	// Boxes and circles along the slopes of the ground
+	for (int i = 0; i < OVERLAP_COUNT; ++i)
+	{
+		float x = -extent + 2.0f * extent * i / OVERLAP_COUNT + shift;
+		float y = 0.5f * extent - 0.5f * b2AbsFloat(x);
+
+		b2AABB box = {{x - 2.0f, y - 2.0f}, {x + 2.0f, y + 2.0f}};
+		b2World_OverlapAABB(worldId, box, filter, CountOverlap, &queryHitCount);
+
+		b2Circle circle = {{0.0f, 0.0f}, 1.5f};
+		b2Transform transform = {{x, y + 1.0f}, b2Rot_identity};
+		b2World_OverlapCircle(worldId, &circle, transform, filter, CountOverlap, &queryHitCount);
+	}
+}
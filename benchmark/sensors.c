@@ -0,0 +1,96 @@
+// SPDX-FileCopyrightText: 2024 Erin Catto
+// SPDX-License-Identifier: MIT
+
+#include "box2d/box2d.h"
+#include "box2d/geometry.h"
+#include "box2d/math_functions.h"
+
+// Large kinematic sensors sweep back and forth over rows of resting boxes. Every step has many sensor
+// overlaps and a steady stream of sensor begin and end events.
+
+#ifdef NDEBUG
+#define SENSOR_COLUMN_COUNT 200
+#else
+#define SENSOR_COLUMN_COUNT 20
+#endif
+
+#define SENSOR_COUNT 10
+
+static b2BodyId sensorIds[SENSOR_COUNT];
+static int sensorEventCount;
+
+b2WorldId Sensors(b2WorldDef* worldDef)
+{
+	b2WorldId worldId = b2CreateWorld(worldDef);
+
+	float width = 1.0f * SENSOR_COLUMN_COUNT;
+
+	{
+		b2BodyDef bodyDef = b2DefaultBodyDef();
+		b2BodyId groundId = b2CreateBody(worldId, &bodyDef);
+
+		b2Segment segment = {{-0.5f * width - 10.0f, 0.0f}, {0.5f * width + 10.0f, 0.0f}};
+		b2ShapeDef shapeDef = b2DefaultShapeDef();
+		b2CreateSegmentShape(groundId, &shapeDef, &segment);
+	}
+
+	{
+		int rowCount = 5;
+		float a = 0.4f;
+		b2Polygon box = b2MakeSquare(a);
+
+		b2BodyDef bodyDef = b2DefaultBodyDef();
+		bodyDef.type = b2_dynamicBody;
+		b2ShapeDef shapeDef = b2DefaultShapeDef();
+
+		for (int i = 0; i < SENSOR_COLUMN_COUNT; ++i)
+		{
+			for (int j = 0; j < rowCount; ++j)
+			{
+				bodyDef.position = (b2Vec2){-0.5f * width + i + 0.5f, a + 2.0f * a * j};
+				b2BodyId bodyId = b2CreateBody(worldId, &bodyDef);
+				b2CreatePolygonShape(bodyId, &shapeDef, &box);
+			}
+		}
+	}
+
+	{
+		b2Polygon box = b2MakeBox(4.0f, 3.0f);
+
+		b2BodyDef bodyDef = b2DefaultBodyDef();
+		bodyDef.type = b2_kinematicBody;
+
+		b2ShapeDef shapeDef = b2DefaultShapeDef();
+		shapeDef.isSensor = true;
+		shapeDef.enableSensorEvents = true;
+
+		float spacing = width / SENSOR_COUNT;
+		for (int i = 0; i < SENSOR_COUNT; ++i)
+		{
+			bodyDef.position = (b2Vec2){-0.5f * width + spacing * (i + 0.5f), 3.0f};
+			bodyDef.linearVelocity = (b2Vec2){(i & 1) ? -5.0f : 5.0f, 0.0f};
+			sensorIds[i] = b2CreateBody(worldId, &bodyDef);
+			b2CreatePolygonShape(sensorIds[i], &shapeDef, &box);
+		}
+	}
+
+	sensorEventCount = 0;
+
+	return worldId;
+}
+
+void SensorsStep(b2WorldId worldId, int stepIndex)
+{
+	// Reverse direction every second
+	if (stepIndex > 0 && stepIndex % 60 == 0)
+	{
+		for (int i = 0; i < SENSOR_COUNT; ++i)
+		{
+			b2Vec2 v = b2Body_GetLinearVelocity(sensorIds[i]);
+			b2Body_SetLinearVelocity(sensorIds[i], (b2Vec2){-v.x, v.y});
+		}
+	}
+
+	b2SensorEvents events = b2World_GetSensorEvents(worldId);
+	sensorEventCount += events.beginCount + events.endCount;
+}
@@ -0,0 +1,91 @@
+// SPDX-FileCopyrightText: 2024 Erin Catto
+// SPDX-License-Identifier: MIT
+
+#include "box2d/box2d.h"
+#include "box2d/geometry.h"
+#include "box2d/math_functions.h"
+
+// A large pyramid island that is put to sleep and woken many times every step. This is the Sleep sample.
+
+#ifdef NDEBUG
+#define SLEEP_BASE_COUNT 100
+#else
+#define SLEEP_BASE_COUNT 20
+#endif
+
+// Odd so the island alternates between awake and sleeping steps
+#define SLEEP_TOGGLE_COUNT 41
+
+static b2BodyId sleepBodyId;
+static bool sleepAwake;
+
+b2WorldId SleepWake(b2WorldDef* worldDef)
+{
+	worldDef->enableSleep = true;
+
+	b2WorldId worldId = b2CreateWorld(worldDef);
+
+	{
+		float groundSize = 100.0f;
+
+		b2BodyDef bodyDef = b2DefaultBodyDef();
+		b2BodyId groundId = b2CreateBody(worldId, &bodyDef);
+
+		b2Polygon box = b2MakeBox(groundSize, 1.0f);
+		b2ShapeDef shapeDef = b2DefaultShapeDef();
+		b2CreatePolygonShape(groundId, &shapeDef, &box);
+	}
+
+	int count = SLEEP_BASE_COUNT;
+	float rad = 0.5f;
+	float shift = rad * 2.0f;
+	float centerx = shift * count / 2.0f;
+	float centery = shift / 2.0f + 1.0f;
+
+	b2BodyDef bodyDef = b2DefaultBodyDef();
+	bodyDef.type = b2_dynamicBody;
+
+	b2ShapeDef shapeDef = b2DefaultShapeDef();
+	shapeDef.density = 1.0f;
+	shapeDef.friction = 0.5f;
+
+	float h = 0.5f;
+	b2Polygon box = b2MakeRoundedBox(h, h, 0.0f);
+
+	sleepBodyId = b2_nullBodyId;
+
+	for (int i = 0; i < count; ++i)
+	{
+		float y = i * shift + centery;
+
+		for (int j = i; j < count; ++j)
+		{
+			float x = 0.5f * i * shift + (j - i) * shift - centerx;
+			bodyDef.position = (b2Vec2){x, y};
+
+			b2BodyId bodyId = b2CreateBody(worldId, &bodyDef);
+			b2CreatePolygonShape(bodyId, &shapeDef, &box);
+
+			if (B2_IS_NULL(sleepBodyId))
+			{
+				sleepBodyId = bodyId;
+			}
+		}
+	}
+
+	sleepAwake = false;
+
+	return worldId;
+}
+
+void SleepWakeStep(b2WorldId worldId, int stepIndex)
+{
+	(void)worldId;
+	(void)stepIndex;
+
+	for (int i = 0; i < SLEEP_TOGGLE_COUNT; ++i)
+	{
+		b2Body_SetAwake(sleepBodyId, sleepAwake);
+		sleepAwake = !sleepAwake;
+	}
+}
@@ -0,0 +1,441 @@
+// SPDX-FileCopyrightText: 2024 Erin Catto
+// SPDX-License-Identifier: MIT
+
+#define _CRT_SECURE_NO_WARNINGS
+
+// Standalone benchmark for b2DynamicTree. For each proxy distribution and proxy count this measures proxy
+// create and destroy throughput, full rebuild, AABB query and ray cast throughput. It then animates the proxies
+// and compares incremental moves against partial and full rebuilds while sampling tree quality over time.
+
+#include "box2d/dynamic_tree.h"
+#include "box2d/geometry.h"
+#include "box2d/math_functions.h"
+#include "box2d/timer.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARRAY_COUNT(A) (int)(sizeof(A) / sizeof(A[0]))
+
+// Same as the broad-phase margin
+#define AABB_MARGIN 0.1f
+
+// Average spacing between proxies in the uniform distribution
+#define PROXY_SPACING 2.0f
+
+#define CLUSTER_SIZE 1000
+#define CLUSTER_RADIUS 10.0f
+
+#define QUERY_COUNT 10000
+#define QUERY_EXTENT 2.0f
+#define RAY_COUNT 10000
+#define RAY_LENGTH 50.0f
+
+// Fraction of proxies jittered each frame for the static distributions
+#define JITTER_FRACTION 0.05f
+
+// Frames between tree quality samples
+#define SAMPLE_INTERVAL 10
+
+typedef enum Distribution
+{
+	e_uniform,
+	e_clustered,
+	e_moving,
+	e_distributionCount
+} Distribution;
+
+static const char* distributionNames[e_distributionCount] = {"uniform", "clustered", "moving"};
+
+typedef enum UpdateMode
+{
+	e_incremental,
+	e_partialRebuild,
+	e_fullRebuild,
+	e_updateModeCount
+} UpdateMode;
+
+static const char* updateModeNames[e_updateModeCount] = {"incremental", "partial", "full"};
+
+typedef struct Proxy
+{
+	b2AABB box;
+	b2AABB fatBox;
+	b2Vec2 velocity;
+	int proxyId;
+	bool moved;
+} Proxy;
+
+static uint32_t randomState;
+
+static uint32_t RandomInt(void)
+{
+	// xorshift32
+	uint32_t x = randomState;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	randomState = x;
+	return x;
+}
+
+static float RandomFloat(float lo, float hi)
+{
+	float r = (float)(RandomInt() & 0xFFFFFF) / (float)0xFFFFFF;
+	return lo + r * (hi - lo);
+}
+
+static void SetSeed(uint32_t seed)
+{
+	// xorshift has a fixed point at zero
+	randomState = seed != 0 ? seed : 1;
+}
+
+static b2AABB MakeFatBox(b2AABB box)
+{
+	b2Vec2 margin = {AABB_MARGIN, AABB_MARGIN};
+	return (b2AABB){b2Sub(box.lowerBound, margin), b2Add(box.upperBound, margin)};
+}
+
+static b2AABB MakeBox(b2Vec2 center, b2Vec2 extents)
+{
+	return (b2AABB){b2Sub(center, extents), b2Add(center, extents)};
+}
+
+// Long thin boxes mixed in with small squares, similar to the dynamic tree sample
+static b2Vec2 RandomExtents(void)
+{
+	float ratio = RandomFloat(1.0f, 5.0f);
+	float width = RandomFloat(0.05f, 0.25f);
+	return (RandomInt() & 1) ? (b2Vec2){ratio * width, width} : (b2Vec2){width, ratio * width};
+}
+
+static void InitializeProxies(Proxy* proxies, int count, Distribution distribution, float extent, uint32_t seed)
+{
+	SetSeed(seed);
+
+	int clusterCount = b2MaxInt(1, count / CLUSTER_SIZE);
+	b2Vec2* clusters = malloc(clusterCount * sizeof(b2Vec2));
+	for (int i = 0; i < clusterCount; ++i)
+	{
+		clusters[i] = (b2Vec2){RandomFloat(-extent, extent), RandomFloat(-extent, extent)};
+	}
+
+	for (int i = 0; i < count; ++i)
+	{
+		Proxy* p = proxies + i;
+
+		b2Vec2 center;
+		if (distribution == e_clustered)
+		{
+			// Sum of uniforms gives a dense core
+			b2Vec2 c = clusters[RandomInt() % clusterCount];
+			float dx = RandomFloat(-CLUSTER_RADIUS, CLUSTER_RADIUS) + RandomFloat(-CLUSTER_RADIUS, CLUSTER_RADIUS);
+			float dy = RandomFloat(-CLUSTER_RADIUS, CLUSTER_RADIUS) + RandomFloat(-CLUSTER_RADIUS, CLUSTER_RADIUS);
+			center = (b2Vec2){c.x + 0.5f * dx, c.y + 0.5f * dy};
+		}
+		else
+		{
+			center = (b2Vec2){RandomFloat(-extent, extent), RandomFloat(-extent, extent)};
+		}
+
+		p->box = MakeBox(center, RandomExtents());
+		p->fatBox = MakeFatBox(p->box);
+		p->velocity = distribution == e_moving ? (b2Vec2){RandomFloat(-0.1f, 0.1f), RandomFloat(-0.1f, 0.1f)} : b2Vec2_zero;
+		p->proxyId = -1;
+		p->moved = false;
+	}
+
+	free(clusters);
+}
+
+static void CreateProxies(b2DynamicTree* tree, Proxy* proxies, int count)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		proxies[i].proxyId = b2DynamicTree_CreateProxy(tree, proxies[i].fatBox, b2_defaultCategoryBits, i);
+	}
+}
+
+// Advance one frame. A proxy is flagged as moved when it leaves its fat box, like the broad-phase.
+static int MoveProxies(Proxy* proxies, int count, Distribution distribution, float extent)
+{
+	int movedCount = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		Proxy* p = proxies + i;
+		p->moved = false;
+
+		b2Vec2 delta;
+		if (distribution == e_moving)
+		{
+			b2Vec2 center = b2AABB_Center(p->box);
+			if (center.x < -extent || extent < center.x)
+			{
+				p->velocity.x = center.x < -extent ? b2AbsFloat(p->velocity.x) : -b2AbsFloat(p->velocity.x);
+			}
+			if (center.y < -extent || extent < center.y)
+			{
+				p->velocity.y = center.y < -extent ? b2AbsFloat(p->velocity.y) : -b2AbsFloat(p->velocity.y);
+			}
+			delta = p->velocity;
+		}
+		else if (RandomFloat(0.0f, 1.0f) < JITTER_FRACTION)
+		{
+			delta = (b2Vec2){RandomFloat(-0.2f, 0.2f), RandomFloat(-0.2f, 0.2f)};
+		}
+		else
+		{
+			continue;
+		}
+
+		p->box.lowerBound = b2Add(p->box.lowerBound, delta);
+		p->box.upperBound = b2Add(p->box.upperBound, delta);
+
+		if (b2AABB_Contains(p->fatBox, p->box) == false)
+		{
+			p->fatBox = MakeFatBox(p->box);
+			p->moved = true;
+			movedCount += 1;
+		}
+	}
+
+	return movedCount;
+}
+
+static void UpdateTree(b2DynamicTree* tree, Proxy* proxies, int count, UpdateMode mode)
+{
+	for (int i = 0; i < count; ++i)
+	{
+		Proxy* p = proxies + i;
+		if (p->moved == false)
+		{
+			continue;
+		}
+
+		if (mode == e_incremental)
+		{
+			b2DynamicTree_MoveProxy(tree, p->proxyId, p->fatBox);
+		}
+		else
+		{
+			b2DynamicTree_EnlargeProxy(tree, p->proxyId, p->fatBox);
+		}
+	}
+
+	if (mode != e_incremental)
+	{
+		b2DynamicTree_Rebuild(tree, mode == e_fullRebuild);
+	}
+}
+
+static bool QueryCallback(int32_t proxyId, int32_t userData, void* context)
+{
+	(void)proxyId;
+	(void)userData;
+	int* hitCount = context;
+	*hitCount += 1;
+	return true;
+}
+
+static float RayCastCallback(const b2RayCastInput* input, int32_t proxyId, int32_t userData, void* context)
+{
+	(void)proxyId;
+	(void)userData;
+	int* hitCount = context;
+	*hitCount += 1;
+	return input->maxFraction;
+}
+
+int main(int argc, char** argv)
+{
+#ifdef NDEBUG
+	int proxyCounts[] = {10000, 100000, 1000000};
+#else
+	int proxyCounts[] = {10000, 100000};
+#endif
+	int proxyCountCount = ARRAY_COUNT(proxyCounts);
+	int frameCount = 60;
+	uint32_t seed = 12345;
+	const char* outputPath = NULL;
+
+	for (int i = 1; i < argc; ++i)
+	{
+		const char* arg = argv[i];
+		if (strncmp(arg, "-n=", 3) == 0)
+		{
+			proxyCounts[0] = b2MaxInt(1, atoi(arg + 3));
+			proxyCountCount = 1;
+		}
+		else if (strncmp(arg, "-f=", 3) == 0)
+		{
+			frameCount = b2MaxInt(1, atoi(arg + 3));
+		}
+		else if (strncmp(arg, "-s=", 3) == 0)
+		{
+			seed = (uint32_t)strtoul(arg + 3, NULL, 10);
+		}
+		else if (strncmp(arg, "-o=", 3) == 0)
+		{
+			outputPath = arg + 3;
+		}
+		else if (strcmp(arg, "-h") == 0)
+		{
+			printf("Usage\n"
+				   "-n=<proxy count>: run a single proxy count instead of the default set\n"
+				   "-f=<frame count>: the number of animated frames per update mode\n"
+				   "-s=<seed>: the random seed used to place the proxies\n"
+				   "-o=<file>: write the tree quality samples over time as CSV\n");
+			return 0;
+		}
+	}
+
+	FILE* outputFile = NULL;
+	if (outputPath != NULL)
+	{
+		outputFile = fopen(outputPath, "w");
+		if (outputFile == NULL)
+		{
+			printf("failed to open %s\n", outputPath);
+			return 1;
+		}
+
+		fprintf(outputFile, "distribution,proxies,mode,frame,moved,update_ms,area_ratio,height\n");
+	}
+
+	printf("Starting Box2D dynamic tree benchmarks\n");
+	printf("frames = %d, seed = %u\n", frameCount, seed);
+	printf("======================================\n");
+
+	for (int countIndex = 0; countIndex < proxyCountCount; ++countIndex)
+	{
+		int proxyCount = proxyCounts[countIndex];
+		float extent = 0.5f * PROXY_SPACING * sqrtf((float)proxyCount);
+		Proxy* proxies = malloc(proxyCount * sizeof(Proxy));
+
+		for (int distributionIndex = 0; distributionIndex < e_distributionCount; ++distributionIndex)
+		{
+			Distribution distribution = (Distribution)distributionIndex;
+			printf("%s, proxies = %d\n", distributionNames[distribution], proxyCount);
+
+			InitializeProxies(proxies, proxyCount, distribution, extent, seed);
+
+			b2DynamicTree tree = b2DynamicTree_Create();
+
+			b2Timer timer = b2CreateTimer();
+			CreateProxies(&tree, proxies, proxyCount);
+			float createMs = b2GetMillisecondsAndReset(&timer);
+
+			float insertRatio = b2DynamicTree_GetAreaRatio(&tree);
+			int insertHeight = b2DynamicTree_GetHeight(&tree);
+
+			b2GetMillisecondsAndReset(&timer);
+			b2DynamicTree_Rebuild(&tree, true);
+			float rebuildMs = b2GetMillisecondsAndReset(&timer);
+
+			printf("  create %.1f ns/proxy, area ratio %.2f, height %d\n", 1000000.0f * createMs / proxyCount, insertRatio,
+				   insertHeight);
+			printf("  full rebuild %.3f ms, area ratio %.2f, height %d\n", rebuildMs, b2DynamicTree_GetAreaRatio(&tree),
+				   b2DynamicTree_GetHeight(&tree));
+
+			// Queries are centered on proxies so they always land in occupied space
+			SetSeed(seed + 1);
+			int hitCount = 0;
+			b2GetMillisecondsAndReset(&timer);
+			for (int i = 0; i < QUERY_COUNT; ++i)
+			{
+				b2Vec2 center = b2AABB_Center(proxies[RandomInt() % proxyCount].box);
+				b2AABB box = MakeBox(center, (b2Vec2){QUERY_EXTENT, QUERY_EXTENT});
+				b2DynamicTree_Query(&tree, box, QueryCallback, &hitCount);
+			}
+			float queryMs = b2GetMillisecondsAndReset(&timer);
+			printf("  query %.1f ns/query, %.1f hits/query\n", 1000000.0f * queryMs / QUERY_COUNT,
+				   (float)hitCount / QUERY_COUNT);
+
+			hitCount = 0;
+			b2GetMillisecondsAndReset(&timer);
+			for (int i = 0; i < RAY_COUNT; ++i)
+			{
+				b2Vec2 origin = b2AABB_Center(proxies[RandomInt() % proxyCount].box);
+				float angle = RandomFloat(-b2_pi, b2_pi);
+				b2RayCastInput input = {origin, {RAY_LENGTH * cosf(angle), RAY_LENGTH * sinf(angle)}, 1.0f};
+				b2DynamicTree_RayCast(&tree, &input, b2_defaultMaskBits, RayCastCallback, &hitCount);
+			}
+			float rayMs = b2GetMillisecondsAndReset(&timer);
+			printf("  ray cast %.1f ns/ray, %.1f hits/ray\n", 1000000.0f * rayMs / RAY_COUNT, (float)hitCount / RAY_COUNT);
+
+			b2GetMillisecondsAndReset(&timer);
+			for (int i = 0; i < proxyCount; ++i)
+			{
+				b2DynamicTree_DestroyProxy(&tree, proxies[i].proxyId);
+			}
+			float destroyMs = b2GetMilliseconds(&timer);
+			printf("  destroy %.1f ns/proxy\n", 1000000.0f * destroyMs / proxyCount);
+
+			b2DynamicTree_Destroy(&tree);
+
+			// Every update mode starts from the same proxies and sees the same motion
+			for (int modeIndex = 0; modeIndex < e_updateModeCount; ++modeIndex)
+			{
+				UpdateMode mode = (UpdateMode)modeIndex;
+
+				InitializeProxies(proxies, proxyCount, distribution, extent, seed);
+				tree = b2DynamicTree_Create();
+				CreateProxies(&tree, proxies, proxyCount);
+				b2DynamicTree_Rebuild(&tree, true);
+
+				float startRatio = b2DynamicTree_GetAreaRatio(&tree);
+				int startHeight = b2DynamicTree_GetHeight(&tree);
+
+				SetSeed(seed + 2);
+				float totalMs = 0.0f;
+				float maxMs = 0.0f;
+				int totalMoved = 0;
+
+				for (int frame = 0; frame < frameCount; ++frame)
+				{
+					int movedCount = MoveProxies(proxies, proxyCount, distribution, extent);
+
+					b2GetMillisecondsAndReset(&timer);
+					UpdateTree(&tree, proxies, proxyCount, mode);
+					float ms = b2GetMilliseconds(&timer);
+
+					totalMs += ms;
+					maxMs = b2MaxFloat(maxMs, ms);
+					totalMoved += movedCount;
+
+					if (outputFile != NULL && (frame % SAMPLE_INTERVAL == 0 || frame == frameCount - 1))
+					{
+						fprintf(outputFile, "%s,%d,%s,%d,%d,%g,%g,%d\n", distributionNames[distribution], proxyCount,
+								updateModeNames[mode], frame, movedCount, ms, b2DynamicTree_GetAreaRatio(&tree),
+								b2DynamicTree_GetHeight(&tree));
+					}
+				}
+
+				printf("  %-11s %.3f ms/frame (max %.3f), %d moved/frame, area ratio %.2f -> %.2f, height %d -> %d\n",
+					   updateModeNames[mode], totalMs / frameCount, maxMs, totalMoved / frameCount, startRatio,
+					   b2DynamicTree_GetAreaRatio(&tree), startHeight, b2DynamicTree_GetHeight(&tree));
+
+				b2DynamicTree_Destroy(&tree);
+			}
+
+			printf("\n");
+		}
+
+		free(proxies);
+	}
+
+	if (outputFile != NULL)
+	{
+		fclose(outputFile);
+		printf("results written to %s\n", outputPath);
+	}
+
+	printf("======================================\n");
+	printf("All Box2D dynamic tree benchmarks complete!\n");
+
+	return 0;
+}
@@ -39,6 +39,18 @@ typedef void* b2AllocFcn(unsigned int size, int alignment);
 ///	@param mem the memory previously allocated through `b2AllocFcn`
 typedef void b2FreeFcn(void* mem);
 
+/// Prototype for a per world allocation function
+///	@param size the allocation size in bytes
+///	@param alignment the required alignment, guaranteed to be a power of 2
+///	@param context the user context from the world definition
+typedef void* b2WorldAllocFcn(unsigned int size, int alignment, void* context);
+
+/// Prototype for a per world free function
+///	@param mem the memory previously allocated through `b2WorldAllocFcn`
+///	@param size the size passed to `b2WorldAllocFcn`
+///	@param context the user context from the world definition
+typedef void b2WorldFreeFcn(void* mem, unsigned int size, void* context);
+
 /// Prototype for the user assert callback. Return 0 to skip the debugger break.
 typedef int b2AssertFcn(const char* condition, const char* fileName, int lineNumber);
 
@@ -27,6 +27,9 @@ typedef struct b2Segment b2Segment;
  * information to get contact points and normals as well as events. You can query to world, checking for overlaps and casting rays
  * or shapes. There is also debugging information such as debug draw, timing information, and counters. You can find documentation
  * here: https://box2d.org/
+ *
+ * Queries may run on other threads during b2World_Step if the world keeps a query snapshot, see b2WorldDef::enableQuerySnapshot.
+ * Shapes and bodies must not be created or destroyed while such queries run.
  * @{
  */
 
@@ -108,6 +111,24 @@ B2_API void b2World_CastPolygon(b2WorldId worldId, const b2Polygon* polygon, b2T
 ///	@see b2WorldDef
 B2_API void b2World_EnableSleeping(b2WorldId worldId, bool flag);
 
+/// Set the number of workers used by the next time step. This may be called between time steps to adjust
+///	parallelism to the current load. This controls how many workers take part in the constraint solver.
+///	The task system may keep running other Box2D tasks on any worker index below the largest worker count used so far.
+///	Ignored if the world uses the built-in serial task system.
+///	@see b2WorldDef::workerCount
+B2_API void b2World_SetWorkerCount(b2WorldId worldId, int workerCount);
+
+/// Get the number of workers used by the time step
+B2_API int b2World_GetWorkerCount(b2WorldId worldId);
+
+/// Enable/disable worker affinity in the constraint solver
+///	@see b2WorldDef::enableWorkerAffinity
+B2_API void b2World_EnableWorkerAffinity(b2WorldId worldId, bool flag);
+
+/// Get the number of solver blocks a worker took from other workers during the last time step.
+///	This is a measure of load imbalance.
+B2_API int b2World_GetWorkerStealCount(b2WorldId worldId, int workerIndex);
+
 /// Enable/disable continuous collision between dynamic and static bodies. Generally you should keep continuous
 /// collision enabled to prevent fast moving objects from going through static objects. The performance gain from
 ///	disabling continuous collision is minor.
@@ -160,9 +181,27 @@ B2_API b2Profile b2World_GetProfile(b2WorldId worldId);
 /// Get world counters and sizes
 B2_API b2Counters b2World_GetCounters(b2WorldId worldId);
 
+/// Get the memory held by the world, broken down by subsystem
+B2_API b2MemoryStats b2World_GetMemoryStats(b2WorldId worldId);
+
 /// Dump memory stats to box2d_memory.txt
 B2_API void b2World_DumpMemoryStats(b2WorldId worldId);
 
+/// Return unused persistent memory to the system. Memory freed when bodies, shapes, contacts, and joints are
+/// destroyed is kept for reuse until this is called. Internal contact and island ids are renumbered so
+/// per-step costs return to the current contact count after a peak. Cannot be called during a time step.
+B2_API void b2World_TrimMemory(b2WorldId worldId);
+
+/// Enable or disable the built-in tracer. While enabled, the profiler zones of every time step are kept in
+/// per-thread ring buffers holding the most recent events. The buffers are shared by all worlds, so recording
+/// is on while any world has tracing enabled. Cost is a flag check per zone while disabled.
+B2_API void b2World_EnableTrace(b2WorldId worldId, bool flag);
+
+/// Write the recorded trace of this world as Chrome Trace Event JSON, viewable in chrome://tracing or Perfetto.
+/// Each worker index is a thread in the trace. Other worlds may keep stepping, but their events are dropped
+/// while the trace is written. Returns false if the file cannot be written. Cannot be called during a time step.
+B2_API bool b2World_WriteTrace(b2WorldId worldId, const char* path);
+
 /** @} */
 
 /**
@@ -46,6 +46,15 @@ typedef void* b2EnqueueTaskCallback(b2TaskCallback* task, int32_t itemCount, int
 ///	@ingroup world
 typedef void b2FinishTaskCallback(void* userTask, void* userContext);
 
+/// Optional interface for tasks that depend on other tasks. This lets Box2D express parts of the time step as a
+///	dependency graph so independent work can overlap instead of joining after every task.
+///	The new task must not start until every non-null user task in the dependency array has finished.
+///	Box2D still calls b2FinishTaskCallback on every user task returned, including the dependencies.
+///	Returns a pointer to the user's task object or nullptr if the work was executed serially within the callback.
+///	@ingroup world
+typedef void* b2EnqueueDependentTaskCallback(b2TaskCallback* task, int32_t itemCount, int32_t minRange, void* taskContext,
+											 void** dependencies, int32_t dependencyCount, void* userContext);
+
 /// Prototype for a pre-solve callback.
 /// This is called after a contact is updated. This allows you to inspect a
 /// contact before it goes to the solver. If you are careful, you can modify the
@@ -137,6 +137,7 @@ typedef struct b2TOIOutput
 {
 	b2TOIState state;
 	float t;
+	int32_t iterations; ///< number of separating axis iterations used
 } b2TOIOutput;
 
 /// Compute the upper bound on time before two shapes penetrate. Time is represented as
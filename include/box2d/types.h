@@ -22,6 +22,18 @@ typedef struct b2RayResult
 	bool hit;
 } b2RayResult;
 
+/// What a world does when it is over its memory budget
+/// @ingroup world
+typedef enum b2MemoryBudgetPolicy
+{
+	/// Create functions return a null id. New contacts are still created so the simulation stays correct.
+	b2_failCreateOverBudget,
+
+	/// Create functions return a null id and new contacts are not created. Refused contacts are tried again
+	/// each step, so shapes that would touch may pass through each other until memory is freed.
+	b2_failCreateAndContactsOverBudget,
+} b2MemoryBudgetPolicy;
+
 /// World definition used to create a simulation world.
 /// Must be initialized using b2DefaultWorldDef.
 /// @ingroup world
@@ -58,18 +70,62 @@ typedef struct b2WorldDef
 	/// Enable continuous collision
 	bool enableContinous;
 
+	/// Keep each solver worker on the same bodies and constraints across stages and sub-steps. Workers only
+	///	take work from each other when the load is imbalanced. This may reduce cache traffic between cores.
+	///	Off by default until benchmarks show a win.
+	bool enableWorkerAffinity;
+
+	/// Keep a read-only copy of the broad-phase and shape transforms from the end of each time step. World queries
+	///	then read this copy and may be called from other threads while b2World_Step runs. Queries see the world
+	///	as it was at the end of the last time step. This costs a copy of the broad-phase trees every time step.
+	///	Queries made before the first time step read the world directly. The first step takes a snapshot and waits
+	///	for them to finish before changing the world.
+	bool enableQuerySnapshot;
+
 	/// Number of workers to use with the provided task system. Box2D performs best when using only
 	///	performance cores and accessing a single L2 cache. Efficiency cores and hyper-threading provide
 	///	little benefit and may even harm performance.
 	int32_t workerCount;
 
-	/// Function to spawn tasks
+	/// Solver work below this threshold is done on the calling thread without using the worker stages. The work is
+	///	estimated as the total number of awake bodies, contacts, and joints. This avoids the parallel solver overhead
+	///	for small worlds. Zero always uses the worker stages when there is more than one worker. A single worker
+	///	always solves on the calling thread.
+	int32_t serialSolveThreshold;
+
+	/// Initial capacity of the stack allocator used for scratch memory during the time step, in bytes.
+	///	The stack is grown before each step using an estimate from the body, contact, and joint counts.
+	///	Scratch memory that does not fit comes from the heap and is reported in b2Counters.
+	int32_t stackAllocatorCapacity;
+
+	/// Maximum bytes held by this world, zero for no limit. This is checked before creating bodies, shapes,
+	///	chains, joints, and contacts, so a single create call may take the world slightly over the budget.
+	int64_t memoryBudget;
+
+	/// What to do when the world is over the memory budget
+	b2MemoryBudgetPolicy memoryBudgetPolicy;
+
+	/// Optional allocation function for all memory held by this world. Uses the global allocator if NULL.
+	///	This is called from worker threads during the time step, so it must be thread safe.
+	b2WorldAllocFcn* allocFcn;
+
+	/// Free function matching allocFcn. Must be set if allocFcn is set.
+	b2WorldFreeFcn* freeFcn;
+
+	/// User context passed to allocFcn and freeFcn
+	void* allocContext;
+
+	/// Function to spawn tasks. Tasks are only spawned from within b2World_Step.
 	b2EnqueueTaskCallback* enqueueTask;
 
 	/// Function to finish a task
 	b2FinishTaskCallback* finishTask;
 
-	/// User context that is provided to enqueueTask and finishTask
+	/// Optional function to spawn tasks that depend on other tasks. If this is null Box2D
+	///	finishes the dependencies before spawning the task with enqueueTask.
+	b2EnqueueDependentTaskCallback* enqueueDependentTask;
+
+	/// User context that is provided to enqueueTask, finishTask, and enqueueDependentTask
 	void* userTaskContext;
 } b2WorldDef;
 
@@ -350,12 +406,93 @@ typedef struct b2Counters
 	int32_t jointCount;
 	int32_t islandCount;
 	int32_t stackUsed;
+	int32_t stackHeapAllocationCount;
 	int32_t staticTreeHeight;
 	int32_t treeHeight;
-	int32_t byteCount;
+	/// Bytes allocated by this world
+	int64_t byteCount;
 	int32_t taskCount;
 	int32_t colorCounts[12];
 } b2Counters;
+
+/// Bytes held by the arrays of a solver set or a group of solver sets.
+typedef struct b2SolverSetMemory
+{
+	int32_t bodySimBytes;
+	int32_t bodyStateBytes;
+	int32_t jointSimBytes;
+	int32_t contactSimBytes;
+	int32_t nonTouchingContactBytes;
+	int32_t islandSimBytes;
+} b2SolverSetMemory;
+
+/// Memory held by a world in bytes, broken down by subsystem. These are capacities, so they show what the world
+/// holds rather than what it currently uses. The solver set and constraint graph arrays are allocated from the
+/// block allocator, so they are also part of the block allocator numbers.
+typedef struct b2MemoryStats
+{
+	// Free id arrays of the id pools
+	int32_t bodyIdBytes;
+	int32_t solverSetIdBytes;
+	int32_t jointIdBytes;
+	int32_t contactIdBytes;
+	int32_t islandIdBytes;
+	int32_t shapeIdBytes;
+	int32_t chainIdBytes;
+
+	// Sparse arrays indexed by id
+	int32_t bodyArrayBytes;
+	int32_t solverSetArrayBytes;
+	int32_t jointArrayBytes;
+	int32_t contactArrayBytes;
+	int32_t islandArrayBytes;
+	int32_t shapeArrayBytes;
+	int32_t chainArrayBytes;
+
+	// Shape geometry pools indexed by b2ShapeType, including free ids
+	int32_t geometryBytes[b2_shapeTypeCount];
+
+	// Solver sets. All sleeping sets are summed together.
+	b2SolverSetMemory staticSet;
+	b2SolverSetMemory disabledSet;
+	b2SolverSetMemory awakeSet;
+	b2SolverSetMemory sleepingSets;
+	int32_t sleepingSetCount;
+
+	// Constraint graph colors including the overflow color: body bit set, contact sims, and joint sims
+	int32_t colorBytes[12];
+
+	// Broad-phase
+	int32_t staticTreeBytes;
+	int32_t movableTreeBytes;
+	int32_t moveSetBytes;
+	int32_t moveArrayBytes;
+	int32_t pairSetBytes;
+	int32_t querySnapshotBytes;
+
+	// Stack allocator used during the time step
+	int32_t stackCapacity;
+	int32_t stackHighWater;
+
+	// Block allocator. Slab bytes minus block bytes is held in free blocks. Block bytes minus requested
+	// bytes is lost to size class rounding. Large allocations bypass the slabs.
+	int32_t blockSlabBytes;
+	int32_t blockBytes;
+	int32_t blockRequestedBytes;
+	int32_t blockLargeBytes;
+
+	// Per worker bit sets and scratch arenas, summed over workers
+	int32_t workerBitSetBytes;
+	int32_t workerArenaBytes;
+	int32_t workerCount;
+
+	// Total bytes allocated by the world, counted against b2WorldDef::memoryBudget
+	int64_t totalBytes;
+
+	// Create calls and contacts refused because the world was over budget
+	int32_t failedCreateCount;
+	int32_t refusedContactCount;
+} b2MemoryStats;
 //! @endcond
 
 /// Use this to initialize your world definition
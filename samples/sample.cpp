@@ -316,7 +316,7 @@ void Sample::Step(Settings& settings)
 		g_draw.DrawString(5, m_textLine, "stack allocator size = %d K", s.stackUsed / 1024);
 		m_textLine += m_textIncrement;
 
-		g_draw.DrawString(5, m_textLine, "total allocation = %d K", s.byteCount / 1024);
+		g_draw.DrawString(5, m_textLine, "total allocation = %d K", (int)(s.byteCount / 1024));
 		m_textLine += m_textIncrement;
 	}
 
@@ -1,9 +1,15 @@
 // SPDX-FileCopyrightText: 2023 Erin Catto
 // SPDX-License-Identifier: MIT
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+// for mremap
+#define _GNU_SOURCE
+#endif
+
 #include "allocate.h"
 
 #include "core.h"
+#include "util.h"
 
 #include "box2d/api.h"
 
@@ -16,7 +22,22 @@
 #endif
 
 #include <stdatomic.h>
+#include <stdbool.h>
 #include <stdint.h>
+#include <string.h>
+
+#if defined(B2_PLATFORM_LINUX) || defined(B2_PLATFORM_ANDROID) || defined(B2_PLATFORM_MACOS) || defined(B2_PLATFORM_IOS)
+#include <sys/mman.h>
+#define B2_USE_MMAP 1
+#else
+#define B2_USE_MMAP 0
+#endif
+
+#if B2_USE_MMAP && defined(MREMAP_MAYMOVE)
+#define B2_USE_MREMAP 1
+#else
+#define B2_USE_MREMAP 0
+#endif
 
 #ifdef BOX2D_PROFILE
 
@@ -108,3 +129,178 @@ int b2GetByteCount(void)
 {
 	return atomic_load_explicit(&b2_byteCount, memory_order_relaxed);
 }
+
+void* b2AllocWith(b2Allocator* allocator, uint32_t size)
+{
+	if (allocator == NULL)
+	{
+		return b2Alloc(size);
+	}
+
+	atomic_fetch_add_explicit(&allocator->byteCount, size, memory_order_relaxed);
+
+	if (allocator->allocFcn == NULL)
+	{
+		return b2Alloc(size);
+	}
+
+	atomic_fetch_add_explicit(&b2_byteCount, size, memory_order_relaxed);
+
+	uint32_t size32 = ((size - 1) | 0x1F) + 1;
+	void* ptr = allocator->allocFcn(size32, B2_ALIGNMENT, allocator->context);
+	b2TracyCAlloc(ptr, size);
+
+	B2_ASSERT(ptr != NULL);
+	B2_ASSERT(((uintptr_t)ptr & 0x1F) == 0);
+
+	return ptr;
+}
+
+void b2FreeWith(b2Allocator* allocator, void* mem, uint32_t size)
+{
+	if (allocator == NULL)
+	{
+		b2Free(mem, size);
+		return;
+	}
+
+	if (mem == NULL)
+	{
+		return;
+	}
+
+	atomic_fetch_sub_explicit(&allocator->byteCount, size, memory_order_relaxed);
+
+	if (allocator->freeFcn == NULL)
+	{
+		b2Free(mem, size);
+		return;
+	}
+
+	b2TracyCFree(mem);
+	uint32_t size32 = ((size - 1) | 0x1F) + 1;
+	allocator->freeFcn(mem, size32, allocator->context);
+	atomic_fetch_sub_explicit(&b2_byteCount, size, memory_order_relaxed);
+}
+
+// Large allocations are rounded up to whole pages
+#define B2_PAGE_SIZE 4096
+
+static uint32_t b2RoundUpPages(uint32_t size)
+{
+	return (size + B2_PAGE_SIZE - 1) & ~(uint32_t)(B2_PAGE_SIZE - 1);
+}
+
+// Pages are mapped directly only when no user allocator is installed
+static bool b2UsePages(b2Allocator* allocator)
+{
+#if B2_USE_MMAP
+	return b2_allocFcn == NULL && (allocator == NULL || allocator->allocFcn == NULL);
+#else
+	B2_MAYBE_UNUSED(allocator);
+	return false;
+#endif
+}
+
+uint32_t b2GetPageAllocationSize(b2Allocator* allocator, uint32_t size)
+{
+	if (b2UsePages(allocator))
+	{
+		return b2RoundUpPages(size);
+	}
+
+	return ((size - 1) | 0x1F) + 1;
+}
+
+void* b2AllocPages(b2Allocator* allocator, uint32_t size)
+{
+#if B2_USE_MMAP
+	if (b2UsePages(allocator))
+	{
+		uint32_t pageSize = b2RoundUpPages(size);
+		void* ptr = mmap(NULL, pageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		B2_ASSERT(ptr != MAP_FAILED);
+		if (ptr == MAP_FAILED)
+		{
+			return NULL;
+		}
+
+		b2TracyCAlloc(ptr, pageSize);
+		atomic_fetch_add_explicit(&b2_byteCount, pageSize, memory_order_relaxed);
+		if (allocator != NULL)
+		{
+			atomic_fetch_add_explicit(&allocator->byteCount, pageSize, memory_order_relaxed);
+		}
+		return ptr;
+	}
+#endif
+
+	return b2AllocWith(allocator, size);
+}
+
+void* b2GrowPages(b2Allocator* allocator, void* mem, uint32_t oldSize, uint32_t newSize)
+{
+	B2_ASSERT(newSize >= oldSize);
+
+#if B2_USE_MREMAP
+	if (b2UsePages(allocator) && mem != NULL)
+	{
+		uint32_t oldPageSize = b2RoundUpPages(oldSize);
+		uint32_t newPageSize = b2RoundUpPages(newSize);
+		if (newPageSize == oldPageSize)
+		{
+			return mem;
+		}
+
+		// The kernel moves the pages if needed, no copy
+		void* ptr = mremap(mem, oldPageSize, newPageSize, MREMAP_MAYMOVE);
+		B2_ASSERT(ptr != MAP_FAILED);
+		if (ptr == MAP_FAILED)
+		{
+			return NULL;
+		}
+
+		b2TracyCFree(mem);
+		b2TracyCAlloc(ptr, newPageSize);
+		atomic_fetch_add_explicit(&b2_byteCount, newPageSize - oldPageSize, memory_order_relaxed);
+		if (allocator != NULL)
+		{
+			atomic_fetch_add_explicit(&allocator->byteCount, newPageSize - oldPageSize, memory_order_relaxed);
+		}
+		return ptr;
+	}
+#endif
+
+	void* ptr = b2AllocPages(allocator, newSize);
+	if (mem != NULL)
+	{
+		memcpy(ptr, mem, oldSize);
+		b2FreePages(allocator, mem, oldSize);
+	}
+	return ptr;
+}
+
+void b2FreePages(b2Allocator* allocator, void* mem, uint32_t size)
+{
+	if (mem == NULL)
+	{
+		return;
+	}
+
+#if B2_USE_MMAP
+	if (b2UsePages(allocator))
+	{
+		uint32_t pageSize = b2RoundUpPages(size);
+		b2TracyCFree(mem);
+		munmap(mem, pageSize);
+		atomic_fetch_sub_explicit(&b2_byteCount, pageSize, memory_order_relaxed);
+		if (allocator != NULL)
+		{
+			atomic_fetch_sub_explicit(&allocator->byteCount, pageSize, memory_order_relaxed);
+		}
+		return;
+	}
+#endif
+
+	b2FreeWith(allocator, mem, size);
+}
@@ -2,7 +2,36 @@
 // SPDX-License-Identifier: MIT
 
 #pragma once
+
+#include "box2d/api.h"
+
+#include <stdatomic.h>
 #include <stdint.h>
 
+// Allocation callbacks owned by a world. Memory held by a world comes from its allocator so it can be placed
+// and counted per world. Functions taking an allocator use the global allocator when it is NULL or has
+// no callbacks.
+typedef struct b2Allocator
+{
+	b2WorldAllocFcn* allocFcn;
+	b2WorldFreeFcn* freeFcn;
+	void* context;
+
+	// Bytes currently allocated through this allocator
+	_Atomic int64_t byteCount;
+} b2Allocator;
+
 void* b2Alloc(uint32_t size);
 void b2Free(void* mem, uint32_t size);
+
+void* b2AllocWith(b2Allocator* allocator, uint32_t size);
+void b2FreeWith(b2Allocator* allocator, void* mem, uint32_t size);
+
+// Page allocations for large arrays. These use virtual memory directly when there is no custom allocator,
+// so growing an allocation can remap the pages instead of copying.
+void* b2AllocPages(b2Allocator* allocator, uint32_t size);
+void* b2GrowPages(b2Allocator* allocator, void* mem, uint32_t oldSize, uint32_t newSize);
+void b2FreePages(b2Allocator* allocator, void* mem, uint32_t size);
+
+// Bytes actually reserved for a page allocation of the given size
+uint32_t b2GetPageAllocationSize(b2Allocator* allocator, uint32_t size);
@@ -0,0 +1,138 @@
+// SPDX-FileCopyrightText: 2024 Erin Catto
+// SPDX-License-Identifier: MIT
+
+#include "arena_allocator.h"
+
+#include "allocate.h"
+#include "array.h"
+#include "core.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct b2ArenaEntry
+{
+	char* data;
+	int size;
+} b2ArenaEntry;
+
+b2ArenaAllocator b2CreateArenaAllocator(b2Allocator* allocator, int capacity)
+{
+	B2_ASSERT(capacity >= 0);
+	b2ArenaAllocator arena = {0};
+	arena.allocator = allocator;
+	arena.capacity = capacity;
+	arena.data = b2AllocWith(allocator, capacity);
+	arena.index = 0;
+	arena.allocation = 0;
+	arena.maxAllocation = 0;
+	arena.heapEntries = b2CreateArray(allocator, sizeof(b2ArenaEntry), 4);
+	return arena;
+}
+
+void b2DestroyArenaAllocator(b2ArenaAllocator* arena)
+{
+	int heapCount = b2Array(arena->heapEntries).count;
+	for (int i = 0; i < heapCount; ++i)
+	{
+		b2FreeWith(arena->allocator, arena->heapEntries[i].data, arena->heapEntries[i].size);
+	}
+
+	b2DestroyArray(arena->heapEntries, sizeof(b2ArenaEntry));
+	b2FreeWith(arena->allocator, arena->data, arena->capacity);
+	*arena = (b2ArenaAllocator){0};
+}
+
+void* b2AllocateArenaItem(b2ArenaAllocator* arena, int size)
+{
+	// ensure allocation is 32 byte aligned to support 256-bit SIMD
+	int size32 = ((size - 1) | 0x1F) + 1;
+
+	char* data;
+	if (arena->index + size32 > arena->capacity)
+	{
+		// fall back to the heap (undesirable)
+		data = b2AllocWith(arena->allocator, size32);
+		b2ArenaEntry entry = {data, size32};
+		b2Array_Push(arena->heapEntries, entry);
+	}
+	else
+	{
+		data = arena->data + arena->index;
+		arena->index += size32;
+	}
+
+	B2_ASSERT(((uintptr_t)data & 0x1F) == 0);
+
+	arena->allocation += size32;
+	if (arena->allocation > arena->maxAllocation)
+	{
+		arena->maxAllocation = arena->allocation;
+	}
+
+	return data;
+}
+
+void b2ResetArena(b2ArenaAllocator* arena)
+{
+	int heapCount = b2Array(arena->heapEntries).count;
+	for (int i = 0; i < heapCount; ++i)
+	{
+		b2FreeWith(arena->allocator, arena->heapEntries[i].data, arena->heapEntries[i].size);
+	}
+	b2Array_Clear(arena->heapEntries);
+
+	if (arena->maxAllocation > arena->capacity)
+	{
+		b2FreeWith(arena->allocator, arena->data, arena->capacity);
+		arena->capacity = arena->maxAllocation + arena->maxAllocation / 2;
+		arena->data = b2AllocWith(arena->allocator, arena->capacity);
+	}
+
+	arena->index = 0;
+	arena->allocation = 0;
+}
+
+int b2GetArenaCapacity(b2ArenaAllocator* arena)
+{
+	return arena->capacity;
+}
+
+int b2GetMaxArenaAllocation(b2ArenaAllocator* arena)
+{
+	return arena->maxAllocation;
+}
+
+void b2ArenaIntArray_Push(b2ArenaAllocator* arena, b2ArenaIntArray* array, int value)
+{
+	if (array->count == array->capacity)
+	{
+		int newCapacity = array->capacity < 8 ? 8 : 2 * array->capacity;
+		int* newData = b2AllocateArenaItem(arena, newCapacity * sizeof(int));
+		if (array->count > 0)
+		{
+			memcpy(newData, array->data, array->count * sizeof(int));
+		}
+		array->data = newData;
+		array->capacity = newCapacity;
+	}
+
+	array->data[array->count] = value;
+	array->count += 1;
+}
+
+static int b2CompareInts(const void* a, const void* b)
+{
+	int valueA = *(const int*)a;
+	int valueB = *(const int*)b;
+	return (valueA > valueB) - (valueA < valueB);
+}
+
+void b2SortInts(int* values, int count)
+{
+	if (count > 1)
+	{
+		qsort(values, count, sizeof(int), b2CompareInts);
+	}
+}
@@ -0,0 +1,48 @@
+// SPDX-FileCopyrightText: 2024 Erin Catto
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include "allocate.h"
+
+// This is a bump allocator for task-local scratch memory. Each worker owns one so tasks can allocate
+// without synchronization. There is no individual free. The arena is reset every time step.
+// This allocator uses the heap if space is insufficient and grows on reset to fit the peak usage.
+typedef struct b2ArenaAllocator
+{
+	char* data;
+	int capacity;
+	int index;
+
+	// Bytes allocated since the last reset, including heap allocations
+	int allocation;
+	int maxAllocation;
+
+	struct b2ArenaEntry* heapEntries;
+
+	b2Allocator* allocator;
+} b2ArenaAllocator;
+
+b2ArenaAllocator b2CreateArenaAllocator(b2Allocator* allocator, int capacity);
+void b2DestroyArenaAllocator(b2ArenaAllocator* arena);
+
+void* b2AllocateArenaItem(b2ArenaAllocator* arena, int size);
+
+// Release all allocations and grow the arena based on usage. The owning worker must not be running tasks.
+void b2ResetArena(b2ArenaAllocator* arena);
+
+int b2GetArenaCapacity(b2ArenaAllocator* arena);
+int b2GetMaxArenaAllocation(b2ArenaAllocator* arena);
+
+// Growable array of integers in an arena. Growing leaves the old storage in the arena until it is reset.
+typedef struct b2ArenaIntArray
+{
+	int* data;
+	int count;
+	int capacity;
+} b2ArenaIntArray;
+
+void b2ArenaIntArray_Push(b2ArenaAllocator* arena, b2ArenaIntArray* array, int value);
+
+// Sort ascending. Used to put values gathered from several workers in a deterministic order.
+void b2SortInts(int* values, int count);
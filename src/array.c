@@ -8,9 +8,10 @@
 
 #include <string.h>
 
-void* b2CreateArray(int elementSize, int capacity)
+void* b2CreateArray(b2Allocator* allocator, int elementSize, int capacity)
 {
-	void* result = (b2ArrayHeader*)b2Alloc(sizeof(b2ArrayHeader) + elementSize * capacity) + 1;
+	void* result = (b2ArrayHeader*)b2AllocWith(allocator, sizeof(b2ArrayHeader) + elementSize * capacity) + 1;
+	b2Array(result).allocator = allocator;
 	b2Array(result).count = 0;
 	b2Array(result).capacity = capacity;
 	return result;
@@ -20,7 +21,7 @@ void b2DestroyArray(void* a, int elementSize)
 {
 	int capacity = b2Array(a).capacity;
 	int size = sizeof(b2ArrayHeader) + elementSize * capacity;
-	b2Free(((b2ArrayHeader*)a) - 1, size);
+	b2FreeWith(b2Array(a).allocator, ((b2ArrayHeader*)a) - 1, size);
 }
 
 void b2Array_Grow(void** a, int elementSize)
@@ -32,7 +33,9 @@ void b2Array_Grow(void** a, int elementSize)
 	int newCapacity = capacity + (capacity >> 1);
 	newCapacity = newCapacity >= 2 ? newCapacity : 2;
 	void* tmp = *a;
-	*a = (b2ArrayHeader*)b2Alloc(sizeof(b2ArrayHeader) + elementSize * newCapacity) + 1;
+	b2Allocator* allocator = b2Array(tmp).allocator;
+	*a = (b2ArrayHeader*)b2AllocWith(allocator, sizeof(b2ArrayHeader) + elementSize * newCapacity) + 1;
+	b2Array(*a).allocator = allocator;
 	b2Array(*a).capacity = newCapacity;
 	b2Array(*a).count = capacity;
 	memcpy(*a, tmp, capacity * elementSize);
@@ -54,7 +57,9 @@ void b2Array_Resize(void** a, int elementSize, int count)
 	int newCapacity = count + (count >> 1);
 	newCapacity = newCapacity >= 2 ? newCapacity : 2;
 	void* tmp = *a;
-	*a = (b2ArrayHeader*)b2Alloc(sizeof(b2ArrayHeader) + elementSize * newCapacity) + 1;
+	b2Allocator* allocator = b2Array(tmp).allocator;
+	*a = (b2ArrayHeader*)b2AllocWith(allocator, sizeof(b2ArrayHeader) + elementSize * newCapacity) + 1;
+	b2Array(*a).allocator = allocator;
 	b2Array(*a).capacity = newCapacity;
 	b2Array(*a).count = count;
 
@@ -62,3 +67,21 @@ void b2Array_Resize(void** a, int elementSize, int count)
 	memcpy(*a, tmp, originalCount * elementSize);
 	b2DestroyArray(tmp, elementSize);
 }
+
+void b2Array_Shrink(void** a, int elementSize)
+{
+	int count = b2Array(*a).count;
+	if (b2Array(*a).capacity == count)
+	{
+		return;
+	}
+
+	void* tmp = *a;
+	b2Allocator* allocator = b2Array(tmp).allocator;
+	*a = (b2ArrayHeader*)b2AllocWith(allocator, sizeof(b2ArrayHeader) + elementSize * count) + 1;
+	b2Array(*a).allocator = allocator;
+	b2Array(*a).capacity = count;
+	b2Array(*a).count = count;
+	memcpy(*a, tmp, count * elementSize);
+	b2DestroyArray(tmp, elementSize);
+}
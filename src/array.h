@@ -3,23 +3,29 @@
 
 #pragma once
 
+#include "allocate.h"
 #include "core.h"
 
 // todo compare with https://github.com/skeeto/growable-buf
 
+// The header keeps the allocator so the array can grow without it being passed to every push
 typedef struct b2ArrayHeader
 {
+	b2Allocator* allocator;
 	int count;
 	int capacity;
 } b2ArrayHeader;
 
 #define b2Array(a) ((b2ArrayHeader*)(a))[-1]
 
-void* b2CreateArray(int elementSize, int capacity);
+void* b2CreateArray(b2Allocator* allocator, int elementSize, int capacity);
 void b2DestroyArray(void* a, int elementSize);
 void b2Array_Grow(void** a, int elementSize);
 void b2Array_Resize(void** a, int elementSize, int count);
 
+// Reduce the capacity to the count, releasing the rest of the allocation
+void b2Array_Shrink(void** a, int elementSize);
+
 #define b2CheckIndex(a, index) B2_ASSERT(0 <= index && index < b2Array(a).count)
 #define b2CheckId(ARRAY, ID) B2_ASSERT(0 <= ID && ID < b2Array(ARRAY).count && ARRAY[ID].id == ID)
 #define b2CheckIdAndRevision(ARRAY, ID, REV) B2_ASSERT(0 <= ID && ID < b2Array(ARRAY).count && ARRAY[ID].id == ID && ARRAY[ID].revision == REV)
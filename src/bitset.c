@@ -7,20 +7,21 @@
 
 #include <string.h>
 
-b2BitSet b2CreateBitSet(uint32_t bitCapacity)
+b2BitSet b2CreateBitSet(b2Allocator* allocator, uint32_t bitCapacity)
 {
 	b2BitSet bitSet = {0};
+	bitSet.allocator = allocator;
 
 	bitSet.blockCapacity = (bitCapacity + sizeof(uint64_t) * 8 - 1) / (sizeof(uint64_t) * 8);
 	bitSet.blockCount = 0;
-	bitSet.bits = b2Alloc(bitSet.blockCapacity * sizeof(uint64_t));
+	bitSet.bits = b2AllocWith(allocator, bitSet.blockCapacity * sizeof(uint64_t));
 	memset(bitSet.bits, 0, bitSet.blockCapacity * sizeof(uint64_t));
 	return bitSet;
 }
 
 void b2DestroyBitSet(b2BitSet* bitSet)
 {
-	b2Free(bitSet->bits, bitSet->blockCapacity * sizeof(uint64_t));
+	b2FreeWith(bitSet->allocator, bitSet->bits, bitSet->blockCapacity * sizeof(uint64_t));
 	bitSet->blockCapacity = 0;
 	bitSet->blockCount = 0;
 	bitSet->bits = NULL;
@@ -31,15 +32,32 @@ void b2SetBitCountAndClear(b2BitSet* bitSet, uint32_t bitCount)
 	uint32_t blockCount = (bitCount + sizeof(uint64_t) * 8 - 1) / (sizeof(uint64_t) * 8);
 	if (bitSet->blockCapacity < blockCount)
 	{
+		b2Allocator* allocator = bitSet->allocator;
 		b2DestroyBitSet(bitSet);
 		uint32_t newBitCapacity = bitCount + (bitCount >> 1);
-		*bitSet = b2CreateBitSet(newBitCapacity);
+		*bitSet = b2CreateBitSet(allocator, newBitCapacity);
 	}
 
 	bitSet->blockCount = blockCount;
 	memset(bitSet->bits, 0, bitSet->blockCount * sizeof(uint64_t));
 }
 
+void b2TrimBitSet(b2BitSet* bitSet, uint32_t bitCapacity)
+{
+	// keep at least one block
+	bitCapacity = bitCapacity > 64 ? bitCapacity : 64;
+	uint32_t blockCapacity = (bitCapacity + sizeof(uint64_t) * 8 - 1) / (sizeof(uint64_t) * 8);
+	if (bitSet->blockCapacity <= blockCapacity)
+	{
+		bitSet->blockCount = 0;
+		return;
+	}
+
+	b2Allocator* allocator = bitSet->allocator;
+	b2DestroyBitSet(bitSet);
+	*bitSet = b2CreateBitSet(allocator, bitCapacity);
+}
+
 void b2GrowBitSet(b2BitSet* bitSet, uint32_t blockCount)
 {
 	B2_ASSERT(blockCount > bitSet->blockCount);
@@ -47,10 +65,10 @@ void b2GrowBitSet(b2BitSet* bitSet, uint32_t blockCount)
 	{
 		uint32_t oldCapacity = bitSet->blockCapacity;
 		bitSet->blockCapacity = blockCount + blockCount / 2;
-		uint64_t* newBits = b2Alloc(bitSet->blockCapacity * sizeof(uint64_t));
+		uint64_t* newBits = b2AllocWith(bitSet->allocator, bitSet->blockCapacity * sizeof(uint64_t));
 		memset(newBits, 0, bitSet->blockCapacity * sizeof(uint64_t));
 		memcpy(newBits, bitSet->bits, bitSet->blockCount * sizeof(uint64_t));
-		b2Free(bitSet->bits, oldCapacity * sizeof(uint64_t));
+		b2FreeWith(bitSet->allocator, bitSet->bits, oldCapacity * sizeof(uint64_t));
 		bitSet->bits = newBits;
 	}
 
@@ -3,6 +3,7 @@
 
 #pragma once
 
+#include "allocate.h"
 #include "core.h"
 
 #include <stdbool.h>
@@ -14,14 +15,18 @@ typedef struct b2BitSet
 	uint64_t* bits;
 	uint32_t blockCapacity;
 	uint32_t blockCount;
+	b2Allocator* allocator;
 } b2BitSet;
 
-b2BitSet b2CreateBitSet(uint32_t bitCapacity);
+b2BitSet b2CreateBitSet(b2Allocator* allocator, uint32_t bitCapacity);
 void b2DestroyBitSet(b2BitSet* bitSet);
 void b2SetBitCountAndClear(b2BitSet* bitSet, uint32_t bitCount);
 void b2InPlaceUnion(b2BitSet* setA, const b2BitSet* setB);
 void b2GrowBitSet(b2BitSet* bitSet, uint32_t blockCount);
 
+// Release storage above the bit capacity. The bits are cleared.
+void b2TrimBitSet(b2BitSet* bitSet, uint32_t bitCapacity);
+
 static inline void b2SetBit(b2BitSet* bitSet, uint32_t bitIndex)
 {
 	uint32_t blockIndex = bitIndex / 64;
@@ -7,12 +7,20 @@
 #include "core.h"
 #include "ctz.h"
 
-#include <limits.h>
+#include "box2d/color.h"
+#include "box2d/math_functions.h"
+
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
 #include <string.h>
 
-#define b2_targetChunkSize (1 << 18)
-#define b2_maxBlockSize (1 << b2_maxBlockPower)
+// A class starts with a small slab and each new slab doubles the blocks the class holds, up to the
+// maximum slab size. Small worlds only pay for a few blocks per class. The largest classes start with
+// fewer blocks so a slab never exceeds the maximum.
+#define b2_minSlabBlocks 8
+#define b2_minSlabSize 4096
+#define b2_maxSlabSize (1 << 18)
 
 // This is a helper struct for building a linked list of memory blocks
 typedef struct b2Block
@@ -20,64 +28,118 @@ typedef struct b2Block
 	struct b2Block* next;
 } b2Block;
 
-// This holds a contiguous block list from a single malloc call. The blocks are all of a the same size (a power of 2).
-// When a chunk is allocated, its blocks are installed in the block allocator free list for the specific power of 2 size.
-typedef struct b2Chunk
+// This holds a contiguous range of blocks from a single allocation. The blocks are all of the same size class.
+// When a slab is allocated, its blocks are installed in the block allocator free list for that class.
+typedef struct b2Slab
 {
-	b2Block* blockList;
+	char* memory;
+
+	// bytes in the slab and the whole blocks that fit
+	int size;
+	int blockCount;
 
-	// size of each block
-	int blockSize;
+	// size class of the blocks
+	int classIndex;
 
-	// size of the entire list
-	int totalSize;
-} b2Chunk;
+	// scratch used by b2TrimBlockAllocator
+	int freeCount;
+} b2Slab;
 
-b2BlockAllocator b2CreateBlockAllocator(void)
+// Size class for an allocation. Class zero holds everything up to the minimum block size. Every power of two
+// above that is split into four classes with a step of a quarter of the lower power. The smallest step is 32
+// bytes so all blocks keep the 32 byte alignment of b2Alloc.
+static int b2GetBlockClass(int size)
 {
-	_Static_assert(b2_blockPowerCount == b2_maxBlockPower - b2_minBlockPower + 1, "wrong size");
-	_Static_assert(b2_targetChunkSize <= (1 << b2_maxBlockPower), "wrong size");
-	_Static_assert(b2_targetChunkSize >= (1 << b2_minBlockPower), "wrong size");
+	B2_ASSERT(0 < size && size <= b2_maxBlockSize);
+
+	if (size <= (1 << b2_minBlockPower))
+	{
+		return 0;
+	}
 
-	b2BlockAllocator allocator = {0};
-	allocator.chunkArray = b2CreateArray(sizeof(b2Chunk), 128);
-	memset(allocator.chunkArray, 0, b2Array(allocator.chunkArray).capacity * sizeof(b2Chunk));
-	return allocator;
+	int power = b2BoundingPowerOf2(size) - 1;
+	int base = 1 << power;
+	int step = base / b2_blockClassesPerPower;
+	int k = (size - base + step - 1) / step;
+	B2_ASSERT(1 <= k && k <= b2_blockClassesPerPower);
+	return (power - b2_minBlockPower) * b2_blockClassesPerPower + k;
 }
 
-void b2DestroyBlockAllocator(b2BlockAllocator* allocator)
+static int b2GetBlockClassSize(int classIndex)
 {
-	int chunkCount = b2Array(allocator->chunkArray).count;
-	for (int32_t i = 0; i < chunkCount; ++i)
+	B2_ASSERT(0 <= classIndex && classIndex < b2_blockClassCount);
+
+	if (classIndex == 0)
 	{
-		b2Chunk* chunk = allocator->chunkArray + i;
-		b2Free(chunk->blockList, chunk->totalSize);
+		return 1 << b2_minBlockPower;
 	}
 
-	b2DestroyArray(allocator->chunkArray, sizeof(b2Chunk));
+	int power = b2_minBlockPower + (classIndex - 1) / b2_blockClassesPerPower;
+	int k = (classIndex - 1) % b2_blockClassesPerPower + 1;
+	int base = 1 << power;
+	return base + k * (base / b2_blockClassesPerPower);
 }
 
-// todo should probably get rid of this allocator
-// large world sample:
-// - block allocator 245 MB
-// - system allocator 206 MB
-// no significant performance difference
-#define B2_USE_SYSTEM_ALLOC 1
-
-#if B2_USE_SYSTEM_ALLOC
-void* b2AllocBlock(b2BlockAllocator* allocator, int size)
+b2BlockAllocator b2CreateBlockAllocator(b2Allocator* allocator)
 {
-	((void)allocator);
-	return b2Alloc(size);
+	_Static_assert(b2_maxSlabSize >= 4 * b2_maxBlockSize, "slabs should hold several of the largest blocks");
+	_Static_assert(((1 << b2_minBlockPower) / b2_blockClassesPerPower) % 32 == 0, "blocks must stay 32 byte aligned");
+
+	b2BlockAllocator blockAllocator = {0};
+	blockAllocator.allocator = allocator;
+	blockAllocator.slabArray = b2CreateArray(allocator, sizeof(b2Slab), 16);
+	return blockAllocator;
 }
 
-void b2FreeBlock(b2BlockAllocator* allocator, void* memory, int size)
+void b2DestroyBlockAllocator(b2BlockAllocator* allocator)
 {
-	((void)allocator);
-	b2Free(memory, size);
+	int slabCount = b2Array(allocator->slabArray).count;
+	for (int i = 0; i < slabCount; ++i)
+	{
+		b2FreeWith(allocator->allocator, allocator->slabArray[i].memory, allocator->slabArray[i].size);
+	}
+
+	b2DestroyArray(allocator->slabArray, sizeof(b2Slab));
+
+	// Large allocations are owned by the arrays and should have been freed
+	B2_ASSERT(allocator->largeCount == 0);
 }
 
-#else
+static b2Block* b2AllocSlab(b2BlockAllocator* allocator, int classIndex)
+{
+	// double the blocks held by the class, at least a page and at most the maximum slab size
+	int blockSize = b2GetBlockClassSize(classIndex);
+	int blockCount = b2MaxInt(b2_minSlabBlocks, allocator->classBlockCounts[classIndex]);
+	blockCount = b2MaxInt(blockCount, (b2_minSlabSize + blockSize - 1) / blockSize);
+	blockCount = b2MinInt(blockCount, b2_maxSlabSize / blockSize);
+
+	b2Slab slab;
+	slab.size = blockCount * blockSize;
+	slab.blockCount = blockCount;
+	slab.memory = b2AllocWith(allocator->allocator, slab.size);
+	slab.classIndex = classIndex;
+	slab.freeCount = 0;
+
+	allocator->classBlockCounts[classIndex] += blockCount;
+	allocator->slabBytes += slab.size;
+
+#if B2_DEBUG
+	memset(slab.memory, 0xcd, slab.size);
+#endif
+
+	// build linked list
+	for (int i = 0; i < blockCount - 1; ++i)
+	{
+		b2Block* block = (b2Block*)(slab.memory + blockSize * i);
+		block->next = (b2Block*)(slab.memory + blockSize * (i + 1));
+	}
+	b2Block* last = (b2Block*)(slab.memory + blockSize * (blockCount - 1));
+	last->next = NULL;
+
+	b2Array_Push(allocator->slabArray, slab);
+
+	return (b2Block*)slab.memory;
+}
 
 void* b2AllocBlock(b2BlockAllocator* allocator, int size)
 {
@@ -90,116 +152,246 @@ void* b2AllocBlock(b2BlockAllocator* allocator, int size)
 
 	if (size > b2_maxBlockSize)
 	{
-		B2_ASSERT(false);
-		return NULL;
+		allocator->largeBytes += (int)b2GetPageAllocationSize(allocator->allocator, size);
+		allocator->largeCount += 1;
+		return b2AllocPages(allocator->allocator, size);
 	}
 
-	int power = b2BoundingPowerOf2(size);
-	power = power < b2_minBlockPower ? b2_minBlockPower : power;
+	int index = b2GetBlockClass(size);
+	allocator->requestedBytes += size;
+	allocator->blockBytes += b2GetBlockClassSize(index);
+
+	b2Block* block = allocator->freeLists[index];
+	if (block == NULL)
+	{
+		// free list is empty, allocate a slab for this class
+		block = b2AllocSlab(allocator, index);
+	}
 
-	int index = power - b2_minBlockPower;
-	B2_ASSERT(0 <= index && index < b2_blockPowerCount);
+	allocator->freeLists[index] = block->next;
+	return block;
+}
 
-	if (allocator->freeLists[index] != NULL)
+#if B2_VALIDATE
+// verify the memory address and size are valid
+static void b2ValidateBlock(b2BlockAllocator* allocator, void* memory, int classIndex)
+{
+	int blockSize = b2GetBlockClassSize(classIndex);
+	bool found = false;
+	int slabCount = b2Array(allocator->slabArray).count;
+	for (int i = 0; i < slabCount; ++i)
 	{
-		b2Block* block = allocator->freeLists[index];
-		allocator->freeLists[index] = block->next;
-		return block;
+		b2Slab* slab = allocator->slabArray + i;
+		if (slab->classIndex != classIndex)
+		{
+			// this slab is not the right size, so make sure it does not overlap the freed memory
+			B2_ASSERT((char*)memory + blockSize <= slab->memory || slab->memory + slab->size <= (char*)memory);
+		}
+		else if (slab->memory <= (char*)memory && (char*)memory + blockSize <= slab->memory + slab->size)
+		{
+			B2_ASSERT(((char*)memory - slab->memory) % blockSize == 0);
+			found = true;
+		}
 	}
 
-	// free list is empty, allocate more blocks for this power
-	b2Chunk chunk;
-	chunk.blockSize = (1 << power);
-	// if the block size is very large then the chunk will hold a single block
-	if (chunk.blockSize > b2_targetChunkSize)
+	B2_ASSERT(found);
+}
+#endif
+
+void b2FreeBlock(b2BlockAllocator* allocator, void* memory, int size)
+{
+	B2_ASSERT(size >= 0);
+
+	if (size == 0 || memory == NULL)
 	{
-		chunk.totalSize = chunk.blockSize;
+		return;
 	}
-	else
+
+	if (size > b2_maxBlockSize)
 	{
-		chunk.totalSize = b2_targetChunkSize;
+		B2_ASSERT(allocator->largeCount > 0);
+		allocator->largeBytes -= (int)b2GetPageAllocationSize(allocator->allocator, size);
+		allocator->largeCount -= 1;
+		b2FreePages(allocator->allocator, memory, size);
+		return;
 	}
-	chunk.blockList = b2Alloc(chunk.totalSize);
 
-#if B2_DEBUG
-	memset(chunk.blockList, 0xcd, chunk.totalSize);
+	int index = b2GetBlockClass(size);
+	int blockSize = b2GetBlockClassSize(index);
+	allocator->requestedBytes -= size;
+	allocator->blockBytes -= blockSize;
+
+#if B2_VALIDATE
+	b2ValidateBlock(allocator, memory, index);
+	memset(memory, 0xfd, blockSize);
 #endif
 
-	// build linked list
-	int blockCount = chunk.totalSize / chunk.blockSize;
-	B2_ASSERT(blockCount * chunk.blockSize == chunk.totalSize);
-	for (int i = 0; i < blockCount - 1; ++i)
+	// add to free list
+	b2Block* block = memory;
+	block->next = allocator->freeLists[index];
+	allocator->freeLists[index] = block;
+}
+
+void* b2GrowBlock(b2BlockAllocator* allocator, void* memory, int oldSize, int newSize)
+{
+	B2_ASSERT(0 <= oldSize && oldSize <= newSize);
+
+	if (memory == NULL || oldSize == 0)
 	{
-		b2Block* block = (b2Block*)((int8_t*)chunk.blockList + chunk.blockSize * i);
-		b2Block* next = (b2Block*)((int8_t*)chunk.blockList + chunk.blockSize * (i + 1));
-		block->next = next;
+		B2_ASSERT(memory == NULL && oldSize == 0);
+		return b2AllocBlock(allocator, newSize);
 	}
-	b2Block* last = (b2Block*)((int8_t*)chunk.blockList + chunk.blockSize * (blockCount - 1));
-	last->next = NULL;
 
-	allocator->freeLists[index] = chunk.blockList->next;
+	if (oldSize > b2_maxBlockSize)
+	{
+		// large to large can remap the pages
+		int oldPageSize = (int)b2GetPageAllocationSize(allocator->allocator, oldSize);
+		allocator->largeBytes += (int)b2GetPageAllocationSize(allocator->allocator, newSize) - oldPageSize;
+		return b2GrowPages(allocator->allocator, memory, oldSize, newSize);
+	}
 
-	b2Array_Push(allocator->chunkArray, chunk);
+	if (newSize <= b2_maxBlockSize)
+	{
+		int index = b2GetBlockClass(oldSize);
+		if (index == b2GetBlockClass(newSize))
+		{
+			// the block already has room
+			allocator->requestedBytes += newSize - oldSize;
+			return memory;
+		}
+	}
 
-	return chunk.blockList;
+	void* newMemory = b2AllocBlock(allocator, newSize);
+	memcpy(newMemory, memory, oldSize);
+	b2FreeBlock(allocator, memory, oldSize);
+	return newMemory;
 }
 
-void b2FreeBlock(b2BlockAllocator* allocator, void* memory, int size)
+static int b2CompareSlabs(const void* a, const void* b)
 {
-	B2_ASSERT(size >= 0);
+	const b2Slab* slabA = a;
+	const b2Slab* slabB = b;
+	uintptr_t addressA = (uintptr_t)slabA->memory;
+	uintptr_t addressB = (uintptr_t)slabB->memory;
+	return addressA < addressB ? -1 : (addressA > addressB ? 1 : 0);
+}
 
-	if (size == 0)
+// Find the slab holding a block. The slabs must be sorted by address.
+static b2Slab* b2FindSlab(b2Slab* slabs, int slabCount, void* memory)
+{
+	int low = 0;
+	int high = slabCount - 1;
+	while (low <= high)
 	{
-		return;
+		int mid = (low + high) >> 1;
+		b2Slab* slab = slabs + mid;
+		if ((char*)memory < slab->memory)
+		{
+			high = mid - 1;
+		}
+		else if ((char*)memory >= slab->memory + slab->size)
+		{
+			low = mid + 1;
+		}
+		else
+		{
+			return slab;
+		}
 	}
 
-	B2_ASSERT(size <= b2_maxBlockSize);
+	B2_ASSERT(false);
+	return NULL;
+}
 
-	int power = b2BoundingPowerOf2(size);
-	power = power < b2_minBlockPower ? b2_minBlockPower : power;
+int b2TrimBlockAllocator(b2BlockAllocator* allocator)
+{
+	b2TracyCZoneNC(trim_blocks, "Trim Blocks", b2_colorGray, true);
 
-	int index = power - b2_minBlockPower;
-	B2_ASSERT(0 <= index && index < b2_blockPowerCount);
+	b2Slab* slabs = allocator->slabArray;
+	int slabCount = b2Array(slabs).count;
+	if (slabCount == 0)
+	{
+		b2TracyCZoneEnd(trim_blocks);
+		return 0;
+	}
 
-#if B2_VALIDATE
-	// verify the memory address and size are valid
-	int blockSize = (1 << power);
-	bool found = false;
-	int chunkCount = b2Array(allocator->chunkArray).count;
-	for (int i = 0; i < chunkCount; ++i)
+	qsort(slabs, slabCount, sizeof(b2Slab), b2CompareSlabs);
+
+	// count the free blocks in each slab
+	for (int i = 0; i < slabCount; ++i)
+	{
+		slabs[i].freeCount = 0;
+	}
+
+	for (int i = 0; i < b2_blockClassCount; ++i)
 	{
-		b2Chunk* chunk = allocator->chunkArray + i;
-		if (chunk->blockSize != blockSize)
+		for (b2Block* block = allocator->freeLists[i]; block != NULL; block = block->next)
 		{
-			// this chunk is not the right size, so make sure it does not overlap the freed memory
-			B2_ASSERT((int8_t*)memory + blockSize <= (int8_t*)chunk->blockList ||
-					  (int8_t*)chunk->blockList + chunk->totalSize <= (int8_t*)memory);
+			b2Slab* slab = b2FindSlab(slabs, slabCount, block);
+			B2_ASSERT(slab->classIndex == i);
+			slab->freeCount += 1;
 		}
-		else
+	}
+
+	// unlink the blocks of slabs that are entirely free
+	for (int i = 0; i < b2_blockClassCount; ++i)
+	{
+		b2Block** link = allocator->freeLists + i;
+		while (*link != NULL)
 		{
-			// does the freed memory overlap this chunk's block list?
-			if ((int8_t*)chunk->blockList <= (int8_t*)memory &&
-				(int8_t*)memory + blockSize <= (int8_t*)chunk->blockList + chunk->totalSize)
+			b2Slab* slab = b2FindSlab(slabs, slabCount, *link);
+			if (slab->freeCount == slab->blockCount)
 			{
-				found = true;
+				*link = (*link)->next;
+			}
+			else
+			{
+				link = &(*link)->next;
 			}
 		}
 	}
 
-	B2_ASSERT(found);
-	memset(memory, 0xfd, blockSize);
-#endif
+	// release the free slabs and compact the slab array
+	int releasedBytes = 0;
+	int keepCount = 0;
+	for (int i = 0; i < slabCount; ++i)
+	{
+		b2Slab* slab = slabs + i;
+		if (slab->freeCount == slab->blockCount)
+		{
+			b2FreeWith(allocator->allocator, slab->memory, slab->size);
+			allocator->classBlockCounts[slab->classIndex] -= slab->blockCount;
+			allocator->slabBytes -= slab->size;
+			releasedBytes += slab->size;
+			continue;
+		}
 
-	// add to free list
-	b2Block* block = memory;
-	block->next = allocator->freeLists[index];
-	allocator->freeLists[index] = block;
+		slabs[keepCount] = *slab;
+		keepCount += 1;
+	}
+
+	b2Array(slabs).count = keepCount;
+
+	b2TracyCZoneEnd(trim_blocks);
+	return releasedBytes;
+}
+
+b2BlockAllocatorStats b2GetBlockAllocatorStats(const b2BlockAllocator* allocator)
+{
+	b2BlockAllocatorStats stats;
+	stats.requestedBytes = allocator->requestedBytes;
+	stats.blockBytes = allocator->blockBytes;
+	stats.slabCount = b2Array(allocator->slabArray).count;
+	stats.slabBytes = allocator->slabBytes;
+	stats.largeBytes = allocator->largeBytes;
+	stats.largeCount = allocator->largeCount;
+	return stats;
 }
-#endif
 
 bool b2ValidateBlockAllocator(b2BlockAllocator* allocator)
 {
-	for (int i = 0; i < b2_blockPowerCount; ++i)
+	int freeBytes = 0;
+	for (int i = 0; i < b2_blockClassCount; ++i)
 	{
 		int count = 0;
 		b2Block* block = allocator->freeLists[i];
@@ -213,7 +405,15 @@ bool b2ValidateBlockAllocator(b2BlockAllocator* allocator)
 				return false;
 			}
 		}
+
+		freeBytes += count * b2GetBlockClassSize(i);
+	}
+
+	// every slab byte is either a live block or a free block
+	if (allocator->blockBytes + freeBytes != allocator->slabBytes)
+	{
+		return false;
 	}
 
-	return true;
+	return allocator->requestedBytes <= allocator->blockBytes;
 }
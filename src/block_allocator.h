@@ -3,38 +3,79 @@
 
 #pragma once
 
-#include <stdbool.h>
+#include "allocate.h"
 
-#define b2_minBlockPower 8
-#define b2_maxBlockPower 30
-#define b2_blockPowerCount (b2_maxBlockPower - b2_minBlockPower + 1)
+#include <stdbool.h>
 
-// todo current benchmarking shows very small gains. like 0.1% but large memory overhead
+// Size classes cover 128 bytes to 64KB with four classes per power of two. This keeps the rounding waste
+// under 25% instead of up to 50% with power of two classes.
+#define b2_minBlockPower 7
+#define b2_maxBlockPower 16
+#define b2_blockClassesPerPower 4
+#define b2_blockClassCount ((b2_maxBlockPower - b2_minBlockPower) * b2_blockClassesPerPower + 1)
+#define b2_maxBlockSize (1 << b2_maxBlockPower)
 
-// This is a block allocator used for allocating objects that persist for more than one time step. Allocations
-// rounded up to a power of 2. Free lists are maintained for a range of powers of two. Not thread-safe.
+// This is a slab allocator used for allocating arrays that persist for more than one time step. Small allocations
+// are rounded up to a size class and carved from slabs that start at a few blocks and grow with the class. Larger allocations go straight to pages so they can
+// grow without a copy where the platform supports it. Not thread-safe.
 typedef struct b2BlockAllocator
 {
-	// Array of all the chunks of memory from malloc
-	struct b2Chunk* chunkArray;
+	// Array of all the slabs
+	struct b2Slab* slabArray;
+
+	// List of free blocks, one list for each size class
+	struct b2Block* freeLists[b2_blockClassCount];
+
+	// Bytes requested by live allocations, before rounding
+	int requestedBytes;
+
+	// Bytes in live blocks after rounding to a size class
+	int blockBytes;
+
+	// Bytes in all slabs and the blocks each class holds. A new slab doubles the blocks of its class.
+	int slabBytes;
+	int classBlockCounts[b2_blockClassCount];
 
-	// List of free blocks, one list for each power of 2
-	struct b2Block* freeLists[b2_blockPowerCount];
+	// Live page allocations for sizes above b2_maxBlockSize
+	int largeBytes;
+	int largeCount;
+
+	b2Allocator* allocator;
 } b2BlockAllocator;
 
+// Memory use of a block allocator. Fragmentation is the difference between slab bytes and block bytes (free blocks)
+// plus the difference between block bytes and requested bytes (rounding).
+typedef struct b2BlockAllocatorStats
+{
+	int requestedBytes;
+	int blockBytes;
+	int slabBytes;
+	int slabCount;
+	int largeBytes;
+	int largeCount;
+} b2BlockAllocatorStats;
+
 // Create an allocator suitable for allocating and freeing objects quickly.
-// Does not return memory to the heap.
-b2BlockAllocator b2CreateBlockAllocator(void);
+// Does not return memory to the heap until b2TrimBlockAllocator is called.
+b2BlockAllocator b2CreateBlockAllocator(b2Allocator* allocator);
 
 // Destroy a block allocator instance
 void b2DestroyBlockAllocator(b2BlockAllocator* allocator);
 
-// Allocate memory. This will use b2Alloc if the size is larger than b2_maxBlockSize.
-// Allocates memory in power of two sizes, so the actual allocation may be larger than requested.
-// Returns the memory pointer along with the actual capacity.
+// Allocate memory. Uses page allocation if the size is larger than b2_maxBlockSize.
+// Allocates memory in size classes, so the actual allocation may be larger than requested.
 void* b2AllocBlock(b2BlockAllocator* allocator, int size);
 
-// Free memory. This will use b2Free if the size is larger than b2_maxBlockSize.
+// Free memory. The size must match the allocation.
 void b2FreeBlock(b2BlockAllocator* allocator, void* memory, int size);
 
+// Grow an allocation, keeping the first oldSize bytes. This avoids the copy if the new size is in the same
+// size class or if both sizes are large and the pages can be remapped. Memory may be NULL if oldSize is zero.
+void* b2GrowBlock(b2BlockAllocator* allocator, void* memory, int oldSize, int newSize);
+
+// Return slabs that have no live blocks to the heap. Returns the number of bytes released.
+int b2TrimBlockAllocator(b2BlockAllocator* allocator);
+
+b2BlockAllocatorStats b2GetBlockAllocatorStats(const b2BlockAllocator* allocator);
+
 bool b2ValidateBlockAllocator(b2BlockAllocator* allocator);
@@ -10,7 +10,6 @@
 #include "island.h"
 #include "joint.h"
 
-#include <string.h>
 
 #define B2_INITIAL_CAPACITY 16
 
@@ -79,6 +78,11 @@ void b2DestroyContactArray(b2BlockAllocator* allocator, b2ContactArray* array)
 	b2FreeBlock(allocator, array->data, array->capacity * sizeof(b2ContactSim));
 }
 
+void b2DestroyNonTouchingContactArray(b2BlockAllocator* allocator, b2NonTouchingContactArray* array)
+{
+	b2FreeBlock(allocator, array->data, array->capacity * sizeof(b2NonTouchingContactSim));
+}
+
 void b2DestroyJointArray(b2BlockAllocator* allocator, b2JointArray* array)
 {
 	b2FreeBlock(allocator, array->data, array->capacity * sizeof(b2JointSim));
@@ -89,6 +93,38 @@ void b2DestroyIslandArray(b2BlockAllocator* allocator, b2IslandArray* array)
 	b2FreeBlock(allocator, array->data, array->capacity * sizeof(b2IslandSim));
 }
 
+// Grow the data of any block array. The arrays share the data and capacity layout.
+static void b2ReserveBlockArray(b2BlockAllocator* allocator, void** data, int* arrayCapacity, int elementSize, int capacity)
+{
+	if (capacity <= *arrayCapacity)
+	{
+		return;
+	}
+
+	*data = b2GrowBlock(allocator, *data, *arrayCapacity * elementSize, capacity * elementSize);
+	*arrayCapacity = capacity;
+}
+
+void b2ReserveBodySimArray(b2BlockAllocator* allocator, b2BodySimArray* array, int capacity)
+{
+	b2ReserveBlockArray(allocator, (void**)&array->data, &array->capacity, sizeof(b2BodySim), capacity);
+}
+
+void b2ReserveBodyStateArray(b2BlockAllocator* allocator, b2BodyStateArray* array, int capacity)
+{
+	b2ReserveBlockArray(allocator, (void**)&array->data, &array->capacity, sizeof(b2BodyState), capacity);
+}
+
+void b2ReserveContactArray(b2BlockAllocator* allocator, b2ContactArray* array, int capacity)
+{
+	b2ReserveBlockArray(allocator, (void**)&array->data, &array->capacity, sizeof(b2ContactSim), capacity);
+}
+
+void b2ReserveJointArray(b2BlockAllocator* allocator, b2JointArray* array, int capacity)
+{
+	b2ReserveBlockArray(allocator, (void**)&array->data, &array->capacity, sizeof(b2JointSim), capacity);
+}
+
 b2BodySim* b2AddBodySim(b2BlockAllocator* allocator, b2BodySimArray* array)
 {
 	int elementSize = sizeof(b2BodySim);
@@ -101,10 +137,7 @@ b2BodySim* b2AddBodySim(b2BlockAllocator* allocator, b2BodySimArray* array)
 	else if (array->count == array->capacity)
 	{
 		int newCapacity = 2 * array->capacity;
-		b2BodySim* newElements = b2AllocBlock(allocator, newCapacity * elementSize);
-		memcpy(newElements, array->data, array->capacity * elementSize);
-		b2FreeBlock(allocator, array->data, array->capacity * elementSize);
-		array->data = newElements;
+		array->data = b2GrowBlock(allocator, array->data, array->capacity * elementSize, newCapacity * elementSize);
 		array->capacity = newCapacity;
 	}
 
@@ -125,10 +158,7 @@ b2BodyState* b2AddBodyState(b2BlockAllocator* allocator, b2BodyStateArray* array
 	else if (array->count == array->capacity)
 	{
 		int newCapacity = 2 * array->capacity;
-		b2BodyState* newElements = b2AllocBlock(allocator, newCapacity * elementSize);
-		memcpy(newElements, array->data, array->capacity * elementSize);
-		b2FreeBlock(allocator, array->data, array->capacity * elementSize);
-		array->data = newElements;
+		array->data = b2GrowBlock(allocator, array->data, array->capacity * elementSize, newCapacity * elementSize);
 		array->capacity = newCapacity;
 	}
 
@@ -149,10 +179,7 @@ b2ContactSim* b2AddContact(b2BlockAllocator* allocator, b2ContactArray* array)
 	else if (array->count == array->capacity)
 	{
 		int newCapacity = 2 * array->capacity;
-		b2ContactSim* newElements = b2AllocBlock(allocator, newCapacity * elementSize);
-		memcpy(newElements, array->data, array->capacity * elementSize);
-		b2FreeBlock(allocator, array->data, array->capacity * elementSize);
-		array->data = newElements;
+		array->data = b2GrowBlock(allocator, array->data, array->capacity * elementSize, newCapacity * elementSize);
 		array->capacity = newCapacity;
 	}
 
@@ -161,6 +188,27 @@ b2ContactSim* b2AddContact(b2BlockAllocator* allocator, b2ContactArray* array)
 	return element;
 }
 
+b2NonTouchingContactSim* b2AddNonTouchingContactSim(b2BlockAllocator* allocator, b2NonTouchingContactArray* array)
+{
+	int elementSize = sizeof(b2NonTouchingContactSim);
+	if (array->capacity == 0)
+	{
+		B2_ASSERT(array->count == 0);
+		array->data = b2AllocBlock(allocator, B2_INITIAL_CAPACITY * elementSize);
+		array->capacity = B2_INITIAL_CAPACITY;
+	}
+	else if (array->count == array->capacity)
+	{
+		int newCapacity = 2 * array->capacity;
+		array->data = b2GrowBlock(allocator, array->data, array->capacity * elementSize, newCapacity * elementSize);
+		array->capacity = newCapacity;
+	}
+
+	b2NonTouchingContactSim* element = array->data + array->count;
+	array->count += 1;
+	return element;
+}
+
 b2JointSim* b2AddJoint(b2BlockAllocator* allocator, b2JointArray* array)
 {
 	int elementSize = sizeof(b2JointSim);
@@ -173,10 +221,7 @@ b2JointSim* b2AddJoint(b2BlockAllocator* allocator, b2JointArray* array)
 	else if (array->count == array->capacity)
 	{
 		int newCapacity = 2 * array->capacity;
-		b2JointSim* newElements = b2AllocBlock(allocator, newCapacity * elementSize);
-		memcpy(newElements, array->data, array->capacity * elementSize);
-		b2FreeBlock(allocator, array->data, array->capacity * elementSize);
-		array->data = newElements;
+		array->data = b2GrowBlock(allocator, array->data, array->capacity * elementSize, newCapacity * elementSize);
 		array->capacity = newCapacity;
 	}
 
@@ -197,10 +242,7 @@ b2IslandSim* b2AddIsland(b2BlockAllocator* allocator, b2IslandArray* array)
 	else if (array->count == array->capacity)
 	{
 		int newCapacity = 2 * array->capacity;
-		b2IslandSim* newElements = b2AllocBlock(allocator, newCapacity * elementSize);
-		memcpy(newElements, array->data, array->capacity * elementSize);
-		b2FreeBlock(allocator, array->data, array->capacity * elementSize);
-		array->data = newElements;
+		array->data = b2GrowBlock(allocator, array->data, array->capacity * elementSize, newCapacity * elementSize);
 		array->capacity = newCapacity;
 	}
 
@@ -256,6 +298,21 @@ int b2RemoveContact(b2ContactArray* array, int index)
 	return B2_NULL_INDEX;
 }
 
+int b2RemoveNonTouchingContactSim(b2NonTouchingContactArray* array, int index)
+{
+	B2_ASSERT(0 <= index && index < array->count);
+	if (index < array->count - 1)
+	{
+		int removed = array->count - 1;
+		array->data[index] = array->data[removed];
+		array->count -= 1;
+		return removed;
+	}
+
+	array->count -= 1;
+	return B2_NULL_INDEX;
+}
+
 int b2RemoveJoint(b2JointArray* array, int index)
 {
 	B2_ASSERT(0 <= index && index < array->count);
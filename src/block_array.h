@@ -8,6 +8,7 @@ typedef struct b2BodySim b2BodySim;
 typedef struct b2BodyState b2BodyState;
 typedef struct b2ContactSim b2ContactSim;
 typedef struct b2IslandSim b2IslandSim;
+typedef struct b2NonTouchingContactSim b2NonTouchingContactSim;
 typedef struct b2JointSim b2JointSim;
 
 typedef struct b2BodySimArray
@@ -31,6 +32,13 @@ typedef struct b2ContactArray
 	int capacity;
 } b2ContactArray;
 
+typedef struct b2NonTouchingContactArray
+{
+	b2NonTouchingContactSim* data;
+	int count;
+	int capacity;
+} b2NonTouchingContactArray;
+
 typedef struct b2IslandArray
 {
 	b2IslandSim* data;
@@ -56,12 +64,20 @@ b2JointArray b2CreateJointArray(b2BlockAllocator* allocator, int capacity);
 void b2DestroyBodySimArray(b2BlockAllocator* allocator, b2BodySimArray* array);
 void b2DestroyBodyStateArray(b2BlockAllocator* allocator, b2BodyStateArray* array);
 void b2DestroyContactArray(b2BlockAllocator* allocator, b2ContactArray* array);
+void b2DestroyNonTouchingContactArray(b2BlockAllocator* allocator, b2NonTouchingContactArray* array);
 void b2DestroyIslandArray(b2BlockAllocator* allocator, b2IslandArray* array);
 void b2DestroyJointArray(b2BlockAllocator* allocator, b2JointArray* array);
 
+// Grow capacity so the array can hold at least the given count without further allocation
+void b2ReserveBodySimArray(b2BlockAllocator* allocator, b2BodySimArray* array, int capacity);
+void b2ReserveBodyStateArray(b2BlockAllocator* allocator, b2BodyStateArray* array, int capacity);
+void b2ReserveContactArray(b2BlockAllocator* allocator, b2ContactArray* array, int capacity);
+void b2ReserveJointArray(b2BlockAllocator* allocator, b2JointArray* array, int capacity);
+
 b2BodySim* b2AddBodySim(b2BlockAllocator* allocator, b2BodySimArray* array);
 b2BodyState* b2AddBodyState(b2BlockAllocator* allocator, b2BodyStateArray* array);
 b2ContactSim* b2AddContact(b2BlockAllocator* allocator, b2ContactArray* array);
+b2NonTouchingContactSim* b2AddNonTouchingContactSim(b2BlockAllocator* allocator, b2NonTouchingContactArray* array);
 b2IslandSim* b2AddIsland(b2BlockAllocator* allocator, b2IslandArray* array);
 b2JointSim* b2AddJoint(b2BlockAllocator* allocator, b2JointArray* array);
 
@@ -70,5 +86,6 @@ b2JointSim* b2AddJoint(b2BlockAllocator* allocator, b2JointArray* array);
 int b2RemoveBodySim(b2BodySimArray* array, int index);
 int b2RemoveBodyState(b2BodyStateArray* array, int index);
 int b2RemoveContact(b2ContactArray* array, int index);
+int b2RemoveNonTouchingContactSim(b2NonTouchingContactArray* array, int index);
 int b2RemoveIsland(b2IslandArray* array, int index);
 int b2RemoveJoint(b2JointArray* array, int index);
@@ -196,6 +196,12 @@ b2BodyId b2CreateBody(b2WorldId worldId, const b2BodyDef* def)
 		return b2_nullBodyId;
 	}
 
+	if (b2IsOverMemoryBudget(world))
+	{
+		world->failedCreateCount += 1;
+		return b2_nullBodyId;
+	}
+
 	bool isAwake = (def->isAwake || def->enableSleep == false) && def->isEnabled;
 
 	// determine the solver set
@@ -385,7 +391,7 @@ void b2DestroyBody(b2BodyId bodyId)
 	{
 		b2ChainShape* chain = world->chainArray + chainId;
 
-		b2Free(chain->shapeIndices, chain->count * sizeof(int));
+		b2FreeWith(&world->allocator, chain->shapeIndices, chain->count * sizeof(int));
 		chain->shapeIndices = NULL;
 
 		// Return chain to free list.
@@ -474,8 +480,7 @@ int b2Body_GetContactData(b2BodyId bodyId, b2ContactData* contactData, int capac
 			contactData[index].shapeIdA = (b2ShapeId){shapeA->id + 1, bodyId.world0, shapeA->revision};
 			contactData[index].shapeIdB = (b2ShapeId){shapeB->id + 1, bodyId.world0, shapeB->revision};
 
-			b2ContactSim* contactSim = b2GetContactSim(world, contact);
-			contactData[index].manifold = contactSim->manifold;
+			contactData[index].manifold = b2GetContactManifold(world, contact);
 			
 			index += 1;
 		}
@@ -540,7 +545,7 @@ void b2UpdateBodyMassData(b2World* world, b2Body* body)
 			{
 				const b2Shape* s = world->shapeArray + shapeId;
 
-				b2ShapeExtent extent = b2ComputeShapeExtent(s, b2Vec2_zero);
+				b2ShapeExtent extent = b2ComputeShapeExtent(world, s, b2Vec2_zero);
 				bodySim->minExtent = b2MinFloat(bodySim->minExtent, extent.minExtent);
 				bodySim->maxExtent = b2MaxFloat(bodySim->maxExtent, extent.maxExtent);
 
@@ -564,7 +569,7 @@ void b2UpdateBodyMassData(b2World* world, b2Body* body)
 			continue;
 		}
 
-		b2MassData massData = b2ComputeShapeMass(s);
+		b2MassData massData = b2ComputeShapeMass(world, s);
 		bodySim->mass += massData.mass;
 		localCenter = b2MulAdd(localCenter, massData.mass, massData.center);
 		bodySim->I += massData.I;
@@ -610,7 +615,7 @@ void b2UpdateBodyMassData(b2World* world, b2Body* body)
 	{
 		const b2Shape* s = world->shapeArray + shapeId;
 
-		b2ShapeExtent extent = b2ComputeShapeExtent(s, localCenter);
+		b2ShapeExtent extent = b2ComputeShapeExtent(world, s, localCenter);
 		bodySim->minExtent = b2MinFloat(bodySim->minExtent, extent.minExtent);
 		bodySim->maxExtent = b2MaxFloat(bodySim->maxExtent, extent.maxExtent);
 
@@ -697,6 +702,8 @@ void b2Body_SetTransform(b2BodyId bodyId, b2Vec2 position, float angle)
 	bodySim->rotation0 = bodySim->transform.q;
 	bodySim->center0 = bodySim->center;
 
+	b2MarkSnapshotBody(world, body->id);
+
 	b2BroadPhase* broadPhase = &world->broadPhase;
 
 	b2Transform transform = bodySim->transform;
@@ -707,7 +714,7 @@ void b2Body_SetTransform(b2BodyId bodyId, b2Vec2 position, float angle)
 	while (shapeId != B2_NULL_INDEX)
 	{
 		b2Shape* shape = world->shapeArray + shapeId;
-		b2AABB aabb = b2ComputeShapeAABB(shape, transform);
+		b2AABB aabb = b2ComputeShapeAABB(world, shape, transform);
 		aabb.lowerBound.x -= speculativeDistance;
 		aabb.lowerBound.y -= speculativeDistance;
 		aabb.upperBound.x += speculativeDistance;
@@ -1041,7 +1048,7 @@ void b2Body_SetType(b2BodyId bodyId, b2BodyType type)
 			shapeId = shape->nextShapeId;
 			b2DestroyShapeProxy(shape, &world->broadPhase);
 			bool forcePairCreation = true;
-			b2CreateShapeProxy(shape, &world->broadPhase, b2_movableProxy, transform, forcePairCreation);
+			b2CreateShapeProxy(world, shape, b2_movableProxy, transform, forcePairCreation);
 		}
 	}
 	else if (type == b2_staticBody)
@@ -1115,7 +1122,7 @@ void b2Body_SetType(b2BodyId bodyId, b2BodyType type)
 			shapeId = shape->nextShapeId;
 			b2DestroyShapeProxy(shape, &world->broadPhase);
 			bool forcePairCreation = true;
-			b2CreateShapeProxy(shape, &world->broadPhase, b2_staticProxy, transform, forcePairCreation);
+			b2CreateShapeProxy(world, shape, b2_staticProxy, transform, forcePairCreation);
 		}
 	}
 	else
@@ -1522,7 +1529,7 @@ void b2Body_Enable(b2BodyId bodyId)
 		b2Shape* shape = world->shapeArray + shapeId;
 		shapeId = shape->nextShapeId;
 
-		b2CreateShapeProxy(shape, &world->broadPhase, proxyType, transform, forcePairCreation);
+		b2CreateShapeProxy(world, shape, proxyType, transform, forcePairCreation);
 	}
 
 	if (setId != b2_staticSet)
@@ -26,7 +26,7 @@
 
 // static FILE* s_file = NULL;
 
-void b2CreateBroadPhase(b2BroadPhase* bp)
+void b2CreateBroadPhase(b2BroadPhase* bp, b2Allocator* allocator)
 {
 	_Static_assert(b2_proxyTypeCount == 2, "must be only two proxy types");
 
@@ -37,10 +37,11 @@ void b2CreateBroadPhase(b2BroadPhase* bp)
 	// }
 
 	bp->proxyCount = 0;
+	bp->allocator = allocator;
 
 	// TODO_ERIN initial size in b2WorldDef?
-	bp->moveSet = b2CreateSet(16);
-	bp->moveArray = b2CreateArray(sizeof(int), 16);
+	bp->moveSet = b2CreateSet(allocator, 16);
+	bp->moveArray = b2CreateArray(allocator, sizeof(int), 16);
 
 	bp->moveResults = NULL;
 	bp->movePairs = NULL;
@@ -48,11 +49,12 @@ void b2CreateBroadPhase(b2BroadPhase* bp)
 	bp->movePairIndex = 0;
 
 	// TODO_ERIN initial size from b2WorldDef
-	bp->pairSet = b2CreateSet(32);
+	bp->pairSet = b2CreateSet(allocator, 32);
 
 	for (int i = 0; i < b2_proxyTypeCount; ++i)
 	{
-		bp->trees[i] = b2DynamicTree_Create();
+		bp->trees[i] = b2CreateDynamicTree(allocator);
+		bp->treeRevisions[i] = 0;
 	}
 }
 
@@ -60,7 +62,7 @@ void b2DestroyBroadPhase(b2BroadPhase* bp)
 {
 	for (int i = 0; i < b2_proxyTypeCount; ++i)
 	{
-		b2DynamicTree_Destroy(bp->trees + i);
+		b2DestroyDynamicTree(bp->trees + i, bp->allocator);
 	}
 
 	b2DestroySet(&bp->moveSet);
@@ -100,7 +102,8 @@ int b2BroadPhase_CreateProxy(b2BroadPhase* bp, b2ProxyType proxyType, b2AABB aab
 							 bool forcePairCreation)
 {
 	B2_ASSERT(0 <= proxyType && proxyType < b2_proxyTypeCount);
-	int proxyId = b2DynamicTree_CreateProxy(bp->trees + proxyType, aabb, categoryBits, shapeIndex);
+	int proxyId = b2CreateTreeProxy(bp->trees + proxyType, bp->allocator, aabb, categoryBits, shapeIndex);
+	bp->treeRevisions[proxyType] += 1;
 	int proxyKey = B2_PROXY_KEY(proxyId, proxyType);
 	if (proxyType != b2_staticProxy || forcePairCreation)
 	{
@@ -121,6 +124,7 @@ void b2BroadPhase_DestroyProxy(b2BroadPhase* bp, int proxyKey)
 
 	B2_ASSERT(0 <= proxyType && proxyType <= b2_proxyTypeCount);
 	b2DynamicTree_DestroyProxy(bp->trees + proxyType, proxyId);
+	bp->treeRevisions[proxyType] += 1;
 }
 
 void b2BroadPhase_MoveProxy(b2BroadPhase* bp, int proxyKey, b2AABB aabb)
@@ -129,6 +133,7 @@ void b2BroadPhase_MoveProxy(b2BroadPhase* bp, int proxyKey, b2AABB aabb)
 	int proxyId = B2_PROXY_ID(proxyKey);
 
 	b2DynamicTree_MoveProxy(bp->trees + proxyType, proxyId, aabb);
+	bp->treeRevisions[proxyType] += 1;
 	b2BufferMove(bp, proxyKey);
 }
 
@@ -141,6 +146,7 @@ void b2BroadPhase_EnlargeProxy(b2BroadPhase* bp, int proxyKey, b2AABB aabb)
 	B2_ASSERT(typeIndex == b2_movableProxy);
 
 	b2DynamicTree_EnlargeProxy(bp->trees + typeIndex, proxyId, aabb);
+	bp->treeRevisions[typeIndex] += 1;
 	b2BufferMove(bp, proxyKey);
 }
 
@@ -251,7 +257,7 @@ static bool b2PairQueryCallback(int proxyId, int shapeId, void* context)
 	}
 	else
 	{
-		pair = b2Alloc(sizeof(b2MovePair));
+		pair = b2AllocWith(bp->allocator, sizeof(b2MovePair));
 		pair->heap = true;
 	}
 
@@ -268,9 +274,8 @@ void b2FindPairsTask(int startIndex, int endIndex, uint32_t threadIndex, void* c
 {
 	b2TracyCZoneNC(pair_task, "Pair Task", b2_colorAquamarine3, true);
 
-	B2_MAYBE_UNUSED(threadIndex);
-
 	b2World* world = context;
+	b2TraceScope traceScope = b2EnterTraceScope(world->worldId, (int)threadIndex);
 	b2BroadPhase* bp = &world->broadPhase;
 
 	b2QueryPairContext queryContext;
@@ -315,6 +320,14 @@ void b2FindPairsTask(int startIndex, int endIndex, uint32_t threadIndex, void* c
 	}
 
 	b2TracyCZoneEnd(pair_task);
+
+	b2LeaveTraceScope(traceScope);
+}
+
+int b2EstimatePairStackSize(const b2BroadPhase* bp)
+{
+	int moveCount = b2Array(bp->moveArray).count;
+	return moveCount * (int)(sizeof(b2MoveResult) + 16 * sizeof(b2MovePair));
 }
 
 void b2UpdateBroadPhasePairs(b2World* world)
@@ -351,6 +364,11 @@ void b2UpdateBroadPhasePairs(b2World* world)
 
 	b2TracyCZoneNC(create_contacts, "Create Contacts", b2_colorGold, true);
 
+	// The budget is checked once for all the new pairs. When they are refused, the proxies that found them are
+	// kept in the move buffer so the pairs are found again next step.
+	bool refuseContacts = b2IsOverContactBudget(world);
+	int retryCount = 0;
+
 	// Single-threaded work
 	// - Clear move flags
 	// - Create contacts in deterministic order
@@ -360,6 +378,14 @@ void b2UpdateBroadPhasePairs(b2World* world)
 	{
 		b2MoveResult* result = bp->moveResults + i;
 		b2MovePair* pair = result->pairList;
+
+		if (refuseContacts && pair != NULL)
+		{
+			// Compact in place, the move array is not read again this step
+			bp->moveArray[retryCount] = bp->moveArray[i];
+			retryCount += 1;
+		}
+
 		while (pair != NULL)
 		{
 			// TODO_ERIN Check user filtering.
@@ -381,13 +407,20 @@ void b2UpdateBroadPhasePairs(b2World* world)
 			b2CheckId(shapes, shapeIdA);
 			b2CheckId(shapes, shapeIdB);
 
-			b2CreateContact(world, shapes + shapeIdA, shapes + shapeIdB);
+			if (refuseContacts)
+			{
+				world->refusedContactCount += 1;
+			}
+			else
+			{
+				b2CreateContact(world, shapes + shapeIdA, shapes + shapeIdB);
+			}
 
 			if (pair->heap)
 			{
 				b2MovePair* temp = pair;
 				pair = pair->next;
-				b2Free(temp, sizeof(b2MovePair));
+				b2FreeWith(bp->allocator, temp, sizeof(b2MovePair));
 			}
 			else
 			{
@@ -410,6 +443,12 @@ void b2UpdateBroadPhasePairs(b2World* world)
 	b2Array_Clear(bp->moveArray);
 	b2ClearSet(&bp->moveSet);
 
+	// Buffer the proxies of refused pairs again. Pushing never overtakes the read index.
+	for (int i = 0; i < retryCount; ++i)
+	{
+		b2BufferMove(bp, bp->moveArray[i]);
+	}
+
 	b2FreeStackItem(alloc, bp->movePairs);
 	bp->movePairs = NULL;
 	b2FreeStackItem(alloc, bp->moveResults);
@@ -436,7 +475,12 @@ bool b2BroadPhase_TestOverlap(const b2BroadPhase* bp, int proxyKeyA, int proxyKe
 
 void b2BroadPhase_RebuildTrees(b2BroadPhase* bp)
 {
-	b2DynamicTree_Rebuild(bp->trees + b2_movableProxy, false);
+	// A single leaf means the root was not enlarged and the tree is unchanged
+	int leafCount = b2RebuildDynamicTree(bp->trees + b2_movableProxy, bp->allocator, false);
+	if (leafCount > 1)
+	{
+		bp->treeRevisions[b2_movableProxy] += 1;
+	}
 }
 
 int b2BroadPhase_GetShapeIndex(b2BroadPhase* bp, int proxyKey)
@@ -4,9 +4,9 @@
 #pragma once
 
 #include "array.h"
+#include "dynamic_tree.h"
 #include "table.h"
 
-#include "box2d/dynamic_tree.h"
 #include "box2d/types.h"
 
 typedef struct b2Shape b2Shape;
@@ -35,6 +35,9 @@ typedef struct b2BroadPhase
 	b2DynamicTree trees[b2_proxyTypeCount];
 	int proxyCount;
 
+	// Incremented whenever a tree changes. Query snapshots skip copying trees that have not changed.
+	uint32_t treeRevisions[b2_proxyTypeCount];
+
 	// The move set and array are used to track shapes that have moved significantly
 	// and need a pair query for new contacts. The array has a deterministic order.
 	// todo perhaps just a move set?
@@ -55,9 +58,12 @@ typedef struct b2BroadPhase
 	// todo pairSet can grow quite large on the first time step and remain large
 	b2HashSet pairSet;
 
+	// Allocator of the owning world
+	b2Allocator* allocator;
+
 } b2BroadPhase;
 
-void b2CreateBroadPhase(b2BroadPhase* bp);
+void b2CreateBroadPhase(b2BroadPhase* bp, b2Allocator* allocator);
 void b2DestroyBroadPhase(b2BroadPhase* bp);
 int b2BroadPhase_CreateProxy(b2BroadPhase* bp, b2ProxyType proxyType, b2AABB aabb, uint32_t categoryBits, int shapeIndex, bool forcePairCreation);
 void b2BroadPhase_DestroyProxy(b2BroadPhase* bp, int proxyKey);
@@ -70,6 +76,9 @@ void b2BroadPhase_RebuildTrees(b2BroadPhase* bp);
 int b2BroadPhase_GetShapeIndex(b2BroadPhase* bp, int proxyKey);
 
 void b2UpdateBroadPhasePairs(b2World* world);
+
+// Upper bound of the stack memory used by b2UpdateBroadPhasePairs
+int b2EstimatePairStackSize(const b2BroadPhase* bp);
 bool b2BroadPhase_TestOverlap(const b2BroadPhase* bp, int proxyKeyA, int proxyKeyB);
 
 void b2ValidateBroadphase(const b2BroadPhase* bp);
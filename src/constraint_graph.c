@@ -27,7 +27,7 @@
 
 _Static_assert(b2_graphColorCount == 12, "graph color count assumed to be 12");
 
-void b2CreateGraph(b2ConstraintGraph* graph, int bodyCapacity)
+void b2CreateGraph(b2ConstraintGraph* graph, b2Allocator* allocator, int bodyCapacity)
 {
 	_Static_assert(b2_graphColorCount >= 2, "must have at least two constraint graph colors");
 
@@ -40,7 +40,7 @@ void b2CreateGraph(b2ConstraintGraph* graph, int bodyCapacity)
 
 		if (i != b2_overflowIndex)
 		{
-			color->bodySet = b2CreateBitSet(bodyCapacity);
+			color->bodySet = b2CreateBitSet(allocator, bodyCapacity);
 			b2SetBitCountAndClear(&color->bodySet, bodyCapacity);
 		}
 	}
@@ -58,27 +58,8 @@ void b2DestroyGraph(b2ConstraintGraph* graph, b2BlockAllocator* allocator)
 	}
 }
 
-// Contacts are always created as non-touching. They get cloned into the constraint
-// graph once they are found to be touching.
-// todo maybe kinematic bodies should not go into graph
-void b2AddContactToGraph(b2World* world, b2ContactSim* contactSim, b2Contact* contact)
+static int b2AssignContactColor(b2ConstraintGraph* graph, int bodyIdA, int bodyIdB, bool staticA, bool staticB)
 {
-	B2_ASSERT(contactSim->manifold.pointCount > 0);
-	B2_ASSERT(contactSim->simFlags & b2_simTouchingFlag);
-	B2_ASSERT(contact->flags & b2_contactTouchingFlag);
-
-	b2ConstraintGraph* graph = &world->constraintGraph;
-	int colorIndex = b2_overflowIndex;
-
-	int bodyIdA = contact->edges[0].bodyId;
-	int bodyIdB = contact->edges[1].bodyId;
-	b2CheckIndex(world->bodyArray, bodyIdA);
-	b2CheckIndex(world->bodyArray, bodyIdB);
-
-	b2Body* bodyA = world->bodyArray + bodyIdA;
-	b2Body* bodyB = world->bodyArray + bodyIdB;
-	bool staticA = bodyA->setIndex == b2_staticSet;
-	bool staticB = bodyB->setIndex == b2_staticSet;
 	B2_ASSERT(staticA == false || staticB == false);
 
 #if B2_FORCE_OVERFLOW == 0
@@ -94,8 +75,7 @@ void b2AddContactToGraph(b2World* world, b2ContactSim* contactSim, b2Contact* co
 
 			b2SetBitGrow(&color->bodySet, bodyIdA);
 			b2SetBitGrow(&color->bodySet, bodyIdB);
-			colorIndex = i;
-			break;
+			return i;
 		}
 	}
 	else if (staticA == false)
@@ -110,8 +90,7 @@ void b2AddContactToGraph(b2World* world, b2ContactSim* contactSim, b2Contact* co
 			}
 
 			b2SetBitGrow(&color->bodySet, bodyIdA);
-			colorIndex = i;
-			break;
+			return i;
 		}
 	}
 	else if (staticB == false)
@@ -126,22 +105,46 @@ void b2AddContactToGraph(b2World* world, b2ContactSim* contactSim, b2Contact* co
 			}
 
 			b2SetBitGrow(&color->bodySet, bodyIdB);
-			colorIndex = i;
-			break;
+			return i;
 		}
 	}
 #endif
 
-	b2GraphColor* color = graph->colors + colorIndex;
-	contact->colorIndex = colorIndex;
-	contact->localIndex = color->contacts.count;
+	return b2_overflowIndex;
+}
+
+// Assign a color to a touching contact and choose its slot in the color. The slot is not allocated.
+static int b2ColorContact(b2World* world, b2Contact* contact)
+{
+	int bodyIdA = contact->edges[0].bodyId;
+	int bodyIdB = contact->edges[1].bodyId;
+	b2CheckIndex(world->bodyArray, bodyIdA);
+	b2CheckIndex(world->bodyArray, bodyIdB);
 
-	b2ContactSim* newContact = b2AddContact(&world->blockAllocator, &color->contacts);
+	b2Body* bodyA = world->bodyArray + bodyIdA;
+	b2Body* bodyB = world->bodyArray + bodyIdB;
+	bool staticA = bodyA->setIndex == b2_staticSet;
+	bool staticB = bodyB->setIndex == b2_staticSet;
+
+	return b2AssignContactColor(&world->constraintGraph, bodyIdA, bodyIdB, staticA, staticB);
+}
+
+void b2FillGraphContact(b2World* world, const b2ContactSim* contactSim, const b2Contact* contact)
+{
+	B2_ASSERT(0 <= contact->colorIndex && contact->colorIndex < b2_graphColorCount);
+	b2GraphColor* color = world->constraintGraph.colors + contact->colorIndex;
+	B2_ASSERT(0 <= contact->localIndex && contact->localIndex < color->contacts.count);
+
+	b2ContactSim* newContact = color->contacts.data + contact->localIndex;
 	memcpy(newContact, contactSim, sizeof(b2ContactSim));
 
+	b2Body* bodyA = world->bodyArray + contact->edges[0].bodyId;
+	b2Body* bodyB = world->bodyArray + contact->edges[1].bodyId;
+	b2SolverSet* awakeSet = world->solverSetArray + b2_awakeSet;
+
 	// todo perhaps skip this if the contact is already awake
-	
-	if (staticA)
+
+	if (bodyA->setIndex == b2_staticSet)
 	{
 		newContact->bodySimIndexA = B2_NULL_INDEX;
 		newContact->invMassA = 0.0f;
@@ -150,7 +153,6 @@ void b2AddContactToGraph(b2World* world, b2ContactSim* contactSim, b2Contact* co
 	else
 	{
 		B2_ASSERT(bodyA->setIndex == b2_awakeSet);
-		b2SolverSet* awakeSet = world->solverSetArray + b2_awakeSet;
 
 		int localIndex = bodyA->localIndex;
 		B2_ASSERT(0 <= localIndex && localIndex < awakeSet->sims.count);
@@ -161,7 +163,7 @@ void b2AddContactToGraph(b2World* world, b2ContactSim* contactSim, b2Contact* co
 		newContact->invIA = bodySimA->invI;
 	}
 
-	if (staticB)
+	if (bodyB->setIndex == b2_staticSet)
 	{
 		newContact->bodySimIndexB = B2_NULL_INDEX;
 		newContact->invMassB = 0.0f;
@@ -170,7 +172,6 @@ void b2AddContactToGraph(b2World* world, b2ContactSim* contactSim, b2Contact* co
 	else
 	{
 		B2_ASSERT(bodyB->setIndex == b2_awakeSet);
-		b2SolverSet* awakeSet = world->solverSetArray + b2_awakeSet;
 
 		int localIndex = bodyB->localIndex;
 		B2_ASSERT(0 <= localIndex && localIndex < awakeSet->sims.count);
@@ -182,6 +183,55 @@ void b2AddContactToGraph(b2World* world, b2ContactSim* contactSim, b2Contact* co
 	}
 }
 
+// Contacts are always created as non-touching. They get cloned into the constraint
+// graph once they are found to be touching.
+// todo maybe kinematic bodies should not go into graph
+void b2AddContactToGraph(b2World* world, b2ContactSim* contactSim, b2Contact* contact)
+{
+	B2_ASSERT(contactSim->manifold.pointCount > 0);
+	B2_ASSERT(contactSim->simFlags & b2_simTouchingFlag);
+	B2_ASSERT(contact->flags & b2_contactTouchingFlag);
+
+	int colorIndex = b2ColorContact(world, contact);
+	b2GraphColor* color = world->constraintGraph.colors + colorIndex;
+	contact->colorIndex = colorIndex;
+	contact->localIndex = color->contacts.count;
+	b2AddContact(&world->blockAllocator, &color->contacts);
+
+	b2FillGraphContact(world, contactSim, contact);
+}
+
+// Colors are assigned in array order so the result matches adding the contacts one at a time.
+void b2ReserveContactsInGraph(b2World* world, const b2ContactSim* contactSims, int count)
+{
+	b2ConstraintGraph* graph = &world->constraintGraph;
+	int colorCounts[b2_graphColorCount];
+	for (int i = 0; i < b2_graphColorCount; ++i)
+	{
+		colorCounts[i] = graph->colors[i].contacts.count;
+	}
+
+	for (int i = 0; i < count; ++i)
+	{
+		int contactId = contactSims[i].contactId;
+		b2CheckIndex(world->contactArray, contactId);
+		b2Contact* contact = world->contactArray + contactId;
+		B2_ASSERT(contact->flags & b2_contactTouchingFlag);
+
+		int colorIndex = b2ColorContact(world, contact);
+		contact->colorIndex = colorIndex;
+		contact->localIndex = colorCounts[colorIndex];
+		colorCounts[colorIndex] += 1;
+	}
+
+	for (int i = 0; i < b2_graphColorCount; ++i)
+	{
+		b2GraphColor* color = graph->colors + i;
+		b2ReserveContactArray(&world->blockAllocator, &color->contacts, colorCounts[i]);
+		color->contacts.count = colorCounts[i];
+	}
+}
+
 void b2RemoveContactFromGraph(b2World* world, int bodyIdA, int bodyIdB, int colorIndex, int localIndex)
 {
 	b2ConstraintGraph* graph = &world->constraintGraph;
@@ -288,6 +338,40 @@ b2JointSim* b2CreateJointInGraph(b2World* world, b2Joint* joint)
 	return jointSim;
 }
 
+void b2ReserveJointsInGraph(b2World* world, const b2JointSim* jointSims, int count)
+{
+	b2ConstraintGraph* graph = &world->constraintGraph;
+	int colorCounts[b2_graphColorCount];
+	for (int i = 0; i < b2_graphColorCount; ++i)
+	{
+		colorCounts[i] = graph->colors[i].joints.count;
+	}
+
+	for (int i = 0; i < count; ++i)
+	{
+		int jointId = jointSims[i].jointId;
+		b2CheckIndex(world->jointArray, jointId);
+		b2Joint* joint = world->jointArray + jointId;
+
+		int bodyIdA = joint->edges[0].bodyId;
+		int bodyIdB = joint->edges[1].bodyId;
+		bool staticA = world->bodyArray[bodyIdA].setIndex == b2_staticSet;
+		bool staticB = world->bodyArray[bodyIdB].setIndex == b2_staticSet;
+
+		int colorIndex = b2AssignJointColor(graph, bodyIdA, bodyIdB, staticA, staticB);
+		joint->colorIndex = colorIndex;
+		joint->localIndex = colorCounts[colorIndex];
+		colorCounts[colorIndex] += 1;
+	}
+
+	for (int i = 0; i < b2_graphColorCount; ++i)
+	{
+		b2GraphColor* color = graph->colors + i;
+		b2ReserveJointArray(&world->blockAllocator, &color->joints, colorCounts[i]);
+		color->joints.count = colorCounts[i];
+	}
+}
+
 void b2AddJointToGraph(b2World* world, b2JointSim* jointSim, b2Joint* joint)
 {
 	b2JointSim* jointDst = b2CreateJointInGraph(world, joint);
@@ -44,12 +44,18 @@ typedef struct b2ConstraintGraph
 	b2GraphColor colors[b2_graphColorCount];
 } b2ConstraintGraph;
 
-void b2CreateGraph(b2ConstraintGraph* graph, int bodyCapacity);
+void b2CreateGraph(b2ConstraintGraph* graph, b2Allocator* allocator, int bodyCapacity);
 void b2DestroyGraph(b2ConstraintGraph* graph, b2BlockAllocator* allocator);
 
 void b2AddContactToGraph(b2World* world, b2ContactSim* contactSim, b2Contact* contact);
+
+// Bulk insertion: colors and slots are assigned serially, then b2FillGraphContact may be called in parallel.
+// The body sims must already be in the awake set.
+void b2ReserveContactsInGraph(b2World* world, const b2ContactSim* contactSims, int count);
+void b2FillGraphContact(b2World* world, const b2ContactSim* contactSim, const b2Contact* contact);
 void b2RemoveContactFromGraph(b2World* world, int bodyIdA, int bodyIdB, int colorIndex, int localIndex);
 
 b2JointSim* b2CreateJointInGraph(b2World* world, b2Joint* joint);
 void b2AddJointToGraph(b2World* world, b2JointSim* jointSim, b2Joint* joint);
+void b2ReserveJointsInGraph(b2World* world, const b2JointSim* jointSims, int count);
 void b2RemoveJointFromGraph(b2World* world, int bodyIdA, int bodyIdB, int colorIndex, int localIndex);
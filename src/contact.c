@@ -55,8 +55,8 @@ static inline float b2MixRestitution(float restitution1, float restitution2)
 
 // todo make relative for all
 // typedef b2Manifold b2ManifoldFcn(const b2Shape* shapeA, const b2Shape* shapeB, b2Transform xfB, b2DistanceCache* cache);
-typedef b2Manifold b2ManifoldFcn(const b2Shape* shapeA, b2Transform xfA, const b2Shape* shapeB, b2Transform xfB,
-								 b2DistanceCache* cache);
+typedef b2Manifold b2ManifoldFcn(const b2World* world, const b2Shape* shapeA, b2Transform xfA, const b2Shape* shapeB,
+								 b2Transform xfB, b2DistanceCache* cache);
 
 struct b2ContactRegister
 {
@@ -67,81 +67,83 @@ struct b2ContactRegister
 static struct b2ContactRegister s_registers[b2_shapeTypeCount][b2_shapeTypeCount];
 static bool s_initialized = false;
 
-static b2Manifold b2CircleManifold(const b2Shape* shapeA, b2Transform xfA, const b2Shape* shapeB, b2Transform xfB,
-								   b2DistanceCache* cache)
+static b2Manifold b2CircleManifold(const b2World* world, const b2Shape* shapeA, b2Transform xfA, const b2Shape* shapeB,
+								   b2Transform xfB, b2DistanceCache* cache)
 {
 	B2_MAYBE_UNUSED(cache);
-	return b2CollideCircles(&shapeA->circle, xfA, &shapeB->circle, xfB);
+	return b2CollideCircles(b2GetShapeCircle(world, shapeA), xfA, b2GetShapeCircle(world, shapeB), xfB);
 }
 
-static b2Manifold b2CapsuleAndCircleManifold(const b2Shape* shapeA, b2Transform xfA, const b2Shape* shapeB, b2Transform xfB,
-											 b2DistanceCache* cache)
+static b2Manifold b2CapsuleAndCircleManifold(const b2World* world, const b2Shape* shapeA, b2Transform xfA, const b2Shape* shapeB,
+											 b2Transform xfB, b2DistanceCache* cache)
 {
 	B2_MAYBE_UNUSED(cache);
-	return b2CollideCapsuleAndCircle(&shapeA->capsule, xfA, &shapeB->circle, xfB);
+	return b2CollideCapsuleAndCircle(b2GetShapeCapsule(world, shapeA), xfA, b2GetShapeCircle(world, shapeB), xfB);
 }
 
-static b2Manifold b2CapsuleManifold(const b2Shape* shapeA, b2Transform xfA, const b2Shape* shapeB, b2Transform xfB,
-									b2DistanceCache* cache)
+static b2Manifold b2CapsuleManifold(const b2World* world, const b2Shape* shapeA, b2Transform xfA, const b2Shape* shapeB,
+									b2Transform xfB, b2DistanceCache* cache)
 {
-	return b2CollideCapsules(&shapeA->capsule, xfA, &shapeB->capsule, xfB, cache);
+	return b2CollideCapsules(b2GetShapeCapsule(world, shapeA), xfA, b2GetShapeCapsule(world, shapeB), xfB, cache);
 }
 
-static b2Manifold b2PolygonAndCircleManifold(const b2Shape* shapeA, b2Transform xfA, const b2Shape* shapeB, b2Transform xfB,
-											 b2DistanceCache* cache)
+static b2Manifold b2PolygonAndCircleManifold(const b2World* world, const b2Shape* shapeA, b2Transform xfA, const b2Shape* shapeB,
+											 b2Transform xfB, b2DistanceCache* cache)
 {
 	B2_MAYBE_UNUSED(cache);
-	return b2CollidePolygonAndCircle(&shapeA->polygon, xfA, &shapeB->circle, xfB);
+	return b2CollidePolygonAndCircle(b2GetShapePolygon(world, shapeA), xfA, b2GetShapeCircle(world, shapeB), xfB);
 }
 
-static b2Manifold b2PolygonAndCapsuleManifold(const b2Shape* shapeA, b2Transform xfA, const b2Shape* shapeB, b2Transform xfB,
-											  b2DistanceCache* cache)
+static b2Manifold b2PolygonAndCapsuleManifold(const b2World* world, const b2Shape* shapeA, b2Transform xfA, const b2Shape* shapeB,
+											  b2Transform xfB, b2DistanceCache* cache)
 {
-	return b2CollidePolygonAndCapsule(&shapeA->polygon, xfA, &shapeB->capsule, xfB, cache);
+	return b2CollidePolygonAndCapsule(b2GetShapePolygon(world, shapeA), xfA, b2GetShapeCapsule(world, shapeB), xfB, cache);
 }
 
-static b2Manifold b2PolygonManifold(const b2Shape* shapeA, b2Transform xfA, const b2Shape* shapeB, b2Transform xfB,
-									b2DistanceCache* cache)
+static b2Manifold b2PolygonManifold(const b2World* world, const b2Shape* shapeA, b2Transform xfA, const b2Shape* shapeB,
+									b2Transform xfB, b2DistanceCache* cache)
 {
-	return b2CollidePolygons(&shapeA->polygon, xfA, &shapeB->polygon, xfB, cache);
+	return b2CollidePolygons(b2GetShapePolygon(world, shapeA), xfA, b2GetShapePolygon(world, shapeB), xfB, cache);
 }
 
-static b2Manifold b2SegmentAndCircleManifold(const b2Shape* shapeA, b2Transform xfA, const b2Shape* shapeB, b2Transform xfB,
-											 b2DistanceCache* cache)
+static b2Manifold b2SegmentAndCircleManifold(const b2World* world, const b2Shape* shapeA, b2Transform xfA, const b2Shape* shapeB,
+											 b2Transform xfB, b2DistanceCache* cache)
 {
 	B2_MAYBE_UNUSED(cache);
-	return b2CollideSegmentAndCircle(&shapeA->segment, xfA, &shapeB->circle, xfB);
+	return b2CollideSegmentAndCircle(b2GetShapeSegment(world, shapeA), xfA, b2GetShapeCircle(world, shapeB), xfB);
 }
 
-static b2Manifold b2SegmentAndCapsuleManifold(const b2Shape* shapeA, b2Transform xfA, const b2Shape* shapeB, b2Transform xfB,
-											  b2DistanceCache* cache)
+static b2Manifold b2SegmentAndCapsuleManifold(const b2World* world, const b2Shape* shapeA, b2Transform xfA, const b2Shape* shapeB,
+											  b2Transform xfB, b2DistanceCache* cache)
 {
-	return b2CollideSegmentAndCapsule(&shapeA->segment, xfA, &shapeB->capsule, xfB, cache);
+	return b2CollideSegmentAndCapsule(b2GetShapeSegment(world, shapeA), xfA, b2GetShapeCapsule(world, shapeB), xfB, cache);
 }
 
-static b2Manifold b2SegmentAndPolygonManifold(const b2Shape* shapeA, b2Transform xfA, const b2Shape* shapeB, b2Transform xfB,
-											  b2DistanceCache* cache)
+static b2Manifold b2SegmentAndPolygonManifold(const b2World* world, const b2Shape* shapeA, b2Transform xfA, const b2Shape* shapeB,
+											  b2Transform xfB, b2DistanceCache* cache)
 {
-	return b2CollideSegmentAndPolygon(&shapeA->segment, xfA, &shapeB->polygon, xfB, cache);
+	return b2CollideSegmentAndPolygon(b2GetShapeSegment(world, shapeA), xfA, b2GetShapePolygon(world, shapeB), xfB, cache);
 }
 
-static b2Manifold b2SmoothSegmentAndCircleManifold(const b2Shape* shapeA, b2Transform xfA, const b2Shape* shapeB, b2Transform xfB,
-												   b2DistanceCache* cache)
+static b2Manifold b2SmoothSegmentAndCircleManifold(const b2World* world, const b2Shape* shapeA, b2Transform xfA,
+												   const b2Shape* shapeB, b2Transform xfB, b2DistanceCache* cache)
 {
 	B2_MAYBE_UNUSED(cache);
-	return b2CollideSmoothSegmentAndCircle(&shapeA->smoothSegment, xfA, &shapeB->circle, xfB);
+	return b2CollideSmoothSegmentAndCircle(b2GetShapeSmoothSegment(world, shapeA), xfA, b2GetShapeCircle(world, shapeB), xfB);
 }
 
-static b2Manifold b2SmoothSegmentAndCapsuleManifold(const b2Shape* shapeA, b2Transform xfA, const b2Shape* shapeB,
-													b2Transform xfB, b2DistanceCache* cache)
+static b2Manifold b2SmoothSegmentAndCapsuleManifold(const b2World* world, const b2Shape* shapeA, b2Transform xfA,
+													const b2Shape* shapeB, b2Transform xfB, b2DistanceCache* cache)
 {
-	return b2CollideSmoothSegmentAndCapsule(&shapeA->smoothSegment, xfA, &shapeB->capsule, xfB, cache);
+	const b2SmoothSegment* smoothSegment = b2GetShapeSmoothSegment(world, shapeA);
+	return b2CollideSmoothSegmentAndCapsule(smoothSegment, xfA, b2GetShapeCapsule(world, shapeB), xfB, cache);
 }
 
-static b2Manifold b2SmoothSegmentAndPolygonManifold(const b2Shape* shapeA, b2Transform xfA, const b2Shape* shapeB,
-													b2Transform xfB, b2DistanceCache* cache)
+static b2Manifold b2SmoothSegmentAndPolygonManifold(const b2World* world, const b2Shape* shapeA, b2Transform xfA,
+													const b2Shape* shapeB, b2Transform xfB, b2DistanceCache* cache)
 {
-	return b2CollideSmoothSegmentAndPolygon(&shapeA->smoothSegment, xfA, &shapeB->polygon, xfB, cache);
+	const b2SmoothSegment* smoothSegment = b2GetShapeSmoothSegment(world, shapeA);
+	return b2CollideSmoothSegmentAndPolygon(smoothSegment, xfA, b2GetShapePolygon(world, shapeB), xfB, cache);
 }
 
 static void b2AddType(b2ManifoldFcn* fcn, b2ShapeType type1, b2ShapeType type2)
@@ -235,7 +237,7 @@ void b2CreateContact(b2World* world, b2Shape* shapeA, b2Shape* shapeB)
 	contact->contactId = contactId;
 	contact->setIndex = setIndex;
 	contact->colorIndex = B2_NULL_INDEX;
-	contact->localIndex = set->contacts.count;
+	contact->localIndex = set->nonTouchingContacts.count;
 	contact->islandId = B2_NULL_INDEX;
 	contact->islandPrev = B2_NULL_INDEX;
 	contact->islandNext = B2_NULL_INDEX;
@@ -299,7 +301,7 @@ void b2CreateContact(b2World* world, b2Shape* shapeA, b2Shape* shapeB)
 
 	// Contacts are created as non-touching. Later if they are found to be touching
 	// they will link islands and be moved into the constraint graph.
-	b2ContactSim* contactSim = b2AddContact(&world->blockAllocator, &set->contacts);
+	b2NonTouchingContactSim* contactSim = b2AddNonTouchingContactSim(&world->blockAllocator, &set->nonTouchingContacts);
 	contactSim->contactId = contactId;
 
 #if B2_VALIDATE
@@ -307,20 +309,14 @@ void b2CreateContact(b2World* world, b2Shape* shapeA, b2Shape* shapeB)
 	contactSim->bodyIdB = shapeB->bodyId;
 #endif
 
-	contactSim->bodySimIndexA = B2_NULL_INDEX;
-	contactSim->bodySimIndexB = B2_NULL_INDEX;
-	contactSim->invMassA = 0.0f;
-	contactSim->invIA = 0.0f;
-	contactSim->invMassB = 0.0f;
-	contactSim->invIB = 0.0f;
 	contactSim->shapeIdA = shapeIdA;
 	contactSim->shapeIdB = shapeIdB;
 	contactSim->cache = b2_emptyDistanceCache;
-	contactSim->manifold = (b2Manifold){0};
 	contactSim->friction = b2MixFriction(shapeA->friction, shapeB->friction);
 	contactSim->restitution = b2MixRestitution(shapeA->restitution, shapeB->restitution);
 	contactSim->tangentSpeed = 0.0f;
 	contactSim->simFlags = 0;
+	contactSim->beginSim = NULL;
 
 	if (shapeA->enablePreSolveEvents || shapeB->enablePreSolveEvents)
 	{
@@ -415,16 +411,27 @@ void b2DestroyContact(b2World* world, b2Contact* contact, bool wakeBodies)
 		B2_ASSERT(contact->setIndex == b2_awakeSet);
 		b2RemoveContactFromGraph(world, bodyIdA, bodyIdB, contact->colorIndex, contact->localIndex);
 	}
+	else if (contact->setIndex >= b2_firstSleepingSet)
+	{
+		// contact is sleeping and touching
+		b2SolverSet* set = world->solverSetArray + contact->setIndex;
+		int movedIndex = b2RemoveContact(&set->contacts, contact->localIndex);
+		if (movedIndex != B2_NULL_INDEX)
+		{
+			b2ContactSim* movedContact = set->contacts.data + contact->localIndex;
+			world->contactArray[movedContact->contactId].localIndex = contact->localIndex;
+		}
+	}
 	else
 	{
-		// contact is non-touching or is sleeping or is a sensor
+		// contact is non-touching or is a sensor
 		B2_ASSERT(contact->setIndex != b2_awakeSet || (contact->flags & b2_contactTouchingFlag) == 0 ||
 				  (contact->flags & b2_contactSensorFlag) != 0);
 		b2SolverSet* set = world->solverSetArray + contact->setIndex;
-		int movedIndex = b2RemoveContact(&set->contacts, contact->localIndex);
+		int movedIndex = b2RemoveNonTouchingContactSim(&set->nonTouchingContacts, contact->localIndex);
 		if (movedIndex != B2_NULL_INDEX)
 		{
-			b2ContactSim* movedContact = set->contacts.data + contact->localIndex;
+			b2NonTouchingContactSim* movedContact = set->nonTouchingContacts.data + contact->localIndex;
 			world->contactArray[movedContact->contactId].localIndex = contact->localIndex;
 		}
 	}
@@ -443,9 +450,124 @@ void b2DestroyContact(b2World* world, b2Contact* contact, bool wakeBodies)
 	}
 }
 
+static int b2RemapContactKey(const int* remap, int key)
+{
+	if (key == B2_NULL_INDEX)
+	{
+		return B2_NULL_INDEX;
+	}
+
+	return (remap[key >> 1] << 1) | (key & 1);
+}
+
+static int b2RemapId(const int* remap, int id)
+{
+	return id == B2_NULL_INDEX ? B2_NULL_INDEX : remap[id];
+}
+
+void b2CompactContactIds(b2World* world)
+{
+	B2_ASSERT(world->locked == false);
+
+	int capacity = b2GetIdCapacity(&world->contactIdPool);
+	int count = b2GetIdCount(&world->contactIdPool);
+	if (count < capacity)
+	{
+		// Live contacts keep their relative order so the contact begin order stays deterministic
+		b2Contact* contacts = world->contactArray;
+		int* remap = b2AllocWith(&world->allocator, capacity * sizeof(int));
+		int nextId = 0;
+		for (int i = 0; i < capacity; ++i)
+		{
+			if (contacts[i].contactId == B2_NULL_INDEX)
+			{
+				remap[i] = B2_NULL_INDEX;
+				continue;
+			}
+
+			remap[i] = nextId;
+			contacts[nextId] = contacts[i];
+			nextId += 1;
+		}
+
+		B2_ASSERT(nextId == count);
+
+		for (int i = 0; i < count; ++i)
+		{
+			b2Contact* contact = contacts + i;
+			contact->contactId = i;
+			contact->edges[0].prevKey = b2RemapContactKey(remap, contact->edges[0].prevKey);
+			contact->edges[0].nextKey = b2RemapContactKey(remap, contact->edges[0].nextKey);
+			contact->edges[1].prevKey = b2RemapContactKey(remap, contact->edges[1].prevKey);
+			contact->edges[1].nextKey = b2RemapContactKey(remap, contact->edges[1].nextKey);
+			contact->islandPrev = b2RemapId(remap, contact->islandPrev);
+			contact->islandNext = b2RemapId(remap, contact->islandNext);
+		}
+
+		int bodyCapacity = b2Array(world->bodyArray).count;
+		for (int i = 0; i < bodyCapacity; ++i)
+		{
+			b2Body* body = world->bodyArray + i;
+			if (body->id != B2_NULL_INDEX)
+			{
+				body->headContactKey = b2RemapContactKey(remap, body->headContactKey);
+			}
+		}
+
+		int islandCapacity = b2Array(world->islandArray).count;
+		for (int i = 0; i < islandCapacity; ++i)
+		{
+			b2Island* island = world->islandArray + i;
+			if (island->islandId != B2_NULL_INDEX)
+			{
+				island->headContact = b2RemapId(remap, island->headContact);
+				island->tailContact = b2RemapId(remap, island->tailContact);
+			}
+		}
+
+		int setCount = b2Array(world->solverSetArray).count;
+		for (int setIndex = 0; setIndex < setCount; ++setIndex)
+		{
+			b2SolverSet* set = world->solverSetArray + setIndex;
+			for (int i = 0; i < set->contacts.count; ++i)
+			{
+				set->contacts.data[i].contactId = remap[set->contacts.data[i].contactId];
+			}
+
+			for (int i = 0; i < set->nonTouchingContacts.count; ++i)
+			{
+				set->nonTouchingContacts.data[i].contactId = remap[set->nonTouchingContacts.data[i].contactId];
+			}
+		}
+
+		for (int colorIndex = 0; colorIndex < b2_graphColorCount; ++colorIndex)
+		{
+			b2ContactArray* colorContacts = &world->constraintGraph.colors[colorIndex].contacts;
+			for (int i = 0; i < colorContacts->count; ++i)
+			{
+				colorContacts->data[i].contactId = remap[colorContacts->data[i].contactId];
+			}
+		}
+
+		b2FreeWith(&world->allocator, remap, capacity * sizeof(int));
+
+		b2Array(world->contactArray).count = count;
+		b2CompactIdPool(&world->contactIdPool, count);
+	}
+
+	b2Array_Shrink((void**)&world->contactArray, sizeof(b2Contact));
+}
+
+bool b2IsContactSimExpanded(const b2Contact* contact)
+{
+	return contact->colorIndex != B2_NULL_INDEX || contact->setIndex >= b2_firstSleepingSet;
+}
+
 b2ContactSim* b2GetContactSim(b2World* world, b2Contact* contact)
 {
-	if (contact->setIndex == b2_awakeSet && contact->colorIndex != B2_NULL_INDEX)
+	B2_ASSERT(b2IsContactSimExpanded(contact));
+
+	if (contact->setIndex == b2_awakeSet)
 	{
 		// contact lives in constraint graph
 		B2_ASSERT(0 <= contact->colorIndex && contact->colorIndex < b2_graphColorCount);
@@ -455,10 +577,72 @@ b2ContactSim* b2GetContactSim(b2World* world, b2Contact* contact)
 	}
 
 	b2SolverSet* set = world->solverSetArray + contact->setIndex;
-	B2_ASSERT(0 <= contact->localIndex && contact->localIndex <= set->contacts.count);
+	B2_ASSERT(0 <= contact->localIndex && contact->localIndex < set->contacts.count);
 	return set->contacts.data + contact->localIndex;
 }
 
+b2NonTouchingContactSim* b2GetNonTouchingContactSim(b2World* world, b2Contact* contact)
+{
+	B2_ASSERT(b2IsContactSimExpanded(contact) == false);
+	B2_ASSERT(contact->setIndex == b2_awakeSet || contact->setIndex == b2_disabledSet);
+
+	b2SolverSet* set = world->solverSetArray + contact->setIndex;
+	B2_ASSERT(0 <= contact->localIndex && contact->localIndex < set->nonTouchingContacts.count);
+	return set->nonTouchingContacts.data + contact->localIndex;
+}
+
+// Sensor contacts may be touching without being expanded. They have no contact points.
+b2Manifold b2GetContactManifold(b2World* world, b2Contact* contact)
+{
+	if (b2IsContactSimExpanded(contact))
+	{
+		return b2GetContactSim(world, contact)->manifold;
+	}
+
+	return (b2Manifold){0};
+}
+
+b2ContactSim b2MakeContactSim(const b2NonTouchingContactSim* source)
+{
+	b2ContactSim contactSim = {0};
+	contactSim.contactId = source->contactId;
+#if B2_VALIDATE
+	contactSim.bodyIdA = source->bodyIdA;
+	contactSim.bodyIdB = source->bodyIdB;
+#endif
+	contactSim.bodySimIndexA = B2_NULL_INDEX;
+	contactSim.bodySimIndexB = B2_NULL_INDEX;
+	contactSim.shapeIdA = source->shapeIdA;
+	contactSim.shapeIdB = source->shapeIdB;
+	contactSim.cache = source->cache;
+	contactSim.friction = source->friction;
+	contactSim.restitution = source->restitution;
+	contactSim.tangentSpeed = source->tangentSpeed;
+	contactSim.simFlags = source->simFlags;
+	return contactSim;
+}
+
+b2NonTouchingContactSim b2MakeNonTouchingContactSim(const b2ContactSim* source)
+{
+	B2_ASSERT(source->manifold.pointCount == 0);
+
+	b2NonTouchingContactSim contactSim = {0};
+	contactSim.contactId = source->contactId;
+#if B2_VALIDATE
+	contactSim.bodyIdA = source->bodyIdA;
+	contactSim.bodyIdB = source->bodyIdB;
+#endif
+	contactSim.shapeIdA = source->shapeIdA;
+	contactSim.shapeIdB = source->shapeIdB;
+	contactSim.cache = source->cache;
+	contactSim.friction = source->friction;
+	contactSim.restitution = source->restitution;
+	contactSim.tangentSpeed = source->tangentSpeed;
+	contactSim.simFlags = source->simFlags;
+	contactSim.beginSim = NULL;
+	return contactSim;
+}
+
 bool b2ShouldShapesCollide(b2Filter filterA, b2Filter filterB)
 {
 	if (filterA.groupIndex == filterB.groupIndex && filterA.groupIndex != 0)
@@ -470,11 +654,12 @@ bool b2ShouldShapesCollide(b2Filter filterA, b2Filter filterB)
 	return collide;
 }
 
-static bool b2TestShapeOverlap(const b2Shape* shapeA, b2Transform xfA, const b2Shape* shapeB, b2Transform xfB)
+static bool b2TestShapeOverlap(const b2World* world, const b2Shape* shapeA, b2Transform xfA, const b2Shape* shapeB,
+							   b2Transform xfB)
 {
 	b2DistanceInput input;
-	input.proxyA = b2MakeShapeDistanceProxy(shapeA);
-	input.proxyB = b2MakeShapeDistanceProxy(shapeB);
+	input.proxyA = b2MakeShapeDistanceProxy(world, shapeA);
+	input.proxyB = b2MakeShapeDistanceProxy(world, shapeB);
 	input.transformA = xfA;
 	input.transformB = xfB;
 	input.useRadii = true;
@@ -496,7 +681,7 @@ bool b2UpdateContact(b2World* world, b2ContactSim* contactSim, b2Shape* shapeA,
 	if (shapeA->isSensor || shapeB->isSensor)
 	{
 		// Sensors don't generate manifolds or hit events
-		touching = b2TestShapeOverlap(shapeA, transformA, shapeB, transformB);
+		touching = b2TestShapeOverlap(world, shapeA, transformA, shapeB, transformB);
 	}
 	else
 	{
@@ -505,7 +690,7 @@ bool b2UpdateContact(b2World* world, b2ContactSim* contactSim, b2Shape* shapeA,
 		// Compute TOI
 		b2ManifoldFcn* fcn = s_registers[shapeA->type][shapeB->type].fcn;
 
-		contactSim->manifold = fcn(shapeA, transformA, shapeB, transformB, &contactSim->cache);
+		contactSim->manifold = fcn(world, shapeA, transformA, shapeB, transformB, &contactSim->cache);
 
 		int pointCount = contactSim->manifold.pointCount;
 		touching = pointCount > 0;
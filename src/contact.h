@@ -136,12 +136,51 @@ typedef struct b2ContactSim
 	uint32_t simFlags;
 } b2ContactSim;
 
+/// Non-touching contacts live in the awake and disabled sets. They have no contact points, so they don't carry
+/// a manifold or body mass data. This keeps large sets of speculative pairs small and cheap to move. A non-touching
+/// contact is expanded to a b2ContactSim when it starts touching and moves into the constraint graph.
+typedef struct b2NonTouchingContactSim
+{
+	int contactId;
+
+#if B2_VALIDATE
+	int bodyIdA;
+	int bodyIdB;
+#endif
+
+	int shapeIdA;
+	int shapeIdB;
+
+	b2DistanceCache cache;
+
+	float friction;
+	float restitution;
+	float tangentSpeed;
+
+	// b2ContactSimFlags
+	uint32_t simFlags;
+
+	// Set by the collide task when a contact starts touching. This points into the worker arena and is only
+	// valid until the contact state is updated.
+	b2ContactSim* beginSim;
+} b2NonTouchingContactSim;
+
 void b2InitializeContactRegisters(void);
 
 void b2CreateContact(b2World* world, b2Shape* shapeA, b2Shape* shapeB);
 void b2DestroyContact(b2World* world, b2Contact* contact, bool wakeBodies);
 
+// Renumber contacts so the ids are dense. Contact ids are internal, so this may run between time steps.
+void b2CompactContactIds(b2World* world);
+
+// Touching contacts are in the constraint graph or a sleeping set. Others are in the awake or disabled set.
+bool b2IsContactSimExpanded(const b2Contact* contact);
 b2ContactSim* b2GetContactSim(b2World* world, b2Contact* contact);
+b2NonTouchingContactSim* b2GetNonTouchingContactSim(b2World* world, b2Contact* contact);
+b2Manifold b2GetContactManifold(b2World* world, b2Contact* contact);
+
+b2ContactSim b2MakeContactSim(const b2NonTouchingContactSim* source);
+b2NonTouchingContactSim b2MakeNonTouchingContactSim(const b2ContactSim* source);
 
 bool b2ShouldShapesCollide(b2Filter filterA, b2Filter filterB);
 
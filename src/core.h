@@ -92,18 +92,25 @@ extern b2AssertFcn* b2AssertHandler;
 
 /// Tracy profiler instrumentation
 ///	https://github.com/wolfpld/tracy
+/// Named zones are also recorded by the built-in tracer when a world has tracing enabled.
+#include "trace.h"
+
 #ifdef BOX2D_PROFILE
 
 	#include <tracy/TracyC.h>
 	#define b2TracyCZoneC(ctx, color, active) TracyCZoneC(ctx, color, active)
-	#define b2TracyCZoneNC(ctx, name, color, active) TracyCZoneNC(ctx, name, color, active)
-	#define b2TracyCZoneEnd(ctx) TracyCZoneEnd(ctx)
+	#define b2TracyCZoneNC(ctx, name, color, active)                                                                             \
+		TracyCZoneNC(ctx, name, color, active);                                                                                  \
+		b2TraceZone ctx##_trace = b2TraceBegin(name, active)
+	#define b2TracyCZoneEnd(ctx)                                                                                                 \
+		b2TraceEnd(&ctx##_trace);                                                                                                \
+		TracyCZoneEnd(ctx)
 
 #else
 
 	#define b2TracyCZoneC(ctx, color, active)
-	#define b2TracyCZoneNC(ctx, name, color, active)
-	#define b2TracyCZoneEnd(ctx)
+	#define b2TracyCZoneNC(ctx, name, color, active) b2TraceZone ctx##_trace = b2TraceBegin(name, active)
+	#define b2TracyCZoneEnd(ctx) b2TraceEnd(&ctx##_trace)
 
 #endif
 
@@ -113,8 +120,8 @@ extern float b2_lengthUnitsPerMeter;
 /// problems, so 100km as a limit should be fine in all cases.
 #define b2_huge (100000.0f * b2_lengthUnitsPerMeter)
 
-/// Maximum parallel workers. Used to size some static arrays.
-#define b2_maxWorkers 64
+/// Used to pad data that is written by several workers to prevent false sharing
+#define b2_cacheLineSize 64
 
 /// Maximum number of colors in the constraint graph. Constraints that cannot
 ///	find a color are added to the overflow set which are solved single-threaded.
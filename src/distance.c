@@ -1042,6 +1042,7 @@ b2TOIOutput b2TimeOfImpact(const b2TOIInput* input)
 	b2TOIOutput output;
 	output.state = b2_toiStateUnknown;
 	output.t = input->tMax;
+	output.iterations = 0;
 
 	const b2DistanceProxy* proxyA = &input->proxyA;
 	const b2DistanceProxy* proxyB = &input->proxyB;
@@ -1269,5 +1270,6 @@ b2TOIOutput b2TimeOfImpact(const b2TOIInput* input)
 	b2_toiTime += time;
 #endif
 
+	output.iterations = iter;
 	return output;
 }
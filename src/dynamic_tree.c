@@ -1,12 +1,13 @@
 // SPDX-FileCopyrightText: 2023 Erin Catto
 // SPDX-License-Identifier: MIT
 
+#include "dynamic_tree.h"
+
 #include "aabb.h"
 #include "allocate.h"
 #include "core.h"
 #include "util.h"
 
-#include "box2d/dynamic_tree.h"
 #include "box2d/math_functions.h"
 
 #include <float.h>
@@ -30,7 +31,7 @@ static inline int16_t b2MaxInt16(int16_t a, int16_t b)
 	return a > b ? a : b;
 }
 
-b2DynamicTree b2DynamicTree_Create(void)
+b2DynamicTree b2CreateDynamicTree(b2Allocator* allocator)
 {
 	_Static_assert((sizeof(b2TreeNode) & 0xF) == 0, "tree node size not a multiple of 16");
 
@@ -39,7 +40,7 @@ b2DynamicTree b2DynamicTree_Create(void)
 
 	tree.nodeCapacity = 16;
 	tree.nodeCount = 0;
-	tree.nodes = (b2TreeNode*)b2Alloc(tree.nodeCapacity * sizeof(b2TreeNode));
+	tree.nodes = (b2TreeNode*)b2AllocWith(allocator, tree.nodeCapacity * sizeof(b2TreeNode));
 	memset(tree.nodes, 0, tree.nodeCapacity * sizeof(b2TreeNode));
 
 	// Build a linked list for the free list.
@@ -63,19 +64,29 @@ b2DynamicTree b2DynamicTree_Create(void)
 	return tree;
 }
 
-void b2DynamicTree_Destroy(b2DynamicTree* tree)
+b2DynamicTree b2DynamicTree_Create(void)
 {
-	b2Free(tree->nodes, tree->nodeCapacity * sizeof(b2TreeNode));
-	b2Free(tree->leafIndices, tree->rebuildCapacity * sizeof(int32_t));
-	b2Free(tree->leafBoxes, tree->rebuildCapacity * sizeof(b2AABB));
-	b2Free(tree->leafCenters, tree->rebuildCapacity * sizeof(b2Vec2));
-	b2Free(tree->binIndices, tree->rebuildCapacity * sizeof(int32_t));
+	return b2CreateDynamicTree(NULL);
+}
+
+void b2DestroyDynamicTree(b2DynamicTree* tree, b2Allocator* allocator)
+{
+	b2FreeWith(allocator, tree->nodes, tree->nodeCapacity * sizeof(b2TreeNode));
+	b2FreeWith(allocator, tree->leafIndices, tree->rebuildCapacity * sizeof(int32_t));
+	b2FreeWith(allocator, tree->leafBoxes, tree->rebuildCapacity * sizeof(b2AABB));
+	b2FreeWith(allocator, tree->leafCenters, tree->rebuildCapacity * sizeof(b2Vec2));
+	b2FreeWith(allocator, tree->binIndices, tree->rebuildCapacity * sizeof(int32_t));
 
 	memset(tree, 0, sizeof(b2DynamicTree));
 }
 
+void b2DynamicTree_Destroy(b2DynamicTree* tree)
+{
+	b2DestroyDynamicTree(tree, NULL);
+}
+
 // Allocate a node from the pool. Grow the pool if necessary.
-static int32_t b2AllocateNode(b2DynamicTree* tree)
+static int32_t b2AllocateNode(b2DynamicTree* tree, b2Allocator* allocator)
 {
 	// Expand the node pool as needed.
 	if (tree->freeList == B2_NULL_INDEX)
@@ -86,9 +97,9 @@ static int32_t b2AllocateNode(b2DynamicTree* tree)
 		b2TreeNode* oldNodes = tree->nodes;
 		int32_t oldCapcity = tree->nodeCapacity;
 		tree->nodeCapacity += oldCapcity >> 1;
-		tree->nodes = (b2TreeNode*)b2Alloc(tree->nodeCapacity * sizeof(b2TreeNode));
+		tree->nodes = (b2TreeNode*)b2AllocWith(allocator, tree->nodeCapacity * sizeof(b2TreeNode));
 		memcpy(tree->nodes, oldNodes, tree->nodeCount * sizeof(b2TreeNode));
-		b2Free(oldNodes, oldCapcity * sizeof(b2TreeNode));
+		b2FreeWith(allocator, oldNodes, oldCapcity * sizeof(b2TreeNode));
 
 		// Build a linked list for the free list. The parent pointer becomes the "next" pointer.
 		// todo avoid building freelist?
@@ -580,7 +591,7 @@ static void b2RotateNodes(b2DynamicTree* tree, int32_t iA)
 	}
 }
 
-static void b2InsertLeaf(b2DynamicTree* tree, int32_t leaf, bool shouldRotate)
+static void b2InsertLeaf(b2DynamicTree* tree, b2Allocator* allocator, int32_t leaf, bool shouldRotate)
 {
 	if (tree->root == B2_NULL_INDEX)
 	{
@@ -595,7 +606,7 @@ static void b2InsertLeaf(b2DynamicTree* tree, int32_t leaf, bool shouldRotate)
 
 	// Stage 2: create a new parent for the leaf and sibling
 	int32_t oldParent = tree->nodes[sibling].parent;
-	int32_t newParent = b2AllocateNode(tree);
+	int32_t newParent = b2AllocateNode(tree, allocator);
 
 	// warning: node pointer can change after allocation
 	b2TreeNode* nodes = tree->nodes;
@@ -725,14 +736,14 @@ static void b2RemoveLeaf(b2DynamicTree* tree, int32_t leaf)
 
 // Create a proxy in the tree as a leaf node. We return the index of the node instead of a pointer so that we can grow
 // the node pool.
-int32_t b2DynamicTree_CreateProxy(b2DynamicTree* tree, b2AABB aabb, uint32_t categoryBits, int32_t userData)
+int32_t b2CreateTreeProxy(b2DynamicTree* tree, b2Allocator* allocator, b2AABB aabb, uint32_t categoryBits, int32_t userData)
 {
 	B2_ASSERT(-b2_huge < aabb.lowerBound.x && aabb.lowerBound.x < b2_huge);
 	B2_ASSERT(-b2_huge < aabb.lowerBound.y && aabb.lowerBound.y < b2_huge);
 	B2_ASSERT(-b2_huge < aabb.upperBound.x && aabb.upperBound.x < b2_huge);
 	B2_ASSERT(-b2_huge < aabb.upperBound.y && aabb.upperBound.y < b2_huge);
 
-	int32_t proxyId = b2AllocateNode(tree);
+	int32_t proxyId = b2AllocateNode(tree, allocator);
 	b2TreeNode* node = tree->nodes + proxyId;
 
 	node->aabb = aabb;
@@ -741,13 +752,18 @@ int32_t b2DynamicTree_CreateProxy(b2DynamicTree* tree, b2AABB aabb, uint32_t cat
 	node->height = 0;
 
 	bool shouldRotate = true;
-	b2InsertLeaf(tree, proxyId, shouldRotate);
+	b2InsertLeaf(tree, allocator, proxyId, shouldRotate);
 
 	tree->proxyCount += 1;
 
 	return proxyId;
 }
 
+int32_t b2DynamicTree_CreateProxy(b2DynamicTree* tree, b2AABB aabb, uint32_t categoryBits, int32_t userData)
+{
+	return b2CreateTreeProxy(tree, NULL, aabb, categoryBits, userData);
+}
+
 void b2DynamicTree_DestroyProxy(b2DynamicTree* tree, int32_t proxyId)
 {
 	B2_ASSERT(0 <= proxyId && proxyId < tree->nodeCapacity);
@@ -777,8 +793,10 @@ void b2DynamicTree_MoveProxy(b2DynamicTree* tree, int32_t proxyId, b2AABB aabb)
 
 	tree->nodes[proxyId].aabb = aabb;
 
+	// Removing the leaf freed its parent, so reinserting it never grows the pool and needs no allocator
+	B2_ASSERT(tree->root == B2_NULL_INDEX || tree->freeList != B2_NULL_INDEX);
 	bool shouldRotate = false;
-	b2InsertLeaf(tree, proxyId, shouldRotate);
+	b2InsertLeaf(tree, NULL, proxyId, shouldRotate);
 }
 
 void b2DynamicTree_EnlargeProxy(b2DynamicTree* tree, int32_t proxyId, b2AABB aabb)
@@ -1022,7 +1040,8 @@ int32_t b2DynamicTree_GetMaxBalance(const b2DynamicTree* tree)
 
 void b2DynamicTree_RebuildBottomUp(b2DynamicTree* tree)
 {
-	int32_t* nodes = (int32_t*)b2Alloc(tree->nodeCount * sizeof(int32_t));
+	int32_t nodeCount = tree->nodeCount;
+	int32_t* nodes = (int32_t*)b2Alloc(nodeCount * sizeof(int32_t));
 	int32_t count = 0;
 
 	// Build array of leaves. Free the rest.
@@ -1073,7 +1092,7 @@ void b2DynamicTree_RebuildBottomUp(b2DynamicTree* tree)
 		b2TreeNode* child1 = tree->nodes + index1;
 		b2TreeNode* child2 = tree->nodes + index2;
 
-		int32_t parentIndex = b2AllocateNode(tree);
+		int32_t parentIndex = b2AllocateNode(tree, NULL);
 		b2TreeNode* parent = tree->nodes + parentIndex;
 		parent->child1 = index1;
 		parent->child2 = index2;
@@ -1091,7 +1110,7 @@ void b2DynamicTree_RebuildBottomUp(b2DynamicTree* tree)
 	}
 
 	tree->root = nodes[0];
-	b2Free(nodes, tree->nodeCount * sizeof(b2TreeNode));
+	b2Free(nodes, nodeCount * sizeof(int32_t));
 
 	b2DynamicTree_Validate(tree);
 }
@@ -1693,7 +1712,7 @@ struct b2RebuildItem
 };
 
 // Returns root node index
-static int32_t b2BuildTree(b2DynamicTree* tree, int32_t leafCount)
+static int32_t b2BuildTree(b2DynamicTree* tree, b2Allocator* allocator, int32_t leafCount)
 {
 	b2TreeNode* nodes = tree->nodes;
 	int32_t* leafIndices = tree->leafIndices;
@@ -1714,7 +1733,7 @@ static int32_t b2BuildTree(b2DynamicTree* tree, int32_t leafCount)
 	struct b2RebuildItem stack[b2_treeStackSize];
 	int32_t top = 0;
 
-	stack[0].nodeIndex = b2AllocateNode(tree);
+	stack[0].nodeIndex = b2AllocateNode(tree, allocator);
 	stack[0].childCount = -1;
 	stack[0].startIndex = 0;
 	stack[0].endIndex = leafCount;
@@ -1817,7 +1836,7 @@ static int32_t b2BuildTree(b2DynamicTree* tree, int32_t leafCount)
 
 				top += 1;
 				struct b2RebuildItem* newItem = stack + top;
-				newItem->nodeIndex = b2AllocateNode(tree);
+				newItem->nodeIndex = b2AllocateNode(tree, allocator);
 				newItem->childCount = -1;
 				newItem->startIndex = startIndex;
 				newItem->endIndex = endIndex;
@@ -1848,7 +1867,7 @@ static int32_t b2BuildTree(b2DynamicTree* tree, int32_t leafCount)
 }
 
 // Not safe to access tree during this operation because it may grow
-int32_t b2DynamicTree_Rebuild(b2DynamicTree* tree, bool fullBuild)
+int32_t b2RebuildDynamicTree(b2DynamicTree* tree, b2Allocator* allocator, bool fullBuild)
 {
 	int32_t proxyCount = tree->proxyCount;
 	if (proxyCount == 0)
@@ -1861,17 +1880,17 @@ int32_t b2DynamicTree_Rebuild(b2DynamicTree* tree, bool fullBuild)
 	{
 		int32_t newCapacity = proxyCount + proxyCount / 2;
 
-		b2Free(tree->leafIndices, tree->rebuildCapacity * sizeof(int32_t));
-		tree->leafIndices = b2Alloc(newCapacity * sizeof(int32_t));
+		b2FreeWith(allocator, tree->leafIndices, tree->rebuildCapacity * sizeof(int32_t));
+		tree->leafIndices = b2AllocWith(allocator, newCapacity * sizeof(int32_t));
 
 #if B2_TREE_HEURISTIC == 0
-		b2Free(tree->leafCenters, tree->rebuildCapacity * sizeof(b2Vec2));
-		tree->leafCenters = b2Alloc(newCapacity * sizeof(b2Vec2));
+		b2FreeWith(allocator, tree->leafCenters, tree->rebuildCapacity * sizeof(b2Vec2));
+		tree->leafCenters = b2AllocWith(allocator, newCapacity * sizeof(b2Vec2));
 #else
-		b2Free(tree->leafBoxes, tree->rebuildCapacity * sizeof(b2AABB));
-		tree->leafBoxes = b2Alloc(newCapacity * sizeof(b2AABB));
-		b2Free(tree->binIndices, tree->rebuildCapacity * sizeof(int32_t));
-		tree->binIndices = b2Alloc(newCapacity * sizeof(int32_t));
+		b2FreeWith(allocator, tree->leafBoxes, tree->rebuildCapacity * sizeof(b2AABB));
+		tree->leafBoxes = b2AllocWith(allocator, newCapacity * sizeof(b2AABB));
+		b2FreeWith(allocator, tree->binIndices, tree->rebuildCapacity * sizeof(int32_t));
+		tree->binIndices = b2AllocWith(allocator, newCapacity * sizeof(int32_t));
 #endif
 		tree->rebuildCapacity = newCapacity;
 	}
@@ -1957,9 +1976,14 @@ int32_t b2DynamicTree_Rebuild(b2DynamicTree* tree, bool fullBuild)
 
 	B2_ASSERT(leafCount <= proxyCount);
 
-	tree->root = b2BuildTree(tree, leafCount);
+	tree->root = b2BuildTree(tree, allocator, leafCount);
 
 	b2DynamicTree_Validate(tree);
 
 	return leafCount;
 }
+
+int32_t b2DynamicTree_Rebuild(b2DynamicTree* tree, bool fullBuild)
+{
+	return b2RebuildDynamicTree(tree, NULL, fullBuild);
+}
@@ -0,0 +1,16 @@
+// SPDX-FileCopyrightText: 2024 Erin Catto
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include "box2d/dynamic_tree.h"
+
+typedef struct b2Allocator b2Allocator;
+
+// Versions of the tree functions that allocate from a world allocator. The tree does not keep the allocator, so a
+// tree created with an allocator must always be grown, rebuilt, and destroyed with that same allocator. The public
+// functions use the global allocator.
+b2DynamicTree b2CreateDynamicTree(b2Allocator* allocator);
+void b2DestroyDynamicTree(b2DynamicTree* tree, b2Allocator* allocator);
+int32_t b2CreateTreeProxy(b2DynamicTree* tree, b2Allocator* allocator, b2AABB aabb, uint32_t categoryBits, int32_t userData);
+int32_t b2RebuildDynamicTree(b2DynamicTree* tree, b2Allocator* allocator, bool fullBuild);
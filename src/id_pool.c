@@ -6,10 +6,10 @@
 #include "array.h"
 #include "util.h"
 
-b2IdPool b2CreateIdPool()
+b2IdPool b2CreateIdPool(b2Allocator* allocator)
 {
 	b2IdPool pool = {0};
-	pool.freeArray = b2CreateArray(sizeof(int), 32);
+	pool.freeArray = b2CreateArray(allocator, sizeof(int), 32);
 	return pool;
 }
 
@@ -47,6 +47,14 @@ void b2FreeId(b2IdPool* pool, int id)
 	b2Array_Push(pool->freeArray, id);
 }
 
+void b2CompactIdPool(b2IdPool* pool, int idCount)
+{
+	B2_ASSERT(idCount == b2GetIdCount(pool));
+	b2Array_Clear(pool->freeArray);
+	b2Array_Shrink((void**)&pool->freeArray, sizeof(int));
+	pool->nextIndex = idCount;
+}
+
 #if B2_VALIDATE
 
 void b2ValidateFreeId(b2IdPool* pool, int id)
@@ -11,13 +11,16 @@ typedef struct b2IdPool
 	int nextIndex;
 } b2IdPool;
 
-b2IdPool b2CreateIdPool();
+b2IdPool b2CreateIdPool(b2Allocator* allocator);
 void b2DestroyIdPool(b2IdPool* pool);
 
 int b2AllocId(b2IdPool* pool);
 void b2FreeId(b2IdPool* pool, int id);
 void b2ValidateFreeId(b2IdPool* pool, int id);
 
+// Used after the owner renumbers its ids to fill [0, idCount). Releases the free list.
+void b2CompactIdPool(b2IdPool* pool, int idCount);
+
 static inline int b2GetIdCount(b2IdPool* pool)
 {
 	return pool->nextIndex - b2Array(pool->freeArray).count;
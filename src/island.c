@@ -9,12 +9,14 @@
 #include "core.h"
 #include "joint.h"
 #include "solver_set.h"
+#include "stack_allocator.h"
 #include "util.h"
 #include "world.h"
 
 #include "box2d/color.h"
 #include "box2d/timer.h"
 
+#include <stdatomic.h>
 #include <stddef.h>
 
 b2Island* b2CreateIsland(b2World* world, int setIndex)
@@ -88,6 +90,108 @@ b2Island* b2GetIsland(b2World* world, int islandId)
 	return world->islandArray + islandId;
 }
 
+static int b2RemapIslandId(const int* remap, int islandId)
+{
+	return islandId == B2_NULL_INDEX ? B2_NULL_INDEX : remap[islandId];
+}
+
+void b2CompactIslandIds(b2World* world)
+{
+	B2_ASSERT(world->locked == false);
+
+	int capacity = b2GetIdCapacity(&world->islandIdPool);
+	int count = b2GetIdCount(&world->islandIdPool);
+	if (count < capacity)
+	{
+		b2Island* islands = world->islandArray;
+		int* remap = b2AllocWith(&world->allocator, capacity * sizeof(int));
+		int nextId = 0;
+		for (int i = 0; i < capacity; ++i)
+		{
+			if (islands[i].islandId == B2_NULL_INDEX)
+			{
+				remap[i] = B2_NULL_INDEX;
+				continue;
+			}
+
+			remap[i] = nextId;
+			islands[nextId] = islands[i];
+			nextId += 1;
+		}
+
+		B2_ASSERT(nextId == count);
+
+		for (int i = 0; i < count; ++i)
+		{
+			islands[i].islandId = i;
+			islands[i].parentIsland = b2RemapIslandId(remap, islands[i].parentIsland);
+		}
+
+		int bodyCapacity = b2Array(world->bodyArray).count;
+		for (int i = 0; i < bodyCapacity; ++i)
+		{
+			b2Body* body = world->bodyArray + i;
+			if (body->id != B2_NULL_INDEX)
+			{
+				body->islandId = b2RemapIslandId(remap, body->islandId);
+			}
+		}
+
+		int contactCapacity = b2Array(world->contactArray).count;
+		for (int i = 0; i < contactCapacity; ++i)
+		{
+			b2Contact* contact = world->contactArray + i;
+			if (contact->contactId != B2_NULL_INDEX)
+			{
+				contact->islandId = b2RemapIslandId(remap, contact->islandId);
+			}
+		}
+
+		int jointCapacity = b2Array(world->jointArray).count;
+		for (int i = 0; i < jointCapacity; ++i)
+		{
+			b2Joint* joint = world->jointArray + i;
+			if (joint->jointId != B2_NULL_INDEX)
+			{
+				joint->islandId = b2RemapIslandId(remap, joint->islandId);
+			}
+		}
+
+		int setCount = b2Array(world->solverSetArray).count;
+		for (int setIndex = 0; setIndex < setCount; ++setIndex)
+		{
+			b2IslandArray* setIslands = &world->solverSetArray[setIndex].islands;
+			for (int i = 0; i < setIslands->count; ++i)
+			{
+				setIslands->data[i].islandId = remap[setIslands->data[i].islandId];
+			}
+		}
+
+		// Split candidates are gathered late in the step and consumed at the start of the next step,
+		// so they can be pending here. Drop candidates whose island no longer exists.
+		int* candidates = world->splitIslandArray;
+		int candidateCount = b2Array(candidates).count;
+		int keepCount = 0;
+		for (int i = 0; i < candidateCount; ++i)
+		{
+			int islandId = candidates[i];
+			if (0 <= islandId && islandId < capacity && remap[islandId] != B2_NULL_INDEX)
+			{
+				candidates[keepCount] = remap[islandId];
+				keepCount += 1;
+			}
+		}
+		b2Array(candidates).count = keepCount;
+
+		b2FreeWith(&world->allocator, remap, capacity * sizeof(int));
+
+		b2Array(world->islandArray).count = count;
+		b2CompactIdPool(&world->islandIdPool, count);
+	}
+
+	b2Array_Shrink((void**)&world->islandArray, sizeof(b2Island));
+}
+
 static void b2AddContactToIsland(b2World* world, int islandId, b2Contact* contact)
 {
 	B2_ASSERT(contact->islandId == B2_NULL_INDEX);
@@ -426,18 +530,9 @@ void b2UnlinkJoint(b2World* world, b2Joint* joint)
 	b2ValidateIsland(world, islandId);
 }
 
-// Merge an island into its root island.
-// todo we can assume all islands are awake here
-static void b2MergeIsland(b2World* world, b2Island* island)
+// Point the bodies, contacts, and joints of a child island to the root island
+static void b2RemapIsland(b2World* world, b2Island* island, int rootId)
 {
-	B2_ASSERT(island->parentIsland != B2_NULL_INDEX);
-
-	int rootId = island->parentIsland;
-	b2CheckIndex(world->islandArray, rootId);
-	b2Island* rootIsland = world->islandArray + rootId;
-	B2_ASSERT(rootIsland->parentIsland == B2_NULL_INDEX);
-
-	// remap island indices
 	int bodyId = island->headBody;
 	while (bodyId != B2_NULL_INDEX)
 	{
@@ -462,6 +557,12 @@ static void b2MergeIsland(b2World* world, b2Island* island)
 		joint->islandId = rootId;
 		jointId = joint->islandNext;
 	}
+}
+
+// Append the lists of a child island to the lists of the root island
+static void b2ConcatenateIsland(b2World* world, b2Island* rootIsland, b2Island* island)
+{
+	B2_ASSERT(rootIsland->parentIsland == B2_NULL_INDEX);
 
 	// connect body lists
 	B2_ASSERT(rootIsland->tailBody != B2_NULL_INDEX);
@@ -534,13 +635,123 @@ static void b2MergeIsland(b2World* world, b2Island* island)
 
 	// Track removed constraints
 	rootIsland->constraintRemoveCount += island->constraintRemoveCount;
-	
-	b2ValidateIsland(world, rootId);
+}
+
+// Temporary data for merging awake islands. Arrays are indexed by the island's local index in the awake set.
+typedef struct b2IslandMergeContext
+{
+	b2World* world;
+	b2IslandSim* islandSims;
+
+	// root island id of each awake island or B2_NULL_INDEX if the island is a root
+	int* rootIds;
+
+	// singly linked list of child islands per root island, in merge order
+	int* childHeads;
+	int* childTails;
+	int* childNexts;
+
+	// local indices of root islands that have children
+	int* mergeRoots;
+	int mergeRootCount;
+} b2IslandMergeContext;
+
+// Find the root of each awake island. Path compression only ever points an island to one of its ancestors,
+// so concurrent compression is safe with relaxed atomics and the roots don't depend on the thread count.
+static void b2FindIslandRootsTask(int startIndex, int endIndex, uint32_t threadIndex, void* context)
+{
+	B2_MAYBE_UNUSED(threadIndex);
+
+	b2IslandMergeContext* mergeContext = context;
+	b2Island* islands = mergeContext->world->islandArray;
+	b2IslandSim* islandSims = mergeContext->islandSims;
+	int* rootIds = mergeContext->rootIds;
+
+	for (int i = startIndex; i < endIndex; ++i)
+	{
+		int islandId = islandSims[i].islandId;
+		b2CheckIndex(islands, islandId);
+		b2Island* island = islands + islandId;
+
+		int rootId = B2_NULL_INDEX;
+		b2Island* rootIsland = island;
+		int parentId = atomic_load_explicit(&rootIsland->parentIsland, memory_order_relaxed);
+		while (parentId != B2_NULL_INDEX)
+		{
+			b2CheckIndex(islands, parentId);
+			b2Island* parent = islands + parentId;
+			int grandParentId = atomic_load_explicit(&parent->parentIsland, memory_order_relaxed);
+			if (grandParentId != B2_NULL_INDEX)
+			{
+				// path compression
+				atomic_store_explicit(&rootIsland->parentIsland, grandParentId, memory_order_relaxed);
+			}
+
+			rootId = parentId;
+			rootIsland = parent;
+			parentId = grandParentId;
+		}
+
+		rootIds[i] = rootId;
+	}
+}
+
+static void b2RemapIslandsTask(int startIndex, int endIndex, uint32_t threadIndex, void* context)
+{
+	B2_MAYBE_UNUSED(threadIndex);
+
+	b2IslandMergeContext* mergeContext = context;
+	b2World* world = mergeContext->world;
+	b2IslandSim* islandSims = mergeContext->islandSims;
+	int* rootIds = mergeContext->rootIds;
+
+	for (int i = startIndex; i < endIndex; ++i)
+	{
+		int rootId = rootIds[i];
+		if (rootId == B2_NULL_INDEX)
+		{
+			continue;
+		}
+
+		b2Island* island = b2GetIsland(world, islandSims[i].islandId);
+		b2RemapIsland(world, island, rootId);
+	}
+}
+
+// Each root island is owned by a single worker, so list concatenation doesn't need synchronization
+static void b2ConcatenateIslandsTask(int startIndex, int endIndex, uint32_t threadIndex, void* context)
+{
+	B2_MAYBE_UNUSED(threadIndex);
+
+	b2IslandMergeContext* mergeContext = context;
+	b2World* world = mergeContext->world;
+	b2IslandSim* islandSims = mergeContext->islandSims;
+
+	for (int i = startIndex; i < endIndex; ++i)
+	{
+		int rootIndex = mergeContext->mergeRoots[i];
+		int rootId = islandSims[rootIndex].islandId;
+		b2Island* rootIsland = b2GetIsland(world, rootId);
+
+		int childIndex = mergeContext->childHeads[rootIndex];
+		while (childIndex != B2_NULL_INDEX)
+		{
+			B2_ASSERT(mergeContext->rootIds[childIndex] == rootId);
+			b2Island* island = b2GetIsland(world, islandSims[childIndex].islandId);
+			b2ConcatenateIsland(world, rootIsland, island);
+			childIndex = mergeContext->childNexts[childIndex];
+		}
+
+		b2ValidateIsland(world, rootId);
+	}
 }
 
 // Iterate over all awake islands and merge any that need merging
 // Islands that get merged into a root island will be removed from the awake island array
 // and returned to the pool.
+// The root finding, remapping, and list concatenation are done in parallel. The merge order of child islands
+// and the island destruction order are the same as a serial merge in reverse awake order, so the result
+// is deterministic.
 // todo this might be faster if b2IslandSim held the connectivity data
 void b2MergeAwakeIslands(b2World* world)
 {
@@ -549,59 +760,130 @@ void b2MergeAwakeIslands(b2World* world)
 	b2SolverSet* awakeSet = world->solverSetArray + b2_awakeSet;
 	b2IslandSim* islandSims = awakeSet->islands.data;
 	int awakeIslandCount = awakeSet->islands.count;
-	b2Island* islands = world->islandArray;
 
-	// Step 1: Ensure every child island points to its root island. This avoids merging a child island with
+	if (awakeIslandCount == 0)
+	{
+		b2TracyCZoneEnd(merge_islands);
+		return;
+	}
+
+	b2StackAllocator* alloc = &world->stackAllocator;
+
+	b2IslandMergeContext mergeContext = {0};
+	mergeContext.world = world;
+	mergeContext.islandSims = islandSims;
+	mergeContext.rootIds = b2AllocateStackItem(alloc, awakeIslandCount * sizeof(int), "island roots");
+
+	// Step 1: Find the root of every awake island. This avoids merging a child island with
 	// a parent island that has already been merged with a grand-parent island.
+	{
+		int minRange = 256;
+		void* userTask =
+			world->enqueueTaskFcn(&b2FindIslandRootsTask, awakeIslandCount, minRange, &mergeContext, world->userTaskContext);
+		world->taskCount += 1;
+		if (userTask != NULL)
+		{
+			world->finishTaskFcn(userTask, world->userTaskContext);
+		}
+	}
+
+	int* rootIds = mergeContext.rootIds;
+	int childCount = 0;
 	for (int i = 0; i < awakeIslandCount; ++i)
 	{
-		int islandId = islandSims[i].islandId;
+		childCount += rootIds[i] != B2_NULL_INDEX ? 1 : 0;
+	}
 
-		b2CheckIndex(islands, islandId);
-		b2Island* island = islands + islandId;
+	if (childCount == 0)
+	{
+		b2FreeStackItem(alloc, mergeContext.rootIds);
+		b2TracyCZoneEnd(merge_islands);
+		return;
+	}
 
-		// find the root island
-		int rootId = islandId;
-		b2Island* rootIsland = island;
-		while (rootIsland->parentIsland != B2_NULL_INDEX)
+	// Step 2: Build the child list of each root island. Children are appended in reverse awake order.
+	mergeContext.childHeads = b2AllocateStackItem(alloc, awakeIslandCount * sizeof(int), "child heads");
+	mergeContext.childTails = b2AllocateStackItem(alloc, awakeIslandCount * sizeof(int), "child tails");
+	mergeContext.childNexts = b2AllocateStackItem(alloc, awakeIslandCount * sizeof(int), "child nexts");
+	mergeContext.mergeRoots = b2AllocateStackItem(alloc, awakeIslandCount * sizeof(int), "merge roots");
+
+	for (int i = 0; i < awakeIslandCount; ++i)
+	{
+		mergeContext.childHeads[i] = B2_NULL_INDEX;
+		mergeContext.childTails[i] = B2_NULL_INDEX;
+		mergeContext.childNexts[i] = B2_NULL_INDEX;
+	}
+
+	b2Island* islands = world->islandArray;
+	for (int i = awakeIslandCount - 1; i >= 0; --i)
+	{
+		int rootId = rootIds[i];
+		if (rootId == B2_NULL_INDEX)
 		{
-			b2CheckIndex(islands, rootIsland->parentIsland);
-			b2Island* parent = islands + rootIsland->parentIsland;
-			if (parent->parentIsland != B2_NULL_INDEX)
-			{
-				// path compression
-				rootIsland->parentIsland = parent->parentIsland;
-			}
+			continue;
+		}
 
-			rootId = rootIsland->parentIsland;
-			rootIsland = parent;
+		b2CheckIndex(islands, rootId);
+		b2Island* rootIsland = islands + rootId;
+		B2_ASSERT(rootIsland->setIndex == b2_awakeSet);
+		int rootIndex = rootIsland->localIndex;
+
+		if (mergeContext.childHeads[rootIndex] == B2_NULL_INDEX)
+		{
+			mergeContext.childHeads[rootIndex] = i;
+			mergeContext.mergeRoots[mergeContext.mergeRootCount] = rootIndex;
+			mergeContext.mergeRootCount += 1;
 		}
+		else
+		{
+			mergeContext.childNexts[mergeContext.childTails[rootIndex]] = i;
+		}
+
+		mergeContext.childTails[rootIndex] = i;
+	}
 
-		if (rootIsland != island)
+	// Step 3: Point the bodies, contacts, and joints of child islands to their root island
+	{
+		int minRange = 16;
+		void* userTask =
+			world->enqueueTaskFcn(&b2RemapIslandsTask, awakeIslandCount, minRange, &mergeContext, world->userTaskContext);
+		world->taskCount += 1;
+		if (userTask != NULL)
 		{
-			island->parentIsland = rootId;
+			world->finishTaskFcn(userTask, world->userTaskContext);
 		}
 	}
 
-	// Step 2: merge every awake island into its parent (which must be a root island)
-	// Reverse to support removal from awake array.
-	for (int i = awakeIslandCount - 1; i >= 0; --i)
+	// Step 4: Concatenate the child island lists onto their root island
 	{
-		int islandId = islandSims[i].islandId;
-		b2CheckIndex(islands, islandId);
-		b2Island* island = islands + islandId;
+		int minRange = 16;
+		void* userTask = world->enqueueTaskFcn(&b2ConcatenateIslandsTask, mergeContext.mergeRootCount, minRange, &mergeContext,
+											   world->userTaskContext);
+		world->taskCount += 1;
+		if (userTask != NULL)
+		{
+			world->finishTaskFcn(userTask, world->userTaskContext);
+		}
+	}
 
-		if (island->parentIsland == B2_NULL_INDEX)
+	// Step 5: Serially destroy the child islands. Reverse to support removal from awake array.
+	for (int i = awakeIslandCount - 1; i >= 0; --i)
+	{
+		if (rootIds[i] == B2_NULL_INDEX)
 		{
 			continue;
 		}
 
-		b2MergeIsland(world, island);
-
 		// this call does a remove swap from the end of the island sim array
-		b2DestroyIsland(world, islandId);
+		b2DestroyIsland(world, islandSims[i].islandId);
 	}
 
+	b2FreeStackItem(alloc, mergeContext.mergeRoots);
+	b2FreeStackItem(alloc, mergeContext.childNexts);
+	b2FreeStackItem(alloc, mergeContext.childTails);
+	b2FreeStackItem(alloc, mergeContext.childHeads);
+	b2FreeStackItem(alloc, mergeContext.rootIds);
+
 	b2ValidateConnectivity(world);
 
 	b2TracyCZoneEnd(merge_islands);
@@ -609,36 +891,80 @@ void b2MergeAwakeIslands(b2World* world)
 
 #define B2_CONTACT_REMOVE_THRESHOLD 1
 
-void b2SplitIsland(b2World* world, int baseId)
+// Gather the split candidates into stack allocated scratch data. This allocates from the stack allocator, so it
+// must be called on the main thread before the split task is enqueued.
+static void b2PrepareSplits(b2World* world, b2SplitIslandContext* context, const int* candidates, int candidateCount)
 {
-	b2CheckIndex(world->islandArray, baseId);
-	b2Island* baseIsland = world->islandArray + baseId;
-	int setIndex = baseIsland->setIndex;
+	*context = (b2SplitIslandContext){0};
+	context->world = world;
 
-	if (setIndex != b2_awakeSet)
+	if (candidateCount == 0)
 	{
-		// can only split awake island
 		return;
 	}
 
-	if (baseIsland->constraintRemoveCount == 0)
+	b2StackAllocator* alloc = &world->stackAllocator;
+	b2IslandSplit* splits = b2AllocateStackItem(alloc, candidateCount * sizeof(b2IslandSplit), "island splits");
+
+	int splitCount = 0;
+	for (int i = 0; i < candidateCount; ++i)
+	{
+		int baseId = candidates[i];
+		b2CheckIndex(world->islandArray, baseId);
+		b2Island* baseIsland = world->islandArray + baseId;
+
+		// The island may have been merged, destroyed, or put to sleep since it was flagged
+		if (baseIsland->setIndex != b2_awakeSet || baseIsland->constraintRemoveCount == 0)
+		{
+			continue;
+		}
+
+		b2ValidateIsland(world, baseId);
+
+		int bodyCount = baseIsland->bodyCount;
+
+		// No lock is needed because I ensure the allocator is not used while the split task is active.
+		b2IslandSplit* split = splits + splitCount;
+		split->baseId = baseId;
+		split->bodyCount = bodyCount;
+		split->stack = b2AllocateStackItem(alloc, bodyCount * sizeof(int), "island stack");
+		split->bodyIds = b2AllocateStackItem(alloc, bodyCount * sizeof(int), "body ids");
+		split->islands = b2AllocateStackItem(alloc, bodyCount * sizeof(b2Island), "split islands");
+		split->islandCount = 0;
+		split->time = 0.0f;
+		splitCount += 1;
+	}
+
+	if (splitCount == 0)
 	{
-		// this island doesn't need to be split
+		b2FreeStackItem(alloc, splits);
 		return;
 	}
 
-	b2ValidateIsland(world, baseId);
+	context->splits = splits;
+	context->splitCount = splitCount;
+}
+
+void b2PrepareSplitIslands(b2World* world, b2SplitIslandContext* context)
+{
+	int* candidates = world->splitIslandArray;
+	b2PrepareSplits(world, context, candidates, b2Array(candidates).count);
+	b2Array_Clear(world->splitIslandArray);
+}
 
-	int bodyCount = baseIsland->bodyCount;
+// Find the connected components of an island using depth first search (DFS). The new islands are
+// gathered in the split scratch data. This only touches the bodies, contacts, and joints of the base island
+// so different islands can be searched concurrently.
+static void b2SearchIsland(b2World* world, b2IslandSplit* split)
+{
+	b2Island* baseIsland = world->islandArray + split->baseId;
+	int bodyCount = split->bodyCount;
 
 	b2Body* bodies = world->bodyArray;
 	b2Contact* contacts = world->contactArray;
 
-	b2StackAllocator* alloc = &world->stackAllocator;
-
-	// No lock is needed because I ensure the allocator is not used while this task is active.
-	int* stack = b2AllocateStackItem(alloc, bodyCount * sizeof(int), "island stack");
-	int* bodyIds = b2AllocateStackItem(alloc, bodyCount * sizeof(int), "body ids");
+	int* stack = split->stack;
+	int* bodyIds = split->bodyIds;
 
 	// Build array containing all body indices from base island. These
 	// serve as seed bodies for the depth first search (DFS).
@@ -675,15 +1001,12 @@ void b2SplitIsland(b2World* world, int baseId)
 		nextJoint = joint->islandNext;
 	}
 
-	// Done with the base split island.
-	b2DestroyIsland(world, baseId);
-
 	// Each island is found as a depth first search starting from a seed body
 	for (int i = 0; i < bodyCount; ++i)
 	{
 		int seedIndex = bodyIds[i];
 		b2Body* seed = bodies + seedIndex;
-		B2_ASSERT(seed->setIndex == setIndex);
+		B2_ASSERT(seed->setIndex == b2_awakeSet);
 
 		if (seed->isMarked == true)
 		{
@@ -695,12 +1018,22 @@ void b2SplitIsland(b2World* world, int baseId)
 		stack[stackCount++] = seedIndex;
 		seed->isMarked = true;
 
-		// Create new island
-		// No lock needed because only a single island can split per time step. No islands are being used during the constraint
-		// solve. However, islands are touched during body finalization.
-		b2Island* island = b2CreateIsland(world, setIndex);
-
-		int islandId = island->islandId;
+		// Gather the new island. It is created later when the island ids can be allocated deterministically.
+		B2_ASSERT(split->islandCount < bodyCount);
+		b2Island* island = split->islands + split->islandCount;
+		split->islandCount += 1;
+
+		*island = (b2Island){0};
+		island->setIndex = B2_NULL_INDEX;
+		island->localIndex = B2_NULL_INDEX;
+		island->islandId = B2_NULL_INDEX;
+		island->headBody = B2_NULL_INDEX;
+		island->tailBody = B2_NULL_INDEX;
+		island->headContact = B2_NULL_INDEX;
+		island->tailContact = B2_NULL_INDEX;
+		island->headJoint = B2_NULL_INDEX;
+		island->tailJoint = B2_NULL_INDEX;
+		island->parentIsland = B2_NULL_INDEX;
 
 		// Perform a depth first search (DFS) on the constraint graph.
 		while (stackCount > 0)
@@ -712,7 +1045,6 @@ void b2SplitIsland(b2World* world, int baseId)
 			B2_ASSERT(body->isMarked == true);
 
 			// Add body to island
-			body->islandId = islandId;
 			if (island->tailBody != B2_NULL_INDEX)
 			{
 				bodies[island->tailBody].islandNext = bodyId;
@@ -775,7 +1107,6 @@ void b2SplitIsland(b2World* world, int baseId)
 				}
 
 				// Add contact to island
-				contact->islandId = islandId;
 				if (island->tailContact != B2_NULL_INDEX)
 				{
 					b2CheckIndex(world->contactArray, island->tailContact);
@@ -834,7 +1165,6 @@ void b2SplitIsland(b2World* world, int baseId)
 				}
 
 				// Add joint to island
-				joint->islandId = islandId;
 				if (island->tailJoint != B2_NULL_INDEX)
 				{
 					b2Joint* tailJoint = b2GetJoint(world, island->tailJoint);
@@ -852,38 +1182,137 @@ void b2SplitIsland(b2World* world, int baseId)
 				island->jointCount += 1;
 			}
 		}
-
-		b2ValidateIsland(world, islandId);
 	}
-
-	b2FreeStackItem(alloc, bodyIds);
-	b2FreeStackItem(alloc, stack);
 }
 
-// Split an island because some contacts and/or joints have been removed.
+// Split islands because some contacts and/or joints have been removed.
 // This is called during the constraint solve while islands are not being touched. This uses DFS and touches a lot of memory,
-// so it can be quite slow.
+// so it can be quite slow. Each work item is one island.
 // Note: contacts/joints connected to static bodies must belong to an island but don't affect island connectivity
 // Note: static bodies are never in an island
-// Note: this task interacts with some allocators without locks under the assumption that no other tasks
-// are interacting with these data structures.
 void b2SplitIslandTask(int startIndex, int endIndex, uint32_t threadIndex, void* context)
 {
 	b2TracyCZoneNC(split, "Split Island", b2_colorHoneydew2, true);
 
-	B2_MAYBE_UNUSED(startIndex);
-	B2_MAYBE_UNUSED(endIndex);
+	b2SplitIslandContext* splitContext = context;
+	b2TraceScope traceScope = b2EnterTraceScope(splitContext->world->worldId, (int)threadIndex);
+
+	for (int i = startIndex; i < endIndex; ++i)
+	{
+		b2Timer timer = b2CreateTimer();
+		b2IslandSplit* split = splitContext->splits + i;
+		b2SearchIsland(splitContext->world, split);
+		split->time = b2GetMilliseconds(&timer);
+	}
+
+	b2TracyCZoneEnd(split);
+
+	b2LeaveTraceScope(traceScope);
+}
+
+static void b2RemapSplitIslandsTask(int startIndex, int endIndex, uint32_t threadIndex, void* context)
+{
 	B2_MAYBE_UNUSED(threadIndex);
 
+	b2SplitIslandContext* splitContext = context;
+	b2World* world = splitContext->world;
+
+	for (int i = startIndex; i < endIndex; ++i)
+	{
+		b2IslandSplit* split = splitContext->splits + i;
+		for (int j = 0; j < split->islandCount; ++j)
+		{
+			b2Island* island = split->islands + j;
+			b2RemapIsland(world, island, island->islandId);
+			b2ValidateIsland(world, island->islandId);
+		}
+	}
+}
+
+// Create the split islands and free the scratch data. The islands are created serially in candidate order
+// so the island ids don't depend on the thread count.
+// Note: this task interacts with the id pool and the awake set, so it must be called on the main thread after the split task.
+void b2FinishSplitIslands(b2SplitIslandContext* context)
+{
+	b2World* world = context->world;
+	int splitCount = context->splitCount;
+	if (splitCount == 0)
+	{
+		return;
+	}
+
+	b2TracyCZoneNC(finish_split, "Finish Split", b2_colorHoneydew2, true);
+
 	b2Timer timer = b2CreateTimer();
-	b2World* world = context;
+	b2IslandSplit* splits = context->splits;
 
-	B2_ASSERT(world->splitIslandId != B2_NULL_INDEX);
+	for (int i = 0; i < splitCount; ++i)
+	{
+		b2IslandSplit* split = splits + i;
 
-	b2SplitIsland(world, world->splitIslandId);
+		// Done with the base split island.
+		b2DestroyIsland(world, split->baseId);
 
-	world->profile.splitIslands += b2GetMilliseconds(&timer);
-	b2TracyCZoneEnd(split);
+		for (int j = 0; j < split->islandCount; ++j)
+		{
+			b2Island* source = split->islands + j;
+			b2Island* island = b2CreateIsland(world, b2_awakeSet);
+
+			island->headBody = source->headBody;
+			island->tailBody = source->tailBody;
+			island->bodyCount = source->bodyCount;
+			island->headContact = source->headContact;
+			island->tailContact = source->tailContact;
+			island->contactCount = source->contactCount;
+			island->headJoint = source->headJoint;
+			island->tailJoint = source->tailJoint;
+			island->jointCount = source->jointCount;
+
+			source->islandId = island->islandId;
+		}
+	}
+
+	// Point bodies, contacts, and joints to their new islands
+	if (splitCount > 1)
+	{
+		void* userTask = world->enqueueTaskFcn(&b2RemapSplitIslandsTask, splitCount, 1, context, world->userTaskContext);
+		world->taskCount += 1;
+		if (userTask != NULL)
+		{
+			world->finishTaskFcn(userTask, world->userTaskContext);
+		}
+	}
+	else
+	{
+		b2RemapSplitIslandsTask(0, splitCount, 0, context);
+	}
+
+	float searchTime = 0.0f;
+	b2StackAllocator* alloc = &world->stackAllocator;
+	for (int i = splitCount - 1; i >= 0; --i)
+	{
+		b2IslandSplit* split = splits + i;
+		searchTime += split->time;
+		b2FreeStackItem(alloc, split->islands);
+		b2FreeStackItem(alloc, split->bodyIds);
+		b2FreeStackItem(alloc, split->stack);
+	}
+
+	b2FreeStackItem(alloc, splits);
+	*context = (b2SplitIslandContext){0};
+
+	world->profile.splitIslands += searchTime + b2GetMilliseconds(&timer);
+
+	b2TracyCZoneEnd(finish_split);
+}
+
+// Split a single island immediately
+void b2SplitIsland(b2World* world, int baseId)
+{
+	b2SplitIslandContext context;
+	b2PrepareSplits(world, &context, &baseId, 1);
+	b2SplitIslandTask(0, context.splitCount, 0, &context);
+	b2FinishSplitIslands(&context);
 }
 
 #if B2_VALIDATE
@@ -49,8 +49,8 @@ typedef struct b2Island
 	int tailJoint;
 	int jointCount;
 
-	// Union find
-	int parentIsland;
+	// Union find. Atomic so root finding can do path compression in parallel.
+	_Atomic int parentIsland;
 
 	// Keeps track of how many contacts have been removed from this island.
 	int constraintRemoveCount;
@@ -67,6 +67,9 @@ void b2DestroyIsland(b2World* world, int islandId);
 
 b2Island* b2GetIsland(b2World* world, int islandId);
 
+// Renumber islands so the ids are dense. Island ids are internal, so this may run between time steps.
+void b2CompactIslandIds(b2World* world);
+
 // Link contacts into the island graph when it starts having contact points
 void b2LinkContact(b2World* world, b2Contact* contact);
 
@@ -81,7 +84,36 @@ void b2UnlinkJoint(b2World* world, b2Joint* joint);
 
 void b2MergeAwakeIslands(b2World* world);
 
+// Maximum number of islands that are split in one time step
+#define b2_maxSplitIslands 8
+
+// Scratch data for splitting one island
+typedef struct b2IslandSplit
+{
+	int baseId;
+	int bodyCount;
+	int* stack;
+	int* bodyIds;
+
+	// New islands found by the search. Only the list data is valid until the islands are created.
+	b2Island* islands;
+	int islandCount;
+
+	float time;
+} b2IslandSplit;
+
+// Islands are searched concurrently and then created serially so the island ids are deterministic
+typedef struct b2SplitIslandContext
+{
+	b2World* world;
+	b2IslandSplit* splits;
+	int splitCount;
+} b2SplitIslandContext;
+
 void b2SplitIsland(b2World* world, int baseId);
+
+void b2PrepareSplitIslands(b2World* world, b2SplitIslandContext* context);
 void b2SplitIslandTask(int startIndex, int endIndex, uint32_t threadIndex, void* context);
+void b2FinishSplitIslands(b2SplitIslandContext* context);
 
 void b2ValidateIsland(b2World* world, int islandId);
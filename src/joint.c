@@ -334,6 +334,12 @@ b2JointId b2CreateDistanceJoint(b2WorldId worldId, const b2DistanceJointDef* def
 		return (b2JointId){0};
 	}
 
+	if (b2IsOverMemoryBudget(world))
+	{
+		world->failedCreateCount += 1;
+		return (b2JointId){0};
+	}
+
 	B2_ASSERT(b2Body_IsValid(def->bodyIdA));
 	B2_ASSERT(b2Body_IsValid(def->bodyIdB));
 	B2_ASSERT(b2IsValid(def->length) && def->length > 0.0f);
@@ -386,6 +392,12 @@ b2JointId b2CreateMotorJoint(b2WorldId worldId, const b2MotorJointDef* def)
 		return (b2JointId){0};
 	}
 
+	if (b2IsOverMemoryBudget(world))
+	{
+		world->failedCreateCount += 1;
+		return (b2JointId){0};
+	}
+
 	b2Body* bodyA = b2GetBodyFullId(world, def->bodyIdA);
 	b2Body* bodyB = b2GetBodyFullId(world, def->bodyIdB);
 
@@ -423,6 +435,12 @@ b2JointId b2CreateMouseJoint(b2WorldId worldId, const b2MouseJointDef* def)
 		return (b2JointId){0};
 	}
 
+	if (b2IsOverMemoryBudget(world))
+	{
+		world->failedCreateCount += 1;
+		return (b2JointId){0};
+	}
+
 	b2Body* bodyA = b2GetBodyFullId(world, def->bodyIdA);
 	b2Body* bodyB = b2GetBodyFullId(world, def->bodyIdB);
 
@@ -458,6 +476,12 @@ b2JointId b2CreateRevoluteJoint(b2WorldId worldId, const b2RevoluteJointDef* def
 		return (b2JointId){0};
 	}
 
+	if (b2IsOverMemoryBudget(world))
+	{
+		world->failedCreateCount += 1;
+		return (b2JointId){0};
+	}
+
 	b2Body* bodyA = b2GetBodyFullId(world, def->bodyIdA);
 	b2Body* bodyB = b2GetBodyFullId(world, def->bodyIdB);
 
@@ -511,6 +535,12 @@ b2JointId b2CreatePrismaticJoint(b2WorldId worldId, const b2PrismaticJointDef* d
 		return (b2JointId){0};
 	}
 
+	if (b2IsOverMemoryBudget(world))
+	{
+		world->failedCreateCount += 1;
+		return (b2JointId){0};
+	}
+
 	b2Body* bodyA = b2GetBodyFullId(world, def->bodyIdA);
 	b2Body* bodyB = b2GetBodyFullId(world, def->bodyIdB);
 
@@ -563,6 +593,12 @@ b2JointId b2CreateWeldJoint(b2WorldId worldId, const b2WeldJointDef* def)
 		return (b2JointId){0};
 	}
 
+	if (b2IsOverMemoryBudget(world))
+	{
+		world->failedCreateCount += 1;
+		return (b2JointId){0};
+	}
+
 	b2Body* bodyA = b2GetBodyFullId(world, def->bodyIdA);
 	b2Body* bodyB = b2GetBodyFullId(world, def->bodyIdB);
 
@@ -604,6 +640,12 @@ b2JointId b2CreateWheelJoint(b2WorldId worldId, const b2WheelJointDef* def)
 		return (b2JointId){0};
 	}
 
+	if (b2IsOverMemoryBudget(world))
+	{
+		world->failedCreateCount += 1;
+		return (b2JointId){0};
+	}
+
 	b2Body* bodyA = b2GetBodyFullId(world, def->bodyIdA);
 	b2Body* bodyB = b2GetBodyFullId(world, def->bodyIdB);
 
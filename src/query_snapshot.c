@@ -0,0 +1,247 @@
+// SPDX-FileCopyrightText: 2024 Erin Catto
+// SPDX-License-Identifier: MIT
+
+#include "query_snapshot.h"
+
+#include "allocate.h"
+#include "array.h"
+#include "body.h"
+#include "core.h"
+#include "shape.h"
+#include "solver_set.h"
+#include "util.h"
+#include "world.h"
+
+#include "box2d/color.h"
+
+// for mm_pause
+#include "x86/sse2.h"
+
+#include <stdatomic.h>
+#include <string.h>
+
+void b2CreateQuerySnapshots(b2World* world)
+{
+	for (int i = 0; i < 2; ++i)
+	{
+		b2QuerySnapshot* snapshot = world->querySnapshots + i;
+		*snapshot = (b2QuerySnapshot){0};
+		for (int j = 0; j < b2_proxyTypeCount; ++j)
+		{
+			snapshot->trees[j] = b2CreateDynamicTree(&world->allocator);
+		}
+	}
+
+	world->snapshotMovedBodyArray = b2CreateArray(&world->allocator, sizeof(int), 16);
+	world->snapshotRefreshedBodyArray = b2CreateArray(&world->allocator, sizeof(int), 16);
+
+	// No snapshot until the first time step
+	atomic_store(&world->querySnapshotIndex, B2_NULL_INDEX);
+	atomic_store(&world->directQueryCount, 0);
+}
+
+void b2DestroyQuerySnapshots(b2World* world)
+{
+	for (int i = 0; i < 2; ++i)
+	{
+		b2QuerySnapshot* snapshot = world->querySnapshots + i;
+		B2_ASSERT(atomic_load(&snapshot->readerCount) == 0);
+
+		for (int j = 0; j < b2_proxyTypeCount; ++j)
+		{
+			b2DestroyDynamicTree(snapshot->trees + j, &world->allocator);
+		}
+
+		b2FreeWith(&world->allocator, snapshot->shapes, snapshot->shapeCapacity * sizeof(b2SnapshotShape));
+		*snapshot = (b2QuerySnapshot){0};
+	}
+
+	b2DestroyArray(world->snapshotMovedBodyArray, sizeof(int));
+	b2DestroyArray(world->snapshotRefreshedBodyArray, sizeof(int));
+	world->snapshotMovedBodyArray = NULL;
+	world->snapshotRefreshedBodyArray = NULL;
+}
+
+// Only the node pool is copied. This is all the queries need.
+static void b2CopyTreeNodes(b2Allocator* allocator, b2DynamicTree* dst, const b2DynamicTree* src)
+{
+	if (dst->nodeCapacity < src->nodeCapacity)
+	{
+		b2FreeWith(allocator, dst->nodes, dst->nodeCapacity * sizeof(b2TreeNode));
+		dst->nodeCapacity = src->nodeCapacity;
+		dst->nodes = b2AllocWith(allocator, dst->nodeCapacity * sizeof(b2TreeNode));
+	}
+
+	memcpy(dst->nodes, src->nodes, src->nodeCapacity * sizeof(b2TreeNode));
+	dst->root = src->root;
+	dst->nodeCount = src->nodeCount;
+	dst->proxyCount = src->proxyCount;
+
+	// The copy is never modified
+	dst->freeList = B2_NULL_INDEX;
+}
+
+static void b2RefreshSnapshotBody(b2World* world, b2QuerySnapshot* snapshot, int bodyId)
+{
+	b2CheckIndex(world->bodyArray, bodyId);
+	b2Body* body = world->bodyArray + bodyId;
+	if (body->id == B2_NULL_INDEX)
+	{
+		// Destroyed after it was marked
+		return;
+	}
+
+	b2Transform transform = b2GetBodyTransformQuick(world, body);
+	int shapeId = body->headShapeId;
+	while (shapeId != B2_NULL_INDEX)
+	{
+		b2Shape* shape = world->shapeArray + shapeId;
+		snapshot->shapes[shapeId] = (b2SnapshotShape){transform, shape->revision};
+		shapeId = shape->nextShapeId;
+	}
+}
+
+void b2UpdateQuerySnapshot(b2World* world)
+{
+	b2TracyCZoneNC(query_snapshot, "Query Snapshot", b2_colorLightSlateGray, true);
+
+	int previousIndex = atomic_load(&world->querySnapshotIndex);
+	int index = previousIndex == 0 ? 1 : 0;
+	b2QuerySnapshot* snapshot = world->querySnapshots + index;
+
+	// Queries that acquired this buffer before the last swap may still be running
+	while (atomic_load(&snapshot->readerCount) > 0)
+	{
+		simde_mm_pause();
+	}
+
+	// The static tree is usually unchanged
+	b2BroadPhase* broadPhase = &world->broadPhase;
+	for (int i = 0; i < b2_proxyTypeCount; ++i)
+	{
+		if (snapshot->treeRevisions[i] != broadPhase->treeRevisions[i])
+		{
+			b2CopyTreeNodes(&world->allocator, snapshot->trees + i, broadPhase->trees + i);
+			snapshot->treeRevisions[i] = broadPhase->treeRevisions[i];
+		}
+	}
+
+	int shapeCapacity = b2Array(world->shapeArray).count;
+	if (snapshot->shapeCapacity < shapeCapacity)
+	{
+		// Keep the transforms of the shapes that are not refreshed
+		int newCapacity = shapeCapacity + shapeCapacity / 2;
+		b2SnapshotShape* snapshotShapes = b2AllocWith(&world->allocator, newCapacity * sizeof(b2SnapshotShape));
+		if (snapshot->shapeCapacity > 0)
+		{
+			memcpy(snapshotShapes, snapshot->shapes, snapshot->shapeCapacity * sizeof(b2SnapshotShape));
+		}
+
+		b2FreeWith(&world->allocator, snapshot->shapes, snapshot->shapeCapacity * sizeof(b2SnapshotShape));
+		snapshot->shapes = snapshotShapes;
+		snapshot->shapeCapacity = newCapacity;
+	}
+
+	// This buffer was last written two updates ago, so it missed the bodies refreshed in the other buffer by the
+	// previous update. Refresh those, then the awake bodies and the bodies marked since the previous update. Static
+	// and sleeping bodies that did not move keep their transforms.
+	int* refreshedBodies = world->snapshotRefreshedBodyArray;
+	int refreshedCount = b2Array(refreshedBodies).count;
+	for (int i = 0; i < refreshedCount; ++i)
+	{
+		b2RefreshSnapshotBody(world, snapshot, refreshedBodies[i]);
+	}
+	b2Array_Clear(world->snapshotRefreshedBodyArray);
+
+	b2SolverSet* awakeSet = world->solverSetArray + b2_awakeSet;
+	int awakeCount = awakeSet->sims.count;
+	for (int i = 0; i < awakeCount; ++i)
+	{
+		int bodyId = awakeSet->sims.data[i].bodyId;
+		b2RefreshSnapshotBody(world, snapshot, bodyId);
+		b2Array_Push(world->snapshotRefreshedBodyArray, bodyId);
+	}
+
+	int* movedBodies = world->snapshotMovedBodyArray;
+	int movedCount = b2Array(movedBodies).count;
+	for (int i = 0; i < movedCount; ++i)
+	{
+		b2RefreshSnapshotBody(world, snapshot, movedBodies[i]);
+		b2Array_Push(world->snapshotRefreshedBodyArray, movedBodies[i]);
+	}
+	b2Array_Clear(world->snapshotMovedBodyArray);
+
+	atomic_store(&world->querySnapshotIndex, index);
+
+	// Queries that started before the first snapshot read the world directly. Let them finish before the
+	// caller changes the world.
+	if (previousIndex == B2_NULL_INDEX)
+	{
+		while (atomic_load(&world->directQueryCount) > 0)
+		{
+			simde_mm_pause();
+		}
+	}
+
+	b2TracyCZoneEnd(query_snapshot);
+}
+
+b2QuerySnapshot* b2AcquireQuerySnapshot(b2World* world)
+{
+	if (world->enableQuerySnapshot == false)
+	{
+		return NULL;
+	}
+
+	while (true)
+	{
+		int index = atomic_load(&world->querySnapshotIndex);
+		if (index == B2_NULL_INDEX)
+		{
+			// Read the world directly. The first snapshot waits for this query to finish.
+			atomic_fetch_add(&world->directQueryCount, 1);
+			if (atomic_load(&world->querySnapshotIndex) == B2_NULL_INDEX)
+			{
+				return NULL;
+			}
+
+			atomic_fetch_sub(&world->directQueryCount, 1);
+			continue;
+		}
+
+		b2QuerySnapshot* snapshot = world->querySnapshots + index;
+		atomic_fetch_add(&snapshot->readerCount, 1);
+
+		// The buffers may have been swapped before the reader count was visible
+		if (atomic_load(&world->querySnapshotIndex) == index)
+		{
+			return snapshot;
+		}
+
+		atomic_fetch_sub(&snapshot->readerCount, 1);
+	}
+}
+
+void b2ReleaseQuerySnapshot(b2World* world, b2QuerySnapshot* snapshot)
+{
+	if (snapshot != NULL)
+	{
+		int count = atomic_fetch_sub(&snapshot->readerCount, 1);
+		B2_ASSERT(count > 0);
+		B2_MAYBE_UNUSED(count);
+	}
+	else if (world->enableQuerySnapshot)
+	{
+		int count = atomic_fetch_sub(&world->directQueryCount, 1);
+		B2_ASSERT(count > 0);
+		B2_MAYBE_UNUSED(count);
+	}
+}
+
+void b2MarkSnapshotBody(b2World* world, int bodyId)
+{
+	if (world->enableQuerySnapshot)
+	{
+		b2Array_Push(world->snapshotMovedBodyArray, bodyId);
+	}
+}
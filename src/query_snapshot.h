@@ -0,0 +1,47 @@
+// SPDX-FileCopyrightText: 2024 Erin Catto
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include "broad_phase.h"
+
+typedef struct b2World b2World;
+
+// The revision detects shapes that were destroyed and re-created after the snapshot was taken
+typedef struct b2SnapshotShape
+{
+	b2Transform transform;
+	uint16_t revision;
+} b2SnapshotShape;
+
+// A read-only copy of the broad-phase trees and shape transforms taken at the end of a time step.
+// Queries may read a snapshot from any thread while the next time step runs.
+typedef struct b2QuerySnapshot
+{
+	b2DynamicTree trees[b2_proxyTypeCount];
+
+	// The broad-phase tree revisions at the last copy. An unchanged tree is not copied again.
+	uint32_t treeRevisions[b2_proxyTypeCount];
+
+	// Indexed by shape id
+	b2SnapshotShape* shapes;
+	int shapeCapacity;
+
+	// Queries currently reading this snapshot
+	_Atomic int readerCount;
+} b2QuerySnapshot;
+
+void b2CreateQuerySnapshots(b2World* world);
+void b2DestroyQuerySnapshots(b2World* world);
+
+// Called on the main thread at the end of the time step. Waits for queries still reading the back buffer.
+void b2UpdateQuerySnapshot(b2World* world);
+
+// Record a body whose shapes changed transform or proxy outside of the awake set, such as a moved static body,
+// a new shape, or a body that fell asleep during the step. Awake bodies are refreshed without this.
+void b2MarkSnapshotBody(b2World* world, int bodyId);
+
+// Returns NULL if the world does not have snapshots or has not taken one yet. Then the query reads the world directly.
+// Every acquire must be paired with a release.
+b2QuerySnapshot* b2AcquireQuerySnapshot(b2World* world);
+void b2ReleaseQuerySnapshot(b2World* world, b2QuerySnapshot* snapshot);
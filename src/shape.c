@@ -13,6 +13,8 @@
 #include "box2d/box2d.h"
 #include "box2d/event_types.h"
 
+#include <string.h>
+
 static b2Shape* b2GetShape(b2World* world, b2ShapeId shapeId)
 {
 	int id = shapeId.index1 - 1;
@@ -34,13 +36,79 @@ static b2ChainShape* b2GetChainShape(b2World* world, b2ChainId chainId)
 	return chain;
 }
 
-static void b2UpdateShapeAABBs(b2Shape* shape, b2Transform transform, b2ProxyType proxyType)
+static const int b2_geometrySizes[b2_shapeTypeCount] = {
+	[b2_circleShape] = sizeof(b2Circle),
+	[b2_capsuleShape] = sizeof(b2Capsule),
+	[b2_segmentShape] = sizeof(b2Segment),
+	[b2_polygonShape] = sizeof(b2Polygon),
+	[b2_smoothSegmentShape] = sizeof(b2SmoothSegment),
+};
+
+void b2CreateGeometryPools(b2World* world)
+{
+	for (int i = 0; i < b2_shapeTypeCount; ++i)
+	{
+		b2GeometryPool* pool = world->geometryPools + i;
+		pool->idPool = b2CreateIdPool(&world->allocator);
+		pool->elementSize = b2_geometrySizes[i];
+		pool->data = b2CreateArray(&world->allocator, pool->elementSize, 16);
+	}
+}
+
+void b2DestroyGeometryPools(b2World* world)
+{
+	for (int i = 0; i < b2_shapeTypeCount; ++i)
+	{
+		b2GeometryPool* pool = world->geometryPools + i;
+		b2DestroyArray(pool->data, pool->elementSize);
+		b2DestroyIdPool(&pool->idPool);
+	}
+}
+
+// Copy geometry into the pool for the shape type and return the index
+static int b2AllocGeometry(b2World* world, b2ShapeType type, const void* geometry)
+{
+	B2_ASSERT(0 <= type && type < b2_shapeTypeCount);
+	b2GeometryPool* pool = world->geometryPools + type;
+	int index = b2AllocId(&pool->idPool);
+	if (index == b2Array(pool->data).count)
+	{
+		b2Array_Resize(&pool->data, pool->elementSize, index + 1);
+	}
+
+	memcpy((char*)pool->data + index * pool->elementSize, geometry, pool->elementSize);
+	return index;
+}
+
+static void b2FreeGeometry(b2World* world, b2Shape* shape)
+{
+	b2GeometryPool* pool = world->geometryPools + shape->type;
+	b2FreeId(&pool->idPool, shape->geometryIndex);
+	shape->geometryIndex = B2_NULL_INDEX;
+}
+
+// Replace the geometry of an existing shape. The shape type may change.
+static void b2SetShapeGeometry(b2World* world, b2Shape* shape, b2ShapeType type, const void* geometry)
+{
+	if (shape->type == type)
+	{
+		b2GeometryPool* pool = world->geometryPools + type;
+		memcpy((char*)pool->data + shape->geometryIndex * pool->elementSize, geometry, pool->elementSize);
+		return;
+	}
+
+	b2FreeGeometry(world, shape);
+	shape->type = type;
+	shape->geometryIndex = b2AllocGeometry(world, type, geometry);
+}
+
+static void b2UpdateShapeAABBs(b2World* world, b2Shape* shape, b2Transform transform, b2ProxyType proxyType)
 {
 	// Compute a bounding box with a speculative margin
 	const float speculativeDistance = b2_speculativeDistance;
 	const float aabbMargin = b2_aabbMargin;
 
-	b2AABB aabb = b2ComputeShapeAABB(shape, transform);
+	b2AABB aabb = b2ComputeShapeAABB(world, shape, transform);
 	aabb.lowerBound.x -= speculativeDistance;
 	aabb.lowerBound.y -= speculativeDistance;
 	aabb.upperBound.x += speculativeDistance;
@@ -78,36 +146,11 @@ static b2Shape* b2CreateShapeInternal(b2World* world, b2Body* body, b2Transform
 	b2CheckIndex(world->shapeArray, shapeId);
 	b2Shape* shape = world->shapeArray + shapeId;
 
-	switch (shapeType)
-	{
-		case b2_capsuleShape:
-			shape->capsule = *(const b2Capsule*)geometry;
-			break;
-
-		case b2_circleShape:
-			shape->circle = *(const b2Circle*)geometry;
-			break;
-
-		case b2_polygonShape:
-			shape->polygon = *(const b2Polygon*)geometry;
-			break;
-
-		case b2_segmentShape:
-			shape->segment = *(const b2Segment*)geometry;
-			break;
-
-		case b2_smoothSegmentShape:
-			shape->smoothSegment = *(const b2SmoothSegment*)geometry;
-			break;
-
-		default:
-			B2_ASSERT(false);
-			break;
-	}
+	shape->type = shapeType;
+	shape->geometryIndex = b2AllocGeometry(world, shapeType, geometry);
 
 	shape->id = shapeId;
 	shape->bodyId = body->id;
-	shape->type = shapeType;
 	shape->density = def->density;
 	shape->friction = def->friction;
 	shape->restitution = def->restitution;
@@ -121,7 +164,7 @@ static b2Shape* b2CreateShapeInternal(b2World* world, b2Body* body, b2Transform
 	shape->enablePreSolveEvents = def->enablePreSolveEvents;
 	shape->isFast = false;
 	shape->proxyKey = B2_NULL_INDEX;
-	shape->localCentroid = b2GetShapeCentroid(shape);
+	shape->localCentroid = b2GetShapeCentroid(world, shape);
 	shape->aabb = (b2AABB){b2Vec2_zero, b2Vec2_zero};
 	shape->fatAABB = (b2AABB){b2Vec2_zero, b2Vec2_zero};
 	shape->revision += 1;
@@ -129,7 +172,7 @@ static b2Shape* b2CreateShapeInternal(b2World* world, b2Body* body, b2Transform
 	if (body->setIndex != b2_disabledSet)
 	{
 		b2ProxyType proxyType = body->setIndex == b2_staticSet ? b2_staticProxy : b2_movableProxy;
-		b2CreateShapeProxy(shape, &world->broadPhase, proxyType, transform, def->forceContactCreation);
+		b2CreateShapeProxy(world, shape, proxyType, transform, def->forceContactCreation);
 	}
 
 	// Add to shape doubly linked list
@@ -162,6 +205,12 @@ b2ShapeId b2CreateShape(b2BodyId bodyId, const b2ShapeDef* def, const void* geom
 		return (b2ShapeId){0};
 	}
 
+	if (b2IsOverMemoryBudget(world))
+	{
+		world->failedCreateCount += 1;
+		return (b2ShapeId){0};
+	}
+
 	b2Body* body = b2GetBodyFullId(world, bodyId);
 	b2Transform transform = b2GetBodyTransformQuick(world, body);
 
@@ -258,6 +307,8 @@ void b2DestroyShapeInternal(b2World* world, b2Shape* shape, b2Body* body, bool w
 		}
 	}
 
+	b2FreeGeometry(world, shape);
+
 	// Return shape to free list.
 	b2FreeId(&world->shapeIdPool, shapeId);
 	shape->id = B2_NULL_INDEX;
@@ -298,6 +349,12 @@ b2ChainId b2CreateChain(b2BodyId bodyId, const b2ChainDef* def)
 		return (b2ChainId){0};
 	}
 
+	if (b2IsOverMemoryBudget(world))
+	{
+		world->failedCreateCount += 1;
+		return (b2ChainId){0};
+	}
+
 	b2Body* body = b2GetBodyFullId(world, bodyId);
 	b2Transform transform = b2GetBodyTransformQuick(world, body);
 
@@ -336,7 +393,7 @@ b2ChainId b2CreateChain(b2BodyId bodyId, const b2ChainDef* def)
 	if (def->isLoop)
 	{
 		chainShape->count = n;
-		chainShape->shapeIndices = b2Alloc(n * sizeof(int));
+		chainShape->shapeIndices = b2AllocWith(&world->allocator, n * sizeof(int));
 
 		b2SmoothSegment smoothSegment;
 
@@ -377,7 +434,7 @@ b2ChainId b2CreateChain(b2BodyId bodyId, const b2ChainDef* def)
 	else
 	{
 		chainShape->count = n - 3;
-		chainShape->shapeIndices = b2Alloc(n * sizeof(int));
+		chainShape->shapeIndices = b2AllocWith(&world->allocator, chainShape->count * sizeof(int));
 
 		b2SmoothSegment smoothSegment;
 
@@ -440,7 +497,7 @@ void b2DestroyChain(b2ChainId chainId)
 		b2DestroyShapeInternal(world, shape, body, wakeBodies);
 	}
 
-	b2Free(chain->shapeIndices, chain->count * sizeof(int));
+	b2FreeWith(&world->allocator, chain->shapeIndices, chain->count * sizeof(int));
 	chain->shapeIndices = NULL;
 
 	// Return chain to free list.
@@ -450,20 +507,20 @@ void b2DestroyChain(b2ChainId chainId)
 	b2ValidateSolverSets(world);
 }
 
-b2AABB b2ComputeShapeAABB(const b2Shape* shape, b2Transform xf)
+b2AABB b2ComputeShapeAABB(const b2World* world, const b2Shape* shape, b2Transform xf)
 {
 	switch (shape->type)
 	{
 		case b2_capsuleShape:
-			return b2ComputeCapsuleAABB(&shape->capsule, xf);
+			return b2ComputeCapsuleAABB(b2GetShapeCapsule(world, shape), xf);
 		case b2_circleShape:
-			return b2ComputeCircleAABB(&shape->circle, xf);
+			return b2ComputeCircleAABB(b2GetShapeCircle(world, shape), xf);
 		case b2_polygonShape:
-			return b2ComputePolygonAABB(&shape->polygon, xf);
+			return b2ComputePolygonAABB(b2GetShapePolygon(world, shape), xf);
 		case b2_segmentShape:
-			return b2ComputeSegmentAABB(&shape->segment, xf);
+			return b2ComputeSegmentAABB(b2GetShapeSegment(world, shape), xf);
 		case b2_smoothSegmentShape:
-			return b2ComputeSegmentAABB(&shape->smoothSegment.segment, xf);
+			return b2ComputeSegmentAABB(&b2GetShapeSmoothSegment(world, shape)->segment, xf);
 		default:
 		{
 			B2_ASSERT(false);
@@ -473,39 +530,52 @@ b2AABB b2ComputeShapeAABB(const b2Shape* shape, b2Transform xf)
 	}
 }
 
-b2Vec2 b2GetShapeCentroid(const b2Shape* shape)
+b2Vec2 b2GetShapeCentroid(const b2World* world, const b2Shape* shape)
 {
 	switch (shape->type)
 	{
 		case b2_capsuleShape:
-			return b2Lerp(shape->capsule.center1, shape->capsule.center2, 0.5f);
+		{
+			const b2Capsule* capsule = b2GetShapeCapsule(world, shape);
+			return b2Lerp(capsule->center1, capsule->center2, 0.5f);
+		}
 		case b2_circleShape:
-			return shape->circle.center;
+			return b2GetShapeCircle(world, shape)->center;
 		case b2_polygonShape:
-			return shape->polygon.centroid;
+			return b2GetShapePolygon(world, shape)->centroid;
 		case b2_segmentShape:
-			return b2Lerp(shape->segment.point1, shape->segment.point2, 0.5f);
+		{
+			const b2Segment* segment = b2GetShapeSegment(world, shape);
+			return b2Lerp(segment->point1, segment->point2, 0.5f);
+		}
 		case b2_smoothSegmentShape:
-			return b2Lerp(shape->smoothSegment.segment.point1, shape->smoothSegment.segment.point2, 0.5f);
+		{
+			const b2Segment* segment = &b2GetShapeSmoothSegment(world, shape)->segment;
+			return b2Lerp(segment->point1, segment->point2, 0.5f);
+		}
 		default:
 			return b2Vec2_zero;
 	}
 }
 
 // todo maybe compute this on shape creation
-float b2GetShapePerimeter(const b2Shape* shape)
+float b2GetShapePerimeter(const b2World* world, const b2Shape* shape)
 {
 	switch (shape->type)
 	{
 		case b2_capsuleShape:
-			return 2.0f * b2Length(b2Sub(shape->capsule.center1, shape->capsule.center2)) + 2.0f * b2_pi * shape->capsule.radius;
+		{
+			const b2Capsule* capsule = b2GetShapeCapsule(world, shape);
+			return 2.0f * b2Length(b2Sub(capsule->center1, capsule->center2)) + 2.0f * b2_pi * capsule->radius;
+		}
 		case b2_circleShape:
-			return 2.0f * b2_pi * shape->circle.radius;
+			return 2.0f * b2_pi * b2GetShapeCircle(world, shape)->radius;
 		case b2_polygonShape:
 		{
-			const b2Vec2* points = shape->polygon.vertices;
-			int count = shape->polygon.count;
-			float perimeter = 2.0f * b2_pi * shape->polygon.radius;
+			const b2Polygon* polygon = b2GetShapePolygon(world, shape);
+			const b2Vec2* points = polygon->vertices;
+			int count = polygon->count;
+			float perimeter = 2.0f * b2_pi * polygon->radius;
 			B2_ASSERT(count > 0);
 			b2Vec2 prev = points[count - 1];
 			for (int i = 0; i < count; ++i)
@@ -518,24 +588,30 @@ float b2GetShapePerimeter(const b2Shape* shape)
 			return perimeter;
 		}
 		case b2_segmentShape:
-			return 2.0f * b2Length(b2Sub(shape->segment.point1, shape->segment.point2));
+		{
+			const b2Segment* segment = b2GetShapeSegment(world, shape);
+			return 2.0f * b2Length(b2Sub(segment->point1, segment->point2));
+		}
 		case b2_smoothSegmentShape:
-			return 2.0f * b2Length(b2Sub(shape->smoothSegment.segment.point1, shape->smoothSegment.segment.point2));
+		{
+			const b2Segment* segment = &b2GetShapeSmoothSegment(world, shape)->segment;
+			return 2.0f * b2Length(b2Sub(segment->point1, segment->point2));
+		}
 		default:
 			return 0.0f;
 	}
 }
 
-b2MassData b2ComputeShapeMass(const b2Shape* shape)
+b2MassData b2ComputeShapeMass(const b2World* world, const b2Shape* shape)
 {
 	switch (shape->type)
 	{
 		case b2_capsuleShape:
-			return b2ComputeCapsuleMass(&shape->capsule, shape->density);
+			return b2ComputeCapsuleMass(b2GetShapeCapsule(world, shape), shape->density);
 		case b2_circleShape:
-			return b2ComputeCircleMass(&shape->circle, shape->density);
+			return b2ComputeCircleMass(b2GetShapeCircle(world, shape), shape->density);
 		case b2_polygonShape:
-			return b2ComputePolygonMass(&shape->polygon, shape->density);
+			return b2ComputePolygonMass(b2GetShapePolygon(world, shape), shape->density);
 		default:
 		{
 			return (b2MassData){0};
@@ -543,7 +619,7 @@ b2MassData b2ComputeShapeMass(const b2Shape* shape)
 	}
 }
 
-b2ShapeExtent b2ComputeShapeExtent(const b2Shape* shape, b2Vec2 localCenter)
+b2ShapeExtent b2ComputeShapeExtent(const b2World* world, const b2Shape* shape, b2Vec2 localCenter)
 {
 	b2ShapeExtent extent = {0};
 
@@ -551,25 +627,27 @@ b2ShapeExtent b2ComputeShapeExtent(const b2Shape* shape, b2Vec2 localCenter)
 	{
 		case b2_capsuleShape:
 		{
-			float radius = shape->capsule.radius;
+			const b2Capsule* capsule = b2GetShapeCapsule(world, shape);
+			float radius = capsule->radius;
 			extent.minExtent = radius;
-			b2Vec2 c1 = b2Sub(shape->capsule.center1, localCenter);
-			b2Vec2 c2 = b2Sub(shape->capsule.center2, localCenter);
+			b2Vec2 c1 = b2Sub(capsule->center1, localCenter);
+			b2Vec2 c2 = b2Sub(capsule->center2, localCenter);
 			extent.maxExtent = sqrtf(b2MaxFloat(b2LengthSquared(c1), b2LengthSquared(c2))) + radius;
 		}
 		break;
 
 		case b2_circleShape:
 		{
-			float radius = shape->circle.radius;
+			const b2Circle* circle = b2GetShapeCircle(world, shape);
+			float radius = circle->radius;
 			extent.minExtent = radius;
-			extent.maxExtent = b2Length(b2Sub(shape->circle.center, localCenter)) + radius;
+			extent.maxExtent = b2Length(b2Sub(circle->center, localCenter)) + radius;
 		}
 		break;
 
 		case b2_polygonShape:
 		{
-			const b2Polygon* poly = &shape->polygon;
+			const b2Polygon* poly = b2GetShapePolygon(world, shape);
 			float minExtent = b2_huge;
 			float maxExtentSqr = 0.0f;
 			int count = poly->count;
@@ -590,18 +668,20 @@ b2ShapeExtent b2ComputeShapeExtent(const b2Shape* shape, b2Vec2 localCenter)
 
 		case b2_segmentShape:
 		{
+			const b2Segment* segment = b2GetShapeSegment(world, shape);
 			extent.minExtent = 0.0f;
-			b2Vec2 c1 = b2Sub(shape->segment.point1, localCenter);
-			b2Vec2 c2 = b2Sub(shape->segment.point2, localCenter);
+			b2Vec2 c1 = b2Sub(segment->point1, localCenter);
+			b2Vec2 c2 = b2Sub(segment->point2, localCenter);
 			extent.maxExtent = sqrtf(b2MaxFloat(b2LengthSquared(c1), b2LengthSquared(c2)));
 		}
 		break;
 
 		case b2_smoothSegmentShape:
 		{
+			const b2Segment* segment = &b2GetShapeSmoothSegment(world, shape)->segment;
 			extent.minExtent = 0.0f;
-			b2Vec2 c1 = b2Sub(shape->smoothSegment.segment.point1, localCenter);
-			b2Vec2 c2 = b2Sub(shape->smoothSegment.segment.point2, localCenter);
+			b2Vec2 c1 = b2Sub(segment->point1, localCenter);
+			b2Vec2 c2 = b2Sub(segment->point2, localCenter);
 			extent.maxExtent = sqrtf(b2MaxFloat(b2LengthSquared(c1), b2LengthSquared(c2)));
 		}
 		break;
@@ -613,7 +693,7 @@ b2ShapeExtent b2ComputeShapeExtent(const b2Shape* shape, b2Vec2 localCenter)
 	return extent;
 }
 
-b2CastOutput b2RayCastShape(const b2RayCastInput* input, const b2Shape* shape, b2Transform transform)
+b2CastOutput b2RayCastShape(const b2World* world, const b2RayCastInput* input, const b2Shape* shape, b2Transform transform)
 {
 	b2RayCastInput localInput = *input;
 	localInput.origin = b2InvTransformPoint(transform, input->origin);
@@ -623,19 +703,19 @@ b2CastOutput b2RayCastShape(const b2RayCastInput* input, const b2Shape* shape, b
 	switch (shape->type)
 	{
 		case b2_capsuleShape:
-			output = b2RayCastCapsule(&localInput, &shape->capsule);
+			output = b2RayCastCapsule(&localInput, b2GetShapeCapsule(world, shape));
 			break;
 		case b2_circleShape:
-			output = b2RayCastCircle(&localInput, &shape->circle);
+			output = b2RayCastCircle(&localInput, b2GetShapeCircle(world, shape));
 			break;
 		case b2_polygonShape:
-			output = b2RayCastPolygon(&localInput, &shape->polygon);
+			output = b2RayCastPolygon(&localInput, b2GetShapePolygon(world, shape));
 			break;
 		case b2_segmentShape:
-			output = b2RayCastSegment(&localInput, &shape->segment, false);
+			output = b2RayCastSegment(&localInput, b2GetShapeSegment(world, shape), false);
 			break;
 		case b2_smoothSegmentShape:
-			output = b2RayCastSegment(&localInput, &shape->smoothSegment.segment, true);
+			output = b2RayCastSegment(&localInput, &b2GetShapeSmoothSegment(world, shape)->segment, true);
 			break;
 		default:
 			return output;
@@ -646,7 +726,8 @@ b2CastOutput b2RayCastShape(const b2RayCastInput* input, const b2Shape* shape, b
 	return output;
 }
 
-b2CastOutput b2ShapeCastShape(const b2ShapeCastInput* input, const b2Shape* shape, b2Transform transform)
+b2CastOutput b2ShapeCastShape(const b2World* world, const b2ShapeCastInput* input, const b2Shape* shape,
+							  b2Transform transform)
 {
 	b2ShapeCastInput localInput = *input;
 
@@ -661,19 +742,19 @@ b2CastOutput b2ShapeCastShape(const b2ShapeCastInput* input, const b2Shape* shap
 	switch (shape->type)
 	{
 		case b2_capsuleShape:
-			output = b2ShapeCastCapsule(&localInput, &shape->capsule);
+			output = b2ShapeCastCapsule(&localInput, b2GetShapeCapsule(world, shape));
 			break;
 		case b2_circleShape:
-			output = b2ShapeCastCircle(&localInput, &shape->circle);
+			output = b2ShapeCastCircle(&localInput, b2GetShapeCircle(world, shape));
 			break;
 		case b2_polygonShape:
-			output = b2ShapeCastPolygon(&localInput, &shape->polygon);
+			output = b2ShapeCastPolygon(&localInput, b2GetShapePolygon(world, shape));
 			break;
 		case b2_segmentShape:
-			output = b2ShapeCastSegment(&localInput, &shape->segment);
+			output = b2ShapeCastSegment(&localInput, b2GetShapeSegment(world, shape));
 			break;
 		case b2_smoothSegmentShape:
-			output = b2ShapeCastSegment(&localInput, &shape->smoothSegment.segment);
+			output = b2ShapeCastSegment(&localInput, &b2GetShapeSmoothSegment(world, shape)->segment);
 			break;
 		default:
 			return output;
@@ -684,15 +765,18 @@ b2CastOutput b2ShapeCastShape(const b2ShapeCastInput* input, const b2Shape* shap
 	return output;
 }
 
-void b2CreateShapeProxy(b2Shape* shape, b2BroadPhase* bp, b2ProxyType type, b2Transform transform, bool forcePairCreation)
+void b2CreateShapeProxy(b2World* world, b2Shape* shape, b2ProxyType type, b2Transform transform, bool forcePairCreation)
 {
 	B2_ASSERT(shape->proxyKey == B2_NULL_INDEX);
 
-	b2UpdateShapeAABBs(shape, transform, type);
+	b2UpdateShapeAABBs(world, shape, transform, type);
 
 	// Create proxies in the broad-phase.
-	shape->proxyKey = b2BroadPhase_CreateProxy(bp, type, shape->fatAABB, shape->filter.categoryBits, shape->id, forcePairCreation);
+	shape->proxyKey = b2BroadPhase_CreateProxy(&world->broadPhase, type, shape->fatAABB, shape->filter.categoryBits, shape->id,
+											   forcePairCreation);
 	B2_ASSERT(B2_PROXY_TYPE(shape->proxyKey) < b2_proxyTypeCount);
+
+	b2MarkSnapshotBody(world, shape->bodyId);
 }
 
 void b2DestroyShapeProxy(b2Shape* shape, b2BroadPhase* bp)
@@ -704,20 +788,29 @@ void b2DestroyShapeProxy(b2Shape* shape, b2BroadPhase* bp)
 	}
 }
 
-b2DistanceProxy b2MakeShapeDistanceProxy(const b2Shape* shape)
+b2DistanceProxy b2MakeShapeDistanceProxy(const b2World* world, const b2Shape* shape)
 {
 	switch (shape->type)
 	{
 		case b2_capsuleShape:
-			return b2MakeProxy(&shape->capsule.center1, 2, shape->capsule.radius);
+		{
+			const b2Capsule* capsule = b2GetShapeCapsule(world, shape);
+			return b2MakeProxy(&capsule->center1, 2, capsule->radius);
+		}
 		case b2_circleShape:
-			return b2MakeProxy(&shape->circle.center, 1, shape->circle.radius);
+		{
+			const b2Circle* circle = b2GetShapeCircle(world, shape);
+			return b2MakeProxy(&circle->center, 1, circle->radius);
+		}
 		case b2_polygonShape:
-			return b2MakeProxy(shape->polygon.vertices, shape->polygon.count, shape->polygon.radius);
+		{
+			const b2Polygon* polygon = b2GetShapePolygon(world, shape);
+			return b2MakeProxy(polygon->vertices, polygon->count, polygon->radius);
+		}
 		case b2_segmentShape:
-			return b2MakeProxy(&shape->segment.point1, 2, 0.0f);
+			return b2MakeProxy(&b2GetShapeSegment(world, shape)->point1, 2, 0.0f);
 		case b2_smoothSegmentShape:
-			return b2MakeProxy(&shape->smoothSegment.segment.point1, 2, 0.0f);
+			return b2MakeProxy(&b2GetShapeSmoothSegment(world, shape)->segment.point1, 2, 0.0f);
 		default:
 		{
 			B2_ASSERT(false);
@@ -766,13 +859,13 @@ bool b2Shape_TestPoint(b2ShapeId shapeId, b2Vec2 point)
 	switch (shape->type)
 	{
 		case b2_capsuleShape:
-			return b2PointInCapsule(localPoint, &shape->capsule);
+			return b2PointInCapsule(localPoint, b2GetShapeCapsule(world, shape));
 
 		case b2_circleShape:
-			return b2PointInCircle(localPoint, &shape->circle);
+			return b2PointInCircle(localPoint, b2GetShapeCircle(world, shape));
 
 		case b2_polygonShape:
-			return b2PointInPolygon(localPoint, &shape->polygon);
+			return b2PointInPolygon(localPoint, b2GetShapePolygon(world, shape));
 
 		default:
 			return false;
@@ -796,23 +889,23 @@ b2CastOutput b2Shape_RayCast(b2ShapeId shapeId, b2Vec2 origin, b2Vec2 translatio
 	switch (shape->type)
 	{
 		case b2_capsuleShape:
-			output = b2RayCastCapsule(&input, &shape->capsule);
+			output = b2RayCastCapsule(&input, b2GetShapeCapsule(world, shape));
 			break;
 
 		case b2_circleShape:
-			output = b2RayCastCircle(&input, &shape->circle);
+			output = b2RayCastCircle(&input, b2GetShapeCircle(world, shape));
 			break;
 
 		case b2_segmentShape:
-			output = b2RayCastSegment(&input, &shape->segment, false);
+			output = b2RayCastSegment(&input, b2GetShapeSegment(world, shape), false);
 			break;
 
 		case b2_polygonShape:
-			output = b2RayCastPolygon(&input, &shape->polygon);
+			output = b2RayCastPolygon(&input, b2GetShapePolygon(world, shape));
 			break;
 
 		case b2_smoothSegmentShape:
-			output = b2RayCastSegment(&input, &shape->smoothSegment.segment, true);
+			output = b2RayCastSegment(&input, &b2GetShapeSmoothSegment(world, shape)->segment, true);
 			break;
 
 		default:
@@ -934,13 +1027,13 @@ static void b2ResetProxy(b2World* world, b2Shape* shape, bool wakeBodies)
 	if (shape->proxyKey != B2_NULL_INDEX)
 	{
 		b2ProxyType proxyType = B2_PROXY_TYPE(shape->proxyKey);
-		b2UpdateShapeAABBs(shape, transform, proxyType);
+		b2UpdateShapeAABBs(world, shape, transform, proxyType);
 		b2BroadPhase_MoveProxy(&world->broadPhase, shape->proxyKey, shape->fatAABB);
 	}
 	else
 	{
 		b2ProxyType proxyType = body->type == b2_staticBody ? b2_staticProxy : b2_movableProxy;
-		b2UpdateShapeAABBs(shape, transform, proxyType);
+		b2UpdateShapeAABBs(world, shape, transform, proxyType);
 	}
 
 	b2ValidateSolverSets(world);
@@ -1051,7 +1144,7 @@ b2Circle b2Shape_GetCircle(b2ShapeId shapeId)
 	b2World* world = b2GetWorld(shapeId.world0);
 	b2Shape* shape = b2GetShape(world, shapeId);
 	B2_ASSERT(shape->type == b2_circleShape);
-	return shape->circle;
+	return *b2GetShapeCircle(world, shape);
 }
 
 b2Segment b2Shape_GetSegment(b2ShapeId shapeId)
@@ -1059,7 +1152,7 @@ b2Segment b2Shape_GetSegment(b2ShapeId shapeId)
 	b2World* world = b2GetWorld(shapeId.world0);
 	b2Shape* shape = b2GetShape(world, shapeId);
 	B2_ASSERT(shape->type == b2_segmentShape);
-	return shape->segment;
+	return *b2GetShapeSegment(world, shape);
 }
 
 b2SmoothSegment b2Shape_GetSmoothSegment(b2ShapeId shapeId)
@@ -1067,7 +1160,7 @@ b2SmoothSegment b2Shape_GetSmoothSegment(b2ShapeId shapeId)
 	b2World* world = b2GetWorld(shapeId.world0);
 	b2Shape* shape = b2GetShape(world, shapeId);
 	B2_ASSERT(shape->type == b2_smoothSegmentShape);
-	return shape->smoothSegment;
+	return *b2GetShapeSmoothSegment(world, shape);
 }
 
 b2Capsule b2Shape_GetCapsule(b2ShapeId shapeId)
@@ -1075,7 +1168,7 @@ b2Capsule b2Shape_GetCapsule(b2ShapeId shapeId)
 	b2World* world = b2GetWorld(shapeId.world0);
 	b2Shape* shape = b2GetShape(world, shapeId);
 	B2_ASSERT(shape->type == b2_capsuleShape);
-	return shape->capsule;
+	return *b2GetShapeCapsule(world, shape);
 }
 
 b2Polygon b2Shape_GetPolygon(b2ShapeId shapeId)
@@ -1083,7 +1176,7 @@ b2Polygon b2Shape_GetPolygon(b2ShapeId shapeId)
 	b2World* world = b2GetWorld(shapeId.world0);
 	b2Shape* shape = b2GetShape(world, shapeId);
 	B2_ASSERT(shape->type == b2_polygonShape);
-	return shape->polygon;
+	return *b2GetShapePolygon(world, shape);
 }
 
 void b2Shape_SetCircle(b2ShapeId shapeId, const b2Circle* circle)
@@ -1095,8 +1188,7 @@ void b2Shape_SetCircle(b2ShapeId shapeId, const b2Circle* circle)
 	}
 
 	b2Shape* shape = b2GetShape(world, shapeId);
-	shape->circle = *circle;
-	shape->type = b2_circleShape;
+	b2SetShapeGeometry(world, shape, b2_circleShape, circle);
 
 	// need to wake bodies so they can react to the shape change
 	bool wakeBodies = true;
@@ -1112,8 +1204,7 @@ void b2Shape_SetCapsule(b2ShapeId shapeId, const b2Capsule* capsule)
 	}
 
 	b2Shape* shape = b2GetShape(world, shapeId);
-	shape->capsule = *capsule;
-	shape->type = b2_capsuleShape;
+	b2SetShapeGeometry(world, shape, b2_capsuleShape, capsule);
 
 	// need to wake bodies so they can react to the shape change
 	bool wakeBodies = true;
@@ -1129,8 +1220,7 @@ void b2Shape_SetSegment(b2ShapeId shapeId, const b2Segment* segment)
 	}
 
 	b2Shape* shape = b2GetShape(world, shapeId);
-	shape->segment = *segment;
-	shape->type = b2_segmentShape;
+	b2SetShapeGeometry(world, shape, b2_segmentShape, segment);
 
 	// need to wake bodies so they can react to the shape change
 	bool wakeBodies = true;
@@ -1146,8 +1236,7 @@ void b2Shape_SetPolygon(b2ShapeId shapeId, const b2Polygon* polygon)
 	}
 
 	b2Shape* shape = b2GetShape(world, shapeId);
-	shape->polygon = *polygon;
-	shape->type = b2_polygonShape;
+	b2SetShapeGeometry(world, shape, b2_polygonShape, polygon);
 
 	// need to wake bodies so they can react to the shape change
 	bool wakeBodies = true;
@@ -1160,7 +1249,7 @@ b2ChainId b2Shape_GetParentChain(b2ShapeId shapeId)
 	b2Shape* shape = b2GetShape(world, shapeId);
 	if (shape->type == b2_smoothSegmentShape)
 	{
-		int chainId = shape->smoothSegment.chainId;
+		int chainId = b2GetShapeSmoothSegment(world, shape)->chainId;
 		if (chainId != B2_NULL_INDEX)
 		{
 			b2CheckId(world->chainArray, chainId);
@@ -1271,8 +1360,7 @@ int b2Shape_GetContactData(b2ShapeId shapeId, b2ContactData* contactData, int ca
 			contactData[index].shapeIdA = (b2ShapeId){shapeA->id + 1, shapeId.world0, shapeA->revision};
 			contactData[index].shapeIdB = (b2ShapeId){shapeB->id + 1, shapeId.world0, shapeB->revision};
 
-			b2ContactSim* contactSim = b2GetContactSim(world, contact);
-			contactData[index].manifold = contactSim->manifold;
+			contactData[index].manifold = b2GetContactManifold(world, contact);
 			index += 1;
 		}
 
@@ -1309,7 +1397,7 @@ b2Vec2 b2Shape_GetClosestPoint(b2ShapeId shapeId, b2Vec2 target)
 	b2Transform transform = b2GetBodyTransformQuick(world, body);
 
 	b2DistanceInput input;
-	input.proxyA = b2MakeShapeDistanceProxy(shape);
+	input.proxyA = b2MakeShapeDistanceProxy(world, shape);
 	input.proxyB = b2MakeProxy(&target, 1, 0.0f);
 	input.transformA = transform;
 	input.transformB = b2Transform_identity;
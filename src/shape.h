@@ -19,6 +19,10 @@ typedef struct b2Shape
 	int prevShapeId;
 	int nextShapeId;
 	b2ShapeType type;
+
+	// Index of the geometry in the pool for this shape type
+	int geometryIndex;
+
 	float density;
 	float friction;
 	float restitution;
@@ -31,15 +35,6 @@ typedef struct b2Shape
 	b2Filter filter;
 	void* userData;
 
-	union
-	{
-		b2Capsule capsule;
-		b2Circle circle;
-		b2Polygon polygon;
-		b2Segment segment;
-		b2SmoothSegment smoothSegment;
-	};
-
 	uint16_t revision;
 	bool isSensor;
 	bool enableSensorEvents;
@@ -66,18 +61,62 @@ typedef struct b2ShapeExtent
 	float maxExtent;
 } b2ShapeExtent;
 
-void b2CreateShapeProxy(b2Shape* shape, b2BroadPhase* bp, b2ProxyType type, b2Transform transform, bool forcePairCreation);
+void b2CreateGeometryPools(b2World* world);
+void b2DestroyGeometryPools(b2World* world);
+
+void b2CreateShapeProxy(b2World* world, b2Shape* shape, b2ProxyType type, b2Transform transform, bool forcePairCreation);
 void b2DestroyShapeProxy(b2Shape* shape, b2BroadPhase* bp);
 
-b2MassData b2ComputeShapeMass(const b2Shape* shape);
-b2ShapeExtent b2ComputeShapeExtent(const b2Shape* shape, b2Vec2 localCenter);
-b2AABB b2ComputeShapeAABB(const b2Shape* shape, b2Transform transform);
-b2Vec2 b2GetShapeCentroid(const b2Shape* shape);
-float b2GetShapePerimeter(const b2Shape* shape);
+b2MassData b2ComputeShapeMass(const b2World* world, const b2Shape* shape);
+b2ShapeExtent b2ComputeShapeExtent(const b2World* world, const b2Shape* shape, b2Vec2 localCenter);
+b2AABB b2ComputeShapeAABB(const b2World* world, const b2Shape* shape, b2Transform transform);
+b2Vec2 b2GetShapeCentroid(const b2World* world, const b2Shape* shape);
+float b2GetShapePerimeter(const b2World* world, const b2Shape* shape);
 
-b2DistanceProxy b2MakeShapeDistanceProxy(const b2Shape* shape);
+b2DistanceProxy b2MakeShapeDistanceProxy(const b2World* world, const b2Shape* shape);
 
-b2CastOutput b2RayCastShape(const b2RayCastInput* input, const b2Shape* shape, b2Transform transform);
-b2CastOutput b2ShapeCastShape(const b2ShapeCastInput* input, const b2Shape* shape, b2Transform transform);
+b2CastOutput b2RayCastShape(const b2World* world, const b2RayCastInput* input, const b2Shape* shape, b2Transform transform);
+b2CastOutput b2ShapeCastShape(const b2World* world, const b2ShapeCastInput* input, const b2Shape* shape,
+							  b2Transform transform);
 
 b2Transform b2GetOwnerTransform(b2World* world, b2Shape* shape);
+
+static inline const b2Capsule* b2GetShapeCapsule(const b2World* world, const b2Shape* shape)
+{
+	B2_ASSERT(shape->type == b2_capsuleShape);
+	const b2GeometryPool* pool = world->geometryPools + b2_capsuleShape;
+	B2_ASSERT(0 <= shape->geometryIndex && shape->geometryIndex < b2Array(pool->data).count);
+	return (const b2Capsule*)pool->data + shape->geometryIndex;
+}
+
+static inline const b2Circle* b2GetShapeCircle(const b2World* world, const b2Shape* shape)
+{
+	B2_ASSERT(shape->type == b2_circleShape);
+	const b2GeometryPool* pool = world->geometryPools + b2_circleShape;
+	B2_ASSERT(0 <= shape->geometryIndex && shape->geometryIndex < b2Array(pool->data).count);
+	return (const b2Circle*)pool->data + shape->geometryIndex;
+}
+
+static inline const b2Polygon* b2GetShapePolygon(const b2World* world, const b2Shape* shape)
+{
+	B2_ASSERT(shape->type == b2_polygonShape);
+	const b2GeometryPool* pool = world->geometryPools + b2_polygonShape;
+	B2_ASSERT(0 <= shape->geometryIndex && shape->geometryIndex < b2Array(pool->data).count);
+	return (const b2Polygon*)pool->data + shape->geometryIndex;
+}
+
+static inline const b2Segment* b2GetShapeSegment(const b2World* world, const b2Shape* shape)
+{
+	B2_ASSERT(shape->type == b2_segmentShape);
+	const b2GeometryPool* pool = world->geometryPools + b2_segmentShape;
+	B2_ASSERT(0 <= shape->geometryIndex && shape->geometryIndex < b2Array(pool->data).count);
+	return (const b2Segment*)pool->data + shape->geometryIndex;
+}
+
+static inline const b2SmoothSegment* b2GetShapeSmoothSegment(const b2World* world, const b2Shape* shape)
+{
+	B2_ASSERT(shape->type == b2_smoothSegmentShape);
+	const b2GeometryPool* pool = world->geometryPools + b2_smoothSegmentShape;
+	B2_ASSERT(0 <= shape->geometryIndex && shape->geometryIndex < b2Array(pool->data).count);
+	return (const b2SmoothSegment*)pool->data + shape->geometryIndex;
+}
@@ -27,11 +27,16 @@
 #include <limits.h>
 #include <stdatomic.h>
 #include <stdbool.h>
+#include <string.h>
+
+_Static_assert(sizeof(b2SolverBlock) == b2_cacheLineSize, "solver block must fill a cache line");
+_Static_assert(sizeof(b2SolverStage) == b2_cacheLineSize, "solver stage must fill a cache line");
 
 typedef struct b2WorkerContext
 {
 	b2StepContext* context;
 	int workerIndex;
+	int stealCount;
 	void* userTask;
 } b2WorkerContext;
 
@@ -173,6 +178,7 @@ static void b2FinalizeBodiesTask(int startIndex, int endIndex, uint32_t threadIn
 
 	b2StepContext* stepContext = context;
 	b2World* world = stepContext->world;
+	b2TraceScope traceScope = b2EnterTraceScope(world->worldId, (int)threadIndex);
 	bool enableSleep = world->enableSleep;
 	b2BodyState* states = stepContext->states;
 	b2BodySim* sims = stepContext->sims;
@@ -185,9 +191,9 @@ static void b2FinalizeBodiesTask(int startIndex, int endIndex, uint32_t threadIn
 
 	b2Island* islands = world->islandArray;
 
-	b2BitSet* enlargedSimBitSet = &world->taskContextArray[threadIndex].enlargedSimBitSet;
-	b2BitSet* awakeIslandBitSet = &world->taskContextArray[threadIndex].awakeIslandBitSet;
 	b2TaskContext* taskContext = world->taskContextArray + threadIndex;
+	b2BitSet* awakeIslandBitSet = &taskContext->awakeIslandBitSet;
+	b2BitSet* splitIslandBitSet = &taskContext->splitIslandBitSet;
 
 	bool enableContinuous = world->enableContinuous;
 
@@ -256,13 +262,11 @@ static void b2FinalizeBodiesTask(int startIndex, int endIndex, uint32_t threadIn
 				// This is deterministic because the order of TOI sweeps doesn't matter
 				if (sim->isBullet)
 				{
-					int bulletIndex = atomic_fetch_add(&stepContext->bulletBodyCount, 1);
-					stepContext->bulletBodies[bulletIndex] = simIndex;
+					b2ArenaIntArray_Push(&taskContext->arena, &taskContext->bulletBodies, simIndex);
 				}
 				else
 				{
-					int fastIndex = atomic_fetch_add(&stepContext->fastBodyCount, 1);
-					stepContext->fastBodies[fastIndex] = simIndex;
+					b2ArenaIntArray_Push(&taskContext->arena, &taskContext->fastBodies, simIndex);
 				}
 
 				sim->isFast = true;
@@ -294,17 +298,13 @@ static void b2FinalizeBodiesTask(int startIndex, int endIndex, uint32_t threadIn
 		else if (island->constraintRemoveCount > 0)
 		{
 			// body wants to sleep but its island needs splitting first
-			if (body->sleepTime > taskContext->splitSleepTime)
-			{
-				// pick the sleepiest candidate
-				taskContext->splitIslandId = body->islandId;
-				taskContext->splitSleepTime = body->sleepTime;
-			}
+			b2SetBit(splitIslandBitSet, island->localIndex);
 		}
 
 		// Update shapes AABBs
 		b2Transform transform = sim->transform;
 		bool isFast = sim->isFast;
+		bool isEnlarged = false;
 		int shapeId = body->headShapeId;
 		while (shapeId != B2_NULL_INDEX)
 		{
@@ -318,12 +318,11 @@ static void b2FinalizeBodiesTask(int startIndex, int endIndex, uint32_t threadIn
 				// Add to moved shapes regardless of AABB changes.
 				shape->isFast = true;
 
-				// Bit-set to keep the move array sorted
-				b2SetBit(enlargedSimBitSet, simIndex);
+				isEnlarged = true;
 			}
 			else
 			{
-				b2AABB aabb = b2ComputeShapeAABB(shape, transform);
+				b2AABB aabb = b2ComputeShapeAABB(world, shape, transform);
 				aabb.lowerBound.x -= speculativeDistance;
 				aabb.lowerBound.y -= speculativeDistance;
 				aabb.upperBound.x += speculativeDistance;
@@ -343,16 +342,23 @@ static void b2FinalizeBodiesTask(int startIndex, int endIndex, uint32_t threadIn
 
 					shape->enlargedAABB = true;
 
-					// Bit-set to keep the move array sorted
-					b2SetBit(enlargedSimBitSet, simIndex);
+					isEnlarged = true;
 				}
 			}
 
 			shapeId = shape->nextShapeId;
 		}
+
+		if (isEnlarged)
+		{
+			// Sorted later to keep the move array deterministic
+			b2ArenaIntArray_Push(&taskContext->arena, &taskContext->enlargedSims, simIndex);
+		}
 	}
 
 	b2TracyCZoneEnd(finalize_bodies);
+
+	b2LeaveTraceScope(traceScope);
 }
 
 /*
@@ -465,9 +471,24 @@ static inline int GetWorkerStartIndex(int workerIndex, int blockCount, int worke
 	return blocksPerWorker * workerIndex + b2MinInt(remainder, workerIndex);
 }
 
-static void b2ExecuteStage(b2SolverStage* stage, b2StepContext* context, int previousSyncIndex, int syncIndex, int workerIndex)
+// One past the last block owned by a worker. Only valid if the worker owns blocks.
+static inline int GetWorkerEndIndex(int workerIndex, int blockCount, int workerCount)
+{
+	if (blockCount <= workerCount)
+	{
+		return workerIndex + 1;
+	}
+
+	return GetWorkerStartIndex(workerIndex + 1, blockCount, workerCount);
+}
+
+// Each worker owns a contiguous range of blocks. This walks forward through the owned range and then
+// keeps going into the ranges of other workers, wrapping around, then searches backwards from the start.
+// Returns the number of blocks executed outside the owned range.
+static int b2ExecuteStage(b2SolverStage* stage, b2StepContext* context, int previousSyncIndex, int syncIndex, int workerIndex)
 {
 	int completedCount = 0;
+	int stealCount = 0;
 	b2SolverBlock* blocks = stage->blocks;
 	int blockCount = stage->blockCount;
 
@@ -476,11 +497,12 @@ static void b2ExecuteStage(b2SolverStage* stage, b2StepContext* context, int pre
 	int startIndex = GetWorkerStartIndex(workerIndex, blockCount, context->workerCount);
 	if (startIndex == B2_NULL_INDEX)
 	{
-		return;
+		return 0;
 	}
 
 	B2_ASSERT(0 <= startIndex && startIndex < blockCount);
 
+	int endIndex = GetWorkerEndIndex(workerIndex, blockCount, context->workerCount);
 	int blockIndex = startIndex;
 
 	// Caution: this can change expectedSyncIndex
@@ -493,6 +515,7 @@ static void b2ExecuteStage(b2SolverStage* stage, b2StepContext* context, int pre
 		b2ExecuteBlock(stage, context, blocks + blockIndex);
 
 		completedCount += 1;
+		stealCount += (blockIndex < startIndex || endIndex <= blockIndex) ? 1 : 0;
 		blockIndex += 1;
 		if (blockIndex >= blockCount)
 		{
@@ -522,20 +545,104 @@ static void b2ExecuteStage(b2SolverStage* stage, b2StepContext* context, int pre
 
 		b2ExecuteBlock(stage, context, blocks + blockIndex);
 		completedCount += 1;
+		stealCount += 1;
 		blockIndex -= 1;
 	}
 
 	(void)atomic_fetch_add(&stage->completionCount, completedCount);
+	return stealCount;
 }
 
-static void b2ExecuteMainStage(b2SolverStage* stage, b2StepContext* context, uint32_t syncBits)
+// Affinity mode. Each worker claims its owned range front to back so the same worker touches the same blocks
+// in every stage that shares the blocks, across all sub-steps. A worker that runs out of work steals from the back of
+// the other ranges, so it only meets the owner when the work is imbalanced.
+// Returns the number of blocks executed outside the owned range.
+static int b2ExecuteAffineStage(b2SolverStage* stage, b2StepContext* context, int previousSyncIndex, int syncIndex,
+								int workerIndex)
+{
+	b2SolverBlock* blocks = stage->blocks;
+	int blockCount = stage->blockCount;
+	int workerCount = context->workerCount;
+
+	int startIndex = GetWorkerStartIndex(workerIndex, blockCount, workerCount);
+	if (startIndex == B2_NULL_INDEX)
+	{
+		return 0;
+	}
+
+	int completedCount = 0;
+	int stealCount = 0;
+	int endIndex = GetWorkerEndIndex(workerIndex, blockCount, workerCount);
+
+	// Owned blocks. Once a claim fails a thief has taken the rest of the range.
+	for (int blockIndex = startIndex; blockIndex < endIndex; ++blockIndex)
+	{
+		int expectedSyncIndex = previousSyncIndex;
+		if (atomic_compare_exchange_strong(&blocks[blockIndex].syncIndex, &expectedSyncIndex, syncIndex) == false)
+		{
+			break;
+		}
+
+		b2ExecuteBlock(stage, context, blocks + blockIndex);
+		completedCount += 1;
+	}
+
+	// Steal from the back of the other ranges. Claimed blocks are skipped because other thieves may be working on
+	// the same range. A thief only claims a block after every block behind it is claimed, so the owner can stop at the
+	// first failed claim.
+	int ownerCount = b2MinInt(workerCount, blockCount);
+	for (int i = 1; i < ownerCount; ++i)
+	{
+		int victimIndex = workerIndex + i;
+		victimIndex = victimIndex < ownerCount ? victimIndex : victimIndex - ownerCount;
+
+		int victimStart = GetWorkerStartIndex(victimIndex, blockCount, workerCount);
+		int victimEnd = GetWorkerEndIndex(victimIndex, blockCount, workerCount);
+		for (int blockIndex = victimEnd - 1; blockIndex >= victimStart; --blockIndex)
+		{
+			// read before claiming to avoid taking ownership of the cache line
+			if (atomic_load_explicit(&blocks[blockIndex].syncIndex, memory_order_relaxed) != previousSyncIndex)
+			{
+				continue;
+			}
+
+			int expectedSyncIndex = previousSyncIndex;
+			if (atomic_compare_exchange_strong(&blocks[blockIndex].syncIndex, &expectedSyncIndex, syncIndex) == false)
+			{
+				continue;
+			}
+
+			b2ExecuteBlock(stage, context, blocks + blockIndex);
+			completedCount += 1;
+			stealCount += 1;
+		}
+	}
+
+	(void)atomic_fetch_add(&stage->completionCount, completedCount);
+	return stealCount;
+}
+
+static int b2ExecuteWorkerStage(b2SolverStage* stage, b2StepContext* context, int previousSyncIndex, int syncIndex,
+								int workerIndex)
+{
+	if (context->enableWorkerAffinity)
+	{
+		return b2ExecuteAffineStage(stage, context, previousSyncIndex, syncIndex, workerIndex);
+	}
+
+	return b2ExecuteStage(stage, context, previousSyncIndex, syncIndex, workerIndex);
+}
+
+// Returns the number of blocks the main thread stole from other workers
+static int b2ExecuteMainStage(b2SolverStage* stage, b2StepContext* context, uint32_t syncBits)
 {
 	int blockCount = stage->blockCount;
 	if (blockCount == 0)
 	{
-		return;
+		return 0;
 	}
 
+	int stealCount = 0;
 	if (blockCount == 1)
 	{
 		b2ExecuteBlock(stage, context, stage->blocks);
@@ -548,7 +655,7 @@ static void b2ExecuteMainStage(b2SolverStage* stage, b2StepContext* context, uin
 		B2_ASSERT(syncIndex > 0);
 		int previousSyncIndex = syncIndex - 1;
 
-		b2ExecuteStage(stage, context, previousSyncIndex, syncIndex, 0);
+		stealCount = b2ExecuteWorkerStage(stage, context, previousSyncIndex, syncIndex, 0);
 
 		// todo consider using the cycle counter as well
 		while (atomic_load(&stage->completionCount) != blockCount)
@@ -558,6 +665,8 @@ static void b2ExecuteMainStage(b2SolverStage* stage, b2StepContext* context, uin
 
 		atomic_store(&stage->completionCount, 0);
 	}
+
+	return stealCount;
 }
 
 // This should not use the thread index because thread 0 can be called twice by enkiTS.
@@ -570,10 +679,14 @@ void b2SolverTask(int startIndex, int endIndex, uint32_t threadIndexDontUse, voi
 	b2WorkerContext* workerContext = taskContext;
 	int workerIndex = workerContext->workerIndex;
 	b2StepContext* context = workerContext->context;
+	b2TraceScope traceScope = b2EnterTraceScope(context->world->worldId, workerIndex);
 	int activeColorCount = context->activeColorCount;
 	b2SolverStage* stages = context->stages;
 	b2Profile* profile = &context->world->profile;
 
+	// Blocks executed outside this worker's own range
+	int stealCount = 0;
+
 	if (workerIndex == 0)
 	{
 		// Main thread synchronizes the workers and does work itself.
@@ -605,7 +718,7 @@ void b2SolverTask(int startIndex, int endIndex, uint32_t threadIndexDontUse, voi
 		uint32_t jointSyncIndex = 1;
 		uint32_t syncBits = (jointSyncIndex << 16) | stageIndex;
 		B2_ASSERT(stages[stageIndex].type == b2_stagePrepareJoints);
-		b2ExecuteMainStage(stages + stageIndex, context, syncBits);
+		stealCount += b2ExecuteMainStage(stages + stageIndex, context, syncBits);
 		stageIndex += 1;
 		jointSyncIndex += 1;
 
@@ -613,7 +726,7 @@ void b2SolverTask(int startIndex, int endIndex, uint32_t threadIndexDontUse, voi
 		uint32_t contactSyncIndex = 1;
 		syncBits = (contactSyncIndex << 16) | stageIndex;
 		B2_ASSERT(stages[stageIndex].type == b2_stagePrepareContacts);
-		b2ExecuteMainStage(stages + stageIndex, context, syncBits);
+		stealCount += b2ExecuteMainStage(stages + stageIndex, context, syncBits);
 		stageIndex += 1;
 		contactSyncIndex += 1;
 
@@ -635,7 +748,7 @@ void b2SolverTask(int startIndex, int endIndex, uint32_t threadIndexDontUse, voi
 			// integrate velocities
 			syncBits = (bodySyncIndex << 16) | iterStageIndex;
 			B2_ASSERT(stages[iterStageIndex].type == b2_stageIntegrateVelocities);
-			b2ExecuteMainStage(stages + iterStageIndex, context, syncBits);
+			stealCount += b2ExecuteMainStage(stages + iterStageIndex, context, syncBits);
 			iterStageIndex += 1;
 			bodySyncIndex += 1;
 
@@ -649,7 +762,7 @@ void b2SolverTask(int startIndex, int endIndex, uint32_t threadIndexDontUse, voi
 			{
 				syncBits = (graphSyncIndex << 16) | iterStageIndex;
 				B2_ASSERT(stages[iterStageIndex].type == b2_stageWarmStart);
-				b2ExecuteMainStage(stages + iterStageIndex, context, syncBits);
+				stealCount += b2ExecuteMainStage(stages + iterStageIndex, context, syncBits);
 				iterStageIndex += 1;
 			}
 			graphSyncIndex += 1;
@@ -665,7 +778,7 @@ void b2SolverTask(int startIndex, int endIndex, uint32_t threadIndexDontUse, voi
 			{
 				syncBits = (graphSyncIndex << 16) | iterStageIndex;
 				B2_ASSERT(stages[iterStageIndex].type == b2_stageSolve);
-				b2ExecuteMainStage(stages + iterStageIndex, context, syncBits);
+				stealCount += b2ExecuteMainStage(stages + iterStageIndex, context, syncBits);
 				iterStageIndex += 1;
 			}
 			graphSyncIndex += 1;
@@ -675,7 +788,7 @@ void b2SolverTask(int startIndex, int endIndex, uint32_t threadIndexDontUse, voi
 			// integrate positions
 			B2_ASSERT(stages[iterStageIndex].type == b2_stageIntegratePositions);
 			syncBits = (bodySyncIndex << 16) | iterStageIndex;
-			b2ExecuteMainStage(stages + iterStageIndex, context, syncBits);
+			stealCount += b2ExecuteMainStage(stages + iterStageIndex, context, syncBits);
 			iterStageIndex += 1;
 			bodySyncIndex += 1;
 
@@ -690,7 +803,7 @@ void b2SolverTask(int startIndex, int endIndex, uint32_t threadIndexDontUse, voi
 			{
 				syncBits = (graphSyncIndex << 16) | iterStageIndex;
 				B2_ASSERT(stages[iterStageIndex].type == b2_stageRelax);
-				b2ExecuteMainStage(stages + iterStageIndex, context, syncBits);
+				stealCount += b2ExecuteMainStage(stages + iterStageIndex, context, syncBits);
 				iterStageIndex += 1;
 			}
 			graphSyncIndex += 1;
@@ -711,7 +824,7 @@ void b2SolverTask(int startIndex, int endIndex, uint32_t threadIndexDontUse, voi
 			{
 				syncBits = (graphSyncIndex << 16) | iterStageIndex;
 				B2_ASSERT(stages[iterStageIndex].type == b2_stageRestitution);
-				b2ExecuteMainStage(stages + iterStageIndex, context, syncBits);
+				stealCount += b2ExecuteMainStage(stages + iterStageIndex, context, syncBits);
 				iterStageIndex += 1;
 			}
 			// graphSyncIndex += 1;
@@ -724,7 +837,7 @@ void b2SolverTask(int startIndex, int endIndex, uint32_t threadIndexDontUse, voi
 
 		syncBits = (contactSyncIndex << 16) | stageIndex;
 		B2_ASSERT(stages[stageIndex].type == b2_stageStoreImpulses);
-		b2ExecuteMainStage(stages + stageIndex, context, syncBits);
+		stealCount += b2ExecuteMainStage(stages + stageIndex, context, syncBits);
 
 		profile->storeImpulses += b2GetMillisecondsAndReset(&timer);
 
@@ -732,6 +845,8 @@ void b2SolverTask(int startIndex, int endIndex, uint32_t threadIndexDontUse, voi
 		atomic_store(&context->atomicSyncBits, UINT_MAX);
 
 		B2_ASSERT(stageIndex + 1 == context->stageCount);
+		workerContext->stealCount = stealCount;
+		b2LeaveTraceScope(traceScope);
 		return;
 	}
 
@@ -783,10 +898,154 @@ void b2SolverTask(int startIndex, int endIndex, uint32_t threadIndexDontUse, voi
 		int previousSyncIndex = syncIndex - 1;
 
 		b2SolverStage* stage = stages + stageIndex;
-		b2ExecuteStage(stage, context, previousSyncIndex, syncIndex, workerIndex);
+		stealCount += b2ExecuteWorkerStage(stage, context, previousSyncIndex, syncIndex, workerIndex);
 
 		lastSyncBits = syncBits;
 	}
+
+	workerContext->stealCount = stealCount;
+
+	b2LeaveTraceScope(traceScope);
+}
+
+// Fused single-threaded version of b2SolverTask used when there is too little work for the stages to pay off.
+// The stages run in the same order as b2SolverTask with one worker, so the results are identical.
+static void b2SolveSerial(b2StepContext* context, int simdContactCount, int awakeJointCount)
+{
+	b2World* world = context->world;
+	b2GraphColor* colors = context->graph->colors;
+	b2Profile* profile = &world->profile;
+	int awakeBodyCount = world->solverSetArray[b2_awakeSet].sims.count;
+	bool enableWarmStarting = world->enableWarmStarting;
+
+	int activeColorIndices[b2_graphColorCount];
+	int colorContactCountsSIMD[b2_graphColorCount];
+	int colorJointCounts[b2_graphColorCount];
+	int activeColorCount = 0;
+	for (int i = 0; i < b2_overflowIndex; ++i)
+	{
+		int colorContactCount = colors[i].contacts.count;
+		int colorJointCount = colors[i].joints.count;
+		if (colorContactCount + colorJointCount > 0)
+		{
+			activeColorIndices[activeColorCount] = i;
+			colorContactCountsSIMD[activeColorCount] = colorContactCount > 0 ? ((colorContactCount - 1) >> 3) + 1 : 0;
+			colorJointCounts[activeColorCount] = colorJointCount;
+			activeColorCount += 1;
+		}
+	}
+	B2_ASSERT(activeColorCount == context->activeColorCount);
+
+	b2Timer timer = b2CreateTimer();
+
+	// The tasks expect non-empty ranges
+	if (awakeJointCount > 0)
+	{
+		b2PrepareJointsTask(0, awakeJointCount, context);
+	}
+
+	if (simdContactCount > 0)
+	{
+		b2PrepareContactsTask(0, simdContactCount, context);
+	}
+	b2PrepareOverflowJoints(context);
+	b2PrepareOverflowContacts(context);
+
+	profile->prepareConstraints += b2GetMillisecondsAndReset(&timer);
+
+	int subStepCount = context->subStepCount;
+	for (int i = 0; i < subStepCount; ++i)
+	{
+		b2IntegrateVelocitiesTask(0, awakeBodyCount, context);
+
+		profile->integrateVelocities += b2GetMillisecondsAndReset(&timer);
+
+		b2WarmStartOverflowJoints(context);
+		b2WarmStartOverflowContacts(context);
+
+		if (enableWarmStarting)
+		{
+			for (int c = 0; c < activeColorCount; ++c)
+			{
+				int colorIndex = activeColorIndices[c];
+				if (colorJointCounts[c] > 0)
+				{
+					b2WarmStartJointsTask(0, colorJointCounts[c], context, colorIndex);
+				}
+
+				if (colorContactCountsSIMD[c] > 0)
+				{
+					b2WarmStartContactsTask(0, colorContactCountsSIMD[c], context, colorIndex);
+				}
+			}
+		}
+
+		profile->warmStart += b2GetMillisecondsAndReset(&timer);
+
+		bool useBias = true;
+		b2SolveOverflowJoints(context, useBias);
+		b2SolveOverflowContacts(context, useBias);
+
+		for (int c = 0; c < activeColorCount; ++c)
+		{
+			int colorIndex = activeColorIndices[c];
+			if (colorJointCounts[c] > 0)
+			{
+				b2SolveJointsTask(0, colorJointCounts[c], context, colorIndex, useBias);
+			}
+
+			if (colorContactCountsSIMD[c] > 0)
+			{
+				b2SolveContactsTask(0, colorContactCountsSIMD[c], context, colorIndex, useBias);
+			}
+		}
+
+		profile->solveVelocities += b2GetMillisecondsAndReset(&timer);
+
+		b2IntegratePositionsTask(0, awakeBodyCount, context);
+
+		profile->integratePositions += b2GetMillisecondsAndReset(&timer);
+
+		useBias = false;
+		b2SolveOverflowJoints(context, useBias);
+		b2SolveOverflowContacts(context, useBias);
+
+		for (int c = 0; c < activeColorCount; ++c)
+		{
+			int colorIndex = activeColorIndices[c];
+			if (colorJointCounts[c] > 0)
+			{
+				b2SolveJointsTask(0, colorJointCounts[c], context, colorIndex, useBias);
+			}
+
+			if (colorContactCountsSIMD[c] > 0)
+			{
+				b2SolveContactsTask(0, colorContactCountsSIMD[c], context, colorIndex, useBias);
+			}
+		}
+
+		profile->relaxVelocities += b2GetMillisecondsAndReset(&timer);
+	}
+
+	b2ApplyOverflowRestitution(context);
+
+	for (int c = 0; c < activeColorCount; ++c)
+	{
+		if (colorContactCountsSIMD[c] > 0)
+		{
+			b2ApplyRestitutionTask(0, colorContactCountsSIMD[c], context, activeColorIndices[c]);
+		}
+	}
+
+	profile->applyRestitution += b2GetMillisecondsAndReset(&timer);
+
+	b2StoreOverflowImpulses(context);
+	if (simdContactCount > 0)
+	{
+		b2StoreImpulsesTask(0, simdContactCount, context);
+	}
+
+	profile->storeImpulses += b2GetMillisecondsAndReset(&timer);
 }
 
 struct b2ContinuousContext
@@ -856,8 +1115,9 @@ static bool b2ContinuousQueryCallback(int proxyId, int shapeId, void* context)
 	if (shape->type == b2_smoothSegmentShape)
 	{
 		b2Transform transform = bodySim->transform;
-		b2Vec2 p1 = b2TransformPoint(transform, shape->smoothSegment.segment.point1);
-		b2Vec2 p2 = b2TransformPoint(transform, shape->smoothSegment.segment.point2);
+		const b2Segment* segment = &b2GetShapeSmoothSegment(world, shape)->segment;
+		b2Vec2 p1 = b2TransformPoint(transform, segment->point1);
+		b2Vec2 p2 = b2TransformPoint(transform, segment->point2);
 		b2Vec2 e = b2Sub(p2, p1);
 		b2Vec2 c1 = continuousContext->centroid1;
 		b2Vec2 c2 = continuousContext->centroid2;
@@ -872,8 +1132,8 @@ static bool b2ContinuousQueryCallback(int proxyId, int shapeId, void* context)
 	}
 
 	b2TOIInput input;
-	input.proxyA = b2MakeShapeDistanceProxy(shape);
-	input.proxyB = b2MakeShapeDistanceProxy(fastShape);
+	input.proxyA = b2MakeShapeDistanceProxy(world, shape);
+	input.proxyB = b2MakeShapeDistanceProxy(world, fastShape);
 	input.sweepA = b2MakeSweep(bodySim);
 	input.sweepB = continuousContext->sweep;
 	input.tMax = continuousContext->fraction;
@@ -886,7 +1146,7 @@ static bool b2ContinuousQueryCallback(int proxyId, int shapeId, void* context)
 	else if (0.0f == output.t)
 	{
 		// fallback to TOI of a small circle around the fast shape centroid
-		b2Vec2 centroid = b2GetShapeCentroid(fastShape);
+		b2Vec2 centroid = b2GetShapeCentroid(world, fastShape);
 		input.proxyB = b2MakeProxy(&centroid, 1, b2_speculativeDistance);
 		output = b2TimeOfImpact(&input);
 		if (0.0f < output.t && output.t < continuousContext->fraction)
@@ -947,7 +1207,7 @@ static void b2SolveContinuous(b2World* world, int bodySimIndex)
 		context.centroid2 = b2TransformPoint(xf2, fastShape->localCentroid);
 
 		b2AABB box1 = fastShape->aabb;
-		b2AABB box2 = b2ComputeShapeAABB(fastShape, xf2);
+		b2AABB box2 = b2ComputeShapeAABB(world, fastShape, xf2);
 		b2AABB box = b2AABB_Union(box1, box2);
 
 		// Store this for later
@@ -987,7 +1247,7 @@ static void b2SolveContinuous(b2World* world, int bodySimIndex)
 			b2Shape* shape = shapes + shapeId;
 
 			// Must recompute aabb at the interpolated transform
-			b2AABB aabb = b2ComputeShapeAABB(shape, transform);
+			b2AABB aabb = b2ComputeShapeAABB(world, shape, transform);
 			aabb.lowerBound.x -= speculativeDistance;
 			aabb.lowerBound.y -= speculativeDistance;
 			aabb.upperBound.x += speculativeDistance;
@@ -1046,11 +1306,10 @@ static void b2SolveContinuous(b2World* world, int bodySimIndex)
 
 static void b2FastBodyTask(int startIndex, int endIndex, uint32_t threadIndex, void* taskContext)
 {
-	B2_MAYBE_UNUSED(threadIndex);
-
 	b2TracyCZoneNC(fast_body_task, "Fast Body Task", b2_colorAqua, true);
 
 	b2StepContext* stepContext = taskContext;
+	b2TraceScope traceScope = b2EnterTraceScope(stepContext->world->worldId, (int)threadIndex);
 
 	B2_ASSERT(startIndex <= endIndex);
 
@@ -1061,15 +1320,16 @@ static void b2FastBodyTask(int startIndex, int endIndex, uint32_t threadIndex, v
 	}
 
 	b2TracyCZoneEnd(fast_body_task);
+
+	b2LeaveTraceScope(traceScope);
 }
 
 static void b2BulletBodyTask(int startIndex, int endIndex, uint32_t threadIndex, void* taskContext)
 {
-	B2_MAYBE_UNUSED(threadIndex);
-
 	b2TracyCZoneNC(bullet_body_task, "Bullet Body Task", b2_colorLightSkyBlue, true);
 
 	b2StepContext* stepContext = taskContext;
+	b2TraceScope traceScope = b2EnterTraceScope(stepContext->world->worldId, (int)threadIndex);
 
 	B2_ASSERT(startIndex <= endIndex);
 
@@ -1080,6 +1340,511 @@ static void b2BulletBodyTask(int startIndex, int endIndex, uint32_t threadIndex,
 	}
 
 	b2TracyCZoneEnd(bullet_body_task);
+
+	b2LeaveTraceScope(traceScope);
+}
+
+// Report hit events
+// todo perhaps optimize this with a bitset
+static void b2HitEventsTask(int startIndex, int endIndex, uint32_t threadIndex, void* context)
+{
+	B2_MAYBE_UNUSED(startIndex);
+	B2_MAYBE_UNUSED(endIndex);
+	b2TracyCZoneNC(hit_events, "Hit Events", b2_colorRosyBrown, true);
+
+	b2Timer timer = b2CreateTimer();
+	b2World* world = context;
+	b2TraceScope traceScope = b2EnterTraceScope(world->worldId, (int)threadIndex);
+
+	b2ContactHitEvent* events = world->contactHitArray;
+	B2_ASSERT(b2Array(events).count == 0);
+
+	float threshold = world->hitEventThreshold;
+	b2GraphColor* colors = world->constraintGraph.colors;
+	for (int i = 0; i < b2_graphColorCount; ++i)
+	{
+		b2GraphColor* color = colors + i;
+		int contactCount = color->contacts.count;
+		b2ContactSim* contactSims = color->contacts.data;
+		for (int j = 0; j < contactCount; ++j)
+		{
+			b2ContactSim* contactSim = contactSims + j;
+			if ((contactSim->simFlags & b2_simEnableHitEvent) == 0)
+			{
+				continue;
+			}
+
+			b2ContactHitEvent event = {0};
+			event.approachSpeed = threshold;
+
+			bool hit = false;
+			int pointCount = contactSim->manifold.pointCount;
+			for (int k = 0; k < pointCount; ++k)
+			{
+				b2ManifoldPoint* mp = contactSim->manifold.points + k;
+				float approachSpeed = -mp->normalVelocity;
+				if (approachSpeed > event.approachSpeed && mp->normalImpulse > 0.0f)
+				{
+					event.approachSpeed = approachSpeed;
+					event.point = mp->point;
+					hit = true;
+				}
+			}
+
+			if (hit == true)
+			{
+				event.normal = contactSim->manifold.normal;
+
+				b2CheckId(world->shapeArray, contactSim->shapeIdA);
+				b2CheckId(world->shapeArray, contactSim->shapeIdB);
+				b2Shape* shapeA = world->shapeArray + contactSim->shapeIdA;
+				b2Shape* shapeB = world->shapeArray + contactSim->shapeIdB;
+
+				event.shapeIdA = (b2ShapeId){shapeA->id + 1, world->worldId, shapeA->revision};
+				event.shapeIdB = (b2ShapeId){shapeB->id + 1, world->worldId, shapeB->revision};
+
+				b2Array_Push(events, event);
+			}
+		}
+	}
+
+	// The array may have been reallocated
+	world->contactHitArray = events;
+
+	world->profile.hitEvents = b2GetMilliseconds(&timer);
+
+	b2TracyCZoneEnd(hit_events);
+
+	b2LeaveTraceScope(traceScope);
+}
+
+// Gather the per-worker results of body finalization that island sleep needs
+static void b2PrepareSleepTask(int startIndex, int endIndex, uint32_t threadIndex, void* context)
+{
+	B2_MAYBE_UNUSED(startIndex);
+	B2_MAYBE_UNUSED(endIndex);
+	b2TracyCZoneNC(prepare_sleep, "Prepare Sleep", b2_colorGainsboro, true);
+
+	b2World* world = context;
+	b2TraceScope traceScope = b2EnterTraceScope(world->worldId, (int)threadIndex);
+
+	b2BitSet* awakeIslandBitSet = &world->taskContextArray[0].awakeIslandBitSet;
+	b2BitSet* splitIslandBitSet = &world->taskContextArray[0].splitIslandBitSet;
+	for (int i = 1; i < b2Array(world->taskContextArray).count; ++i)
+	{
+		b2InPlaceUnion(awakeIslandBitSet, &world->taskContextArray[i].awakeIslandBitSet);
+		b2InPlaceUnion(splitIslandBitSet, &world->taskContextArray[i].splitIslandBitSet);
+	}
+
+	// Collect split island candidates for the next time step. No need to split if sleeping is disabled.
+	// The candidates are in awake island order so they don't depend on how bodies were distributed to workers.
+	B2_ASSERT(b2Array(world->splitIslandArray).count == 0);
+	b2IslandSim* islandSims = world->solverSetArray[b2_awakeSet].islands.data;
+	uint32_t wordCount = splitIslandBitSet->blockCount;
+	uint64_t* bits = splitIslandBitSet->bits;
+	int candidateCount = 0;
+	for (uint32_t k = 0; k < wordCount && candidateCount < b2_maxSplitIslands; ++k)
+	{
+		uint64_t word = bits[k];
+		while (word != 0 && candidateCount < b2_maxSplitIslands)
+		{
+			uint32_t ctz = b2CTZ64(word);
+			uint32_t islandIndex = 64 * k + ctz;
+
+			b2Array_Push(world->splitIslandArray, islandSims[islandIndex].islandId);
+			candidateCount += 1;
+
+			// Clear the smallest set bit
+			word = word & (word - 1);
+		}
+	}
+
+	b2TracyCZoneEnd(prepare_sleep);
+
+	b2LeaveTraceScope(traceScope);
+}
+
+// Estimate of the stack used by the solver this step. Called before the step so the stack can be grown ahead of use.
+// This is not a strict bound. Sets woken in collide and unusual bursts of new touching contacts fall back to the heap.
+int b2EstimateSolverStackSize(b2World* world)
+{
+	b2SolverSet* awakeSet = world->solverSetArray + b2_awakeSet;
+	int awakeBodyCount = awakeSet->sims.count;
+	if (awakeBodyCount == 0)
+	{
+		return 0;
+	}
+
+	b2GraphColor* colors = world->constraintGraph.colors;
+	int simdContactCount = 0;
+	int jointCount = 0;
+	for (int i = 0; i < b2_overflowIndex; ++i)
+	{
+		int colorContactCount = colors[i].contacts.count;
+		simdContactCount += colorContactCount > 0 ? ((colorContactCount - 1) >> 3) + 1 : 0;
+		jointCount += colors[i].joints.count;
+	}
+
+	int overflowContactCount = colors[b2_overflowIndex].contacts.count;
+	jointCount += colors[b2_overflowIndex].joints.count;
+
+	// Any awake non-touching contact may begin touching in collide and join the graph before the solve. Most
+	// go to a color, so they are counted as SIMD lanes only. Overflow from a begin touch burst uses the heap.
+	int beginTouchCount = awakeSet->nonTouchingContacts.count;
+	simdContactCount += b2MinInt(beginTouchCount, (beginTouchCount >> 3) + b2_overflowIndex);
+
+	// Summed in 64 bits because there may be millions of contacts. First the enlarged, fast, and bullet bodies,
+	// plus island splitting which may see every awake body.
+	int64_t size = (int64_t)awakeBodyCount * (int64_t)(4 * sizeof(int) + sizeof(b2Island));
+
+	// contact and joint constraints
+	size += (int64_t)simdContactCount * (int64_t)(8 * sizeof(b2ContactSim*) + sizeof(b2ContactConstraintSIMD));
+	size += (int64_t)overflowContactCount * (int64_t)sizeof(b2ContactConstraint);
+	size += (int64_t)jointCount * (int64_t)sizeof(b2JointSim*);
+
+	// stages, blocks, and worker state
+	int workerCount = world->workerCount;
+	int maxBlockCount = 4 * workerCount;
+	size += (5 + 4 * b2_overflowIndex) * (int64_t)sizeof(b2SolverStage);
+	size += (3 + 2 * b2_overflowIndex) * maxBlockCount * (int64_t)sizeof(b2SolverBlock);
+	size += workerCount * (int64_t)sizeof(b2WorkerContext);
+
+	// 32 byte alignment of each allocation and cache line alignment of the stages and blocks
+	size += 32 * 32 + 5 * b2_cacheLineSize;
+
+	return size < INT_MAX ? (int)size : INT_MAX;
+}
+
+// Build the work blocks and stages used to spread the constraint solve over the workers. The serial solve
+// does not need them. The stages and blocks are one cache aligned stack item so each has a line of its own.
+static b2SolverStage* b2PrepareStages(b2StepContext* context, const int* activeColorIndices, int activeColorCount,
+									   int simdContactCount, int awakeJointCount, int* stageCountOut)
+{
+	b2World* world = context->world;
+	b2GraphColor* colors = world->constraintGraph.colors;
+	int awakeBodyCount = world->solverSetArray[b2_awakeSet].sims.count;
+	int workerCount = world->workerCount;
+
+	// Each worker receives at most M blocks of work. The workers may receive less than there is not sufficient work.
+	// Each block of work has a minimum number of elements (block size). This in turn may limit number of blocks.
+	// If there are many elements then the block size is increased so there are still at most M blocks of work per worker.
+	// M is a tunable number that has two goals:
+	// 1. keep M small to reduce overhead
+	// 2. keep M large enough for other workers to be able to steal work
+	// The block size is a power of two to make math efficient.
+
+	const int blocksPerWorker = 4;
+	const int maxBlockCount = blocksPerWorker * workerCount;
+
+	// Configure blocks for tasks that parallel-for bodies
+	int bodyBlockSize = 1 << 5;
+	int bodyBlockCount;
+	if (awakeBodyCount > bodyBlockSize * maxBlockCount)
+	{
+		// Too many blocks, increase block size
+		bodyBlockSize = awakeBodyCount / maxBlockCount;
+		bodyBlockCount = maxBlockCount;
+	}
+	else
+	{
+		bodyBlockCount = ((awakeBodyCount - 1) >> 5) + 1;
+	}
+
+	// Configure blocks for tasks parallel-for each active graph color
+	// The blocks are a mix of SIMD contact blocks and joint blocks
+	int colorContactCounts[b2_graphColorCount];
+	int colorContactBlockSizes[b2_graphColorCount];
+	int colorContactBlockCounts[b2_graphColorCount];
+
+	int colorJointCounts[b2_graphColorCount];
+	int colorJointBlockSizes[b2_graphColorCount];
+	int colorJointBlockCounts[b2_graphColorCount];
+
+	int graphBlockCount = 0;
+	for (int c = 0; c < activeColorCount; ++c)
+	{
+		b2GraphColor* color = colors + activeColorIndices[c];
+		int colorContactCount = color->contacts.count;
+		int colorJointCount = color->joints.count;
+
+		// 8-way SIMD
+		int colorContactCountSIMD = colorContactCount > 0 ? ((colorContactCount - 1) >> 3) + 1 : 0;
+
+		colorContactCounts[c] = colorContactCountSIMD;
+
+		// determine the number of contact work blocks for this color
+		if (colorContactCountSIMD > blocksPerWorker * maxBlockCount)
+		{
+			// too many contact blocks
+			colorContactBlockSizes[c] = colorContactCountSIMD / maxBlockCount;
+			colorContactBlockCounts[c] = maxBlockCount;
+		}
+		else if (colorContactCountSIMD > 0)
+		{
+			// dividing by blocksPerWorker (4)
+			colorContactBlockSizes[c] = blocksPerWorker;
+			colorContactBlockCounts[c] = ((colorContactCountSIMD - 1) >> 2) + 1;
+		}
+		else
+		{
+			// no contacts in this color
+			colorContactBlockSizes[c] = 0;
+			colorContactBlockCounts[c] = 0;
+		}
+
+		colorJointCounts[c] = colorJointCount;
+
+		// determine number of joint work blocks for this color
+		if (colorJointCount > blocksPerWorker * maxBlockCount)
+		{
+			// too many joint blocks
+			colorJointBlockSizes[c] = colorJointCount / maxBlockCount;
+			colorJointBlockCounts[c] = maxBlockCount;
+		}
+		else if (colorJointCount > 0)
+		{
+			// dividing by blocksPerWorker (4)
+			colorJointBlockSizes[c] = blocksPerWorker;
+			colorJointBlockCounts[c] = ((colorJointCount - 1) >> 2) + 1;
+		}
+		else
+		{
+			colorJointBlockSizes[c] = 0;
+			colorJointBlockCounts[c] = 0;
+		}
+
+		graphBlockCount += colorContactBlockCounts[c] + colorJointBlockCounts[c];
+	}
+
+	// Define work blocks for preparing contacts and storing contact impulses
+	int contactBlockSize = blocksPerWorker;
+	int contactBlockCount = simdContactCount > 0 ? ((simdContactCount - 1) >> 2) + 1 : 0;
+	if (simdContactCount > contactBlockSize * maxBlockCount)
+	{
+		// Too many blocks, increase block size
+		contactBlockSize = simdContactCount / maxBlockCount;
+		contactBlockCount = maxBlockCount;
+	}
+
+	// Define work blocks for preparing joints
+	int jointBlockSize = blocksPerWorker;
+	int jointBlockCount = awakeJointCount > 0 ? ((awakeJointCount - 1) >> 2) + 1 : 0;
+	if (awakeJointCount > jointBlockSize * maxBlockCount)
+	{
+		// Too many blocks, increase block size
+		jointBlockSize = awakeJointCount / maxBlockCount;
+		jointBlockCount = maxBlockCount;
+	}
+
+	int stageCount = 0;
+
+	// b2_stagePrepareJoints
+	stageCount += 1;
+	// b2_stagePrepareContacts
+	stageCount += 1;
+	// b2_stageIntegrateVelocities
+	stageCount += 1;
+	// b2_stageWarmStart
+	stageCount += activeColorCount;
+	// b2_stageSolve
+	stageCount += activeColorCount;
+	// b2_stageIntegratePositions
+	stageCount += 1;
+	// b2_stageRelax
+	stageCount += activeColorCount;
+	// b2_stageRestitution
+	stageCount += activeColorCount;
+	// b2_stageStoreImpulses
+	stageCount += 1;
+
+	int blockCount = bodyBlockCount + contactBlockCount + jointBlockCount + graphBlockCount;
+	int byteCount = stageCount * (int)sizeof(b2SolverStage) + blockCount * (int)sizeof(b2SolverBlock);
+	b2SolverStage* stages = b2AllocateCacheAlignedStackItem(&world->stackAllocator, byteCount, "stages");
+	b2SolverBlock* bodyBlocks = (b2SolverBlock*)(stages + stageCount);
+	b2SolverBlock* contactBlocks = bodyBlocks + bodyBlockCount;
+	b2SolverBlock* jointBlocks = contactBlocks + contactBlockCount;
+	b2SolverBlock* graphBlocks = jointBlocks + jointBlockCount;
+
+	// Prepare body work blocks
+	for (int i = 0; i < bodyBlockCount; ++i)
+	{
+		b2SolverBlock* block = bodyBlocks + i;
+		block->startIndex = i * bodyBlockSize;
+		block->count = (int16_t)bodyBlockSize;
+		block->blockType = b2_bodyBlock;
+		block->syncIndex = 0;
+	}
+	bodyBlocks[bodyBlockCount - 1].count = (int16_t)(awakeBodyCount - (bodyBlockCount - 1) * bodyBlockSize);
+
+	// Prepare joint work blocks
+	for (int i = 0; i < jointBlockCount; ++i)
+	{
+		b2SolverBlock* block = jointBlocks + i;
+		block->startIndex = i * jointBlockSize;
+		block->count = (int16_t)jointBlockSize;
+		block->blockType = b2_jointBlock;
+		block->syncIndex = 0;
+	}
+
+	if (jointBlockCount > 0)
+	{
+		jointBlocks[jointBlockCount - 1].count = (int16_t)(awakeJointCount - (jointBlockCount - 1) * jointBlockSize);
+	}
+
+	// Prepare contact work blocks
+	for (int i = 0; i < contactBlockCount; ++i)
+	{
+		b2SolverBlock* block = contactBlocks + i;
+		block->startIndex = i * contactBlockSize;
+		block->count = (int16_t)contactBlockSize;
+		block->blockType = b2_contactBlock;
+		block->syncIndex = 0;
+	}
+
+	if (contactBlockCount > 0)
+	{
+		contactBlocks[contactBlockCount - 1].count = (int16_t)(simdContactCount - (contactBlockCount - 1) * contactBlockSize);
+	}
+
+	// Prepare graph work blocks
+	b2SolverBlock* graphColorBlocks[b2_graphColorCount];
+	b2SolverBlock* baseGraphBlock = graphBlocks;
+
+	for (int i = 0; i < activeColorCount; ++i)
+	{
+		graphColorBlocks[i] = baseGraphBlock;
+
+		int colorJointBlockCount = colorJointBlockCounts[i];
+		int colorJointBlockSize = colorJointBlockSizes[i];
+		for (int j = 0; j < colorJointBlockCount; ++j)
+		{
+			b2SolverBlock* block = baseGraphBlock + j;
+			block->startIndex = j * colorJointBlockSize;
+			block->count = (int16_t)colorJointBlockSize;
+			block->blockType = b2_graphJointBlock;
+			block->syncIndex = 0;
+		}
+
+		if (colorJointBlockCount > 0)
+		{
+			baseGraphBlock[colorJointBlockCount - 1].count =
+				(int16_t)(colorJointCounts[i] - (colorJointBlockCount - 1) * colorJointBlockSize);
+			baseGraphBlock += colorJointBlockCount;
+		}
+
+		int colorContactBlockCount = colorContactBlockCounts[i];
+		int colorContactBlockSize = colorContactBlockSizes[i];
+		for (int j = 0; j < colorContactBlockCount; ++j)
+		{
+			b2SolverBlock* block = baseGraphBlock + j;
+			block->startIndex = j * colorContactBlockSize;
+			block->count = (int16_t)colorContactBlockSize;
+			block->blockType = b2_graphContactBlock;
+			block->syncIndex = 0;
+		}
+
+		if (colorContactBlockCount > 0)
+		{
+			baseGraphBlock[colorContactBlockCount - 1].count =
+				(int16_t)(colorContactCounts[i] - (colorContactBlockCount - 1) * colorContactBlockSize);
+			baseGraphBlock += colorContactBlockCount;
+		}
+	}
+
+	ptrdiff_t blockDiff = baseGraphBlock - graphBlocks;
+	B2_ASSERT(blockDiff == graphBlockCount);
+
+	b2SolverStage* stage = stages;
+
+	// Prepare joints
+	stage->type = b2_stagePrepareJoints;
+	stage->blocks = jointBlocks;
+	stage->blockCount = jointBlockCount;
+	stage->colorIndex = -1;
+	stage->completionCount = 0;
+	stage += 1;
+
+	// Prepare contacts
+	stage->type = b2_stagePrepareContacts;
+	stage->blocks = contactBlocks;
+	stage->blockCount = contactBlockCount;
+	stage->colorIndex = -1;
+	stage->completionCount = 0;
+	stage += 1;
+
+	// Integrate velocities
+	stage->type = b2_stageIntegrateVelocities;
+	stage->blocks = bodyBlocks;
+	stage->blockCount = bodyBlockCount;
+	stage->colorIndex = -1;
+	stage->completionCount = 0;
+	stage += 1;
+
+	// Warm start
+	for (int i = 0; i < activeColorCount; ++i)
+	{
+		stage->type = b2_stageWarmStart;
+		stage->blocks = graphColorBlocks[i];
+		stage->blockCount = colorJointBlockCounts[i] + colorContactBlockCounts[i];
+		stage->colorIndex = activeColorIndices[i];
+		stage->completionCount = 0;
+		stage += 1;
+	}
+
+	// Solve graph
+	for (int i = 0; i < activeColorCount; ++i)
+	{
+		stage->type = b2_stageSolve;
+		stage->blocks = graphColorBlocks[i];
+		stage->blockCount = colorJointBlockCounts[i] + colorContactBlockCounts[i];
+		stage->colorIndex = activeColorIndices[i];
+		stage->completionCount = 0;
+		stage += 1;
+	}
+
+	// Integrate positions
+	stage->type = b2_stageIntegratePositions;
+	stage->blocks = bodyBlocks;
+	stage->blockCount = bodyBlockCount;
+	stage->colorIndex = -1;
+	stage->completionCount = 0;
+	stage += 1;
+
+	// Relax constraints
+	for (int i = 0; i < activeColorCount; ++i)
+	{
+		stage->type = b2_stageRelax;
+		stage->blocks = graphColorBlocks[i];
+		stage->blockCount = colorJointBlockCounts[i] + colorContactBlockCounts[i];
+		stage->colorIndex = activeColorIndices[i];
+		stage->completionCount = 0;
+		stage += 1;
+	}
+
+	// Restitution
+	// Note: joint blocks mixed in, could have joint limit restitution
+	for (int i = 0; i < activeColorCount; ++i)
+	{
+		stage->type = b2_stageRestitution;
+		stage->blocks = graphColorBlocks[i];
+		stage->blockCount = colorJointBlockCounts[i] + colorContactBlockCounts[i];
+		stage->colorIndex = activeColorIndices[i];
+		stage->completionCount = 0;
+		stage += 1;
+	}
+
+	// Store impulses
+	stage->type = b2_stageStoreImpulses;
+	stage->blocks = contactBlocks;
+	stage->blockCount = contactBlockCount;
+	stage->colorIndex = -1;
+	stage->completionCount = 0;
+	stage += 1;
+
+	B2_ASSERT((int)(stage - stages) == stageCount);
+
+	*stageCountOut = stageCount;
+	return stages;
 }
 
 // Solve with graph coloring
@@ -1111,11 +1876,17 @@ void b2Solve(b2World* world, b2StepContext* stepContext)
 
 	b2TracyCZoneNC(solve, "Solve", b2_colorMistyRose, true);
 
-	// Prepare buffers for continuous collision (fast bodies)
-	stepContext->fastBodyCount = 0;
-	stepContext->fastBodies = b2AllocateStackItem(&world->stackAllocator, awakeBodyCount * sizeof(int), "fast bodies");
-	stepContext->bulletBodyCount = 0;
-	stepContext->bulletBodies = b2AllocateStackItem(&world->stackAllocator, awakeBodyCount * sizeof(int), "bullet bodies");
+	// Workers collect enlarged and fast bodies in their own arenas
+	for (int i = 0; i < b2Array(world->taskContextArray).count; ++i)
+	{
+		world->taskContextArray[i].enlargedSims = (b2ArenaIntArray){0};
+		world->taskContextArray[i].fastBodies = (b2ArenaIntArray){0};
+		world->taskContextArray[i].bulletBodies = (b2ArenaIntArray){0};
+	}
+
+	// Tasks that overlap with later parts of the step
+	void* hitEventsTask = NULL;
+	void* sleepTask = NULL;
 
 	b2TracyCZoneNC(graph_solver, "Graph", b2_colorSeaGreen, true);
 
@@ -1150,47 +1921,13 @@ void b2Solve(b2World* world, b2StepContext* stepContext)
 			world->bodyMoveEventArray = bodyMoveEventArray;
 		}
 
-		// Each worker receives at most M blocks of work. The workers may receive less than there is not sufficient work.
-		// Each block of work has a minimum number of elements (block size). This in turn may limit number of blocks.
-		// If there are many elements then the block size is increased so there are still at most M blocks of work per worker.
-		// M is a tunable number that has two goals:
-		// 1. keep M small to reduce overhead
-		// 2. keep M large enough for other workers to be able to steal work
-		// The block size is a power of two to make math efficient.
-
+		// Small scenes skip the worker stages and solve on this thread. The tasks and the spin barriers cost more than
+		// they save when there is little work. The work is estimated by the total element count, not per stage.
 		int workerCount = world->workerCount;
-		const int blocksPerWorker = 4;
-		const int maxBlockCount = blocksPerWorker * workerCount;
+		bool useStages = workerCount > 1 && awakeBodyCount + awakeContactCount + awakeJointCount >= world->serialSolveThreshold;
 
-		// Configure blocks for tasks that parallel-for bodies
-		int bodyBlockSize = 1 << 5;
-		int bodyBlockCount;
-		if (awakeBodyCount > bodyBlockSize * maxBlockCount)
-		{
-			// Too many blocks, increase block size
-			bodyBlockSize = awakeBodyCount / maxBlockCount;
-			bodyBlockCount = maxBlockCount;
-		}
-		else
-		{
-			bodyBlockCount = ((awakeBodyCount - 1) >> 5) + 1;
-		}
-
-		// Configure blocks for tasks parallel-for each active graph color
-		// The blocks are a mix of SIMD contact blocks and joint blocks
+		// Gather the active colors. The SIMD contact count includes the empty lanes at the end of each color.
 		int activeColorIndices[b2_graphColorCount];
-
-		int colorContactCounts[b2_graphColorCount];
-		int colorContactBlockSizes[b2_graphColorCount];
-		int colorContactBlockCounts[b2_graphColorCount];
-
-		int colorJointCounts[b2_graphColorCount];
-		int colorJointBlockSizes[b2_graphColorCount];
-		int colorJointBlockCounts[b2_graphColorCount];
-
-		int graphBlockCount = 0;
-
-		// c is the active color index
 		int simdContactCount = 0;
 		int c = 0;
 		for (int i = 0; i < b2_graphColorCount - 1; ++i)
@@ -1203,53 +1940,7 @@ void b2Solve(b2World* world, b2StepContext* stepContext)
 				activeColorIndices[c] = i;
 
 				// 8-way SIMD
-				int colorContactCountSIMD = colorContactCount > 0 ? ((colorContactCount - 1) >> 3) + 1 : 0;
-
-				colorContactCounts[c] = colorContactCountSIMD;
-
-				// determine the number of contact work blocks for this color
-				if (colorContactCountSIMD > blocksPerWorker * maxBlockCount)
-				{
-					// too many contact blocks
-					colorContactBlockSizes[c] = colorContactCountSIMD / maxBlockCount;
-					colorContactBlockCounts[c] = maxBlockCount;
-				}
-				else if (colorContactCountSIMD > 0)
-				{
-					// dividing by blocksPerWorker (4)
-					colorContactBlockSizes[c] = blocksPerWorker;
-					colorContactBlockCounts[c] = ((colorContactCountSIMD - 1) >> 2) + 1;
-				}
-				else
-				{
-					// no contacts in this color
-					colorContactBlockSizes[c] = 0;
-					colorContactBlockCounts[c] = 0;
-				}
-
-				colorJointCounts[c] = colorJointCount;
-
-				// determine number of joint work blocks for this color
-				if (colorJointCount > blocksPerWorker * maxBlockCount)
-				{
-					// too many joint blocks
-					colorJointBlockSizes[c] = colorJointCount / maxBlockCount;
-					colorJointBlockCounts[c] = maxBlockCount;
-				}
-				else if (colorJointCount > 0)
-				{
-					// dividing by blocksPerWorker (4)
-					colorJointBlockSizes[c] = blocksPerWorker;
-					colorJointBlockCounts[c] = ((colorJointCount - 1) >> 2) + 1;
-				}
-				else
-				{
-					colorJointBlockSizes[c] = 0;
-					colorJointBlockCounts[c] = 0;
-				}
-
-				graphBlockCount += colorContactBlockCounts[c] + colorJointBlockCounts[c];
-				simdContactCount += colorContactCountSIMD;
+				simdContactCount += colorContactCount > 0 ? ((colorContactCount - 1) >> 3) + 1 : 0;
 				c += 1;
 			}
 		}
@@ -1317,252 +2008,33 @@ void b2Solve(b2World* world, b2StepContext* stepContext)
 			B2_ASSERT(jointBase == awakeJointCount);
 		}
 
-		// Define work blocks for preparing contacts and storing contact impulses
-		int contactBlockSize = blocksPerWorker;
-		int contactBlockCount = simdContactCount > 0 ? ((simdContactCount - 1) >> 2) + 1 : 0;
-		if (simdContactCount > contactBlockSize * maxBlockCount)
-		{
-			// Too many blocks, increase block size
-			contactBlockSize = simdContactCount / maxBlockCount;
-			contactBlockCount = maxBlockCount;
-		}
-
-		// Define work blocks for preparing joints
-		int jointBlockSize = blocksPerWorker;
-		int jointBlockCount = awakeJointCount > 0 ? ((awakeJointCount - 1) >> 2) + 1 : 0;
-		if (awakeJointCount > jointBlockSize * maxBlockCount)
+		// The serial solve doesn't use stages
+		int stageCount = 0;
+		b2SolverStage* stages = NULL;
+		if (useStages)
 		{
-			// Too many blocks, increase block size
-			jointBlockSize = awakeJointCount / maxBlockCount;
-			jointBlockCount = maxBlockCount;
+			stages = b2PrepareStages(stepContext, activeColorIndices, activeColorCount, simdContactCount, awakeJointCount,
+									 &stageCount);
 		}
 
-		int stageCount = 0;
-
-		// b2_stagePrepareJoints
-		stageCount += 1;
-		// b2_stagePrepareContacts
-		stageCount += 1;
-		// b2_stageIntegrateVelocities
-		stageCount += 1;
-		// b2_stageWarmStart
-		stageCount += activeColorCount;
-		// b2_stageSolve
-		stageCount += activeColorCount;
-		// b2_stageIntegratePositions
-		stageCount += 1;
-		// b2_stageRelax
-		stageCount += activeColorCount;
-		// b2_stageRestitution
-		stageCount += activeColorCount;
-		// b2_stageStoreImpulses
-		stageCount += 1;
-
-		b2SolverStage* stages = b2AllocateStackItem(&world->stackAllocator, stageCount * sizeof(b2SolverStage), "stages");
-		b2SolverBlock* bodyBlocks =
-			b2AllocateStackItem(&world->stackAllocator, bodyBlockCount * sizeof(b2SolverBlock), "body blocks");
-		b2SolverBlock* contactBlocks =
-			b2AllocateStackItem(&world->stackAllocator, contactBlockCount * sizeof(b2SolverBlock), "contact blocks");
-		b2SolverBlock* jointBlocks =
-			b2AllocateStackItem(&world->stackAllocator, jointBlockCount * sizeof(b2SolverBlock), "joint blocks");
-		b2SolverBlock* graphBlocks =
-			b2AllocateStackItem(&world->stackAllocator, graphBlockCount * sizeof(b2SolverBlock), "graph blocks");
-
-		// Split an awake island. This modifies:
+		// Split awake islands. This modifies:
 		// - stack allocator
 		// - world island array and solver set
 		// - island indices on bodies, contacts, and joints
 		// I'm squeezing this task in here because it may be expensive and this is a safe place to put it.
+		// The islands are searched in parallel. They are created after the constraint solve.
 		// Note: cannot split islands in parallel with FinalizeBodies
+		b2SplitIslandContext splitContext;
+		b2PrepareSplitIslands(world, &splitContext);
 		void* splitIslandTask = NULL;
-		if (world->splitIslandId != B2_NULL_INDEX)
+		if (splitContext.splitCount > 0)
 		{
-			splitIslandTask = world->enqueueTaskFcn(&b2SplitIslandTask, 1, 1, world, world->userTaskContext);
+			splitIslandTask =
+				world->enqueueTaskFcn(&b2SplitIslandTask, splitContext.splitCount, 1, &splitContext, world->userTaskContext);
 			world->taskCount += 1;
 			world->activeTaskCount += splitIslandTask == NULL ? 0 : 1;
 		}
 
-		// Prepare body work blocks
-		for (int i = 0; i < bodyBlockCount; ++i)
-		{
-			b2SolverBlock* block = bodyBlocks + i;
-			block->startIndex = i * bodyBlockSize;
-			block->count = (int16_t)bodyBlockSize;
-			block->blockType = b2_bodyBlock;
-			block->syncIndex = 0;
-		}
-		bodyBlocks[bodyBlockCount - 1].count = (int16_t)(awakeBodyCount - (bodyBlockCount - 1) * bodyBlockSize);
-
-		// Prepare joint work blocks
-		for (int i = 0; i < jointBlockCount; ++i)
-		{
-			b2SolverBlock* block = jointBlocks + i;
-			block->startIndex = i * jointBlockSize;
-			block->count = (int16_t)jointBlockSize;
-			block->blockType = b2_jointBlock;
-			block->syncIndex = 0;
-		}
-
-		if (jointBlockCount > 0)
-		{
-			jointBlocks[jointBlockCount - 1].count = (int16_t)(awakeJointCount - (jointBlockCount - 1) * jointBlockSize);
-		}
-
-		// Prepare contact work blocks
-		for (int i = 0; i < contactBlockCount; ++i)
-		{
-			b2SolverBlock* block = contactBlocks + i;
-			block->startIndex = i * contactBlockSize;
-			block->count = (int16_t)contactBlockSize;
-			block->blockType = b2_contactBlock;
-			block->syncIndex = 0;
-		}
-
-		if (contactBlockCount > 0)
-		{
-			contactBlocks[contactBlockCount - 1].count = (int16_t)(simdContactCount - (contactBlockCount - 1) * contactBlockSize);
-		}
-
-		// Prepare graph work blocks
-		b2SolverBlock* graphColorBlocks[b2_graphColorCount];
-		b2SolverBlock* baseGraphBlock = graphBlocks;
-
-		for (int i = 0; i < activeColorCount; ++i)
-		{
-			graphColorBlocks[i] = baseGraphBlock;
-
-			int colorJointBlockCount = colorJointBlockCounts[i];
-			int colorJointBlockSize = colorJointBlockSizes[i];
-			for (int j = 0; j < colorJointBlockCount; ++j)
-			{
-				b2SolverBlock* block = baseGraphBlock + j;
-				block->startIndex = j * colorJointBlockSize;
-				block->count = (int16_t)colorJointBlockSize;
-				block->blockType = b2_graphJointBlock;
-				block->syncIndex = 0;
-			}
-
-			if (colorJointBlockCount > 0)
-			{
-				baseGraphBlock[colorJointBlockCount - 1].count =
-					(int16_t)(colorJointCounts[i] - (colorJointBlockCount - 1) * colorJointBlockSize);
-				baseGraphBlock += colorJointBlockCount;
-			}
-
-			int colorContactBlockCount = colorContactBlockCounts[i];
-			int colorContactBlockSize = colorContactBlockSizes[i];
-			for (int j = 0; j < colorContactBlockCount; ++j)
-			{
-				b2SolverBlock* block = baseGraphBlock + j;
-				block->startIndex = j * colorContactBlockSize;
-				block->count = (int16_t)colorContactBlockSize;
-				block->blockType = b2_graphContactBlock;
-				block->syncIndex = 0;
-			}
-
-			if (colorContactBlockCount > 0)
-			{
-				baseGraphBlock[colorContactBlockCount - 1].count =
-					(int16_t)(colorContactCounts[i] - (colorContactBlockCount - 1) * colorContactBlockSize);
-				baseGraphBlock += colorContactBlockCount;
-			}
-		}
-
-		ptrdiff_t blockDiff = baseGraphBlock - graphBlocks;
-		B2_ASSERT(blockDiff == graphBlockCount);
-
-		b2SolverStage* stage = stages;
-
-		// Prepare joints
-		stage->type = b2_stagePrepareJoints;
-		stage->blocks = jointBlocks;
-		stage->blockCount = jointBlockCount;
-		stage->colorIndex = -1;
-		stage->completionCount = 0;
-		stage += 1;
-
-		// Prepare contacts
-		stage->type = b2_stagePrepareContacts;
-		stage->blocks = contactBlocks;
-		stage->blockCount = contactBlockCount;
-		stage->colorIndex = -1;
-		stage->completionCount = 0;
-		stage += 1;
-
-		// Integrate velocities
-		stage->type = b2_stageIntegrateVelocities;
-		stage->blocks = bodyBlocks;
-		stage->blockCount = bodyBlockCount;
-		stage->colorIndex = -1;
-		stage->completionCount = 0;
-		stage += 1;
-
-		// Warm start
-		for (int i = 0; i < activeColorCount; ++i)
-		{
-			stage->type = b2_stageWarmStart;
-			stage->blocks = graphColorBlocks[i];
-			stage->blockCount = colorJointBlockCounts[i] + colorContactBlockCounts[i];
-			stage->colorIndex = activeColorIndices[i];
-			stage->completionCount = 0;
-			stage += 1;
-		}
-
-		// Solve graph
-		for (int i = 0; i < activeColorCount; ++i)
-		{
-			stage->type = b2_stageSolve;
-			stage->blocks = graphColorBlocks[i];
-			stage->blockCount = colorJointBlockCounts[i] + colorContactBlockCounts[i];
-			stage->colorIndex = activeColorIndices[i];
-			stage->completionCount = 0;
-			stage += 1;
-		}
-
-		// Integrate positions
-		stage->type = b2_stageIntegratePositions;
-		stage->blocks = bodyBlocks;
-		stage->blockCount = bodyBlockCount;
-		stage->colorIndex = -1;
-		stage->completionCount = 0;
-		stage += 1;
-
-		// Relax constraints
-		for (int i = 0; i < activeColorCount; ++i)
-		{
-			stage->type = b2_stageRelax;
-			stage->blocks = graphColorBlocks[i];
-			stage->blockCount = colorJointBlockCounts[i] + colorContactBlockCounts[i];
-			stage->colorIndex = activeColorIndices[i];
-			stage->completionCount = 0;
-			stage += 1;
-		}
-
-		// Restitution
-		// Note: joint blocks mixed in, could have joint limit restitution
-		for (int i = 0; i < activeColorCount; ++i)
-		{
-			stage->type = b2_stageRestitution;
-			stage->blocks = graphColorBlocks[i];
-			stage->blockCount = colorJointBlockCounts[i] + colorContactBlockCounts[i];
-			stage->colorIndex = activeColorIndices[i];
-			stage->completionCount = 0;
-			stage += 1;
-		}
-
-		// Store impulses
-		stage->type = b2_stageStoreImpulses;
-		stage->blocks = contactBlocks;
-		stage->blockCount = contactBlockCount;
-		stage->colorIndex = -1;
-		stage->completionCount = 0;
-		stage += 1;
-
-		B2_ASSERT((int)(stage - stages) == stageCount);
-
-		B2_ASSERT(workerCount <= b2_maxWorkers);
-		b2WorkerContext workerContext[b2_maxWorkers];
-
 		stepContext->graph = graph;
 		stepContext->joints = joints;
 		stepContext->contacts = contacts;
@@ -1571,6 +2043,7 @@ void b2Solve(b2World* world, b2StepContext* stepContext)
 		stepContext->workerCount = workerCount;
 		stepContext->stageCount = stageCount;
 		stepContext->stages = stages;
+		stepContext->enableWorkerAffinity = world->enableWorkerAffinity;
 		stepContext->atomicSyncBits = 0;
 
 		world->profile.prepareTasks = b2GetMillisecondsAndReset(&timer);
@@ -1578,25 +2051,33 @@ void b2Solve(b2World* world, b2StepContext* stepContext)
 		b2TracyCZoneEnd(prepare_stages);
 
 		// Must use worker index because thread 0 can be assigned multiple tasks by enkiTS
-		for (int i = 0; i < workerCount; ++i)
+		int solverTaskCount = useStages ? workerCount : 0;
+		b2WorkerContext* workerContext =
+			b2AllocateStackItem(&world->stackAllocator, solverTaskCount * sizeof(b2WorkerContext), "worker contexts");
+		for (int i = 0; i < solverTaskCount; ++i)
 		{
 			workerContext[i].context = stepContext;
 			workerContext[i].workerIndex = i;
+			workerContext[i].stealCount = 0;
 			workerContext[i].userTask = world->enqueueTaskFcn(b2SolverTask, 1, 1, workerContext + i, world->userTaskContext);
 			world->taskCount += 1;
 			world->activeTaskCount += workerContext[i].userTask == NULL ? 0 : 1;
 		}
 
+		if (useStages == false)
+		{
+			b2SolveSerial(stepContext, simdContactCount, awakeJointCount);
+		}
+
 		// Finish island split
 		if (splitIslandTask != NULL)
 		{
 			world->finishTaskFcn(splitIslandTask, world->userTaskContext);
 			world->activeTaskCount -= 1;
 		}
-		world->splitIslandId = B2_NULL_INDEX;
 
 		// Finish constraint solve
-		for (int i = 0; i < workerCount; ++i)
+		for (int i = 0; i < solverTaskCount; ++i)
 		{
 			if (workerContext[i].userTask != NULL)
 			{
@@ -1605,36 +2086,54 @@ void b2Solve(b2World* world, b2StepContext* stepContext)
 			}
 		}
 
+		// Report steal counts for this step
+		for (int i = 0; i < b2Array(world->taskContextArray).count; ++i)
+		{
+			world->taskContextArray[i].stealCount = i < solverTaskCount ? workerContext[i].stealCount : 0;
+		}
+
+		b2FreeStackItem(&world->stackAllocator, workerContext);
+
 		world->profile.solverTasks = b2GetMillisecondsAndReset(&timer);
 
-		// Prepare contact, enlarged body, and island bit sets used in body finalization.
+		// Create the split islands. Must happen after the constraint solve and before body finalization.
+		b2FinishSplitIslands(&splitContext);
+
+		// Prepare island bit sets used in body finalization. Island splitting may have added awake islands.
 		int awakeIslandCount = awakeSet->islands.count;
-		for (int i = 0; i < world->workerCount; ++i)
+		for (int i = 0; i < b2Array(world->taskContextArray).count; ++i)
 		{
 			b2TaskContext* taskContext = world->taskContextArray + i;
-			b2SetBitCountAndClear(&taskContext->enlargedSimBitSet, awakeBodyCount);
 			b2SetBitCountAndClear(&taskContext->awakeIslandBitSet, awakeIslandCount);
-			taskContext->splitIslandId = B2_NULL_INDEX;
-			taskContext->splitSleepTime = 0.0f;
+			b2SetBitCountAndClear(&taskContext->splitIslandBitSet, awakeIslandCount);
 		}
 
+		// Hit events only read the contact impulses, so they overlap with body finalization and continuous collision.
+		// They must be done before island sleep moves contacts out of the constraint graph.
+		hitEventsTask = b2EnqueueDependentTask(world, &b2HitEventsTask, 1, 1, world, NULL, 0);
+
 		// Finalize bodies. Must happen after the constraint solver and after island splitting.
-		void* finalizeBodiesTask =
-			world->enqueueTaskFcn(b2FinalizeBodiesTask, awakeBodyCount, 64, stepContext, world->userTaskContext);
-		world->taskCount += 1;
+		void* finalizeBodiesTask = b2EnqueueDependentTask(world, &b2FinalizeBodiesTask, awakeBodyCount, 64, stepContext, NULL, 0);
+
+		// Sleep preparation only depends on finalization, so it can overlap with proxy enlargement below.
+		if (world->enableSleep == true)
+		{
+			sleepTask = b2EnqueueDependentTask(world, &b2PrepareSleepTask, 1, 1, world, &finalizeBodiesTask, 1);
+		}
+
 		if (finalizeBodiesTask != NULL)
 		{
 			world->finishTaskFcn(finalizeBodiesTask, world->userTaskContext);
+			world->activeTaskCount -= 1;
+			finalizeBodiesTask = NULL;
 		}
 
 		world->profile.finalizeBodies = b2GetMillisecondsAndReset(&timer);
 
-
-		b2FreeStackItem(&world->stackAllocator, graphBlocks);
-		b2FreeStackItem(&world->stackAllocator, jointBlocks);
-		b2FreeStackItem(&world->stackAllocator, contactBlocks);
-		b2FreeStackItem(&world->stackAllocator, bodyBlocks);
-		b2FreeStackItem(&world->stackAllocator, stages);
+		if (stages != NULL)
+		{
+			b2FreeStackItem(&world->stackAllocator, stages);
+		}
 		b2FreeStackItem(&world->stackAllocator, overflowContactConstraints);
 		b2FreeStackItem(&world->stackAllocator, simdContactConstraints);
 		b2FreeStackItem(&world->stackAllocator, joints);
@@ -1644,64 +2143,6 @@ void b2Solve(b2World* world, b2StepContext* stepContext)
 	b2TracyCZoneEnd(graph_solver);
 	world->profile.solveConstraints = b2GetMillisecondsAndReset(&timer);
 
-	// Report hit events
-	// todo perhaps optimize this with a bitset
-	{
-		b2ContactHitEvent* events = world->contactHitArray;
-		B2_ASSERT(b2Array(events).count == 0);
-
-		float threshold = world->hitEventThreshold;
-		b2GraphColor* colors = world->constraintGraph.colors;
-		for (int i = 0; i < b2_graphColorCount; ++i)
-		{
-			b2GraphColor* color = colors + i;
-			int contactCount = color->contacts.count;
-			b2ContactSim* contactSims = color->contacts.data;
-			for (int j = 0; j < contactCount; ++j)
-			{
-				b2ContactSim* contactSim = contactSims + j;
-				if ((contactSim->simFlags & b2_simEnableHitEvent) == 0)
-				{
-					continue;
-				}
-
-				b2ContactHitEvent event = {0};
-				event.approachSpeed = threshold;
-
-				bool hit = false;
-				int pointCount = contactSim->manifold.pointCount;
-				for (int k = 0; k < pointCount; ++k)
-				{
-					b2ManifoldPoint* mp = contactSim->manifold.points + k;
-					float approachSpeed = -mp->normalVelocity;
-					if (approachSpeed > event.approachSpeed && mp->normalImpulse > 0.0f)
-					{
-						event.approachSpeed = approachSpeed;
-						event.point = mp->point;
-						hit = true;
-					}
-				}
-
-				if (hit == true)
-				{
-					event.normal = contactSim->manifold.normal;
-
-					b2CheckId(world->shapeArray, contactSim->shapeIdA);
-					b2CheckId(world->shapeArray, contactSim->shapeIdB);
-					b2Shape* shapeA = world->shapeArray + contactSim->shapeIdA;
-					b2Shape* shapeB = world->shapeArray + contactSim->shapeIdB;
-
-					event.shapeIdA = (b2ShapeId){shapeA->id + 1, world->worldId, shapeA->revision};
-					event.shapeIdB = (b2ShapeId){shapeB->id + 1, world->worldId, shapeB->revision};
-
-					b2Array_Push(events, event);
-				}
-			}
-		}
-	}
-
-	world->profile.hitEvents = b2GetMillisecondsAndReset(&timer);
-
 	// Finish the user tree task that was queued earlier in the time step. This must be complete before touching the broad-phase.
 	if (world->userTreeTask != NULL)
 	{
@@ -1716,64 +2157,73 @@ void b2Solve(b2World* world, b2StepContext* stepContext)
 
 	b2TracyCZoneNC(enlarge_proxies, "Enlarge Proxies", b2_colorDarkTurquoise, true);
 
-	// Gather bits for all sim bodies that have enlarged AABBs
-	b2BitSet* simBitSet = &world->taskContextArray[0].enlargedSimBitSet;
-	for (int i = 1; i < world->workerCount; ++i)
+	// Gather all sim bodies that have enlarged AABBs and clear the worker lists
+	int taskContextCount = b2Array(world->taskContextArray).count;
+	int enlargedCount = 0;
+	for (int i = 0; i < taskContextCount; ++i)
+	{
+		enlargedCount += world->taskContextArray[i].enlargedSims.count;
+	}
+
+	int* enlargedSims = b2AllocateStackItem(&world->stackAllocator, enlargedCount * sizeof(int), "enlarged sims");
+	enlargedCount = 0;
+	for (int i = 0; i < taskContextCount; ++i)
 	{
-		b2InPlaceUnion(simBitSet, &world->taskContextArray[i].enlargedSimBitSet);
+		b2ArenaIntArray* sims = &world->taskContextArray[i].enlargedSims;
+		if (sims->count > 0)
+		{
+			memcpy(enlargedSims + enlargedCount, sims->data, sims->count * sizeof(int));
+			enlargedCount += sims->count;
+		}
+
+		*sims = (b2ArenaIntArray){0};
 	}
 
+	b2SortInts(enlargedSims, enlargedCount);
+
 	// Enlarge broad-phase proxies and build move array
 	// Apply shape AABB changes to broad-phase. This also create the move array which must be
 	// in deterministic order. I'm tracking sim bodies because the number of shape ids can be huge.
 	{
 		b2BroadPhase* broadPhase = &world->broadPhase;
 		b2Shape* shapes = world->shapeArray;
-		uint32_t wordCount = simBitSet->blockCount;
-		uint64_t* bits = simBitSet->bits;
-		for (uint32_t k = 0; k < wordCount; ++k)
+		for (int enlargedIndex = 0; enlargedIndex < enlargedCount; ++enlargedIndex)
 		{
-			uint64_t word = bits[k];
-			while (word != 0)
-			{
-				uint32_t ctz = b2CTZ64(word);
-				uint32_t bodySimIndex = 64 * k + ctz;
-
-				// cache misses
-				B2_ASSERT(bodySimIndex < awakeSet->sims.count);
-				b2BodySim* bodySim = awakeSet->sims.data + bodySimIndex;
+			int bodySimIndex = enlargedSims[enlargedIndex];
 
-				b2CheckIndex(world->bodyArray, bodySim->bodyId);
-				b2Body* body = world->bodyArray + bodySim->bodyId;
+			// cache misses
+			B2_ASSERT(bodySimIndex < awakeSet->sims.count);
+			b2BodySim* bodySim = awakeSet->sims.data + bodySimIndex;
 
-				int shapeId = body->headShapeId;
-				while (shapeId != B2_NULL_INDEX)
-				{
-					b2CheckId(shapes, shapeId);
-					b2Shape* shape = shapes + shapeId;
+			b2CheckIndex(world->bodyArray, bodySim->bodyId);
+			b2Body* body = world->bodyArray + bodySim->bodyId;
 
-					if (shape->enlargedAABB)
-					{
-						B2_ASSERT(shape->isFast == false);
+			int shapeId = body->headShapeId;
+			while (shapeId != B2_NULL_INDEX)
+			{
+				b2CheckId(shapes, shapeId);
+				b2Shape* shape = shapes + shapeId;
 
-						b2BroadPhase_EnlargeProxy(broadPhase, shape->proxyKey, shape->fatAABB);
-						shape->enlargedAABB = false;
-					}
-					else if (shape->isFast)
-					{
-						// Shape is fast. It's aabb will be enlarged in continuous collision.
-						b2BufferMove(broadPhase, shape->proxyKey);
-					}
+				if (shape->enlargedAABB)
+				{
+					B2_ASSERT(shape->isFast == false);
 
-					shapeId = shape->nextShapeId;
+					b2BroadPhase_EnlargeProxy(broadPhase, shape->proxyKey, shape->fatAABB);
+					shape->enlargedAABB = false;
+				}
+				else if (shape->isFast)
+				{
+					// Shape is fast. It's aabb will be enlarged in continuous collision.
+					b2BufferMove(broadPhase, shape->proxyKey);
 				}
 
-				// Clear the smallest set bit
-				word = word & (word - 1);
+				shapeId = shape->nextShapeId;
 			}
 		}
 	}
 
+	b2FreeStackItem(&world->stackAllocator, enlargedSims);
+
 	b2TracyCZoneEnd(enlarge_proxies);
 
 	b2ValidateBroadphase(&world->broadPhase);
@@ -1784,28 +2234,59 @@ void b2Solve(b2World* world, b2StepContext* stepContext)
 
 	b2TracyCZoneNC(continuous_collision, "Continuous", b2_colorDarkGoldenrod, true);
 
-	// Parallel continuous collision
+	// Gather the fast bodies found by each worker and clear the worker lists
+	{
+		int fastBodyCount = 0;
+		int bulletBodyCount = 0;
+		for (int i = 0; i < taskContextCount; ++i)
+		{
+			fastBodyCount += world->taskContextArray[i].fastBodies.count;
+			bulletBodyCount += world->taskContextArray[i].bulletBodies.count;
+		}
+
+		stepContext->fastBodies = b2AllocateStackItem(&world->stackAllocator, fastBodyCount * sizeof(int), "fast bodies");
+		stepContext->bulletBodies = b2AllocateStackItem(&world->stackAllocator, bulletBodyCount * sizeof(int), "bullet bodies");
+
+		for (int i = 0; i < taskContextCount; ++i)
+		{
+			b2TaskContext* taskContext = world->taskContextArray + i;
+			if (taskContext->fastBodies.count > 0)
+			{
+				memcpy(stepContext->fastBodies + stepContext->fastBodyCount, taskContext->fastBodies.data,
+					   taskContext->fastBodies.count * sizeof(int));
+				stepContext->fastBodyCount += taskContext->fastBodies.count;
+			}
+
+			if (taskContext->bulletBodies.count > 0)
+			{
+				memcpy(stepContext->bulletBodies + stepContext->bulletBodyCount, taskContext->bulletBodies.data,
+					   taskContext->bulletBodies.count * sizeof(int));
+				stepContext->bulletBodyCount += taskContext->bulletBodies.count;
+			}
+
+			taskContext->fastBodies = (b2ArenaIntArray){0};
+			taskContext->bulletBodies = (b2ArenaIntArray){0};
+		}
+	}
+
+	// Parallel continuous collision. Bullets are swept after the non-bullet fast bodies.
 	{
-		// fast bodies
 		int minRange = 8;
 		void* userFastBodyTask =
-			world->enqueueTaskFcn(&b2FastBodyTask, stepContext->fastBodyCount, minRange, stepContext, world->userTaskContext);
-		world->taskCount += 1;
+			b2EnqueueDependentTask(world, &b2FastBodyTask, stepContext->fastBodyCount, minRange, stepContext, NULL, 0);
+		void* userBulletBodyTask = b2EnqueueDependentTask(world, &b2BulletBodyTask, stepContext->bulletBodyCount, minRange,
+														  stepContext, &userFastBodyTask, 1);
+
 		if (userFastBodyTask != NULL)
 		{
 			world->finishTaskFcn(userFastBodyTask, world->userTaskContext);
+			world->activeTaskCount -= 1;
 		}
-	}
 
-	{
-		// bullet bodies
-		int minRange = 8;
-		void* userBulletBodyTask =
-			world->enqueueTaskFcn(&b2BulletBodyTask, stepContext->bulletBodyCount, minRange, stepContext, world->userTaskContext);
-		world->taskCount += 1;
 		if (userBulletBodyTask != NULL)
 		{
 			world->finishTaskFcn(userBulletBodyTask, world->userTaskContext);
+			world->activeTaskCount -= 1;
 		}
 	}
 
@@ -1856,6 +2337,7 @@ void b2Solve(b2World* world, b2StepContext* stepContext)
 				B2_ASSERT(b2ContainsKey(&broadPhase->moveSet, proxyKey + 1));
 
 				b2DynamicTree_EnlargeProxy(movableTree, proxyId, shape->fatAABB);
+				broadPhase->treeRevisions[b2_movableProxy] += 1;
 
 				shapeId = shape->nextShapeId;
 			}
@@ -1902,6 +2384,7 @@ void b2Solve(b2World* world, b2StepContext* stepContext)
 				B2_ASSERT(b2ContainsKey(&broadPhase->moveSet, proxyKey + 1));
 
 				b2DynamicTree_EnlargeProxy(movableTree, proxyId, shape->fatAABB);
+				broadPhase->treeRevisions[b2_movableProxy] += 1;
 
 				shapeId = shape->nextShapeId;
 			}
@@ -1920,34 +2403,33 @@ void b2Solve(b2World* world, b2StepContext* stepContext)
 
 	world->profile.continuous = b2GetMillisecondsAndReset(&timer);
 
+	// Finish hit events before island sleep changes the constraint graph
+	if (hitEventsTask != NULL)
+	{
+		world->finishTaskFcn(hitEventsTask, world->userTaskContext);
+		world->activeTaskCount -= 1;
+	}
+
 	// Island sleeping
 	// This must be done last because putting islands to sleep invalidates the enlarged body bits.
 	if (world->enableSleep == true)
 	{
 		b2TracyCZoneNC(sleep_islands, "Island Sleep", b2_colorGainsboro, true);
 
-		// Collect split island candidate for the next time step. No need to split if sleeping is disabled.
-		B2_ASSERT(world->splitIslandId == B2_NULL_INDEX);
-		float splitSleepTimer = 0.0f;
-		for (int i = 0; i < world->workerCount; ++i)
+		if (sleepTask != NULL)
 		{
-			b2TaskContext* taskContext = world->taskContextArray + i;
-			if (taskContext->splitIslandId != B2_NULL_INDEX && taskContext->splitSleepTime > splitSleepTimer)
-			{
-				world->splitIslandId = taskContext->splitIslandId;
-				splitSleepTimer = taskContext->splitSleepTime;
-			}
+			world->finishTaskFcn(sleepTask, world->userTaskContext);
+			world->activeTaskCount -= 1;
 		}
 
 		b2BitSet* awakeIslandBitSet = &world->taskContextArray[0].awakeIslandBitSet;
-		for (int i = 1; i < world->workerCount; ++i)
-		{
-			b2InPlaceUnion(awakeIslandBitSet, &world->taskContextArray[i].awakeIslandBitSet);
-		}
 
-		// Need to process in reverse because this moves islands to sleeping solver sets.
+		// Gather the islands that fell asleep and move them to sleeping solver sets in one batch.
+		// Reverse order matches the order islands were historically put to sleep.
 		b2IslandSim* islands = awakeSet->islands.data;
 		int count = awakeSet->islands.count;
+		int* sleepIslandIds = b2AllocateStackItem(&world->stackAllocator, count * sizeof(int), "sleep island ids");
+		int sleepCount = 0;
 		for (int islandIndex = count - 1; islandIndex >= 0; islandIndex -= 1)
 		{
 			if (b2GetBit(awakeIslandBitSet, islandIndex) == true)
@@ -1956,12 +2438,13 @@ void b2Solve(b2World* world, b2StepContext* stepContext)
 				continue;
 			}
 
-			b2IslandSim* island = islands + islandIndex;
-			int islandId = island->islandId;
-
-			b2TrySleepIsland(world, islandId);
+			sleepIslandIds[sleepCount] = islands[islandIndex].islandId;
+			sleepCount += 1;
 		}
 
+		b2SleepIslands(world, sleepIslandIds, sleepCount);
+		b2FreeStackItem(&world->stackAllocator, sleepIslandIds);
+
 		b2ValidateSolverSets(world);
 
 		b2TracyCZoneEnd(sleep_islands);
@@ -4,6 +4,7 @@
 #pragma once
 
 #include "block_array.h"
+#include "core.h"
 
 #include "box2d/math_types.h"
 
@@ -50,25 +51,34 @@ typedef enum b2SolverBlockType
 // on a single block index atomic. For non-iterative stages the sync index is simply set to one. For iterative stages (solver
 // iteration) the same block of work is executed once per iteration and the atomic sync index is shared across iterations, so it
 // increases monotonically.
+// Blocks are padded to a cache line so workers claiming neighboring blocks don't contend for the same line.
 typedef struct b2SolverBlock
 {
 	int startIndex;
 	int16_t count;
 	int16_t blockType; // b2SolverBlockType
-	// todo consider false sharing of this atomic
 	_Atomic int syncIndex;
+	char padding[b2_cacheLineSize - 3 * sizeof(int)];
 } b2SolverBlock;
 
 // Each stage must be completed before going to the next stage.
 // Non-iterative stages use a stage instance once while iterative stages re-use the same instance each iteration.
+// Stages are padded to a cache line so the completion counters of different stages don't share a line.
 typedef struct b2SolverStage
 {
-	b2SolverStageType type;
-	b2SolverBlock* blocks;
-	int blockCount;
-	int colorIndex;
-	// todo consider false sharing of this atomic
-	_Atomic int completionCount;
+	union
+	{
+		struct
+		{
+			b2SolverStageType type;
+			b2SolverBlock* blocks;
+			int blockCount;
+			int colorIndex;
+			_Atomic int completionCount;
+		};
+
+		char padding[b2_cacheLineSize];
+	};
 } b2SolverStage;
 
 // Context for a time step. Recreated each time step.
@@ -107,29 +117,34 @@ typedef struct b2StepContext
 
 	// Array of fast bodies that need continuous collision handling
 	int* fastBodies;
-	_Atomic int fastBodyCount;
+	int fastBodyCount;
 
 	// Array of bullet bodies that need continuous collision handling
 	int* bulletBodies;
-	_Atomic int bulletBodyCount;
+	int bulletBodyCount;
 
 	// joint pointers for simplified parallel-for access.
 	b2JointSim** joints;
 
 	// contact pointers for simplified parallel-for access.
-	// - parallel-for collide with no gaps
+	// - parallel-for collide of touching contacts with no gaps
 	// - parallel-for prepare and store contacts with NULL gaps for SIMD remainders
 	// despite being an array of pointers, these are contiguous sub-arrays corresponding
 	// to constraint graph colors
 	b2ContactSim** contacts;
 
+	// Number of touching contacts in the collide range. The non-touching contacts of the awake set follow.
+	int touchingContactCount;
+
 	struct b2ContactConstraintSIMD* simdContactConstraints;
 	int activeColorCount;
 	int workerCount;
 
 	b2SolverStage* stages;
 	int stageCount;
+
 	bool enableWarmStarting;
+	bool enableWorkerAffinity;
 
 	// todo padding to prevent false sharing
 	char dummy1[64];
@@ -156,3 +171,6 @@ static inline b2Softness b2MakeSoft(float hertz, float zeta, float h)
 }
 
 void b2Solve(b2World* world, b2StepContext* stepContext);
+
+// Upper bound of the stack memory used by b2Solve for the current awake set
+int b2EstimateSolverStackSize(b2World* world);
@@ -3,24 +3,33 @@
 
 #include "solver_set.h"
 
+#include "array.h"
+#include "bitset.h"
 #include "body.h"
 #include "constraint_graph.h"
 #include "contact.h"
 #include "core.h"
 #include "island.h"
 #include "joint.h"
+#include "stack_allocator.h"
+#include "util.h"
 #include "world.h"
 
+#include "box2d/color.h"
 #include "box2d/event_types.h"
 
 #include <string.h>
 
+// Minimum number of items per task when moving data between solver sets. Smaller batches are done on the calling thread.
+#define b2_solverSetMinRange 256
+
 void b2DestroySolverSet(b2World* world, int setIndex)
 {
 	b2SolverSet* set = world->solverSetArray + setIndex;
 	b2DestroyBodySimArray(&world->blockAllocator, &set->sims);
 	b2DestroyBodyStateArray(&world->blockAllocator, &set->states);
 	b2DestroyContactArray(&world->blockAllocator, &set->contacts);
+	b2DestroyNonTouchingContactArray(&world->blockAllocator, &set->nonTouchingContacts);
 	b2DestroyJointArray(&world->blockAllocator, &set->joints);
 	b2DestroyIslandArray(&world->blockAllocator, &set->islands);
 	b2FreeId(&world->solverSetIdPool, setIndex);
@@ -28,16 +37,122 @@ void b2DestroySolverSet(b2World* world, int setIndex)
 	set->setIndex = B2_NULL_INDEX;
 }
 
+// Run a solver set task using the task system when there is enough work. Sets are also woken and put to sleep
+// by the user between steps. The task system is only used within the step, so those run on the calling thread.
+static void b2RunSolverSetTask(b2World* world, b2TaskCallback* task, int itemCount, int minRange, void* context)
+{
+	if (itemCount == 0)
+	{
+		return;
+	}
+
+	if (itemCount <= minRange || world->locked == false)
+	{
+		task(0, itemCount, 0, context);
+		return;
+	}
+
+	void* userTask = world->enqueueTaskFcn(task, itemCount, minRange, context, world->userTaskContext);
+	world->taskCount += 1;
+	if (userTask != NULL)
+	{
+		world->finishTaskFcn(userTask, world->userTaskContext);
+	}
+}
+
+typedef struct b2WakeContext
+{
+	b2World* world;
+	b2SolverSet* set;
+	int bodyBase;
+} b2WakeContext;
+
+// Copy bodies into the slots reserved at the end of the awake set
+static void b2WakeBodiesTask(int startIndex, int endIndex, uint32_t threadIndex, void* context)
+{
+	b2TracyCZoneNC(wake_bodies, "Wake Bodies", b2_colorGainsboro, true);
+
+	b2WakeContext* wakeContext = context;
+	b2World* world = wakeContext->world;
+	b2TraceScope traceScope = b2EnterTraceScope(world->worldId, (int)threadIndex);
+	b2SolverSet* set = wakeContext->set;
+	b2SolverSet* awakeSet = world->solverSetArray + b2_awakeSet;
+	b2Body* bodies = world->bodyArray;
+	int bodyBase = wakeContext->bodyBase;
+
+	for (int i = startIndex; i < endIndex; ++i)
+	{
+		b2BodySim* simSrc = set->sims.data + i;
+
+		b2Body* body = bodies + simSrc->bodyId;
+		B2_ASSERT(body->setIndex == set->setIndex);
+		body->setIndex = b2_awakeSet;
+		body->localIndex = bodyBase + i;
+
+		// Reset sleep timer
+		body->sleepTime = 0.0f;
+
+		memcpy(awakeSet->sims.data + bodyBase + i, simSrc, sizeof(b2BodySim));
+		awakeSet->states.data[bodyBase + i] = b2_identityBodyState;
+	}
+
+	b2TracyCZoneEnd(wake_bodies);
+
+	b2LeaveTraceScope(traceScope);
+}
+
+// Copy contacts and joints into the graph slots assigned by b2ReserveContactsInGraph and b2ReserveJointsInGraph
+static void b2WakeConstraintsTask(int startIndex, int endIndex, uint32_t threadIndex, void* context)
+{
+	b2TracyCZoneNC(wake_constraints, "Wake Constraints", b2_colorGainsboro, true);
+
+	b2WakeContext* wakeContext = context;
+	b2World* world = wakeContext->world;
+	b2TraceScope traceScope = b2EnterTraceScope(world->worldId, (int)threadIndex);
+	b2SolverSet* set = wakeContext->set;
+	b2GraphColor* colors = world->constraintGraph.colors;
+	int contactCount = set->contacts.count;
+
+	for (int i = startIndex; i < endIndex; ++i)
+	{
+		if (i < contactCount)
+		{
+			b2ContactSim* contactSim = set->contacts.data + i;
+			b2Contact* contact = world->contactArray + contactSim->contactId;
+			B2_ASSERT(contact->setIndex == b2_awakeSet);
+			b2FillGraphContact(world, contactSim, contact);
+		}
+		else
+		{
+			b2JointSim* jointSim = set->joints.data + (i - contactCount);
+			b2Joint* joint = world->jointArray + jointSim->jointId;
+			B2_ASSERT(joint->setIndex == b2_awakeSet);
+			b2GraphColor* color = colors + joint->colorIndex;
+			B2_ASSERT(0 <= joint->localIndex && joint->localIndex < color->joints.count);
+			memcpy(color->joints.data + joint->localIndex, jointSim, sizeof(b2JointSim));
+		}
+	}
+
+	b2TracyCZoneEnd(wake_constraints);
+
+	b2LeaveTraceScope(traceScope);
+}
+
 // Wake a solver set. Does not merge islands.
 // Contacts can be in several places:
 // 1. non-touching contacts in the disabled set
 // 2. non-touching contacts already in the awake set
 // 3. touching contacts in the sleeping set
 // This handles contact types 1 and 3. Type 2 doesn't need any action.
+// The awake arrays and graph colors are grown once and the copies are done in parallel for large sets.
+// Graph colors are assigned serially in the same order as before so the result is deterministic.
 void b2WakeSolverSet(b2World* world, int setIndex)
 {
 	B2_ASSERT(setIndex >= b2_firstSleepingSet);
 	b2CheckIndex(world->solverSetArray, setIndex);
+
+	b2TracyCZoneNC(wake_set, "Wake Set", b2_colorGainsboro, true);
+
 	b2SolverSet* set = world->solverSetArray + setIndex;
 	b2SolverSet* awakeSet = world->solverSetArray + b2_awakeSet;
 	b2SolverSet* disabledSet = world->solverSetArray + b2_disabledSet;
@@ -46,26 +161,24 @@ void b2WakeSolverSet(b2World* world, int setIndex)
 	b2Body* bodies = world->bodyArray;
 	b2Contact* contacts = world->contactArray;
 
+	b2WakeContext context = {world, set, awakeSet->sims.count};
+
+	// reserve awake body slots
 	int bodyCount = set->sims.count;
-	for (int i = 0; i < bodyCount; ++i)
 	{
-		b2BodySim* simSrc = set->sims.data + i;
-
-		b2Body* body = bodies + simSrc->bodyId;
-		B2_ASSERT(body->setIndex == setIndex);
-		body->setIndex = b2_awakeSet;
-		body->localIndex = awakeSet->sims.count;
-
-		// Reset sleep timer
-		body->sleepTime = 0.0f;
+		int newCount = awakeSet->sims.count + bodyCount;
+		b2ReserveBodySimArray(alloc, &awakeSet->sims, newCount);
+		b2ReserveBodyStateArray(alloc, &awakeSet->states, newCount);
+		awakeSet->sims.count = newCount;
+		awakeSet->states.count = newCount;
+	}
 
-		b2BodySim* simDst = b2AddBodySim(alloc, &awakeSet->sims);
-		memcpy(simDst, simSrc, sizeof(b2BodySim));
+	b2RunSolverSetTask(world, &b2WakeBodiesTask, bodyCount, b2_solverSetMinRange, &context);
 
-		b2BodyState* state = b2AddBodyState(alloc, &awakeSet->states);
-		*state = b2_identityBodyState;
-
-		// move non-touching contacts from disabled set to awake set
+	// move non-touching contacts from disabled set to awake set
+	for (int i = 0; i < bodyCount; ++i)
+	{
+		b2Body* body = bodies + set->sims.data[i].bodyId;
 		int contactKey = body->headContactKey;
 		while (contactKey != B2_NULL_INDEX)
 		{
@@ -84,21 +197,22 @@ void b2WakeSolverSet(b2World* world, int setIndex)
 			}
 
 			int localIndex = contact->localIndex;
-			B2_ASSERT(0 <= localIndex && localIndex < disabledSet->contacts.count);
-			b2ContactSim* contactSim = disabledSet->contacts.data + localIndex;
+			B2_ASSERT(0 <= localIndex && localIndex < disabledSet->nonTouchingContacts.count);
+			b2NonTouchingContactSim* contactSim = disabledSet->nonTouchingContacts.data + localIndex;
 
-			B2_ASSERT((contact->flags & b2_contactTouchingFlag) == 0 && contactSim->manifold.pointCount == 0);
+			B2_ASSERT((contact->flags & b2_contactTouchingFlag) == 0);
 
 			contact->setIndex = b2_awakeSet;
-			contact->localIndex = awakeSet->contacts.count;
-			b2ContactSim* awakeContactSim = b2AddContact(&world->blockAllocator, &awakeSet->contacts);
-			memcpy(awakeContactSim, contactSim, sizeof(b2ContactSim));
+			contact->localIndex = awakeSet->nonTouchingContacts.count;
+			b2NonTouchingContactSim* awakeContactSim =
+				b2AddNonTouchingContactSim(&world->blockAllocator, &awakeSet->nonTouchingContacts);
+			memcpy(awakeContactSim, contactSim, sizeof(b2NonTouchingContactSim));
 
-			int movedLocalIndex = b2RemoveContact(&disabledSet->contacts, localIndex);
+			int movedLocalIndex = b2RemoveNonTouchingContactSim(&disabledSet->nonTouchingContacts, localIndex);
 			if (movedLocalIndex != B2_NULL_INDEX)
 			{
 				// fix moved element
-				b2ContactSim* movedContact = disabledSet->contacts.data + localIndex;
+				b2NonTouchingContactSim* movedContact = disabledSet->nonTouchingContacts.data + localIndex;
 				int movedId = movedContact->contactId;
 				b2CheckIndex(contacts, movedId);
 				B2_ASSERT(contacts[movedId].localIndex == movedLocalIndex);
@@ -107,9 +221,11 @@ void b2WakeSolverSet(b2World* world, int setIndex)
 		}
 	}
 
-	// transfer touching contacts from sleeping set to contact graph
+	// transfer touching contacts and joints from sleeping set to contact graph
+	int contactCount = set->contacts.count;
+	int jointCount = set->joints.count;
 	{
-		int contactCount = set->contacts.count;
+		b2ReserveContactsInGraph(world, set->contacts.data, contactCount);
 		for (int i = 0; i < contactCount; ++i)
 		{
 			b2ContactSim* contactSim = set->contacts.data + i;
@@ -118,25 +234,21 @@ void b2WakeSolverSet(b2World* world, int setIndex)
 			B2_ASSERT(contactSim->simFlags & b2_simTouchingFlag);
 			B2_ASSERT(contactSim->manifold.pointCount > 0);
 			B2_ASSERT(contact->setIndex == setIndex);
-			b2AddContactToGraph(world, contactSim, contact);
 			contact->setIndex = b2_awakeSet;
 		}
-	}
 
-	// transfer joints from sleeping set to awake set
-	{
+		b2ReserveJointsInGraph(world, set->joints.data, jointCount);
 		b2Joint* joints = world->jointArray;
-		int jointCount = set->joints.count;
 		for (int i = 0; i < jointCount; ++i)
 		{
-			b2JointSim* jointSim = set->joints.data + i;
-			b2Joint* joint = joints + jointSim->jointId;
+			b2Joint* joint = joints + set->joints.data[i].jointId;
 			B2_ASSERT(joint->setIndex == setIndex);
-			b2AddJointToGraph(world, jointSim, joint);
 			joint->setIndex = b2_awakeSet;
 		}
 	}
 
+	b2RunSolverSetTask(world, &b2WakeConstraintsTask, contactCount + jointCount, b2_solverSetMinRange, &context);
+
 	// transfer island from sleeping set to awake set
 	// Usually a sleeping set has only one island, but it is possible
 	// that joints are created between sleeping islands and they
@@ -160,62 +272,72 @@ void b2WakeSolverSet(b2World* world, int setIndex)
 	b2DestroySolverSet(world, setIndex);
 
 	b2ValidateSolverSets(world);
+
+	b2TracyCZoneEnd(wake_set);
 }
 
-void b2TrySleepIsland(b2World* world, int islandId)
+// An island that is going to sleep and its new solver set
+typedef struct b2SleepIsland
 {
-	b2CheckIndex(world->islandArray, islandId);
-	b2Island* island = world->islandArray + islandId;
-	B2_ASSERT(island->setIndex == b2_awakeSet);
-
-	// cannot put an island to sleep while it has a pending split
-	if (island->constraintRemoveCount > 0)
-	{
-		return;
-	}
+	int islandId;
+	int setIndex;
+} b2SleepIsland;
 
-	b2BodyMoveEvent* moveEvents = world->bodyMoveEventArray;
+typedef enum b2SleepMoveType
+{
+	b2_sleepMoveBody,
+	b2_sleepMoveContact,
+	b2_sleepMoveJoint,
+} b2SleepMoveType;
 
-	// island is sleeping
-	// - create new sleeping solver set
-	// - move island to sleeping solver set
-	// - identify non-touching contacts that should move to sleeping solver set or disabled set
-	// - remove old island
-	// - fix island
-	int sleepSetId = b2AllocId(&world->solverSetIdPool);
-	if (sleepSetId == b2Array(world->solverSetArray).count)
-	{
-		b2SolverSet set = {0};
-		set.setIndex = B2_NULL_INDEX;
-		b2Array_Push(world->solverSetArray, set);
-	}
+// Moves an awake element from the tail of an array into a hole left by a sleeping element
+typedef struct b2SleepMove
+{
+	int type;
+	int colorIndex;
+	int dst;
+	int src;
+} b2SleepMove;
 
-	b2SolverSet* sleepSet = world->solverSetArray + sleepSetId;
-	*sleepSet = (b2SolverSet){0};
+typedef struct b2SleepContext
+{
+	b2World* world;
+	b2SleepIsland* islands;
+	int islandCount;
+	b2SleepMove* moves;
+	int moveCount;
+} b2SleepContext;
+
+// Copy island data into the pre-sized sleeping set. The awake arrays are not modified while this runs.
+static void b2CopySleepingIslandsTask(int startIndex, int endIndex, uint32_t threadIndex, void* context)
+{
+	b2TracyCZoneNC(copy_sleep, "Copy Sleep", b2_colorGainsboro, true);
 
-	// grab awake set after creating the sleep set because the solver set array may have been resized
+	b2SleepContext* sleepContext = context;
+	b2World* world = sleepContext->world;
+	b2TraceScope traceScope = b2EnterTraceScope(world->worldId, (int)threadIndex);
 	b2SolverSet* awakeSet = world->solverSetArray + b2_awakeSet;
-	B2_ASSERT(0 <= island->localIndex && island->localIndex < awakeSet->islands.count);
-
-	sleepSet->setIndex = sleepSetId;
-	sleepSet->sims = b2CreateBodySimArray(&world->blockAllocator, island->bodyCount);
-	sleepSet->contacts = b2CreateContactArray(&world->blockAllocator, island->contactCount);
-	sleepSet->joints = b2CreateJointArray(&world->blockAllocator, island->jointCount);
+	b2GraphColor* colors = world->constraintGraph.colors;
+	b2BodyMoveEvent* moveEvents = world->bodyMoveEventArray;
+	b2Body* bodies = world->bodyArray;
+	b2Contact* contacts = world->contactArray;
+	b2Joint* joints = world->jointArray;
 
-	// move awake bodies to sleeping set
-	// this shuffles around bodies in the awake set
+	for (int i = startIndex; i < endIndex; ++i)
 	{
-		b2SolverSet* disabledSet = world->solverSetArray + b2_disabledSet;
-		b2Body* bodies = world->bodyArray;
-		b2Contact* contacts = world->contactArray;
+		b2SleepIsland* sleepIsland = sleepContext->islands + i;
+		b2Island* island = world->islandArray + sleepIsland->islandId;
+		b2SolverSet* sleepSet = world->solverSetArray + sleepIsland->setIndex;
+
+		int sleepIndex = 0;
 		int bodyId = island->headBody;
 		while (bodyId != B2_NULL_INDEX)
 		{
 			b2CheckIndex(bodies, bodyId);
 			b2Body* body = bodies + bodyId;
 			B2_ASSERT(body->setIndex == b2_awakeSet);
-			B2_ASSERT(body->islandId == islandId);
-			
+			B2_ASSERT(body->islandId == sleepIsland->islandId);
+
 			// Update the body move event to indicate this body fell asleep
 			// It could happen the body is forced asleep before it ever moves.
 			if (body->bodyMoveIndex != B2_NULL_INDEX)
@@ -226,37 +348,365 @@ void b2TrySleepIsland(b2World* world, int islandId)
 				moveEvents[body->bodyMoveIndex].fellAsleep = true;
 				body->bodyMoveIndex = B2_NULL_INDEX;
 			}
-			
+
 			int awakeBodyIndex = body->localIndex;
 			B2_ASSERT(0 <= awakeBodyIndex && awakeBodyIndex < awakeSet->sims.count);
+			B2_ASSERT(sleepIndex < sleepSet->sims.count);
+			memcpy(sleepSet->sims.data + sleepIndex, awakeSet->sims.data + awakeBodyIndex, sizeof(b2BodySim));
+			sleepIndex += 1;
 
-			b2BodySim* awakeSim = awakeSet->sims.data + awakeBodyIndex;
+			bodyId = body->islandNext;
+		}
 
-			// move body sim to sleep set
-			int sleepBodyIndex = sleepSet->sims.count;
-			b2BodySim* sleepBodySim = b2AddBodySim(&world->blockAllocator, &sleepSet->sims);
-			memcpy(sleepBodySim, awakeSim, sizeof(b2BodySim));
+		sleepIndex = 0;
+		int contactId = island->headContact;
+		while (contactId != B2_NULL_INDEX)
+		{
+			b2CheckIndex(contacts, contactId);
+			b2Contact* contact = contacts + contactId;
+			B2_ASSERT(contact->setIndex == b2_awakeSet);
+			B2_ASSERT(contact->islandId == sleepIsland->islandId);
+			int colorIndex = contact->colorIndex;
+			B2_ASSERT(0 <= colorIndex && colorIndex < b2_graphColorCount);
 
-			int movedIndex = b2RemoveBodySim(&awakeSet->sims, awakeBodyIndex);
-			if (movedIndex != B2_NULL_INDEX)
+			b2GraphColor* color = colors + colorIndex;
+			B2_ASSERT(0 <= contact->localIndex && contact->localIndex < color->contacts.count);
+			B2_ASSERT(sleepIndex < sleepSet->contacts.count);
+			memcpy(sleepSet->contacts.data + sleepIndex, color->contacts.data + contact->localIndex, sizeof(b2ContactSim));
+			sleepIndex += 1;
+
+			contactId = contact->islandNext;
+		}
+
+		sleepIndex = 0;
+		int jointId = island->headJoint;
+		while (jointId != B2_NULL_INDEX)
+		{
+			b2CheckIndex(joints, jointId);
+			b2Joint* joint = joints + jointId;
+			B2_ASSERT(joint->setIndex == b2_awakeSet);
+			B2_ASSERT(joint->islandId == sleepIsland->islandId);
+			int colorIndex = joint->colorIndex;
+			B2_ASSERT(0 <= colorIndex && colorIndex < b2_graphColorCount);
+
+			b2GraphColor* color = colors + colorIndex;
+			B2_ASSERT(0 <= joint->localIndex && joint->localIndex < color->joints.count);
+			B2_ASSERT(sleepIndex < sleepSet->joints.count);
+			memcpy(sleepSet->joints.data + sleepIndex, color->joints.data + joint->localIndex, sizeof(b2JointSim));
+			sleepIndex += 1;
+
+			jointId = joint->islandNext;
+		}
+	}
+
+	b2TracyCZoneEnd(copy_sleep);
+
+	b2LeaveTraceScope(traceScope);
+}
+
+// Fill the holes left by sleeping elements. Every move has a unique source and destination and sources
+// are beyond the new array count, so the moves are independent.
+static void b2CompactAwakeTask(int startIndex, int endIndex, uint32_t threadIndex, void* context)
+{
+	b2TracyCZoneNC(compact_awake, "Compact Awake", b2_colorGainsboro, true);
+
+	b2SleepContext* sleepContext = context;
+	b2World* world = sleepContext->world;
+	b2TraceScope traceScope = b2EnterTraceScope(world->worldId, (int)threadIndex);
+	b2SolverSet* awakeSet = world->solverSetArray + b2_awakeSet;
+	b2GraphColor* colors = world->constraintGraph.colors;
+
+	for (int i = startIndex; i < endIndex; ++i)
+	{
+		b2SleepMove* move = sleepContext->moves + i;
+		int dst = move->dst;
+		int src = move->src;
+
+		switch (move->type)
+		{
+			case b2_sleepMoveBody:
+			{
+				memcpy(awakeSet->sims.data + dst, awakeSet->sims.data + src, sizeof(b2BodySim));
+				awakeSet->states.data[dst] = awakeSet->states.data[src];
+				int movedId = awakeSet->sims.data[dst].bodyId;
+				b2CheckIndex(world->bodyArray, movedId);
+				b2Body* movedBody = world->bodyArray + movedId;
+				B2_ASSERT(movedBody->localIndex == src);
+				movedBody->localIndex = dst;
+			}
+			break;
+
+			case b2_sleepMoveContact:
 			{
-				// fix local index on moved element
-				b2BodySim* movedSim = awakeSet->sims.data + awakeBodyIndex;
-				int movedId = movedSim->bodyId;
-				b2CheckIndex(bodies, movedId);
-				b2Body* movedBody = bodies + movedId;
-				B2_ASSERT(movedBody->localIndex == movedIndex);
-				movedBody->localIndex = awakeBodyIndex;
+				b2GraphColor* color = colors + move->colorIndex;
+				memcpy(color->contacts.data + dst, color->contacts.data + src, sizeof(b2ContactSim));
+				int movedId = color->contacts.data[dst].contactId;
+				b2CheckIndex(world->contactArray, movedId);
+				b2Contact* movedContact = world->contactArray + movedId;
+				B2_ASSERT(movedContact->localIndex == src);
+				movedContact->localIndex = dst;
 			}
+			break;
+
+			case b2_sleepMoveJoint:
+			{
+				b2GraphColor* color = colors + move->colorIndex;
+				memcpy(color->joints.data + dst, color->joints.data + src, sizeof(b2JointSim));
+				int movedId = color->joints.data[dst].jointId;
+				b2CheckIndex(world->jointArray, movedId);
+				b2Joint* movedJoint = world->jointArray + movedId;
+				B2_ASSERT(movedJoint->localIndex == src);
+				movedJoint->localIndex = dst;
+			}
+			break;
+
+			default:
+				B2_ASSERT(false);
+				break;
+		}
+	}
+
+	b2TracyCZoneEnd(compact_awake);
+
+	b2LeaveTraceScope(traceScope);
+}
+
+// Plan the moves that remove the flagged elements from an array of the given count. Holes are filled in ascending order
+// by the last remaining element, so the result is deterministic. Returns the new count.
+static int b2PlanCompaction(b2SleepContext* context, const uint8_t* removed, int count, int type, int colorIndex)
+{
+	int newCount = count;
+	for (int hole = 0; hole < newCount; ++hole)
+	{
+		if (removed[hole] == 0)
+		{
+			continue;
+		}
+
+		// drop removed elements from the tail
+		while (newCount > hole && removed[newCount - 1] != 0)
+		{
+			newCount -= 1;
+		}
+
+		if (hole >= newCount)
+		{
+			break;
+		}
+
+		newCount -= 1;
+		b2SleepMove* move = context->moves + context->moveCount;
+		move->type = type;
+		move->colorIndex = colorIndex;
+		move->dst = hole;
+		move->src = newCount;
+		context->moveCount += 1;
+	}
+
+	return newCount;
+}
+
+// Put a batch of awake islands to sleep. Each island gets its own sleeping solver set.
+// - serially create pre-sized sleeping sets
+// - copy bodies, contacts, and joints into the sleeping sets in parallel
+// - serially update graph coloring, id bookkeeping, and non-touching contacts
+// - compact the awake arrays in parallel
+// The compaction order only depends on the island order, so this is deterministic.
+void b2SleepIslands(b2World* world, const int* islandIds, int count)
+{
+	if (count == 0)
+	{
+		return;
+	}
 
-			// destroy state, no need to clone
-			b2RemoveBodyState(&awakeSet->states, awakeBodyIndex);
+	b2TracyCZoneNC(sleep_islands, "Sleep Islands", b2_colorGainsboro, true);
 
+	b2StackAllocator* alloc = &world->stackAllocator;
+	b2SleepContext context = {0};
+	context.world = world;
+	context.islands = b2AllocateStackItem(alloc, count * sizeof(b2SleepIsland), "sleep islands");
+
+	// Create sleeping sets sized for their islands
+	int sleepBodyCount = 0;
+	int sleepContactCount = 0;
+	int sleepJointCount = 0;
+	for (int i = 0; i < count; ++i)
+	{
+		int islandId = islandIds[i];
+		b2CheckIndex(world->islandArray, islandId);
+		b2Island* island = world->islandArray + islandId;
+		B2_ASSERT(island->setIndex == b2_awakeSet);
+
+		// cannot put an island to sleep while it has a pending split
+		if (island->constraintRemoveCount > 0)
+		{
+			continue;
+		}
+
+		int sleepSetId = b2AllocId(&world->solverSetIdPool);
+		if (sleepSetId == b2Array(world->solverSetArray).count)
+		{
+			b2SolverSet set = {0};
+			set.setIndex = B2_NULL_INDEX;
+			b2Array_Push(world->solverSetArray, set);
+		}
+
+		b2SolverSet* sleepSet = world->solverSetArray + sleepSetId;
+		*sleepSet = (b2SolverSet){0};
+		sleepSet->setIndex = sleepSetId;
+		sleepSet->sims = b2CreateBodySimArray(&world->blockAllocator, island->bodyCount);
+		sleepSet->sims.count = island->bodyCount;
+		sleepSet->contacts = b2CreateContactArray(&world->blockAllocator, island->contactCount);
+		sleepSet->contacts.count = island->contactCount;
+		sleepSet->joints = b2CreateJointArray(&world->blockAllocator, island->jointCount);
+		sleepSet->joints.count = island->jointCount;
+
+		context.islands[context.islandCount] = (b2SleepIsland){islandId, sleepSetId};
+		context.islandCount += 1;
+
+		sleepBodyCount += island->bodyCount;
+		sleepContactCount += island->contactCount;
+		sleepJointCount += island->jointCount;
+	}
+
+	if (context.islandCount == 0)
+	{
+		b2FreeStackItem(alloc, context.islands);
+		b2TracyCZoneEnd(sleep_islands);
+		return;
+	}
+
+	b2RunSolverSetTask(world, &b2CopySleepingIslandsTask, context.islandCount, 1, &context);
+
+	// grab awake set after creating the sleep sets because the solver set array may have been resized
+	b2SolverSet* awakeSet = world->solverSetArray + b2_awakeSet;
+	b2SolverSet* disabledSet = world->solverSetArray + b2_disabledSet;
+	b2GraphColor* colors = world->constraintGraph.colors;
+	b2Body* bodies = world->bodyArray;
+	b2Contact* contacts = world->contactArray;
+	b2Joint* joints = world->jointArray;
+
+	// Flags for awake elements that are leaving
+	int awakeBodyCount = awakeSet->sims.count;
+	uint8_t* removedBodies = b2AllocateStackItem(alloc, awakeBodyCount * sizeof(uint8_t), "removed bodies");
+	memset(removedBodies, 0, awakeBodyCount * sizeof(uint8_t));
+
+	uint8_t* removedContacts[b2_graphColorCount];
+	uint8_t* removedJoints[b2_graphColorCount];
+	for (int i = 0; i < b2_graphColorCount; ++i)
+	{
+		int colorContactCount = colors[i].contacts.count;
+		removedContacts[i] = b2AllocateStackItem(alloc, colorContactCount * sizeof(uint8_t), "removed contacts");
+		memset(removedContacts[i], 0, colorContactCount * sizeof(uint8_t));
+
+		int colorJointCount = colors[i].joints.count;
+		removedJoints[i] = b2AllocateStackItem(alloc, colorJointCount * sizeof(uint8_t), "removed joints");
+		memset(removedJoints[i], 0, colorJointCount * sizeof(uint8_t));
+	}
+
+	// Serially update bookkeeping and the constraint graph
+	for (int i = 0; i < context.islandCount; ++i)
+	{
+		int islandId = context.islands[i].islandId;
+		int sleepSetId = context.islands[i].setIndex;
+		b2Island* island = world->islandArray + islandId;
+
+		int sleepIndex = 0;
+		int bodyId = island->headBody;
+		while (bodyId != B2_NULL_INDEX)
+		{
+			b2Body* body = bodies + bodyId;
+			removedBodies[body->localIndex] = 1;
 			body->setIndex = sleepSetId;
-			body->localIndex = sleepBodyIndex;
+			body->localIndex = sleepIndex;
+			sleepIndex += 1;
+
+			// The body may have moved in this step but is no longer awake for the snapshot
+			b2MarkSnapshotBody(world, bodyId);
+			bodyId = body->islandNext;
+		}
+
+		sleepIndex = 0;
+		int contactId = island->headContact;
+		while (contactId != B2_NULL_INDEX)
+		{
+			b2Contact* contact = contacts + contactId;
+			int colorIndex = contact->colorIndex;
+			b2GraphColor* color = colors + colorIndex;
+
+			// Remove bodies from graph coloring associated with this constraint
+			if (colorIndex != b2_overflowIndex)
+			{
+				// might clear a bit for a static body, but this has no effect
+				b2ClearBit(&color->bodySet, contact->edges[0].bodyId);
+				b2ClearBit(&color->bodySet, contact->edges[1].bodyId);
+			}
+
+			removedContacts[colorIndex][contact->localIndex] = 1;
+			contact->setIndex = sleepSetId;
+			contact->colorIndex = B2_NULL_INDEX;
+			contact->localIndex = sleepIndex;
+			sleepIndex += 1;
+			contactId = contact->islandNext;
+		}
+
+		sleepIndex = 0;
+		int jointId = island->headJoint;
+		while (jointId != B2_NULL_INDEX)
+		{
+			b2Joint* joint = joints + jointId;
+			int colorIndex = joint->colorIndex;
+			b2GraphColor* color = colors + colorIndex;
+
+			if (colorIndex != b2_overflowIndex)
+			{
+				// might clear a bit for a static body, but this has no effect
+				b2ClearBit(&color->bodySet, joint->edges[0].bodyId);
+				b2ClearBit(&color->bodySet, joint->edges[1].bodyId);
+			}
+
+			removedJoints[colorIndex][joint->localIndex] = 1;
+			joint->setIndex = sleepSetId;
+			joint->colorIndex = B2_NULL_INDEX;
+			joint->localIndex = sleepIndex;
+			sleepIndex += 1;
+			jointId = joint->islandNext;
+		}
+
+		// move island struct
+		{
+			b2SolverSet* sleepSet = world->solverSetArray + sleepSetId;
+			int islandIndex = island->localIndex;
+			b2IslandSim* sleepIsland = b2AddIsland(&world->blockAllocator, &sleepSet->islands);
+			sleepIsland->islandId = islandId;
+
+			int movedIslandIndex = b2RemoveIsland(&awakeSet->islands, islandIndex);
+			if (movedIslandIndex != B2_NULL_INDEX)
+			{
+				// fix index on moved element
+				b2IslandSim* movedIslandSim = awakeSet->islands.data + islandIndex;
+				int movedIslandId = movedIslandSim->islandId;
+				b2CheckIndex(world->islandArray, movedIslandId);
+				b2Island* movedIsland = world->islandArray + movedIslandId;
+				B2_ASSERT(movedIsland->localIndex == movedIslandIndex);
+				movedIsland->localIndex = islandIndex;
+			}
+
+			island->setIndex = sleepSetId;
+			island->localIndex = 0;
+		}
+	}
 
-			// Move non-touching contacts to the disabled set.
-			// Non-touching contacts may exist between sleeping islands and there is no clear ownership.
+	// Move non-touching contacts to the disabled set.
+	// Non-touching contacts may exist between sleeping islands and there is no clear ownership.
+	// This is done after all the bodies in the batch have been moved to their sleeping set.
+	for (int i = 0; i < context.islandCount; ++i)
+	{
+		b2Island* island = world->islandArray + context.islands[i].islandId;
+		int bodyId = island->headBody;
+		while (bodyId != B2_NULL_INDEX)
+		{
+			b2Body* body = bodies + bodyId;
 			int contactKey = body->headContactKey;
 			while (contactKey != B2_NULL_INDEX)
 			{
@@ -265,19 +715,18 @@ void b2TrySleepIsland(b2World* world, int islandId)
 
 				b2CheckIndex(contacts, contactId);
 				b2Contact* contact = contacts + contactId;
-
-				B2_ASSERT(contact->setIndex == b2_awakeSet || contact->setIndex == b2_disabledSet);
 				contactKey = contact->edges[edgeIndex].nextKey;
 
-				if (contact->setIndex == b2_disabledSet)
+				if (contact->setIndex != b2_awakeSet)
 				{
-					// already moved to disabled set by another body in the island
+					// touching contact moved to the sleeping set or non-touching contact already moved to the disabled set
+					B2_ASSERT(contact->setIndex == b2_disabledSet || contact->setIndex >= b2_firstSleepingSet);
 					continue;
 				}
 
 				if (contact->colorIndex != B2_NULL_INDEX)
 				{
-					// contact is touching and will be moved separately
+					// contact is touching and will be moved with its island
 					B2_ASSERT((contact->flags & b2_contactTouchingFlag) != 0);
 					continue;
 				}
@@ -294,22 +743,23 @@ void b2TrySleepIsland(b2World* world, int islandId)
 				}
 
 				int localIndex = contact->localIndex;
-				B2_ASSERT(0 <= localIndex && localIndex < awakeSet->contacts.count);
-				b2ContactSim* contactSim = awakeSet->contacts.data + localIndex;
+				B2_ASSERT(0 <= localIndex && localIndex < awakeSet->nonTouchingContacts.count);
+				b2NonTouchingContactSim* contactSim = awakeSet->nonTouchingContacts.data + localIndex;
 
-				B2_ASSERT((contact->flags & b2_contactTouchingFlag) == 0 && contactSim->manifold.pointCount == 0);
+				B2_ASSERT((contact->flags & b2_contactTouchingFlag) == 0);
 
 				// move the non-touching contact to the disabled set
 				contact->setIndex = b2_disabledSet;
-				contact->localIndex = disabledSet->contacts.count;
-				b2ContactSim* disabledContactSim = b2AddContact(&world->blockAllocator, &disabledSet->contacts);
-				memcpy(disabledContactSim, contactSim, sizeof(b2ContactSim));
+				contact->localIndex = disabledSet->nonTouchingContacts.count;
+				b2NonTouchingContactSim* disabledContactSim =
+					b2AddNonTouchingContactSim(&world->blockAllocator, &disabledSet->nonTouchingContacts);
+				memcpy(disabledContactSim, contactSim, sizeof(b2NonTouchingContactSim));
 
-				int movedContactIndex = b2RemoveContact(&awakeSet->contacts, localIndex);
+				int movedContactIndex = b2RemoveNonTouchingContactSim(&awakeSet->nonTouchingContacts, localIndex);
 				if (movedContactIndex != B2_NULL_INDEX)
 				{
 					// fix moved element
-					b2ContactSim* movedContactSim = awakeSet->contacts.data + localIndex;
+					b2NonTouchingContactSim* movedContactSim = awakeSet->nonTouchingContacts.data + localIndex;
 					int movedId = movedContactSim->contactId;
 					b2CheckIndex(contacts, movedId);
 					B2_ASSERT(contacts[movedId].localIndex == movedContactIndex);
@@ -321,135 +771,47 @@ void b2TrySleepIsland(b2World* world, int islandId)
 		}
 	}
 
-	// move touching contacts
-	// this shuffles contacts in the awake set
-	{
-		b2Contact* contacts = world->contactArray;
-		int contactId = island->headContact;
-		while (contactId != B2_NULL_INDEX)
-		{
-			b2CheckIndex(contacts, contactId);
-			b2Contact* contact = contacts + contactId;
-			B2_ASSERT(contact->setIndex == b2_awakeSet);
-			B2_ASSERT(contact->islandId == islandId);
-			int colorIndex = contact->colorIndex;
-			B2_ASSERT(0 <= colorIndex && colorIndex < b2_graphColorCount);
-
-			b2GraphColor* color = world->constraintGraph.colors + colorIndex;
-
-			// Remove bodies from graph coloring associated with this constraint
-			if (colorIndex != b2_overflowIndex)
-			{
-				// might clear a bit for a static body, but this has no effect
-				b2ClearBit(&color->bodySet, contact->edges[0].bodyId);
-				b2ClearBit(&color->bodySet, contact->edges[1].bodyId);
-			}
-
-			int awakeContactIndex = contact->localIndex;
-			B2_ASSERT(0 <= awakeContactIndex && awakeContactIndex < color->contacts.count);
-			b2ContactSim* awakeContactSim = color->contacts.data + awakeContactIndex;
-
-			int sleepContactIndex = sleepSet->contacts.count;
-			b2ContactSim* sleepContactSim = b2AddContact(&world->blockAllocator, &sleepSet->contacts);
-			memcpy(sleepContactSim, awakeContactSim, sizeof(b2ContactSim));
-
-			int movedIndex = b2RemoveContact(&color->contacts, awakeContactIndex);
-			if (movedIndex != B2_NULL_INDEX)
-			{
-				// fix moved element
-				b2ContactSim* movedContactSim = color->contacts.data + awakeContactIndex;
-				int movedId = movedContactSim->contactId;
-				b2CheckIndex(contacts, movedId);
-				b2Contact* movedContact = contacts + movedId;
-				B2_ASSERT(movedContact->localIndex == movedIndex);
-				movedContact->localIndex = awakeContactIndex;
-			}
-
-			contact->setIndex = sleepSetId;
-			contact->colorIndex = B2_NULL_INDEX;
-			contact->localIndex = sleepContactIndex;
-
-			contactId = contact->islandNext;
-		}
-	}
+	// Plan the compaction of the awake body and graph arrays
+	context.moves = b2AllocateStackItem(alloc, (sleepBodyCount + sleepContactCount + sleepJointCount) * sizeof(b2SleepMove),
+										"sleep moves");
 
-	// move joints
-	// this shuffles joints in the awake set
+	int newBodyCount = b2PlanCompaction(&context, removedBodies, awakeBodyCount, b2_sleepMoveBody, B2_NULL_INDEX);
+	int newContactCounts[b2_graphColorCount];
+	int newJointCounts[b2_graphColorCount];
+	for (int i = 0; i < b2_graphColorCount; ++i)
 	{
-		b2Joint* joints = world->jointArray;
-		int jointId = island->headJoint;
-		while (jointId != B2_NULL_INDEX)
-		{
-			b2CheckIndex(joints, jointId);
-			b2Joint* joint = joints + jointId;
-			B2_ASSERT(joint->setIndex == b2_awakeSet);
-			B2_ASSERT(joint->islandId == islandId);
-			int colorIndex = joint->colorIndex;
-			int localIndex = joint->localIndex;
-
-			B2_ASSERT(0 <= colorIndex && colorIndex < b2_graphColorCount);
-
-			b2GraphColor* color = world->constraintGraph.colors + colorIndex;
-
-			B2_ASSERT(0 <= localIndex && localIndex < color->joints.count);
-			b2JointSim* awakeJointSim = color->joints.data + localIndex;
-
-			if (colorIndex != b2_overflowIndex)
-			{
-				// might clear a bit for a static body, but this has no effect
-				b2ClearBit(&color->bodySet, joint->edges[0].bodyId);
-				b2ClearBit(&color->bodySet, joint->edges[1].bodyId);
-			}
-
-			int sleepJointIndex = sleepSet->joints.count;
-			b2JointSim* sleepJointSim = b2AddJoint(&world->blockAllocator, &sleepSet->joints);
-			memcpy(sleepJointSim, awakeJointSim, sizeof(b2JointSim));
-
-			int movedIndex = b2RemoveJoint(&color->joints, localIndex);
-			if (movedIndex != B2_NULL_INDEX)
-			{
-				// fix moved element
-				b2JointSim* movedJointSim = color->joints.data + localIndex;
-				int movedId = movedJointSim->jointId;
-				b2CheckIndex(joints, movedId);
-				b2Joint* movedJoint = joints + movedId;
-				B2_ASSERT(movedJoint->localIndex == movedIndex);
-				movedJoint->localIndex = localIndex;
-			}
+		newContactCounts[i] = b2PlanCompaction(&context, removedContacts[i], colors[i].contacts.count, b2_sleepMoveContact, i);
+		newJointCounts[i] = b2PlanCompaction(&context, removedJoints[i], colors[i].joints.count, b2_sleepMoveJoint, i);
+	}
 
-			joint->setIndex = sleepSetId;
-			joint->colorIndex = B2_NULL_INDEX;
-			joint->localIndex = sleepJointIndex;
+	b2RunSolverSetTask(world, &b2CompactAwakeTask, context.moveCount, b2_solverSetMinRange, &context);
 
-			jointId = joint->islandNext;
-		}
+	// destroy state, no need to clone
+	awakeSet->sims.count = newBodyCount;
+	awakeSet->states.count = newBodyCount;
+	for (int i = 0; i < b2_graphColorCount; ++i)
+	{
+		colors[i].contacts.count = newContactCounts[i];
+		colors[i].joints.count = newJointCounts[i];
 	}
 
-	// move island struct
+	b2FreeStackItem(alloc, context.moves);
+	for (int i = b2_graphColorCount - 1; i >= 0; --i)
 	{
-		B2_ASSERT(island->setIndex == b2_awakeSet);
-
-		int islandIndex = island->localIndex;
-		b2IslandSim* sleepIsland = b2AddIsland(&world->blockAllocator, &sleepSet->islands);
-		sleepIsland->islandId = islandId;
-
-		int movedIslandIndex = b2RemoveIsland(&awakeSet->islands, islandIndex);
-		if (movedIslandIndex != B2_NULL_INDEX)
-		{
-			// fix index on moved element
-			b2IslandSim* movedIslandSim = awakeSet->islands.data + islandIndex;
-			int movedIslandId = movedIslandSim->islandId;
-			b2CheckIndex(world->islandArray, movedIslandId);
-			b2Island* movedIsland = world->islandArray + movedIslandId;
-			B2_ASSERT(movedIsland->localIndex == movedIslandIndex);
-			movedIsland->localIndex = islandIndex;
-		}
-
-		island->setIndex = sleepSetId;
-		island->localIndex = 0;
+		b2FreeStackItem(alloc, removedJoints[i]);
+		b2FreeStackItem(alloc, removedContacts[i]);
 	}
+	b2FreeStackItem(alloc, removedBodies);
+	b2FreeStackItem(alloc, context.islands);
 
 	b2ValidateSolverSets(world);
+
+	b2TracyCZoneEnd(sleep_islands);
+}
+
+void b2TrySleepIsland(b2World* world, int islandId)
+{
+	b2SleepIslands(world, &islandId, 1);
 }
 
 // This is called when joints are created between sets. I want to allow the sets
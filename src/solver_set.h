@@ -27,10 +27,12 @@ typedef struct b2SolverSet
 	// This holds sleeping/disabled joints. Empty for static/active set.
 	b2JointArray joints;
 
-	// This holds all contacts for sleeping sets.
-	// This holds non-touching contacts for the awake set.
+	// This holds touching contacts for sleeping sets. Empty for other sets.
 	b2ContactArray contacts;
 
+	// This holds non-touching contacts for the awake and disabled sets. Empty for other sets.
+	b2NonTouchingContactArray nonTouchingContacts;
+
 	// The awake set has an array of islands. Sleeping sets normally have a single islands. However, joints
 	// created between sleeping sets causes the sets to merge, leaving them with multiple islands. These sleeping
 	// islands will be naturally merged with the set is woken.
@@ -46,6 +48,7 @@ void b2DestroySolverSet(b2World* world, int setIndex);
 
 void b2WakeSolverSet(b2World* world, int setIndex);
 void b2TrySleepIsland(b2World* world, int islandId);
+void b2SleepIslands(b2World* world, const int* islandIds, int count);
 
 // Merge set 2 into set 1 then destroy set 2.
 // Warning: any pointers into these sets will be orphaned.
@@ -7,62 +7,76 @@
 #include "array.h"
 #include "core.h"
 
+#include <limits.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 typedef struct b2StackEntry
 {
 	char* data;
 	const char* name;
 	int size;
+	int offset;
 	bool usedMalloc;
 } b2StackEntry;
 
 
-b2StackAllocator b2CreateStackAllocator(int capacity)
+b2StackAllocator b2CreateStackAllocator(b2Allocator* allocator, int capacity)
 {
 	B2_ASSERT(capacity >= 0);
-	b2StackAllocator allocator = {0};
-	allocator.capacity = capacity;
-	allocator.data = b2Alloc(capacity);
-	allocator.allocation = 0;
-	allocator.maxAllocation = 0;
-	allocator.index = 0;
-	allocator.entries = b2CreateArray(sizeof(b2StackEntry), 32);
-	return allocator;
+	b2StackAllocator stack = {0};
+	stack.allocator = allocator;
+	stack.capacity = capacity;
+	stack.data = b2AllocWith(allocator, capacity);
+	stack.allocation = 0;
+	stack.maxAllocation = 0;
+	stack.heapAllocationCount = 0;
+	stack.index = 0;
+	stack.entries = b2CreateArray(allocator, sizeof(b2StackEntry), 32);
+	return stack;
 }
 
 void b2DestroyStackAllocator(b2StackAllocator* allocator)
 {
 	b2DestroyArray(allocator->entries, sizeof(b2StackEntry));
-	b2Free(allocator->data, allocator->capacity);
+	b2FreeWith(allocator->allocator, allocator->data, allocator->capacity);
 }
 
-void* b2AllocateStackItem(b2StackAllocator* alloc, int size, const char* name)
+static void* b2AllocateStackItemInternal(b2StackAllocator* alloc, int size, int alignment, const char* name)
 {
+	B2_ASSERT(alignment >= 32 && (alignment & (alignment - 1)) == 0);
+
 	// ensure allocation is 32 byte aligned to support 256-bit SIMD
 	int size32 = ((size - 1) | 0x1F) + 1;
 
+	// the stack and the heap are 32 byte aligned, so larger alignments need at most this much padding
+	int maxPadding = alignment - 32;
+
+	char* base;
 	b2StackEntry entry;
-	entry.size = size32;
 	entry.name = name;
-	if (alloc->index + size32 > alloc->capacity)
+	if (alloc->index + size32 + maxPadding > alloc->capacity)
 	{
 		// fall back to the heap (undesirable)
-		entry.data = b2Alloc(size32);
+		entry.size = size32 + maxPadding;
+		base = b2AllocWith(alloc->allocator, entry.size);
+		entry.offset = (int)(-(intptr_t)base & (alignment - 1));
 		entry.usedMalloc = true;
-
-		B2_ASSERT(((uintptr_t)entry.data & 0x1F) == 0);
+		alloc->heapAllocationCount += 1;
 	}
 	else
 	{
-		entry.data = alloc->data + alloc->index;
+		base = alloc->data + alloc->index;
+		entry.offset = (int)(-(intptr_t)base & (alignment - 1));
+		entry.size = size32 + entry.offset;
 		entry.usedMalloc = false;
-		alloc->index += size32;
-
-		B2_ASSERT(((uintptr_t)entry.data & 0x1F) == 0);
+		alloc->index += entry.size;
 	}
 
-	alloc->allocation += size32;
+	entry.data = base + entry.offset;
+	B2_ASSERT(((uintptr_t)entry.data & (alignment - 1)) == 0);
+
+	alloc->allocation += entry.size;
 	if (alloc->allocation > alloc->maxAllocation)
 	{
 		alloc->maxAllocation = alloc->allocation;
@@ -72,6 +86,16 @@ void* b2AllocateStackItem(b2StackAllocator* alloc, int size, const char* name)
 	return entry.data;
 }
 
+void* b2AllocateStackItem(b2StackAllocator* alloc, int size, const char* name)
+{
+	return b2AllocateStackItemInternal(alloc, size, 32, name);
+}
+
+void* b2AllocateCacheAlignedStackItem(b2StackAllocator* alloc, int size, const char* name)
+{
+	return b2AllocateStackItemInternal(alloc, size, b2_cacheLineSize, name);
+}
+
 void b2FreeStackItem(b2StackAllocator* alloc, void* mem)
 {
 	int entryCount = b2Array(alloc->entries).count;
@@ -80,7 +104,7 @@ void b2FreeStackItem(b2StackAllocator* alloc, void* mem)
 	B2_ASSERT(mem == entry->data);
 	if (entry->usedMalloc)
 	{
-		b2Free(mem, entry->size);
+		b2FreeWith(alloc->allocator, (char*)mem - entry->offset, entry->size);
 	}
 	else
 	{
@@ -90,6 +114,13 @@ void b2FreeStackItem(b2StackAllocator* alloc, void* mem)
 	b2Array_Pop(alloc->entries);
 }
 
+// Leave room for half again as much, without overflow
+static int b2GetGrownCapacity(int size)
+{
+	int64_t capacity = (int64_t)size + size / 2;
+	return capacity < INT_MAX ? (int)capacity : INT_MAX;
+}
+
 void b2GrowStack(b2StackAllocator* alloc)
 {
 	// Stack must not be in use
@@ -97,9 +128,22 @@ void b2GrowStack(b2StackAllocator* alloc)
 
 	if (alloc->maxAllocation > alloc->capacity)
 	{
-		b2Free(alloc->data, alloc->capacity);
-		alloc->capacity = alloc->maxAllocation + alloc->maxAllocation / 2;
-		alloc->data = b2Alloc(alloc->capacity);
+		b2FreeWith(alloc->allocator, alloc->data, alloc->capacity);
+		alloc->capacity = b2GetGrownCapacity(alloc->maxAllocation);
+		alloc->data = b2AllocWith(alloc->allocator, alloc->capacity);
+	}
+}
+
+void b2ReserveStack(b2StackAllocator* alloc, int capacity)
+{
+	// Stack must not be in use
+	B2_ASSERT(alloc->allocation == 0);
+
+	if (capacity > alloc->capacity)
+	{
+		b2FreeWith(alloc->allocator, alloc->data, alloc->capacity);
+		alloc->capacity = b2GetGrownCapacity(capacity);
+		alloc->data = b2AllocWith(alloc->allocator, alloc->capacity);
 	}
 }
 
@@ -117,3 +161,8 @@ int b2GetMaxStackAllocation(b2StackAllocator* alloc)
 {
 	return alloc->maxAllocation;
 }
+
+int b2GetStackHeapAllocationCount(b2StackAllocator* alloc)
+{
+	return alloc->heapAllocationCount;
+}
@@ -3,6 +3,8 @@
 
 #pragma once
 
+#include "allocate.h"
+
 // This is a stack-like arena allocator used for fast per step allocations.
 // You must nest allocate/free pairs. The code will B2_ASSERT
 // if you try to interleave multiple allocate/free pairs.
@@ -17,18 +19,30 @@ typedef struct b2StackAllocator
 	int allocation;
 	int maxAllocation;
 
+	// Allocations that did not fit and went to the heap
+	int heapAllocationCount;
+
 	struct b2StackEntry* entries;
+
+	b2Allocator* allocator;
 } b2StackAllocator;
 
-b2StackAllocator b2CreateStackAllocator(int capacity);
+b2StackAllocator b2CreateStackAllocator(b2Allocator* allocator, int capacity);
 void b2DestroyStackAllocator(b2StackAllocator* allocator);
 
 void* b2AllocateStackItem(b2StackAllocator* alloc, int size, const char* name);
+
+// Allocate on a cache line boundary for data that is written by different threads
+void* b2AllocateCacheAlignedStackItem(b2StackAllocator* alloc, int size, const char* name);
 void b2FreeStackItem(b2StackAllocator* alloc, void* mem);
 
 // Grow the stack based on usage
 void b2GrowStack(b2StackAllocator* alloc);
 
+// Grow the stack ahead of use so the expected allocations do not fall back to the heap
+void b2ReserveStack(b2StackAllocator* alloc, int capacity);
+
 int b2GetStackCapacity(b2StackAllocator* alloc);
 int b2GetStackAllocation(b2StackAllocator* alloc);
 int b2GetMaxStackAllocation(b2StackAllocator* alloc);
+int b2GetStackHeapAllocationCount(b2StackAllocator* alloc);
@@ -18,9 +18,10 @@ _Atomic int g_probeCount;
 
 // todo compare with https://github.com/skeeto/scratch/blob/master/set32/set32.h
 
-b2HashSet b2CreateSet(int32_t capacity)
+b2HashSet b2CreateSet(b2Allocator* allocator, int32_t capacity)
 {
 	b2HashSet set = {0};
+	set.allocator = allocator;
 
 	// Capacity must be a power of 2
 	if (capacity > 16)
@@ -33,15 +34,15 @@ b2HashSet b2CreateSet(int32_t capacity)
 	}
 
 	set.count = 0;
-	set.items = b2Alloc(capacity * sizeof(b2SetItem));
-	memset(set.items, 0, capacity * sizeof(b2SetItem));
+	set.items = b2AllocWith(allocator, set.capacity * sizeof(b2SetItem));
+	memset(set.items, 0, set.capacity * sizeof(b2SetItem));
 
 	return set;
 }
 
 void b2DestroySet(b2HashSet* set)
 {
-	b2Free(set->items, set->capacity * sizeof(b2SetItem));
+	b2FreeWith(set->allocator, set->items, set->capacity * sizeof(b2SetItem));
 	set->items = NULL;
 	set->count = 0;
 	set->capacity = 0;
@@ -108,7 +109,7 @@ static void b2GrowTable(b2HashSet* set)
 	set->count = 0;
 	// Capacity must be a power of 2
 	set->capacity = 2 * oldCapacity;
-	set->items = b2Alloc(set->capacity * sizeof(b2SetItem));
+	set->items = b2AllocWith(set->allocator, set->capacity * sizeof(b2SetItem));
 	memset(set->items, 0, set->capacity * sizeof(b2SetItem));
 
 	// Transfer items into new array
@@ -126,7 +127,7 @@ static void b2GrowTable(b2HashSet* set)
 
 	B2_ASSERT(set->count == oldCount);
 
-	b2Free(oldItems, oldCapacity * sizeof(b2SetItem));
+	b2FreeWith(set->allocator, oldItems, oldCapacity * sizeof(b2SetItem));
 }
 
 bool b2ContainsKey(const b2HashSet* set, uint64_t key)
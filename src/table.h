@@ -3,6 +3,8 @@
 
 #pragma once
 
+#include "allocate.h"
+
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -19,9 +21,10 @@ typedef struct b2HashSet
 	b2SetItem* items;
 	uint32_t capacity;
 	uint32_t count;
+	b2Allocator* allocator;
 } b2HashSet;
 
-b2HashSet b2CreateSet(int32_t capacity);
+b2HashSet b2CreateSet(b2Allocator* allocator, int32_t capacity);
 void b2DestroySet(b2HashSet* set);
 
 void b2ClearSet(b2HashSet* set);
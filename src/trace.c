@@ -0,0 +1,351 @@
+// SPDX-FileCopyrightText: 2024 Erin Catto
+// SPDX-License-Identifier: MIT
+
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+// for clock_gettime
+#define _GNU_SOURCE
+#endif
+
+#include "trace.h"
+
+#include "allocate.h"
+#include "core.h"
+#include "util.h"
+
+#include "box2d/timer.h"
+
+#include <stdio.h>
+
+#if defined(B2_PLATFORM_WINDOWS)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+#if defined(B2_COMPILER_MSVC)
+#define b2_threadLocal __declspec(thread)
+#else
+#define b2_threadLocal _Thread_local
+#endif
+
+// Events kept per thread. Older events are overwritten so the buffers hold the most recent steps.
+#define b2_traceEventCapacity (1 << 14)
+#define b2_traceEventMask (b2_traceEventCapacity - 1)
+
+// Threads beyond this limit are not traced
+#define b2_maxTraceThreads 64
+
+typedef struct b2TraceEvent
+{
+	const char* name;
+	uint64_t start;
+	uint64_t end;
+	int worldId;
+	int workerIndex;
+} b2TraceEvent;
+
+// Written only by the owning thread
+typedef struct b2TraceBuffer
+{
+	b2TraceEvent events[b2_traceEventCapacity];
+	uint64_t count;
+} b2TraceBuffer;
+
+// Number of worlds with tracing enabled
+_Atomic int b2_traceEnabled;
+
+// Worlds that have used tracing and still exist
+static _Atomic int b2_traceWorldCount;
+
+// Serializes enabling, writing, and freeing. These may be called for different worlds on different threads.
+static atomic_flag b2_traceLock = ATOMIC_FLAG_INIT;
+
+// Recording threads hold the gate open. Writing and freeing close it and wait for the recording threads to
+// leave, so the buffers are never read or freed while written. Events are dropped while the gate is closed.
+static _Atomic int b2_traceRecorderCount;
+static _Atomic int b2_traceGateClosed;
+
+// A thread reserves a slot by incrementing the count and then publishes its buffer in the slot. Readers may
+// see the count before the buffer, so they skip null slots.
+static b2TraceBuffer* _Atomic b2_traceBuffers[b2_maxTraceThreads];
+static _Atomic int b2_traceBufferCount;
+
+// Bumped when the buffers are freed so threads drop their cached buffer
+static _Atomic int b2_traceEpoch;
+
+static b2_threadLocal b2TraceBuffer* b2_threadTraceBuffer;
+static b2_threadLocal int b2_threadTraceEpoch;
+
+// World and worker of the zones recorded on this thread
+static b2_threadLocal b2TraceScope b2_threadTraceScope = {B2_NULL_INDEX, 0};
+
+#if defined(B2_PLATFORM_WINDOWS)
+
+static double b2GetTraceTicksPerMicrosecond(void)
+{
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	return 0.000001 * (double)frequency.QuadPart;
+}
+
+uint64_t b2GetTraceTicks(void)
+{
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return (uint64_t)counter.QuadPart;
+}
+
+#else
+
+static double b2GetTraceTicksPerMicrosecond(void)
+{
+	return 1000.0;
+}
+
+uint64_t b2GetTraceTicks(void)
+{
+	struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return 1000000000ull * (uint64_t)t.tv_sec + (uint64_t)t.tv_nsec;
+}
+
+#endif
+
+b2TraceScope b2EnterTraceScope(int worldId, int workerIndex)
+{
+	b2TraceScope previous = b2_threadTraceScope;
+	b2_threadTraceScope = (b2TraceScope){worldId, workerIndex};
+	return previous;
+}
+
+void b2LeaveTraceScope(b2TraceScope previous)
+{
+	b2_threadTraceScope = previous;
+}
+
+static void b2LockTrace(void)
+{
+	while (atomic_flag_test_and_set(&b2_traceLock))
+	{
+		b2Yield();
+	}
+}
+
+static void b2UnlockTrace(void)
+{
+	atomic_flag_clear(&b2_traceLock);
+}
+
+// Must hold the lock
+static void b2CloseTraceGate(void)
+{
+	atomic_store(&b2_traceGateClosed, 1);
+	while (atomic_load(&b2_traceRecorderCount) > 0)
+	{
+		b2Yield();
+	}
+}
+
+static void b2OpenTraceGate(void)
+{
+	atomic_store(&b2_traceGateClosed, 0);
+}
+
+// The count briefly goes past the slot limit while a thread backs out of a reservation
+static int b2GetTraceBufferCount(void)
+{
+	int count = atomic_load_explicit(&b2_traceBufferCount, memory_order_relaxed);
+	return count < b2_maxTraceThreads ? count : b2_maxTraceThreads;
+}
+
+static b2TraceBuffer* b2GetThreadTraceBuffer(void)
+{
+	int epoch = atomic_load_explicit(&b2_traceEpoch, memory_order_relaxed);
+	if (b2_threadTraceBuffer != NULL && b2_threadTraceEpoch == epoch)
+	{
+		return b2_threadTraceBuffer;
+	}
+
+	b2_threadTraceBuffer = NULL;
+	b2_threadTraceEpoch = epoch;
+
+	int index = atomic_fetch_add_explicit(&b2_traceBufferCount, 1, memory_order_relaxed);
+	if (index >= b2_maxTraceThreads)
+	{
+		atomic_fetch_sub_explicit(&b2_traceBufferCount, 1, memory_order_relaxed);
+		return NULL;
+	}
+
+	b2TraceBuffer* buffer = b2Alloc(sizeof(b2TraceBuffer));
+	buffer->count = 0;
+	atomic_store_explicit(b2_traceBuffers + index, buffer, memory_order_release);
+	b2_threadTraceBuffer = buffer;
+	return buffer;
+}
+
+void b2RecordTraceZone(const b2TraceZone* zone)
+{
+	if (atomic_load_explicit(&b2_traceEnabled, memory_order_relaxed) == 0)
+	{
+		return;
+	}
+
+	// Pairs with b2CloseTraceGate. Either the gate is seen closed here or the closing thread waits for this one.
+	atomic_fetch_add(&b2_traceRecorderCount, 1);
+	if (atomic_load(&b2_traceGateClosed) == 0)
+	{
+		b2TraceBuffer* buffer = b2GetThreadTraceBuffer();
+		if (buffer != NULL)
+		{
+			b2TraceEvent* event = buffer->events + (buffer->count & b2_traceEventMask);
+			event->name = zone->name;
+			event->start = zone->start;
+			event->end = b2GetTraceTicks();
+			event->worldId = b2_threadTraceScope.worldId;
+			event->workerIndex = b2_threadTraceScope.workerIndex;
+			buffer->count += 1;
+		}
+	}
+	atomic_fetch_sub(&b2_traceRecorderCount, 1);
+}
+
+void b2EnableTrace(bool flag)
+{
+	b2LockTrace();
+
+	if (flag)
+	{
+		atomic_fetch_add(&b2_traceEnabled, 1);
+	}
+	else
+	{
+		int count = atomic_fetch_sub(&b2_traceEnabled, 1);
+		B2_ASSERT(count > 0);
+		B2_MAYBE_UNUSED(count);
+	}
+
+	b2UnlockTrace();
+}
+
+void b2RetainTrace(void)
+{
+	b2LockTrace();
+	atomic_fetch_add(&b2_traceWorldCount, 1);
+	b2UnlockTrace();
+}
+
+void b2ReleaseTrace(void)
+{
+	b2LockTrace();
+
+	int worldCount = atomic_fetch_sub(&b2_traceWorldCount, 1);
+	B2_ASSERT(worldCount > 0);
+
+	// Threads still holding the gate open may be finishing a zone, so wait for them before freeing
+	if (worldCount == 1)
+	{
+		B2_ASSERT(atomic_load(&b2_traceEnabled) == 0);
+		b2CloseTraceGate();
+
+		int bufferCount = b2GetTraceBufferCount();
+		for (int i = 0; i < bufferCount; ++i)
+		{
+			b2TraceBuffer* buffer = atomic_exchange_explicit(b2_traceBuffers + i, NULL, memory_order_acquire);
+			if (buffer != NULL)
+			{
+				b2Free(buffer, sizeof(b2TraceBuffer));
+			}
+		}
+
+		atomic_store(&b2_traceBufferCount, 0);
+		atomic_fetch_add(&b2_traceEpoch, 1);
+		b2OpenTraceGate();
+	}
+
+	b2UnlockTrace();
+}
+
+bool b2WriteTrace(int worldId, const char* path)
+{
+	FILE* file = fopen(path, "w");
+	if (file == NULL)
+	{
+		return false;
+	}
+
+	// Other worlds may be stepping, so recording is paused while the buffers are read
+	b2LockTrace();
+	b2CloseTraceGate();
+
+	int bufferCount = b2GetTraceBufferCount();
+
+	// Timestamps are relative to the oldest event of this world still held
+	uint64_t base = UINT64_MAX;
+	for (int i = 0; i < bufferCount; ++i)
+	{
+		b2TraceBuffer* buffer = atomic_load_explicit(b2_traceBuffers + i, memory_order_acquire);
+		if (buffer == NULL)
+		{
+			continue;
+		}
+
+		uint64_t first = buffer->count > b2_traceEventCapacity ? buffer->count - b2_traceEventCapacity : 0;
+		for (uint64_t j = first; j < buffer->count; ++j)
+		{
+			const b2TraceEvent* event = buffer->events + (j & b2_traceEventMask);
+			if (event->worldId == worldId)
+			{
+				base = event->start < base ? event->start : base;
+			}
+		}
+	}
+
+	double scale = 1.0 / b2GetTraceTicksPerMicrosecond();
+
+	fprintf(file, "{\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"Box2D world %d\"}}", worldId);
+
+	// Worker indices are the thread ids
+	uint64_t workerBits = 0;
+	for (int i = 0; i < bufferCount; ++i)
+	{
+		b2TraceBuffer* buffer = atomic_load_explicit(b2_traceBuffers + i, memory_order_acquire);
+		if (buffer == NULL)
+		{
+			continue;
+		}
+
+		uint64_t first = buffer->count > b2_traceEventCapacity ? buffer->count - b2_traceEventCapacity : 0;
+		for (uint64_t j = first; j < buffer->count; ++j)
+		{
+			const b2TraceEvent* event = buffer->events + (j & b2_traceEventMask);
+			if (event->worldId != worldId)
+			{
+				continue;
+			}
+
+			int worker = event->workerIndex;
+			if (worker < 64 && (workerBits & (1ull << worker)) == 0)
+			{
+				workerBits |= 1ull << worker;
+				fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"worker %d\"}}",
+						worker, worker);
+			}
+
+			double ts = scale * (double)(event->start - base);
+			double dur = scale * (double)(event->end - event->start);
+			fprintf(file, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}", event->name, worker,
+					ts, dur);
+		}
+	}
+
+	b2OpenTraceGate();
+	b2UnlockTrace();
+
+	fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+	fclose(file);
+	return true;
+}
@@ -0,0 +1,67 @@
+// SPDX-FileCopyrightText: 2024 Erin Catto
+// SPDX-License-Identifier: MIT
+
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Built-in tracer that records the profiler zones into per-thread ring buffers so a trace can be written in
+// the Chrome Trace Event format without Tracy. The buffers are process wide. Each event is tagged with the world
+// and worker of the scope it was recorded in, so a trace can be written for one world. Recording is on while any
+// world has tracing enabled.
+
+// A zone in flight. The start is zero when tracing was off as the zone began.
+typedef struct b2TraceZone
+{
+	const char* name;
+	uint64_t start;
+} b2TraceZone;
+
+// The world and worker that zones on the current thread are recorded for
+typedef struct b2TraceScope
+{
+	int worldId;
+	int workerIndex;
+} b2TraceScope;
+
+extern _Atomic int b2_traceEnabled;
+
+// The step and every task enter a scope and restore the previous scope when done. A thread may run tasks of
+// another world while it waits for its own tasks. Returns the previous scope.
+b2TraceScope b2EnterTraceScope(int worldId, int workerIndex);
+void b2LeaveTraceScope(b2TraceScope previous);
+
+uint64_t b2GetTraceTicks(void);
+void b2RecordTraceZone(const b2TraceZone* zone);
+
+// Called by worlds as they enable or disable tracing
+void b2EnableTrace(bool flag);
+
+// A world retains the buffers the first time it enables tracing and releases them when it is destroyed.
+// The buffers are freed with the last release, after threads finishing a zone are done with them.
+void b2RetainTrace(void);
+void b2ReleaseTrace(void);
+
+// Write the events of one world. Recording is paused while the buffers are read. Returns false if the file
+// cannot be opened.
+bool b2WriteTrace(int worldId, const char* path);
+
+static inline b2TraceZone b2TraceBegin(const char* name, bool active)
+{
+	b2TraceZone zone = {name, 0};
+	if (active && atomic_load_explicit(&b2_traceEnabled, memory_order_relaxed))
+	{
+		zone.start = b2GetTraceTicks();
+	}
+	return zone;
+}
+
+static inline void b2TraceEnd(const b2TraceZone* zone)
+{
+	if (zone->start != 0)
+	{
+		b2RecordTraceZone(zone);
+	}
+}
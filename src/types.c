@@ -19,6 +19,9 @@ b2WorldDef b2DefaultWorldDef()
 	def.jointDampingRatio = 2.0f;
 	def.enableSleep = true;
 	def.enableContinous = true;
+	def.enableWorkerAffinity = false;
+	def.serialSolveThreshold = 512;
+	def.stackAllocatorCapacity = 2048;
 	return def;
 }
 
@@ -19,10 +19,12 @@
 #include "ctz.h"
 #include "island.h"
 #include "joint.h"
+#include "query_snapshot.h"
 #include "shape.h"
 #include "solver.h"
 #include "solver_set.h"
 #include "stack_allocator.h"
+#include "trace.h"
 #include "util.h"
 
 // needed for dll export
@@ -85,6 +87,57 @@ static void b2DefaultFinishTaskFcn(void* userTask, void* userContext)
 	B2_MAYBE_UNUSED(userContext);
 }
 
+// Enqueue a task that must not start before the dependencies are done. Without a user dependent task callback
+// the dependencies are finished here and set to NULL so the caller doesn't finish them again.
+// Dependencies are expected to be counted in activeTaskCount.
+void* b2EnqueueDependentTask(b2World* world, b2TaskCallback* task, int itemCount, int minRange, void* taskContext,
+							 void** dependencies, int dependencyCount)
+{
+	void* userTask;
+	if (world->enqueueDependentTaskFcn != NULL)
+	{
+		userTask = world->enqueueDependentTaskFcn(task, itemCount, minRange, taskContext, dependencies, dependencyCount,
+												  world->userTaskContext);
+	}
+	else
+	{
+		for (int i = 0; i < dependencyCount; ++i)
+		{
+			if (dependencies[i] != NULL)
+			{
+				world->finishTaskFcn(dependencies[i], world->userTaskContext);
+				world->activeTaskCount -= 1;
+				dependencies[i] = NULL;
+			}
+		}
+
+		userTask = world->enqueueTaskFcn(task, itemCount, minRange, taskContext, world->userTaskContext);
+	}
+
+	world->taskCount += 1;
+	world->activeTaskCount += userTask == NULL ? 0 : 1;
+	return userTask;
+}
+
+// Task contexts are created when the worker count grows and are kept when it shrinks, so the task system
+// may still use any worker index seen before. The bit sets start small and grow as needed during the time step.
+static void b2CreateTaskContexts(b2World* world, int workerCount)
+{
+	while (b2Array(world->taskContextArray).count < workerCount)
+	{
+		b2TaskContext context;
+		context.awakeIslandBitSet = b2CreateBitSet(&world->allocator, 256);
+		context.splitIslandBitSet = b2CreateBitSet(&world->allocator, 256);
+		context.stealCount = 0;
+		context.arena = b2CreateArenaAllocator(&world->allocator, 1024);
+		context.fastBodies = (b2ArenaIntArray){0};
+		context.bulletBodies = (b2ArenaIntArray){0};
+		context.contactChanges = (b2ArenaIntArray){0};
+		context.enlargedSims = (b2ArenaIntArray){0};
+		b2Array_Push(world->taskContextArray, context);
+	}
+}
+
 b2WorldId b2CreateWorld(const b2WorldDef* def)
 {
 	_Static_assert(b2_maxWorlds < UINT16_MAX, "b2_maxWorlds limit exceeded");
@@ -112,18 +165,25 @@ b2WorldId b2CreateWorld(const b2WorldDef* def)
 	world->worldId = (uint16_t)worldId;
 	world->inUse = true;
 
-	world->blockAllocator = b2CreateBlockAllocator();
-	world->stackAllocator = b2CreateStackAllocator(2048);
-	b2CreateBroadPhase(&world->broadPhase);
-	b2CreateGraph(&world->constraintGraph, 16);
+	// Everything the world holds is allocated through this
+	B2_ASSERT((def->allocFcn == NULL) == (def->freeFcn == NULL));
+	world->allocator.allocFcn = def->allocFcn;
+	world->allocator.freeFcn = def->freeFcn;
+	world->allocator.context = def->allocContext;
+	atomic_store(&world->allocator.byteCount, 0);
+
+	world->blockAllocator = b2CreateBlockAllocator(&world->allocator);
+	world->stackAllocator = b2CreateStackAllocator(&world->allocator, def->stackAllocatorCapacity);
+	b2CreateBroadPhase(&world->broadPhase, &world->allocator);
+	b2CreateGraph(&world->constraintGraph, &world->allocator, 16);
 
 	// pools
-	world->bodyIdPool = b2CreateIdPool();
-	world->bodyArray = b2CreateArray(sizeof(b2Body), 16);
-	world->solverSetArray = b2CreateArray(sizeof(b2SolverSet), 8);
+	world->bodyIdPool = b2CreateIdPool(&world->allocator);
+	world->bodyArray = b2CreateArray(&world->allocator, sizeof(b2Body), 16);
+	world->solverSetArray = b2CreateArray(&world->allocator, sizeof(b2SolverSet), 8);
 
 	// add empty static, active, and disabled body sets
-	world->solverSetIdPool = b2CreateIdPool();
+	world->solverSetIdPool = b2CreateIdPool(&world->allocator);
 	b2SolverSet set = {0};
 
 	// static set
@@ -141,30 +201,32 @@ b2WorldId b2CreateWorld(const b2WorldDef* def)
 	b2Array_Push(world->solverSetArray, set);
 	B2_ASSERT(world->solverSetArray[b2_awakeSet].setIndex == b2_awakeSet);
 
-	world->shapeIdPool = b2CreateIdPool();
-	world->shapeArray = b2CreateArray(sizeof(b2Shape), 16);
+	world->shapeIdPool = b2CreateIdPool(&world->allocator);
+	world->shapeArray = b2CreateArray(&world->allocator, sizeof(b2Shape), 16);
+
+	world->chainIdPool = b2CreateIdPool(&world->allocator);
+	world->chainArray = b2CreateArray(&world->allocator, sizeof(b2ChainShape), 4);
 
-	world->chainIdPool = b2CreateIdPool();
-	world->chainArray = b2CreateArray(sizeof(b2ChainShape), 4);
+	b2CreateGeometryPools(world);
 
-	world->contactIdPool = b2CreateIdPool();
-	world->contactArray = b2CreateArray(sizeof(b2Contact), 16);
+	world->contactIdPool = b2CreateIdPool(&world->allocator);
+	world->contactArray = b2CreateArray(&world->allocator, sizeof(b2Contact), 16);
 
-	world->jointIdPool = b2CreateIdPool();
-	world->jointArray = b2CreateArray(sizeof(b2Joint), 16);
+	world->jointIdPool = b2CreateIdPool(&world->allocator);
+	world->jointArray = b2CreateArray(&world->allocator, sizeof(b2Joint), 16);
 
-	world->islandIdPool = b2CreateIdPool();
-	world->islandArray = b2CreateArray(sizeof(b2Island), 8);
+	world->islandIdPool = b2CreateIdPool(&world->allocator);
+	world->islandArray = b2CreateArray(&world->allocator, sizeof(b2Island), 8);
 
-	world->bodyMoveEventArray = b2CreateArray(sizeof(b2BodyMoveEvent), 4);
-	world->sensorBeginEventArray = b2CreateArray(sizeof(b2SensorBeginTouchEvent), 4);
-	world->sensorEndEventArray = b2CreateArray(sizeof(b2SensorEndTouchEvent), 4);
-	world->contactBeginArray = b2CreateArray(sizeof(b2ContactBeginTouchEvent), 4);
-	world->contactEndArray = b2CreateArray(sizeof(b2ContactEndTouchEvent), 4);
-	world->contactHitArray = b2CreateArray(sizeof(b2ContactHitEvent), 4);
+	world->bodyMoveEventArray = b2CreateArray(&world->allocator, sizeof(b2BodyMoveEvent), 4);
+	world->sensorBeginEventArray = b2CreateArray(&world->allocator, sizeof(b2SensorBeginTouchEvent), 4);
+	world->sensorEndEventArray = b2CreateArray(&world->allocator, sizeof(b2SensorEndTouchEvent), 4);
+	world->contactBeginArray = b2CreateArray(&world->allocator, sizeof(b2ContactBeginTouchEvent), 4);
+	world->contactEndArray = b2CreateArray(&world->allocator, sizeof(b2ContactEndTouchEvent), 4);
+	world->contactHitArray = b2CreateArray(&world->allocator, sizeof(b2ContactHitEvent), 4);
 
 	world->stepIndex = 0;
-	world->splitIslandId = B2_NULL_INDEX;
+	world->splitIslandArray = b2CreateArray(&world->allocator, sizeof(int), b2_maxSplitIslands);
 	world->activeTaskCount = 0;
 	world->taskCount = 0;
 	world->gravity = def->gravity;
@@ -180,12 +242,25 @@ b2WorldId b2CreateWorld(const b2WorldDef* def)
 	world->enableWarmStarting = true;
 	world->enableContinuous = def->enableContinous;
 	world->userTreeTask = NULL;
+	world->serialSolveThreshold = def->serialSolveThreshold;
+	world->enableWorkerAffinity = def->enableWorkerAffinity;
+	world->enableQuerySnapshot = def->enableQuerySnapshot;
+	world->enableTrace = false;
+	world->traceRetained = false;
+	world->memoryBudget = def->memoryBudget;
+	world->memoryBudgetPolicy = def->memoryBudgetPolicy;
+
+	if (world->enableQuerySnapshot)
+	{
+		b2CreateQuerySnapshots(world);
+	}
 
 	if (def->workerCount > 0 && def->enqueueTask != NULL && def->finishTask != NULL)
 	{
-		world->workerCount = b2MinInt(def->workerCount, b2_maxWorkers);
+		world->workerCount = def->workerCount;
 		world->enqueueTaskFcn = def->enqueueTask;
 		world->finishTaskFcn = def->finishTask;
+		world->enqueueDependentTaskFcn = def->enqueueDependentTask;
 		world->userTaskContext = def->userTaskContext;
 	}
 	else
@@ -193,20 +268,16 @@ b2WorldId b2CreateWorld(const b2WorldDef* def)
 		world->workerCount = 1;
 		world->enqueueTaskFcn = b2DefaultAddTaskFcn;
 		world->finishTaskFcn = b2DefaultFinishTaskFcn;
+		world->enqueueDependentTaskFcn = NULL;
 		world->userTaskContext = NULL;
 	}
 
-	world->taskContextArray = b2CreateArray(sizeof(b2TaskContext), world->workerCount);
-	for (int i = 0; i < world->workerCount; ++i)
-	{
-		world->taskContextArray[i].contactStateBitSet = b2CreateBitSet(1024);
-		world->taskContextArray[i].enlargedSimBitSet = b2CreateBitSet(256);
-		world->taskContextArray[i].awakeIslandBitSet = b2CreateBitSet(256);
-	}
+	world->taskContextArray = b2CreateArray(&world->allocator, sizeof(b2TaskContext), world->workerCount);
+	b2CreateTaskContexts(world, world->workerCount);
 
-	world->debugBodySet = b2CreateBitSet(256);
-	world->debugJointSet = b2CreateBitSet(256);
-	world->debugContactSet = b2CreateBitSet(256);
+	world->debugBodySet = b2CreateBitSet(&world->allocator, 256);
+	world->debugJointSet = b2CreateBitSet(&world->allocator, 256);
+	world->debugContactSet = b2CreateBitSet(&world->allocator, 256);
 
 	// add one to worldId so that 0 represents a null b2WorldId
 	return (b2WorldId){(uint16_t)(worldId + 1), world->revision};
@@ -220,14 +291,31 @@ void b2DestroyWorld(b2WorldId worldId)
 	b2DestroyBitSet(&world->debugJointSet);
 	b2DestroyBitSet(&world->debugContactSet);
 
-	for (int i = 0; i < world->workerCount; ++i)
+	if (world->enableQuerySnapshot)
+	{
+		b2DestroyQuerySnapshots(world);
+	}
+
+	if (world->enableTrace)
+	{
+		b2EnableTrace(false);
+	}
+
+	if (world->traceRetained)
+	{
+		b2ReleaseTrace();
+	}
+
+	int taskContextCount = b2Array(world->taskContextArray).count;
+	for (int i = 0; i < taskContextCount; ++i)
 	{
-		b2DestroyBitSet(&world->taskContextArray[i].contactStateBitSet);
-		b2DestroyBitSet(&world->taskContextArray[i].enlargedSimBitSet);
 		b2DestroyBitSet(&world->taskContextArray[i].awakeIslandBitSet);
+		b2DestroyBitSet(&world->taskContextArray[i].splitIslandBitSet);
+		b2DestroyArenaAllocator(&world->taskContextArray[i].arena);
 	}
 
 	b2DestroyArray(world->taskContextArray, sizeof(b2TaskContext));
+	b2DestroyArray(world->splitIslandArray, sizeof(int));
 
 	b2DestroyArray(world->bodyMoveEventArray, sizeof(b2BodyMoveEvent));
 	b2DestroyArray(world->sensorBeginEventArray, sizeof(b2SensorBeginTouchEvent));
@@ -242,7 +330,7 @@ void b2DestroyWorld(b2WorldId worldId)
 		b2ChainShape* chain = world->chainArray + i;
 		if (chain->id != B2_NULL_INDEX)
 		{
-			b2Free(chain->shapeIndices, chain->count * sizeof(int));
+			b2FreeWith(&world->allocator, chain->shapeIndices, chain->count * sizeof(int));
 		}
 		else
 		{
@@ -253,6 +341,7 @@ void b2DestroyWorld(b2WorldId worldId)
 	b2DestroyArray(world->bodyArray, sizeof(b2Body));
 	b2DestroyArray(world->shapeArray, sizeof(b2Shape));
 	b2DestroyArray(world->chainArray, sizeof(b2ChainShape));
+	b2DestroyGeometryPools(world);
 	b2DestroyArray(world->contactArray, sizeof(b2Contact));
 	b2DestroyArray(world->jointArray, sizeof(b2Joint));
 	b2DestroyArray(world->islandArray, sizeof(b2Island));
@@ -286,6 +375,9 @@ void b2DestroyWorld(b2WorldId worldId)
 	b2DestroyBlockAllocator(&world->blockAllocator);
 	b2DestroyStackAllocator(&world->stackAllocator);
 
+	// Everything allocated for the world should be returned
+	B2_ASSERT(atomic_load(&world->allocator.byteCount) == 0);
+
 	// Wipe world but preserve revision
 	uint16_t revision = world->revision;
 	*world = (b2World){0};
@@ -293,96 +385,167 @@ void b2DestroyWorld(b2WorldId worldId)
 	world->revision = revision + 1;
 }
 
+// Update a touching contact in the constraint graph
+static void b2CollideContact(b2World* world, b2TaskContext* taskContext, b2ContactSim* contactSim)
+{
+	int contactId = contactSim->contactId;
+
+	b2Shape* shapeA = world->shapeArray + contactSim->shapeIdA;
+	b2Shape* shapeB = world->shapeArray + contactSim->shapeIdB;
+
+	// Do proxies still overlap?
+	bool overlap = b2AABB_Overlaps(shapeA->fatAABB, shapeB->fatAABB);
+	if (overlap == false)
+	{
+		contactSim->simFlags |= b2_simDisjoint;
+		contactSim->simFlags &= ~b2_simTouchingFlag;
+		b2ArenaIntArray_Push(&taskContext->arena, &taskContext->contactChanges, contactId);
+		return;
+	}
+
+	bool wasTouching = (contactSim->simFlags & b2_simTouchingFlag);
+
+	// Update contact respecting shape/body order (A,B)
+	b2Body* bodyA = world->bodyArray + shapeA->bodyId;
+	b2Body* bodyB = world->bodyArray + shapeB->bodyId;
+	b2BodySim* bodySimA = b2GetBodySim(world, bodyA);
+	b2BodySim* bodySimB = b2GetBodySim(world, bodyB);
+
+	// avoid cache misses in b2PrepareContactsTask
+	contactSim->bodySimIndexA = bodyA->setIndex == b2_awakeSet ? bodyA->localIndex : B2_NULL_INDEX;
+	contactSim->invMassA = bodySimA->invMass;
+	contactSim->invIA = bodySimA->invI;
+
+	contactSim->bodySimIndexB = bodyB->setIndex == b2_awakeSet ? bodyB->localIndex : B2_NULL_INDEX;
+	contactSim->invMassB = bodySimB->invMass;
+	contactSim->invIB = bodySimB->invI;
+
+	b2Transform transformA = bodySimA->transform;
+	b2Transform transformB = bodySimB->transform;
+
+	b2Vec2 centerOffsetA = b2RotateVector(transformA.q, bodySimA->localCenter);
+	b2Vec2 centerOffsetB = b2RotateVector(transformB.q, bodySimB->localCenter);
+
+	bool touching = b2UpdateContact(world, contactSim, shapeA, transformA, centerOffsetA, shapeB, transformB, centerOffsetB);
+
+	// State changes that affect island connectivity
+	if (touching == true && wasTouching == false)
+	{
+		contactSim->simFlags |= b2_simStartedTouching;
+		b2ArenaIntArray_Push(&taskContext->arena, &taskContext->contactChanges, contactId);
+	}
+	else if (touching == false && wasTouching == true)
+	{
+		contactSim->simFlags |= b2_simStoppedTouching;
+		b2ArenaIntArray_Push(&taskContext->arena, &taskContext->contactChanges, contactId);
+	}
+}
+
+// Update a non-touching contact in the awake set. The manifold is computed in a temporary contact sim
+// because there are no points to warm start. If the contact starts touching the contact sim is kept in
+// the worker arena until it is moved to the constraint graph.
+static void b2CollideNonTouchingContact(b2World* world, b2TaskContext* taskContext, b2NonTouchingContactSim* sim)
+{
+	int contactId = sim->contactId;
+
+	b2Shape* shapeA = world->shapeArray + sim->shapeIdA;
+	b2Shape* shapeB = world->shapeArray + sim->shapeIdB;
+
+	// Do proxies still overlap?
+	bool overlap = b2AABB_Overlaps(shapeA->fatAABB, shapeB->fatAABB);
+	if (overlap == false)
+	{
+		sim->simFlags |= b2_simDisjoint;
+		sim->simFlags &= ~b2_simTouchingFlag;
+		b2ArenaIntArray_Push(&taskContext->arena, &taskContext->contactChanges, contactId);
+		return;
+	}
+
+	bool wasTouching = (sim->simFlags & b2_simTouchingFlag);
+
+	b2Body* bodyA = world->bodyArray + shapeA->bodyId;
+	b2Body* bodyB = world->bodyArray + shapeB->bodyId;
+	b2BodySim* bodySimA = b2GetBodySim(world, bodyA);
+	b2BodySim* bodySimB = b2GetBodySim(world, bodyB);
+
+	b2Transform transformA = bodySimA->transform;
+	b2Transform transformB = bodySimB->transform;
+
+	b2Vec2 centerOffsetA = b2RotateVector(transformA.q, bodySimA->localCenter);
+	b2Vec2 centerOffsetB = b2RotateVector(transformB.q, bodySimB->localCenter);
+
+	b2ContactSim contactSim = b2MakeContactSim(sim);
+	bool touching = b2UpdateContact(world, &contactSim, shapeA, transformA, centerOffsetA, shapeB, transformB, centerOffsetB);
+
+	sim->cache = contactSim.cache;
+	sim->simFlags = contactSim.simFlags;
+
+	// State changes that affect island connectivity
+	if (touching == true && wasTouching == false)
+	{
+		sim->simFlags |= b2_simStartedTouching;
+		b2ArenaIntArray_Push(&taskContext->arena, &taskContext->contactChanges, contactId);
+
+		// Sensors stay non-touching contacts
+		if (contactSim.manifold.pointCount > 0)
+		{
+			contactSim.simFlags = sim->simFlags;
+			sim->beginSim = b2AllocateArenaItem(&taskContext->arena, sizeof(b2ContactSim));
+			memcpy(sim->beginSim, &contactSim, sizeof(b2ContactSim));
+		}
+	}
+	else if (touching == false && wasTouching == true)
+	{
+		sim->simFlags |= b2_simStoppedTouching;
+		b2ArenaIntArray_Push(&taskContext->arena, &taskContext->contactChanges, contactId);
+	}
+}
+
 static void b2CollideTask(int startIndex, int endIndex, uint32_t threadIndex, void* context)
 {
 	b2TracyCZoneNC(collide_task, "Collide Task", b2_colorDodgerBlue1, true);
 
 	b2StepContext* stepContext = context;
 	b2World* world = stepContext->world;
-	B2_ASSERT(threadIndex < world->workerCount);
+	b2TraceScope traceScope = b2EnterTraceScope(world->worldId, (int)threadIndex);
+	B2_ASSERT(threadIndex < b2Array(world->taskContextArray).count);
 	b2TaskContext* taskContext = world->taskContextArray + threadIndex;
 	b2ContactSim** contactSims = stepContext->contacts;
-	b2Shape* shapes = world->shapeArray;
-	b2Body* bodies = world->bodyArray;
+	int touchingCount = stepContext->touchingContactCount;
+	b2NonTouchingContactSim* nonTouchingSims = world->solverSetArray[b2_awakeSet].nonTouchingContacts.data;
 
 	B2_ASSERT(startIndex < endIndex);
 
 	for (int i = startIndex; i < endIndex; ++i)
 	{
-		b2ContactSim* contactSim = contactSims[i];
-
-		int contactId = contactSim->contactId;
-
-		b2Shape* shapeA = shapes + contactSim->shapeIdA;
-		b2Shape* shapeB = shapes + contactSim->shapeIdB;
-
-		// Do proxies still overlap?
-		bool overlap = b2AABB_Overlaps(shapeA->fatAABB, shapeB->fatAABB);
-		if (overlap == false)
+		if (i < touchingCount)
 		{
-			contactSim->simFlags |= b2_simDisjoint;
-			contactSim->simFlags &= ~b2_simTouchingFlag;
-			b2SetBit(&taskContext->contactStateBitSet, contactId);
+			b2CollideContact(world, taskContext, contactSims[i]);
 		}
 		else
 		{
-			bool wasTouching = (contactSim->simFlags & b2_simTouchingFlag);
-
-			// Update contact respecting shape/body order (A,B)
-			b2Body* bodyA = bodies + shapeA->bodyId;
-			b2Body* bodyB = bodies + shapeB->bodyId;
-			b2BodySim* bodySimA = b2GetBodySim(world, bodyA);
-			b2BodySim* bodySimB = b2GetBodySim(world, bodyB);
-
-			// avoid cache misses in b2PrepareContactsTask
-			contactSim->bodySimIndexA = bodyA->setIndex == b2_awakeSet ? bodyA->localIndex : B2_NULL_INDEX;
-			contactSim->invMassA = bodySimA->invMass;
-			contactSim->invIA = bodySimA->invI;
-
-			contactSim->bodySimIndexB = bodyB->setIndex == b2_awakeSet ? bodyB->localIndex : B2_NULL_INDEX;
-			contactSim->invMassB = bodySimB->invMass;
-			contactSim->invIB = bodySimB->invI;
-
-			b2Transform transformA = bodySimA->transform;
-			b2Transform transformB = bodySimB->transform;
-
-			b2Vec2 centerOffsetA = b2RotateVector(transformA.q, bodySimA->localCenter);
-			b2Vec2 centerOffsetB = b2RotateVector(transformB.q, bodySimB->localCenter);
-
-			bool touching =
-				b2UpdateContact(world, contactSim, shapeA, transformA, centerOffsetA, shapeB, transformB, centerOffsetB);
-
-			// Move
-
-			// State changes that affect island connectivity
-			if (touching == true && wasTouching == false)
-			{
-				contactSim->simFlags |= b2_simStartedTouching;
-				b2SetBit(&taskContext->contactStateBitSet, contactId);
-			}
-			else if (touching == false && wasTouching == true)
-			{
-				contactSim->simFlags |= b2_simStoppedTouching;
-				b2SetBit(&taskContext->contactStateBitSet, contactId);
-			}
+			b2CollideNonTouchingContact(world, taskContext, nonTouchingSims + (i - touchingCount));
 		}
 	}
 
 	b2TracyCZoneEnd(collide_task);
+
+	b2LeaveTraceScope(traceScope);
 }
 
 static void b2UpdateTreesTask(int startIndex, int endIndex, uint32_t threadIndex, void* context)
 {
 	B2_MAYBE_UNUSED(startIndex);
 	B2_MAYBE_UNUSED(endIndex);
-	B2_MAYBE_UNUSED(threadIndex);
-
 	b2TracyCZoneNC(tree_task, "Rebuild Trees", b2_colorSnow1, true);
 
 	b2World* world = context;
+	b2TraceScope traceScope = b2EnterTraceScope(world->worldId, (int)threadIndex);
 	b2BroadPhase_RebuildTrees(&world->broadPhase);
 
 	b2TracyCZoneEnd(tree_task);
+
+	b2LeaveTraceScope(traceScope);
 }
 
 static void b2AddNonTouchingContact(b2World* world, b2Contact* contact, b2ContactSim* contactSim)
@@ -390,20 +553,20 @@ static void b2AddNonTouchingContact(b2World* world, b2Contact* contact, b2Contac
 	B2_ASSERT(contact->setIndex == b2_awakeSet);
 	b2SolverSet* set = world->solverSetArray + b2_awakeSet;
 	contact->colorIndex = B2_NULL_INDEX;
-	contact->localIndex = set->contacts.count;
+	contact->localIndex = set->nonTouchingContacts.count;
 
-	b2ContactSim* newContactSim = b2AddContact(&world->blockAllocator, &set->contacts);
-	memcpy(newContactSim, contactSim, sizeof(b2ContactSim));
+	b2NonTouchingContactSim* newContactSim = b2AddNonTouchingContactSim(&world->blockAllocator, &set->nonTouchingContacts);
+	*newContactSim = b2MakeNonTouchingContactSim(contactSim);
 }
 
 static void b2RemoveNonTouchingContact(b2World* world, int setIndex, int localIndex)
 {
 	b2CheckIndex(world->solverSetArray, setIndex);
 	b2SolverSet* set = world->solverSetArray + setIndex;
-	int movedIndex = b2RemoveContact(&set->contacts, localIndex);
+	int movedIndex = b2RemoveNonTouchingContactSim(&set->nonTouchingContacts, localIndex);
 	if (movedIndex != B2_NULL_INDEX)
 	{
-		b2ContactSim* movedContactSim = set->contacts.data + localIndex;
+		b2NonTouchingContactSim* movedContactSim = set->nonTouchingContacts.data + localIndex;
 		b2CheckIndex(world->contactArray, movedContactSim->contactId);
 		b2Contact* movedContact = world->contactArray + movedContactSim->contactId;
 		B2_ASSERT(movedContact->setIndex == setIndex);
@@ -428,16 +591,17 @@ static void b2Collide(b2StepContext* context)
 	world->taskCount += 1;
 	world->activeTaskCount += world->userTreeTask == NULL ? 0 : 1;
 
-	// gather contacts into a single array for easier parallel-for
-	int contactCount = 0;
+	// gather touching contacts into a single array for easier parallel-for
+	int touchingCount = 0;
 	b2GraphColor* graphColors = world->constraintGraph.colors;
 	for (int i = 0; i < b2_graphColorCount; ++i)
 	{
-		contactCount += graphColors[i].contacts.count;
+		touchingCount += graphColors[i].contacts.count;
 	}
 
-	int nonTouchingCount = world->solverSetArray[b2_awakeSet].contacts.count;
-	contactCount += nonTouchingCount;
+	// non-touching contacts are indexed directly after the touching contacts
+	int nonTouchingCount = world->solverSetArray[b2_awakeSet].nonTouchingContacts.count;
+	int contactCount = touchingCount + nonTouchingCount;
 
 	if (contactCount == 0)
 	{
@@ -445,7 +609,8 @@ static void b2Collide(b2StepContext* context)
 		return;
 	}
 
-	b2ContactSim** contactSims = b2AllocateStackItem(&world->stackAllocator, contactCount * sizeof(b2ContactSim), "contacts");
+	b2ContactSim** contactSims =
+		b2AllocateStackItem(&world->stackAllocator, touchingCount * sizeof(b2ContactSim*), "contacts");
 
 	int contactIndex = 0;
 	for (int i = 0; i < b2_graphColorCount; ++i)
@@ -460,24 +625,17 @@ static void b2Collide(b2StepContext* context)
 		}
 	}
 
-	{
-		b2ContactSim* base = world->solverSetArray[b2_awakeSet].contacts.data;
-		for (int i = 0; i < nonTouchingCount; ++i)
-		{
-			contactSims[contactIndex] = base + i;
-			contactIndex += 1;
-		}
-	}
-
-	B2_ASSERT(contactIndex == contactCount);
+	B2_ASSERT(contactIndex == touchingCount);
 
 	context->contacts = contactSims;
+	context->touchingContactCount = touchingCount;
 
-	// Contact bit set on ids because contact pointers are unstable as they move between touching and not touching.
-	int contactIdCapacity = b2GetIdCapacity(&world->contactIdPool);
-	for (int i = 0; i < world->workerCount; ++i)
+	// Contact changes are recorded by id because contact pointers are unstable as they move between touching and
+	// not touching. The arena was reset at the start of the step.
+	int taskContextCount = b2Array(world->taskContextArray).count;
+	for (int i = 0; i < taskContextCount; ++i)
 	{
-		b2SetBitCountAndClear(&world->taskContextArray[i].contactStateBitSet, contactIdCapacity);
+		world->taskContextArray[i].contactChanges = (b2ArenaIntArray){0};
 	}
 
 	// Task should take at least 40us on a 4GHz CPU (10K cycles)
@@ -496,176 +654,197 @@ static void b2Collide(b2StepContext* context)
 	// Serially update contact state
 	b2TracyCZoneNC(contact_state, "Contact State", b2_colorCoral, true);
 
-	// Bitwise OR all contact bits
-	b2BitSet* bitSet = &world->taskContextArray[0].contactStateBitSet;
-	for (int i = 1; i < world->workerCount; ++i)
+	// Gather the changed contact ids of all workers and clear the worker lists. Sorting makes the order independent
+	// of the task distribution.
+	int changeCount = 0;
+	for (int i = 0; i < taskContextCount; ++i)
 	{
-		b2InPlaceUnion(bitSet, &world->taskContextArray[i].contactStateBitSet);
+		changeCount += world->taskContextArray[i].contactChanges.count;
 	}
 
+	int* changedContactIds = b2AllocateStackItem(&world->stackAllocator, changeCount * sizeof(int), "contact changes");
+	changeCount = 0;
+	for (int i = 0; i < taskContextCount; ++i)
+	{
+		b2ArenaIntArray* changes = &world->taskContextArray[i].contactChanges;
+		if (changes->count > 0)
+		{
+			memcpy(changedContactIds + changeCount, changes->data, changes->count * sizeof(int));
+			changeCount += changes->count;
+		}
+
+		*changes = (b2ArenaIntArray){0};
+	}
+
+	b2SortInts(changedContactIds, changeCount);
+
 	b2Contact* contacts = world->contactArray;
 	b2SolverSet* awakeSet = world->solverSetArray + b2_awakeSet;
 
 	const b2Shape* shapes = world->shapeArray;
 	int16_t worldId = world->worldId;
 
-	// Process contact state changes. Iterate over set bits
-	for (uint32_t k = 0; k < bitSet->blockCount; ++k)
+	// Process contact state changes in id order
+	for (int changeIndex = 0; changeIndex < changeCount; ++changeIndex)
 	{
-		uint64_t bits = bitSet->bits[k];
-		while (bits != 0)
-		{
-			uint32_t ctz = b2CTZ64(bits);
-			int contactId = (int)(64 * k + ctz);
+		int contactId = changedContactIds[changeIndex];
 
-			b2CheckIndex(contacts, contactId);
+		b2CheckIndex(contacts, contactId);
 
-			b2Contact* contact = contacts + contactId;
-			B2_ASSERT(contact->setIndex == b2_awakeSet);
+		b2Contact* contact = contacts + contactId;
+		B2_ASSERT(contact->setIndex == b2_awakeSet);
 
-			int colorIndex = contact->colorIndex;
-			int localIndex = contact->localIndex;
+		int colorIndex = contact->colorIndex;
+		int localIndex = contact->localIndex;
 
-			b2ContactSim* contactSim = NULL;
-			if (colorIndex != B2_NULL_INDEX)
-			{
-				// contact lives in constraint graph
-				B2_ASSERT(0 <= colorIndex && colorIndex < b2_graphColorCount);
-				b2GraphColor* color = graphColors + colorIndex;
-				B2_ASSERT(0 <= localIndex && localIndex < color->contacts.count);
-				contactSim = color->contacts.data + localIndex;
-			}
-			else
-			{
-				B2_ASSERT(0 <= localIndex && localIndex < awakeSet->contacts.count);
-				contactSim = awakeSet->contacts.data + localIndex;
-			}
+		b2ContactSim* contactSim = NULL;
+		b2NonTouchingContactSim* nonTouchingSim = NULL;
+		uint32_t simFlags;
+		if (colorIndex != B2_NULL_INDEX)
+		{
+			// contact lives in constraint graph
+			B2_ASSERT(0 <= colorIndex && colorIndex < b2_graphColorCount);
+			b2GraphColor* color = graphColors + colorIndex;
+			B2_ASSERT(0 <= localIndex && localIndex < color->contacts.count);
+			contactSim = color->contacts.data + localIndex;
+			simFlags = contactSim->simFlags;
+		}
+		else
+		{
+			B2_ASSERT(0 <= localIndex && localIndex < awakeSet->nonTouchingContacts.count);
+			nonTouchingSim = awakeSet->nonTouchingContacts.data + localIndex;
+			simFlags = nonTouchingSim->simFlags;
+		}
 
-			const b2Shape* shapeA = shapes + contact->shapeIdA;
-			const b2Shape* shapeB = shapes + contact->shapeIdB;
-			b2ShapeId shapeIdA = {shapeA->id + 1, worldId, shapeA->revision};
-			b2ShapeId shapeIdB = {shapeB->id + 1, worldId, shapeB->revision};
-			uint32_t flags = contact->flags;
-			uint32_t simFlags = contactSim->simFlags;
+		const b2Shape* shapeA = shapes + contact->shapeIdA;
+		const b2Shape* shapeB = shapes + contact->shapeIdB;
+		b2ShapeId shapeIdA = {shapeA->id + 1, worldId, shapeA->revision};
+		b2ShapeId shapeIdB = {shapeB->id + 1, worldId, shapeB->revision};
+		uint32_t flags = contact->flags;
 
-			if (simFlags & b2_simDisjoint)
+		if (simFlags & b2_simDisjoint)
+		{
+			// Was touching?
+			if ((flags & b2_contactTouchingFlag) != 0 && (flags & b2_contactEnableContactEvents) != 0)
 			{
-				// Was touching?
-				if ((flags & b2_contactTouchingFlag) != 0 && (flags & b2_contactEnableContactEvents) != 0)
-				{
-					b2ContactEndTouchEvent event = {shapeIdA, shapeIdB};
-					b2Array_Push(world->contactEndArray, event);
-				}
-
-				// Bounding boxes no longer overlap
-				contact->flags &= ~b2_contactTouchingFlag;
-				b2DestroyContact(world, contact, false);
-				contact = NULL;
-				contactSim = NULL;
+				b2ContactEndTouchEvent event = {shapeIdA, shapeIdB};
+				b2Array_Push(world->contactEndArray, event);
 			}
-			else if (simFlags & b2_simStartedTouching)
+
+			// Bounding boxes no longer overlap
+			contact->flags &= ~b2_contactTouchingFlag;
+			b2DestroyContact(world, contact, false);
+			contact = NULL;
+			contactSim = NULL;
+			nonTouchingSim = NULL;
+		}
+		else if (simFlags & b2_simStartedTouching)
+		{
+			B2_ASSERT(contact->islandId == B2_NULL_INDEX);
+			B2_ASSERT(nonTouchingSim != NULL);
+			if ((flags & b2_contactSensorFlag) != 0)
 			{
-				B2_ASSERT(contact->islandId == B2_NULL_INDEX);
-				if ((flags & b2_contactSensorFlag) != 0)
+				if ((flags & b2_contactEnableSensorEvents) != 0)
 				{
-					if ((flags & b2_contactEnableSensorEvents) != 0)
+					if (shapeA->isSensor)
 					{
-						if (shapeA->isSensor)
-						{
-							b2SensorBeginTouchEvent event = {shapeIdA, shapeIdB};
-							b2Array_Push(world->sensorBeginEventArray, event);
-						}
-
-						if (shapeB->isSensor)
-						{
-							b2SensorBeginTouchEvent event = {shapeIdB, shapeIdA};
-							b2Array_Push(world->sensorBeginEventArray, event);
-						}
+						b2SensorBeginTouchEvent event = {shapeIdA, shapeIdB};
+						b2Array_Push(world->sensorBeginEventArray, event);
 					}
 
-					contactSim->simFlags &= ~b2_simStartedTouching;
-					contact->flags |= b2_contactTouchingFlag;
-				}
-				else
-				{
-					if (flags & b2_contactEnableContactEvents)
+					if (shapeB->isSensor)
 					{
-						b2ContactBeginTouchEvent event = {shapeIdA, shapeIdB};
-						b2Array_Push(world->contactBeginArray, event);
+						b2SensorBeginTouchEvent event = {shapeIdB, shapeIdA};
+						b2Array_Push(world->sensorBeginEventArray, event);
 					}
+				}
 
-					B2_ASSERT(contactSim->manifold.pointCount > 0);
-					B2_ASSERT(contact->setIndex == b2_awakeSet);
+				nonTouchingSim->simFlags &= ~b2_simStartedTouching;
+				contact->flags |= b2_contactTouchingFlag;
+			}
+			else
+			{
+				if (flags & b2_contactEnableContactEvents)
+				{
+					b2ContactBeginTouchEvent event = {shapeIdA, shapeIdB};
+					b2Array_Push(world->contactBeginArray, event);
+				}
 
-					// Link first because this wakes colliding bodies and ensures the body sims
-					// are in the correct place.
-					contact->flags |= b2_contactTouchingFlag;
-					b2LinkContact(world, contact);
+				// The collide task expanded the contact sim in the worker arena
+				b2ContactSim* beginSim = nonTouchingSim->beginSim;
+				B2_ASSERT(beginSim != NULL && beginSim->manifold.pointCount > 0);
+				B2_ASSERT(contact->setIndex == b2_awakeSet);
 
-					// Make sure these didn't change
-					B2_ASSERT(contact->colorIndex == B2_NULL_INDEX);
-					B2_ASSERT(contact->localIndex == localIndex);
+				// Link first because this wakes colliding bodies and ensures the body sims
+				// are in the correct place.
+				contact->flags |= b2_contactTouchingFlag;
+				b2LinkContact(world, contact);
 
-					// Contact sim pointer may have become orphaned due to awake set growth,
-					// so I just need to refresh it.
-					B2_ASSERT(0 <= localIndex && localIndex < awakeSet->contacts.count);
-					contactSim = awakeSet->contacts.data + localIndex;
+				// Make sure these didn't change
+				B2_ASSERT(contact->colorIndex == B2_NULL_INDEX);
+				B2_ASSERT(contact->localIndex == localIndex);
 
-					contactSim->simFlags &= ~b2_simStartedTouching;
+				// The non-touching sim pointer may have become orphaned due to awake set growth.
+				// The begin sim is in the worker arena so it is still valid.
+				B2_ASSERT(0 <= localIndex && localIndex < awakeSet->nonTouchingContacts.count);
+				nonTouchingSim = NULL;
 
-					b2AddContactToGraph(world, contactSim, contact);
-					b2RemoveNonTouchingContact(world, b2_awakeSet, localIndex);
-					contactSim = NULL;
-				}
+				beginSim->simFlags &= ~b2_simStartedTouching;
+
+				b2AddContactToGraph(world, beginSim, contact);
+				b2RemoveNonTouchingContact(world, b2_awakeSet, localIndex);
 			}
-			else if (simFlags & b2_simStoppedTouching)
+		}
+		else if (simFlags & b2_simStoppedTouching)
+		{
+			contact->flags &= ~b2_contactTouchingFlag;
+
+			if ((flags & b2_contactSensorFlag) != 0)
 			{
-				contactSim->simFlags &= ~b2_simStoppedTouching;
-				contact->flags &= ~b2_contactTouchingFlag;
+				// sensors are never in the constraint graph
+				B2_ASSERT(nonTouchingSim != NULL);
+				nonTouchingSim->simFlags &= ~b2_simStoppedTouching;
 
-				if ((flags & b2_contactSensorFlag) != 0)
+				if ((flags & b2_contactEnableSensorEvents) != 0)
 				{
-					if ((flags & b2_contactEnableSensorEvents) != 0)
+					if (shapeA->isSensor)
 					{
-						if (shapeA->isSensor)
-						{
-							b2SensorEndTouchEvent event = {shapeIdA, shapeIdB};
-							b2Array_Push(world->sensorEndEventArray, event);
-						}
+						b2SensorEndTouchEvent event = {shapeIdA, shapeIdB};
+						b2Array_Push(world->sensorEndEventArray, event);
+					}
 
-						if (shapeB->isSensor)
-						{
-							b2SensorEndTouchEvent event = {shapeIdB, shapeIdA};
-							b2Array_Push(world->sensorEndEventArray, event);
-						}
+					if (shapeB->isSensor)
+					{
+						b2SensorEndTouchEvent event = {shapeIdB, shapeIdA};
+						b2Array_Push(world->sensorEndEventArray, event);
 					}
 				}
-				else
+			}
+			else
+			{
+				if (contact->flags & b2_contactEnableContactEvents)
 				{
-					if (contact->flags & b2_contactEnableContactEvents)
-					{
-						b2ContactEndTouchEvent event = {shapeIdA, shapeIdB};
-						b2Array_Push(world->contactEndArray, event);
-					}
+					b2ContactEndTouchEvent event = {shapeIdA, shapeIdB};
+					b2Array_Push(world->contactEndArray, event);
+				}
 
-					B2_ASSERT(contactSim->manifold.pointCount == 0);
+				B2_ASSERT(contactSim != NULL && contactSim->manifold.pointCount == 0);
+				contactSim->simFlags &= ~b2_simStoppedTouching;
 
-					b2UnlinkContact(world, contact);
-					int bodyIdA = contact->edges[0].bodyId;
-					int bodyIdB = contact->edges[1].bodyId;
+				b2UnlinkContact(world, contact);
+				int bodyIdA = contact->edges[0].bodyId;
+				int bodyIdB = contact->edges[1].bodyId;
 
-					b2AddNonTouchingContact(world, contact, contactSim);
-					b2RemoveContactFromGraph(world, bodyIdA, bodyIdB, colorIndex, localIndex);
-					contact = NULL;
-					contactSim = NULL;
-				}
+				b2AddNonTouchingContact(world, contact, contactSim);
+				b2RemoveContactFromGraph(world, bodyIdA, bodyIdB, colorIndex, localIndex);
+				contact = NULL;
+				contactSim = NULL;
 			}
-
-			// Clear the smallest set bit
-			bits = bits & (bits - 1);
 		}
 	}
 
+	b2FreeStackItem(&world->stackAllocator, changedContactIds);
+
 	b2ValidateSolverSets(world);
 	b2ValidateContacts(world);
 
@@ -673,6 +852,26 @@ static void b2Collide(b2StepContext* context)
 	b2TracyCZoneEnd(collide);
 }
 
+// Grow the stack before the step uses it so that scratch allocations do not fall back to the heap.
+// The step phases free their scratch memory before the next phase starts.
+static void b2ReserveStepStack(b2World* world)
+{
+	int pairSize = b2EstimatePairStackSize(&world->broadPhase);
+
+	int contactCount = 0;
+	for (int i = 0; i < b2_graphColorCount; ++i)
+	{
+		contactCount += world->constraintGraph.colors[i].contacts.count;
+	}
+	// touching contact pointers, then the ids of contacts that changed state
+	int collideSize = b2MaxInt(contactCount * (int)sizeof(b2ContactSim*), b2GetIdCount(&world->contactIdPool) * (int)sizeof(int));
+
+	int solveSize = b2EstimateSolverStackSize(world);
+
+	int size = b2MaxInt(pairSize, b2MaxInt(collideSize, solveSize));
+	b2ReserveStack(&world->stackAllocator, size);
+}
+
 void b2World_Step(b2WorldId worldId, float timeStep, int subStepCount)
 {
 	b2World* world = b2GetWorldFromId(worldId);
@@ -699,14 +898,31 @@ void b2World_Step(b2WorldId worldId, float timeStep, int subStepCount)
 		return;
 	}
 
+	// The calling thread is worker zero of this world
+	b2TraceScope traceScope = b2EnterTraceScope(world->worldId, 0);
+
 	b2TracyCZoneNC(world_step, "Step", b2_colorChartreuse, true);
 
+	// Until now queries read the world directly. Take the first snapshot before the step changes anything.
+	if (world->enableQuerySnapshot && atomic_load(&world->querySnapshotIndex) == B2_NULL_INDEX)
+	{
+		b2UpdateQuerySnapshot(world);
+	}
+
 	world->locked = true;
 	world->activeTaskCount = 0;
 	world->taskCount = 0;
 
 	b2Timer stepTimer = b2CreateTimer();
 
+	int taskContextCount = b2Array(world->taskContextArray).count;
+	for (int i = 0; i < taskContextCount; ++i)
+	{
+		b2ResetArena(&world->taskContextArray[i].arena);
+	}
+
+	b2ReserveStepStack(world);
+
 	// Update collision pairs and create contacts
 	{
 		b2Timer timer = b2CreateTimer();
@@ -714,6 +930,9 @@ void b2World_Step(b2WorldId worldId, float timeStep, int subStepCount)
 		world->profile.pairs = b2GetMilliseconds(&timer);
 	}
 
+	// The new contacts may need more room
+	b2ReserveStepStack(world);
+
 	b2StepContext context = {0};
 	context.world = world;
 	context.dt = timeStep;
@@ -760,6 +979,11 @@ void b2World_Step(b2WorldId worldId, float timeStep, int subStepCount)
 		world->profile.solve = b2GetMilliseconds(&timer);
 	}
 
+	if (world->enableQuerySnapshot)
+	{
+		b2UpdateQuerySnapshot(world);
+	}
+
 	world->locked = false;
 
 	world->profile.step = b2GetMilliseconds(&stepTimer);
@@ -773,15 +997,17 @@ void b2World_Step(b2WorldId worldId, float timeStep, int subStepCount)
 	B2_ASSERT(world->activeTaskCount == 0);
 
 	b2TracyCZoneEnd(world_step);
+
+	b2LeaveTraceScope(traceScope);
 }
 
-static void b2DrawShape(b2DebugDraw* draw, b2Shape* shape, b2Transform xf, b2HexColor color)
+static void b2DrawShape(b2World* world, b2DebugDraw* draw, b2Shape* shape, b2Transform xf, b2HexColor color)
 {
 	switch (shape->type)
 	{
 		case b2_capsuleShape:
 		{
-			b2Capsule* capsule = &shape->capsule;
+			const b2Capsule* capsule = b2GetShapeCapsule(world, shape);
 			b2Vec2 p1 = b2TransformPoint(xf, capsule->center1);
 			b2Vec2 p2 = b2TransformPoint(xf, capsule->center2);
 			draw->DrawSolidCapsule(p1, p2, capsule->radius, color, draw->context);
@@ -790,7 +1016,7 @@ static void b2DrawShape(b2DebugDraw* draw, b2Shape* shape, b2Transform xf, b2Hex
 
 		case b2_circleShape:
 		{
-			b2Circle* circle = &shape->circle;
+			const b2Circle* circle = b2GetShapeCircle(world, shape);
 			xf.p = b2TransformPoint(xf, circle->center);
 			draw->DrawSolidCircle(xf, circle->radius, color, draw->context);
 		}
@@ -798,14 +1024,14 @@ static void b2DrawShape(b2DebugDraw* draw, b2Shape* shape, b2Transform xf, b2Hex
 
 		case b2_polygonShape:
 		{
-			b2Polygon* poly = &shape->polygon;
+			const b2Polygon* poly = b2GetShapePolygon(world, shape);
 			draw->DrawSolidPolygon(xf, poly->vertices, poly->count, poly->radius, color, draw->context);
 		}
 		break;
 
 		case b2_segmentShape:
 		{
-			b2Segment* segment = &shape->segment;
+			const b2Segment* segment = b2GetShapeSegment(world, shape);
 			b2Vec2 p1 = b2TransformPoint(xf, segment->point1);
 			b2Vec2 p2 = b2TransformPoint(xf, segment->point2);
 			draw->DrawSegment(p1, p2, color, draw->context);
@@ -814,7 +1040,7 @@ static void b2DrawShape(b2DebugDraw* draw, b2Shape* shape, b2Transform xf, b2Hex
 
 		case b2_smoothSegmentShape:
 		{
-			b2Segment* segment = &shape->smoothSegment.segment;
+			const b2Segment* segment = &b2GetShapeSmoothSegment(world, shape)->segment;
 			b2Vec2 p1 = b2TransformPoint(xf, segment->point1);
 			b2Vec2 p2 = b2TransformPoint(xf, segment->point2);
 			draw->DrawSegment(p1, p2, color, draw->context);
@@ -893,7 +1119,7 @@ static bool DrawQueryCallback(int proxyId, int shapeId, void* context)
 			color = b2_colorGray;
 		}
 
-		b2DrawShape(draw, shape, bodySim->transform, color);
+		b2DrawShape(world, draw, shape, bodySim->transform, color);
 	}
 
 	if (draw->drawAABBs)
@@ -1174,7 +1400,7 @@ void b2World_Draw(b2WorldId worldId, b2DebugDraw* draw)
 						color = b2_colorGray;
 					}
 
-					b2DrawShape(draw, shape, xf, color);
+					b2DrawShape(world, draw, shape, xf, color);
 					shapeId = shape->nextShapeId;
 				}
 			}
@@ -1590,6 +1816,57 @@ void b2World_EnableWarmStarting(b2WorldId worldId, bool flag)
 	world->enableWarmStarting = flag;
 }
 
+void b2World_SetWorkerCount(b2WorldId worldId, int workerCount)
+{
+	b2World* world = b2GetWorldFromId(worldId);
+	B2_ASSERT(world->locked == false);
+	if (world->locked)
+	{
+		return;
+	}
+
+	B2_ASSERT(workerCount > 0);
+
+	// The built-in task system is serial and only supports one worker
+	if (world->enqueueTaskFcn == b2DefaultAddTaskFcn)
+	{
+		return;
+	}
+
+	workerCount = b2MaxInt(workerCount, 1);
+	b2CreateTaskContexts(world, workerCount);
+	world->workerCount = workerCount;
+}
+
+int b2World_GetWorkerCount(b2WorldId worldId)
+{
+	b2World* world = b2GetWorldFromId(worldId);
+	return world->workerCount;
+}
+
+void b2World_EnableWorkerAffinity(b2WorldId worldId, bool flag)
+{
+	b2World* world = b2GetWorldFromId(worldId);
+	B2_ASSERT(world->locked == false);
+	if (world->locked)
+	{
+		return;
+	}
+
+	world->enableWorkerAffinity = flag;
+}
+
+int b2World_GetWorkerStealCount(b2WorldId worldId, int workerIndex)
+{
+	b2World* world = b2GetWorldFromId(worldId);
+	if (workerIndex < 0 || b2Array(world->taskContextArray).count <= workerIndex)
+	{
+		return 0;
+	}
+
+	return world->taskContextArray[workerIndex].stealCount;
+}
+
 void b2World_EnableContinuous(b2WorldId worldId, bool flag)
 {
 	b2World* world = b2GetWorldFromId(worldId);
@@ -1663,7 +1940,8 @@ b2Counters b2World_GetCounters(b2WorldId worldId)
 	s.treeHeight = b2DynamicTree_GetHeight(tree);
 
 	s.stackUsed = b2GetMaxStackAllocation(&world->stackAllocator);
-	s.byteCount = b2GetByteCount();
+	s.stackHeapAllocationCount = b2GetStackHeapAllocationCount(&world->stackAllocator);
+	s.byteCount = atomic_load(&world->allocator.byteCount);
 	s.taskCount = world->taskCount;
 
 	for (int i = 0; i < b2_graphColorCount; ++i)
@@ -1673,55 +1951,145 @@ b2Counters b2World_GetCounters(b2WorldId worldId)
 	return s;
 }
 
-void b2World_DumpMemoryStats(b2WorldId worldId)
+void b2World_EnableTrace(b2WorldId worldId, bool flag)
 {
-	FILE* file = fopen("box2d_memory.txt", "w");
-	if (file == NULL)
+	b2World* world = b2GetWorldFromId(worldId);
+	B2_ASSERT(world->locked == false);
+	if (world->locked || world->enableTrace == flag)
 	{
 		return;
 	}
 
+	if (world->traceRetained == false)
+	{
+		b2RetainTrace();
+		world->traceRetained = true;
+	}
+
+	world->enableTrace = flag;
+	b2EnableTrace(flag);
+}
+
+bool b2World_WriteTrace(b2WorldId worldId, const char* path)
+{
+	b2World* world = b2GetWorldFromId(worldId);
+	B2_ASSERT(world->locked == false);
+	if (world->locked)
+	{
+		return false;
+	}
+
+	return b2WriteTrace(world->worldId, path);
+}
+
+void b2World_TrimMemory(b2WorldId worldId)
+{
+	b2World* world = b2GetWorldFromId(worldId);
+	B2_ASSERT(world->locked == false);
+	if (world->locked)
+	{
+		return;
+	}
+
+	// Contact and island ids are internal so they are renumbered to shrink the sparse arrays. Body, shape, and
+	// joint ids are held by the user and keep their revisions, so those arrays are left alone.
+	b2CompactContactIds(world);
+	b2CompactIslandIds(world);
+
+	// Bit sets keep the size of their largest use, so after a peak they would keep the memory and the clear cost
+	int contactCapacity = b2GetIdCapacity(&world->contactIdPool);
+	int taskContextCount = b2Array(world->taskContextArray).count;
+	for (int i = 0; i < taskContextCount; ++i)
+	{
+		b2TaskContext* context = world->taskContextArray + i;
+		b2TrimBitSet(&context->awakeIslandBitSet, world->solverSetArray[b2_awakeSet].islands.count);
+		b2TrimBitSet(&context->splitIslandBitSet, world->solverSetArray[b2_awakeSet].islands.count);
+	}
+
+	b2TrimBitSet(&world->debugBodySet, b2GetIdCapacity(&world->bodyIdPool));
+	b2TrimBitSet(&world->debugJointSet, b2GetIdCapacity(&world->jointIdPool));
+	b2TrimBitSet(&world->debugContactSet, contactCapacity);
+
+	b2TrimBlockAllocator(&world->blockAllocator);
+}
+
+int64_t b2GetWorldByteCount(b2World* world)
+{
+	return atomic_load(&world->allocator.byteCount);
+}
+
+bool b2IsOverMemoryBudget(b2World* world)
+{
+	if (world->memoryBudget == 0)
+	{
+		return false;
+	}
+
+	return b2GetWorldByteCount(world) >= world->memoryBudget;
+}
+
+bool b2IsOverContactBudget(b2World* world)
+{
+	if (world->memoryBudget == 0 || world->memoryBudgetPolicy != b2_failCreateAndContactsOverBudget)
+	{
+		return false;
+	}
+
+	return b2GetWorldByteCount(world) >= world->memoryBudget;
+}
+
+static void b2AddSolverSetMemory(b2SolverSetMemory* memory, const b2SolverSet* set)
+{
+	memory->bodySimBytes += set->sims.capacity * (int)sizeof(b2BodySim);
+	memory->bodyStateBytes += set->states.capacity * (int)sizeof(b2BodyState);
+	memory->jointSimBytes += set->joints.capacity * (int)sizeof(b2JointSim);
+	memory->contactSimBytes += set->contacts.capacity * (int)sizeof(b2ContactSim);
+	memory->nonTouchingContactBytes += set->nonTouchingContacts.capacity * (int)sizeof(b2NonTouchingContactSim);
+	memory->islandSimBytes += set->islands.capacity * (int)sizeof(b2IslandSim);
+}
+
+b2MemoryStats b2World_GetMemoryStats(b2WorldId worldId)
+{
+	_Static_assert(b2_graphColorCount == sizeof(((b2MemoryStats*)0)->colorBytes) / sizeof(int32_t), "color count mismatch");
+
 	b2World* world = b2GetWorldFromId(worldId);
+	b2MemoryStats s = {0};
 
 	// id pools
-	fprintf(file, "id pools\n");
-	fprintf(file, "body ids: %d\n", b2GetIdBytes(&world->bodyIdPool));
-	fprintf(file, "solver set ids: %d\n", b2GetIdBytes(&world->solverSetIdPool));
-	fprintf(file, "joint ids: %d\n", b2GetIdBytes(&world->jointIdPool));
-	fprintf(file, "contact ids: %d\n", b2GetIdBytes(&world->contactIdPool));
-	fprintf(file, "island ids: %d\n", b2GetIdBytes(&world->islandIdPool));
-	fprintf(file, "shape ids: %d\n", b2GetIdBytes(&world->shapeIdPool));
-	fprintf(file, "chain ids: %d\n", b2GetIdBytes(&world->chainIdPool));
-	fprintf(file, "\n");
+	s.bodyIdBytes = b2GetIdBytes(&world->bodyIdPool);
+	s.solverSetIdBytes = b2GetIdBytes(&world->solverSetIdPool);
+	s.jointIdBytes = b2GetIdBytes(&world->jointIdPool);
+	s.contactIdBytes = b2GetIdBytes(&world->contactIdPool);
+	s.islandIdBytes = b2GetIdBytes(&world->islandIdPool);
+	s.shapeIdBytes = b2GetIdBytes(&world->shapeIdPool);
+	s.chainIdBytes = b2GetIdBytes(&world->chainIdPool);
 
 	// world arrays
-	fprintf(file, "world arrays\n");
-	fprintf(file, "bodies: %d\n", b2GetArrayBytes(world->bodyArray, sizeof(b2Body)));
-	fprintf(file, "solver sets: %d\n", b2GetArrayBytes(world->solverSetArray, sizeof(b2SolverSet)));
-	fprintf(file, "joints: %d\n", b2GetArrayBytes(world->jointArray, sizeof(b2Joint)));
-	fprintf(file, "contacts: %d\n", b2GetArrayBytes(world->contactArray, sizeof(b2Contact)));
-	fprintf(file, "islands: %d\n", b2GetArrayBytes(world->islandArray, sizeof(b2Island)));
-	fprintf(file, "shapes: %d\n", b2GetArrayBytes(world->shapeArray, sizeof(b2Shape)));
-	fprintf(file, "chains: %d\n", b2GetArrayBytes(world->chainArray, sizeof(b2ChainShape)));
-	fprintf(file, "\n");
+	s.bodyArrayBytes = b2GetArrayBytes(world->bodyArray, sizeof(b2Body));
+	s.solverSetArrayBytes = b2GetArrayBytes(world->solverSetArray, sizeof(b2SolverSet));
+	s.jointArrayBytes = b2GetArrayBytes(world->jointArray, sizeof(b2Joint));
+	s.contactArrayBytes = b2GetArrayBytes(world->contactArray, sizeof(b2Contact));
+	s.islandArrayBytes = b2GetArrayBytes(world->islandArray, sizeof(b2Island));
+	s.shapeArrayBytes = b2GetArrayBytes(world->shapeArray, sizeof(b2Shape));
+	s.chainArrayBytes = b2GetArrayBytes(world->chainArray, sizeof(b2ChainShape));
 
-	// broad-phase
-	fprintf(file, "broad-phase\n");
-	fprintf(file, "static tree: %d\n", b2DynamicTree_GetByteCount(world->broadPhase.trees + b2_staticProxy));
-	fprintf(file, "movable tree: %d\n", b2DynamicTree_GetByteCount(world->broadPhase.trees + b2_movableProxy));
-	b2HashSet* moveSet = &world->broadPhase.moveSet;
-	fprintf(file, "moveSet: %d (%d, %d)\n", b2GetHashSetBytes(moveSet), moveSet->count, moveSet->capacity);
-	fprintf(file, "moveArray: %d\n", b2GetArrayBytes(world->broadPhase.moveArray, sizeof(int)));
-	b2HashSet* pairSet = &world->broadPhase.pairSet;
-	fprintf(file, "pairSet: %d (%d, %d)\n", b2GetHashSetBytes(pairSet), pairSet->count, pairSet->capacity);
-	fprintf(file, "\n");
+	int chainCapacity = b2Array(world->chainArray).count;
+	for (int i = 0; i < chainCapacity; ++i)
+	{
+		b2ChainShape* chain = world->chainArray + i;
+		if (chain->id != B2_NULL_INDEX)
+		{
+			s.chainArrayBytes += chain->count * (int)sizeof(int);
+		}
+	}
+
+	for (int i = 0; i < b2_shapeTypeCount; ++i)
+	{
+		b2GeometryPool* pool = world->geometryPools + i;
+		s.geometryBytes[i] = b2GetArrayBytes(pool->data, pool->elementSize) + b2GetIdBytes(&pool->idPool);
+	}
 
 	// solver sets
-	int bodySimCapacity = 0;
-	int bodyStateCapacity = 0;
-	int jointSimCapacity = 0;
-	int contactSimCapacity = 0;
-	int islandSimCapacity = 0;
 	int solverSetCapacity = b2Array(world->solverSetArray).count;
 	for (int i = 0; i < solverSetCapacity; ++i)
 	{
@@ -1731,51 +2099,247 @@ void b2World_DumpMemoryStats(b2WorldId worldId)
 			continue;
 		}
 
-		bodySimCapacity += set->sims.capacity;
-		bodyStateCapacity += set->states.capacity;
-		jointSimCapacity += set->joints.capacity;
-		contactSimCapacity += set->contacts.capacity;
-		islandSimCapacity += set->islands.capacity;
+		if (i == b2_staticSet)
+		{
+			b2AddSolverSetMemory(&s.staticSet, set);
+		}
+		else if (i == b2_disabledSet)
+		{
+			b2AddSolverSetMemory(&s.disabledSet, set);
+		}
+		else if (i == b2_awakeSet)
+		{
+			b2AddSolverSetMemory(&s.awakeSet, set);
+		}
+		else
+		{
+			b2AddSolverSetMemory(&s.sleepingSets, set);
+			s.sleepingSetCount += 1;
+		}
 	}
 
-	fprintf(file, "solver sets\n");
-	fprintf(file, "body sim: %d\n", bodySimCapacity * (int)sizeof(b2BodySim));
-	fprintf(file, "body state: %d\n", bodyStateCapacity * (int)sizeof(b2BodyState));
-	fprintf(file, "joint sim: %d\n", jointSimCapacity * (int)sizeof(b2JointSim));
-	fprintf(file, "contact sim: %d\n", contactSimCapacity * (int)sizeof(b2ContactSim));
-	fprintf(file, "island sim: %d\n", islandSimCapacity * (int)sizeof(islandSimCapacity));
-	fprintf(file, "\n");
-
 	// constraint graph
-	int bodyBitSetBytes = 0;
-	contactSimCapacity = 0;
-	jointSimCapacity = 0;
 	for (int i = 0; i < b2_graphColorCount; ++i)
 	{
 		b2GraphColor* c = world->constraintGraph.colors + i;
-		bodyBitSetBytes += b2GetBitSetBytes(&c->bodySet);
-		contactSimCapacity += c->contacts.capacity;
-		jointSimCapacity += c->joints.capacity;
+		s.colorBytes[i] = b2GetBitSetBytes(&c->bodySet) + c->contacts.capacity * (int)sizeof(b2ContactSim) +
+						  c->joints.capacity * (int)sizeof(b2JointSim);
 	}
 
+	// broad-phase
+	s.staticTreeBytes = b2DynamicTree_GetByteCount(world->broadPhase.trees + b2_staticProxy);
+	s.movableTreeBytes = b2DynamicTree_GetByteCount(world->broadPhase.trees + b2_movableProxy);
+	s.moveSetBytes = b2GetHashSetBytes(&world->broadPhase.moveSet);
+	s.moveArrayBytes = b2GetArrayBytes(world->broadPhase.moveArray, sizeof(int));
+	s.pairSetBytes = b2GetHashSetBytes(&world->broadPhase.pairSet);
+
+	if (world->enableQuerySnapshot)
+	{
+		for (int i = 0; i < 2; ++i)
+		{
+			b2QuerySnapshot* snapshot = world->querySnapshots + i;
+			for (int j = 0; j < b2_proxyTypeCount; ++j)
+			{
+				s.querySnapshotBytes += b2DynamicTree_GetByteCount(snapshot->trees + j);
+			}
+			s.querySnapshotBytes += snapshot->shapeCapacity * (int)sizeof(b2SnapshotShape);
+		}
+
+		s.querySnapshotBytes += b2GetArrayBytes(world->snapshotMovedBodyArray, sizeof(int));
+		s.querySnapshotBytes += b2GetArrayBytes(world->snapshotRefreshedBodyArray, sizeof(int));
+	}
+
+	// stack allocator
+	s.stackCapacity = world->stackAllocator.capacity;
+	s.stackHighWater = b2GetMaxStackAllocation(&world->stackAllocator);
+
+	// block allocator
+	b2BlockAllocatorStats blockStats = b2GetBlockAllocatorStats(&world->blockAllocator);
+	s.blockSlabBytes = blockStats.slabBytes;
+	s.blockBytes = blockStats.blockBytes;
+	s.blockRequestedBytes = blockStats.requestedBytes;
+	s.blockLargeBytes = blockStats.largeBytes;
+
+	// workers
+	s.workerCount = b2Array(world->taskContextArray).count;
+	for (int i = 0; i < s.workerCount; ++i)
+	{
+		b2TaskContext* context = world->taskContextArray + i;
+		s.workerBitSetBytes += b2GetBitSetBytes(&context->awakeIslandBitSet);
+		s.workerBitSetBytes += b2GetBitSetBytes(&context->splitIslandBitSet);
+		s.workerArenaBytes += b2GetArenaCapacity(&context->arena);
+	}
+
+	s.totalBytes = b2GetWorldByteCount(world);
+	s.failedCreateCount = world->failedCreateCount;
+	s.refusedContactCount = world->refusedContactCount;
+
+	return s;
+}
+
+static void b2DumpSolverSetMemory(FILE* file, const char* name, const b2SolverSetMemory* memory)
+{
+	fprintf(file, "%s\n", name);
+	fprintf(file, "body sim: %d\n", memory->bodySimBytes);
+	fprintf(file, "body state: %d\n", memory->bodyStateBytes);
+	fprintf(file, "joint sim: %d\n", memory->jointSimBytes);
+	fprintf(file, "contact sim: %d\n", memory->contactSimBytes);
+	fprintf(file, "non-touching contact sim: %d\n", memory->nonTouchingContactBytes);
+	fprintf(file, "island sim: %d\n", memory->islandSimBytes);
+	fprintf(file, "\n");
+}
+
+void b2World_DumpMemoryStats(b2WorldId worldId)
+{
+	FILE* file = fopen("box2d_memory.txt", "w");
+	if (file == NULL)
+	{
+		return;
+	}
+
+	b2World* world = b2GetWorldFromId(worldId);
+	b2MemoryStats s = b2World_GetMemoryStats(worldId);
+
+	// id pools
+	fprintf(file, "id pools\n");
+	fprintf(file, "body ids: %d\n", s.bodyIdBytes);
+	fprintf(file, "solver set ids: %d\n", s.solverSetIdBytes);
+	fprintf(file, "joint ids: %d\n", s.jointIdBytes);
+	fprintf(file, "contact ids: %d\n", s.contactIdBytes);
+	fprintf(file, "island ids: %d\n", s.islandIdBytes);
+	fprintf(file, "shape ids: %d\n", s.shapeIdBytes);
+	fprintf(file, "chain ids: %d\n", s.chainIdBytes);
+	fprintf(file, "\n");
+
+	// world arrays
+	fprintf(file, "world arrays\n");
+	fprintf(file, "bodies: %d\n", s.bodyArrayBytes);
+	fprintf(file, "solver sets: %d\n", s.solverSetArrayBytes);
+	fprintf(file, "joints: %d\n", s.jointArrayBytes);
+	fprintf(file, "contacts: %d\n", s.contactArrayBytes);
+	fprintf(file, "islands: %d\n", s.islandArrayBytes);
+	fprintf(file, "shapes: %d\n", s.shapeArrayBytes);
+	fprintf(file, "chains: %d\n", s.chainArrayBytes);
+	fprintf(file, "\n");
+
+	// shape geometry
+	fprintf(file, "geometry\n");
+	fprintf(file, "circles: %d\n", s.geometryBytes[b2_circleShape]);
+	fprintf(file, "capsules: %d\n", s.geometryBytes[b2_capsuleShape]);
+	fprintf(file, "segments: %d\n", s.geometryBytes[b2_segmentShape]);
+	fprintf(file, "polygons: %d\n", s.geometryBytes[b2_polygonShape]);
+	fprintf(file, "smooth segments: %d\n", s.geometryBytes[b2_smoothSegmentShape]);
+	fprintf(file, "\n");
+
+	// broad-phase
+	b2HashSet* moveSet = &world->broadPhase.moveSet;
+	b2HashSet* pairSet = &world->broadPhase.pairSet;
+	fprintf(file, "broad-phase\n");
+	fprintf(file, "static tree: %d\n", s.staticTreeBytes);
+	fprintf(file, "movable tree: %d\n", s.movableTreeBytes);
+	fprintf(file, "moveSet: %d (%d, %d)\n", s.moveSetBytes, moveSet->count, moveSet->capacity);
+	fprintf(file, "moveArray: %d\n", s.moveArrayBytes);
+	fprintf(file, "pairSet: %d (%d, %d)\n", s.pairSetBytes, pairSet->count, pairSet->capacity);
+	fprintf(file, "query snapshots: %d\n", s.querySnapshotBytes);
+	fprintf(file, "\n");
+
+	// solver sets
+	b2DumpSolverSetMemory(file, "static set", &s.staticSet);
+	b2DumpSolverSetMemory(file, "disabled set", &s.disabledSet);
+	b2DumpSolverSetMemory(file, "awake set", &s.awakeSet);
+	fprintf(file, "sleeping sets: %d\n", s.sleepingSetCount);
+	b2DumpSolverSetMemory(file, "sleeping sets", &s.sleepingSets);
+
+	// constraint graph
 	fprintf(file, "constraint graph\n");
-	fprintf(file, "body bit sets: %d\n", bodyBitSetBytes);
-	fprintf(file, "joint sim: %d\n", jointSimCapacity * (int)sizeof(b2JointSim));
-	fprintf(file, "contact sim: %d\n", contactSimCapacity * (int)sizeof(b2ContactSim));
+	for (int i = 0; i < b2_graphColorCount; ++i)
+	{
+		fprintf(file, "color %d: %d\n", i, s.colorBytes[i]);
+	}
 	fprintf(file, "\n");
 
 	// stack allocator
-	fprintf(file, "stack allocator: %d\n\n", world->stackAllocator.capacity);
+	fprintf(file, "stack allocator: %d (high water %d)\n\n", s.stackCapacity, s.stackHighWater);
+
+	// block allocator
+	fprintf(file, "block allocator\n");
+	fprintf(file, "slabs: %d\n", s.blockSlabBytes);
+	fprintf(file, "blocks: %d\n", s.blockBytes);
+	fprintf(file, "requested: %d\n", s.blockRequestedBytes);
+	fprintf(file, "free blocks: %d\n", s.blockSlabBytes - s.blockBytes);
+	fprintf(file, "rounding waste: %d\n", s.blockBytes - s.blockRequestedBytes);
+	fprintf(file, "large: %d\n", s.blockLargeBytes);
+	fprintf(file, "\n");
 
-	// chain shapes
-	// todo
+	// workers
+	fprintf(file, "workers: %d\n", s.workerCount);
+	fprintf(file, "bit sets: %d\n", s.workerBitSetBytes);
+	fprintf(file, "arenas: %d\n", s.workerArenaBytes);
+	fprintf(file, "\n");
+
+	fprintf(file, "total: %lld (budget %lld)\n", (long long)s.totalBytes, (long long)world->memoryBudget);
+	fprintf(file, "failed creates: %d\n", s.failedCreateCount);
+	fprintf(file, "refused contacts: %d\n", s.refusedContactCount);
 
 	fclose(file);
 }
 
+// Queries read the snapshot if the world has one. Otherwise they read the live broad-phase and cannot run during the step.
+static b2DynamicTree* b2BeginQuery(b2World* world, b2QuerySnapshot** snapshot)
+{
+	*snapshot = b2AcquireQuerySnapshot(world);
+	if (*snapshot != NULL)
+	{
+		return (*snapshot)->trees;
+	}
+
+	B2_ASSERT(world->locked == false);
+	if (world->locked)
+	{
+		b2ReleaseQuerySnapshot(world, NULL);
+		return NULL;
+	}
+
+	return world->broadPhase.trees;
+}
+
+// Get a shape found by a query and optionally its transform. Returns NULL if the shape was destroyed after the snapshot.
+static b2Shape* b2GetQueryShape(b2World* world, b2QuerySnapshot* snapshot, int shapeId, b2Transform* transform)
+{
+	if (snapshot != NULL)
+	{
+		B2_ASSERT(0 <= shapeId && shapeId < b2Array(world->shapeArray).count);
+		b2Shape* shape = world->shapeArray + shapeId;
+		b2SnapshotShape* snapshotShape = snapshot->shapes + shapeId;
+		if (shape->id == B2_NULL_INDEX || shape->revision != snapshotShape->revision)
+		{
+			return NULL;
+		}
+
+		if (transform != NULL)
+		{
+			*transform = snapshotShape->transform;
+		}
+
+		return shape;
+	}
+
+	b2CheckId(world->shapeArray, shapeId);
+	b2Shape* shape = world->shapeArray + shapeId;
+
+	if (transform != NULL)
+	{
+		b2Body* body = b2GetBody(world, shape->bodyId);
+		*transform = b2GetBodyTransformQuick(world, body);
+	}
+
+	return shape;
+}
+
 typedef struct WorldQueryContext
 {
 	b2World* world;
+	b2QuerySnapshot* snapshot;
 	b2OverlapResultFcn* fcn;
 	b2QueryFilter filter;
 	void* userContext;
@@ -1788,8 +2352,11 @@ static bool TreeQueryCallback(int proxyId, int shapeId, void* context)
 	WorldQueryContext* worldContext = context;
 	b2World* world = worldContext->world;
 
-	b2CheckId(world->shapeArray, shapeId);
-	b2Shape* shape = world->shapeArray + shapeId;
+	b2Shape* shape = b2GetQueryShape(world, worldContext->snapshot, shapeId, NULL);
+	if (shape == NULL)
+	{
+		return true;
+	}
 
 	b2Filter shapeFilter = shape->filter;
 	b2QueryFilter queryFilter = worldContext->filter;
@@ -1807,25 +2374,29 @@ static bool TreeQueryCallback(int proxyId, int shapeId, void* context)
 void b2World_OverlapAABB(b2WorldId worldId, b2AABB aabb, b2QueryFilter filter, b2OverlapResultFcn* fcn, void* context)
 {
 	b2World* world = b2GetWorldFromId(worldId);
-	B2_ASSERT(world->locked == false);
-	if (world->locked)
+	b2QuerySnapshot* snapshot;
+	b2DynamicTree* trees = b2BeginQuery(world, &snapshot);
+	if (trees == NULL)
 	{
 		return;
 	}
 
 	B2_ASSERT(b2AABB_IsValid(aabb));
 
-	WorldQueryContext worldContext = {world, fcn, filter, context};
+	WorldQueryContext worldContext = {world, snapshot, fcn, filter, context};
 
 	for (int i = 0; i < b2_proxyTypeCount; ++i)
 	{
-		b2DynamicTree_Query(world->broadPhase.trees + i, aabb, TreeQueryCallback, &worldContext);
+		b2DynamicTree_Query(trees + i, aabb, TreeQueryCallback, &worldContext);
 	}
+
+	b2ReleaseQuerySnapshot(world, snapshot);
 }
 
 typedef struct WorldOverlapContext
 {
 	b2World* world;
+	b2QuerySnapshot* snapshot;
 	b2OverlapResultFcn* fcn;
 	b2QueryFilter filter;
 	b2DistanceProxy proxy;
@@ -1840,8 +2411,12 @@ static bool TreeOverlapCallback(int proxyId, int shapeId, void* context)
 	WorldOverlapContext* worldContext = context;
 	b2World* world = worldContext->world;
 
-	b2CheckId(world->shapeArray, shapeId);
-	b2Shape* shape = world->shapeArray + shapeId;
+	b2Transform transform;
+	b2Shape* shape = b2GetQueryShape(world, worldContext->snapshot, shapeId, &transform);
+	if (shape == NULL)
+	{
+		return true;
+	}
 
 	b2Filter shapeFilter = shape->filter;
 	b2QueryFilter queryFilter = worldContext->filter;
@@ -1851,12 +2426,9 @@ static bool TreeOverlapCallback(int proxyId, int shapeId, void* context)
 		return true;
 	}
 
-	b2Body* body = b2GetBody(world, shape->bodyId);
-	b2Transform transform = b2GetBodyTransformQuick(world, body);
-
 	b2DistanceInput input;
 	input.proxyA = worldContext->proxy;
-	input.proxyB = b2MakeShapeDistanceProxy(shape);
+	input.proxyB = b2MakeShapeDistanceProxy(world, shape);
 	input.transformA = worldContext->transform;
 	input.transformB = transform;
 	input.useRadii = true;
@@ -1878,8 +2450,9 @@ void b2World_OverlapCircle(b2WorldId worldId, const b2Circle* circle, b2Transfor
 						   b2OverlapResultFcn* fcn, void* context)
 {
 	b2World* world = b2GetWorldFromId(worldId);
-	B2_ASSERT(world->locked == false);
-	if (world->locked)
+	b2QuerySnapshot* snapshot;
+	b2DynamicTree* trees = b2BeginQuery(world, &snapshot);
+	if (trees == NULL)
 	{
 		return;
 	}
@@ -1889,21 +2462,24 @@ void b2World_OverlapCircle(b2WorldId worldId, const b2Circle* circle, b2Transfor
 
 	b2AABB aabb = b2ComputeCircleAABB(circle, transform);
 	WorldOverlapContext worldContext = {
-		world, fcn, filter, b2MakeProxy(&circle->center, 1, circle->radius), transform, context,
+		world, snapshot, fcn, filter, b2MakeProxy(&circle->center, 1, circle->radius), transform, context,
 	};
 
 	for (int i = 0; i < b2_proxyTypeCount; ++i)
 	{
-		b2DynamicTree_Query(world->broadPhase.trees + i, aabb, TreeOverlapCallback, &worldContext);
+		b2DynamicTree_Query(trees + i, aabb, TreeOverlapCallback, &worldContext);
 	}
+
+	b2ReleaseQuerySnapshot(world, snapshot);
 }
 
 void b2World_OverlapCapsule(b2WorldId worldId, const b2Capsule* capsule, b2Transform transform, b2QueryFilter filter,
 							b2OverlapResultFcn* fcn, void* context)
 {
 	b2World* world = b2GetWorldFromId(worldId);
-	B2_ASSERT(world->locked == false);
-	if (world->locked)
+	b2QuerySnapshot* snapshot;
+	b2DynamicTree* trees = b2BeginQuery(world, &snapshot);
+	if (trees == NULL)
 	{
 		return;
 	}
@@ -1913,21 +2489,24 @@ void b2World_OverlapCapsule(b2WorldId worldId, const b2Capsule* capsule, b2Trans
 
 	b2AABB aabb = b2ComputeCapsuleAABB(capsule, transform);
 	WorldOverlapContext worldContext = {
-		world, fcn, filter, b2MakeProxy(&capsule->center1, 2, capsule->radius), transform, context,
+		world, snapshot, fcn, filter, b2MakeProxy(&capsule->center1, 2, capsule->radius), transform, context,
 	};
 
 	for (int i = 0; i < b2_proxyTypeCount; ++i)
 	{
-		b2DynamicTree_Query(world->broadPhase.trees + i, aabb, TreeOverlapCallback, &worldContext);
+		b2DynamicTree_Query(trees + i, aabb, TreeOverlapCallback, &worldContext);
 	}
+
+	b2ReleaseQuerySnapshot(world, snapshot);
 }
 
 void b2World_OverlapPolygon(b2WorldId worldId, const b2Polygon* polygon, b2Transform transform, b2QueryFilter filter,
 							b2OverlapResultFcn* fcn, void* context)
 {
 	b2World* world = b2GetWorldFromId(worldId);
-	B2_ASSERT(world->locked == false);
-	if (world->locked)
+	b2QuerySnapshot* snapshot;
+	b2DynamicTree* trees = b2BeginQuery(world, &snapshot);
+	if (trees == NULL)
 	{
 		return;
 	}
@@ -1937,18 +2516,21 @@ void b2World_OverlapPolygon(b2WorldId worldId, const b2Polygon* polygon, b2Trans
 
 	b2AABB aabb = b2ComputePolygonAABB(polygon, transform);
 	WorldOverlapContext worldContext = {
-		world, fcn, filter, b2MakeProxy(polygon->vertices, polygon->count, polygon->radius), transform, context,
+		world, snapshot, fcn, filter, b2MakeProxy(polygon->vertices, polygon->count, polygon->radius), transform, context,
 	};
 
 	for (int i = 0; i < b2_proxyTypeCount; ++i)
 	{
-		b2DynamicTree_Query(world->broadPhase.trees + i, aabb, TreeOverlapCallback, &worldContext);
+		b2DynamicTree_Query(trees + i, aabb, TreeOverlapCallback, &worldContext);
 	}
+
+	b2ReleaseQuerySnapshot(world, snapshot);
 }
 
 typedef struct WorldRayCastContext
 {
 	b2World* world;
+	b2QuerySnapshot* snapshot;
 	b2CastResultFcn* fcn;
 	b2QueryFilter filter;
 	float fraction;
@@ -1962,8 +2544,13 @@ static float RayCastCallback(const b2RayCastInput* input, int proxyId, int shape
 	WorldRayCastContext* worldContext = context;
 	b2World* world = worldContext->world;
 
-	b2CheckId(world->shapeArray, shapeId);
-	b2Shape* shape = world->shapeArray + shapeId;
+	b2Transform transform;
+	b2Shape* shape = b2GetQueryShape(world, worldContext->snapshot, shapeId, &transform);
+	if (shape == NULL)
+	{
+		return input->maxFraction;
+	}
+
 	b2Filter shapeFilter = shape->filter;
 	b2QueryFilter queryFilter = worldContext->filter;
 
@@ -1972,9 +2559,7 @@ static float RayCastCallback(const b2RayCastInput* input, int proxyId, int shape
 		return input->maxFraction;
 	}
 
-	b2Body* body = b2GetBody(world, shape->bodyId);
-	b2Transform transform = b2GetBodyTransformQuick(world, body);
-	b2CastOutput output = b2RayCastShape(input, shape, transform);
+	b2CastOutput output = b2RayCastShape(world, input, shape, transform);
 
 	if (output.hit)
 	{
@@ -1991,8 +2576,9 @@ void b2World_CastRay(b2WorldId worldId, b2Vec2 origin, b2Vec2 translation, b2Que
 					 void* context)
 {
 	b2World* world = b2GetWorldFromId(worldId);
-	B2_ASSERT(world->locked == false);
-	if (world->locked)
+	b2QuerySnapshot* snapshot;
+	b2DynamicTree* trees = b2BeginQuery(world, &snapshot);
+	if (trees == NULL)
 	{
 		return;
 	}
@@ -2002,19 +2588,21 @@ void b2World_CastRay(b2WorldId worldId, b2Vec2 origin, b2Vec2 translation, b2Que
 
 	b2RayCastInput input = {origin, translation, 1.0f};
 
-	WorldRayCastContext worldContext = {world, fcn, filter, 1.0f, context};
+	WorldRayCastContext worldContext = {world, snapshot, fcn, filter, 1.0f, context};
 
 	for (int i = 0; i < b2_proxyTypeCount; ++i)
 	{
-		b2DynamicTree_RayCast(world->broadPhase.trees + i, &input, filter.maskBits, RayCastCallback, &worldContext);
+		b2DynamicTree_RayCast(trees + i, &input, filter.maskBits, RayCastCallback, &worldContext);
 
 		if (worldContext.fraction == 0.0f)
 		{
-			return;
+			break;
 		}
 
 		input.maxFraction = worldContext.fraction;
 	}
+
+	b2ReleaseQuerySnapshot(world, snapshot);
 }
 
 // This callback finds the closest hit. This is the most common callback used in games.
@@ -2034,8 +2622,9 @@ b2RayResult b2World_CastRayClosest(b2WorldId worldId, b2Vec2 origin, b2Vec2 tran
 	b2RayResult result = {0};
 
 	b2World* world = b2GetWorldFromId(worldId);
-	B2_ASSERT(world->locked == false);
-	if (world->locked)
+	b2QuerySnapshot* snapshot;
+	b2DynamicTree* trees = b2BeginQuery(world, &snapshot);
+	if (trees == NULL)
 	{
 		return result;
 	}
@@ -2044,20 +2633,21 @@ b2RayResult b2World_CastRayClosest(b2WorldId worldId, b2Vec2 origin, b2Vec2 tran
 	B2_ASSERT(b2Vec2_IsValid(translation));
 
 	b2RayCastInput input = {origin, translation, 1.0f};
-	WorldRayCastContext worldContext = {world, b2RayCastClosestFcn, filter, 1.0f, &result};
+	WorldRayCastContext worldContext = {world, snapshot, b2RayCastClosestFcn, filter, 1.0f, &result};
 
 	for (int i = 0; i < b2_proxyTypeCount; ++i)
 	{
-		b2DynamicTree_RayCast(world->broadPhase.trees + i, &input, filter.maskBits, RayCastCallback, &worldContext);
+		b2DynamicTree_RayCast(trees + i, &input, filter.maskBits, RayCastCallback, &worldContext);
 
 		if (worldContext.fraction == 0.0f)
 		{
-			return result;
+			break;
 		}
 
 		input.maxFraction = worldContext.fraction;
 	}
 
+	b2ReleaseQuerySnapshot(world, snapshot);
 	return result;
 }
 
@@ -2068,8 +2658,13 @@ static float ShapeCastCallback(const b2ShapeCastInput* input, int proxyId, int s
 	WorldRayCastContext* worldContext = context;
 	b2World* world = worldContext->world;
 
-	b2CheckId(world->shapeArray, shapeId);
-	b2Shape* shape = world->shapeArray + shapeId;
+	b2Transform transform;
+	b2Shape* shape = b2GetQueryShape(world, worldContext->snapshot, shapeId, &transform);
+	if (shape == NULL)
+	{
+		return input->maxFraction;
+	}
+
 	b2Filter shapeFilter = shape->filter;
 	b2QueryFilter queryFilter = worldContext->filter;
 
@@ -2078,9 +2673,7 @@ static float ShapeCastCallback(const b2ShapeCastInput* input, int proxyId, int s
 		return input->maxFraction;
 	}
 
-	b2Body* body = b2GetBody(world, shape->bodyId);
-	b2Transform transform = b2GetBodyTransformQuick(world, body);
-	b2CastOutput output = b2ShapeCastShape(input, shape, transform);
+	b2CastOutput output = b2ShapeCastShape(world, input, shape, transform);
 
 	if (output.hit)
 	{
@@ -2097,8 +2690,9 @@ void b2World_CastCircle(b2WorldId worldId, const b2Circle* circle, b2Transform o
 						b2QueryFilter filter, b2CastResultFcn* fcn, void* context)
 {
 	b2World* world = b2GetWorldFromId(worldId);
-	B2_ASSERT(world->locked == false);
-	if (world->locked)
+	b2QuerySnapshot* snapshot;
+	b2DynamicTree* trees = b2BeginQuery(world, &snapshot);
+	if (trees == NULL)
 	{
 		return;
 	}
@@ -2114,27 +2708,30 @@ void b2World_CastCircle(b2WorldId worldId, const b2Circle* circle, b2Transform o
 	input.translation = translation;
 	input.maxFraction = 1.0f;
 
-	WorldRayCastContext worldContext = {world, fcn, filter, 1.0f, context};
+	WorldRayCastContext worldContext = {world, snapshot, fcn, filter, 1.0f, context};
 
 	for (int i = 0; i < b2_proxyTypeCount; ++i)
 	{
-		b2DynamicTree_ShapeCast(world->broadPhase.trees + i, &input, filter.maskBits, ShapeCastCallback, &worldContext);
+		b2DynamicTree_ShapeCast(trees + i, &input, filter.maskBits, ShapeCastCallback, &worldContext);
 
 		if (worldContext.fraction == 0.0f)
 		{
-			return;
+			break;
 		}
 
 		input.maxFraction = worldContext.fraction;
 	}
+
+	b2ReleaseQuerySnapshot(world, snapshot);
 }
 
 void b2World_CastCapsule(b2WorldId worldId, const b2Capsule* capsule, b2Transform originTransform, b2Vec2 translation,
 						 b2QueryFilter filter, b2CastResultFcn* fcn, void* context)
 {
 	b2World* world = b2GetWorldFromId(worldId);
-	B2_ASSERT(world->locked == false);
-	if (world->locked)
+	b2QuerySnapshot* snapshot;
+	b2DynamicTree* trees = b2BeginQuery(world, &snapshot);
+	if (trees == NULL)
 	{
 		return;
 	}
@@ -2151,27 +2748,30 @@ void b2World_CastCapsule(b2WorldId worldId, const b2Capsule* capsule, b2Transfor
 	input.translation = translation;
 	input.maxFraction = 1.0f;
 
-	WorldRayCastContext worldContext = {world, fcn, filter, 1.0f, context};
+	WorldRayCastContext worldContext = {world, snapshot, fcn, filter, 1.0f, context};
 
 	for (int i = 0; i < b2_proxyTypeCount; ++i)
 	{
-		b2DynamicTree_ShapeCast(world->broadPhase.trees + i, &input, filter.maskBits, ShapeCastCallback, &worldContext);
+		b2DynamicTree_ShapeCast(trees + i, &input, filter.maskBits, ShapeCastCallback, &worldContext);
 
 		if (worldContext.fraction == 0.0f)
 		{
-			return;
+			break;
 		}
 
 		input.maxFraction = worldContext.fraction;
 	}
+
+	b2ReleaseQuerySnapshot(world, snapshot);
 }
 
 void b2World_CastPolygon(b2WorldId worldId, const b2Polygon* polygon, b2Transform originTransform, b2Vec2 translation,
 						 b2QueryFilter filter, b2CastResultFcn* fcn, void* context)
 {
 	b2World* world = b2GetWorldFromId(worldId);
-	B2_ASSERT(world->locked == false);
-	if (world->locked)
+	b2QuerySnapshot* snapshot;
+	b2DynamicTree* trees = b2BeginQuery(world, &snapshot);
+	if (trees == NULL)
 	{
 		return;
 	}
@@ -2190,19 +2790,21 @@ void b2World_CastPolygon(b2WorldId worldId, const b2Polygon* polygon, b2Transfor
 	input.translation = translation;
 	input.maxFraction = 1.0f;
 
-	WorldRayCastContext worldContext = {world, fcn, filter, 1.0f, context};
+	WorldRayCastContext worldContext = {world, snapshot, fcn, filter, 1.0f, context};
 
 	for (int i = 0; i < b2_proxyTypeCount; ++i)
 	{
-		b2DynamicTree_ShapeCast(world->broadPhase.trees + i, &input, filter.maskBits, ShapeCastCallback, &worldContext);
+		b2DynamicTree_ShapeCast(trees + i, &input, filter.maskBits, ShapeCastCallback, &worldContext);
 
 		if (worldContext.fraction == 0.0f)
 		{
-			return;
+			break;
 		}
 
 		input.maxFraction = worldContext.fraction;
 	}
+
+	b2ReleaseQuerySnapshot(world, snapshot);
 }
 
 #if 0
@@ -2349,7 +2951,7 @@ static bool ExplosionCallback(int proxyId, int shapeId, void* context)
 	b2Transform transform = b2GetBodyTransformQuick(world, body);
 
 	b2DistanceInput input;
-	input.proxyA = b2MakeShapeDistanceProxy(shape);
+	input.proxyA = b2MakeShapeDistanceProxy(world, shape);
 	input.proxyB = b2MakeProxy(&explosionContext->position, 1, 0.0f);
 	input.transformA = transform;
 	input.transformB = b2Transform_identity;
@@ -2367,12 +2969,12 @@ static bool ExplosionCallback(int proxyId, int shapeId, void* context)
 
 	if (output.distance == 0.0f)
 	{
-		b2Vec2 localCentroid = b2GetShapeCentroid(shape);
+		b2Vec2 localCentroid = b2GetShapeCentroid(world, shape);
 		closestPoint = b2TransformPoint(transform, localCentroid);
 	}
 
 	float falloff = 0.4f;
-	float perimeter = b2GetShapePerimeter(shape);
+	float perimeter = b2GetShapePerimeter(world, shape);
 	float magnitude = explosionContext->magnitude * perimeter * (1.0f - falloff * output.distance / explosionContext->radius);
 
 	b2Vec2 direction = b2Normalize(b2Sub(closestPoint, explosionContext->position));
@@ -2550,6 +3152,7 @@ void b2ValidateSolverSets(b2World* world)
 			if (setIndex == b2_staticSet)
 			{
 				B2_ASSERT(set->contacts.count == 0);
+				B2_ASSERT(set->nonTouchingContacts.count == 0);
 				B2_ASSERT(set->islands.count == 0);
 				B2_ASSERT(set->states.count == 0);
 			}
@@ -2675,18 +3278,25 @@ void b2ValidateSolverSets(b2World* world)
 			{
 				b2Contact* contacts = world->contactArray;
 				B2_ASSERT(set->contacts.count >= 0);
+				B2_ASSERT(setIndex >= b2_firstSleepingSet || set->contacts.count == 0);
 				totalContactCount += set->contacts.count;
 				for (int i = 0; i < set->contacts.count; ++i)
 				{
 					b2ContactSim* contactSim = set->contacts.data + i;
 					b2CheckIndex(contacts, contactSim->contactId);
 					b2Contact* contact = contacts + contactSim->contactId;
-					if (setIndex == b2_awakeSet)
-					{
-						// contact should be non-touching if awake
-						// or it could be this contact hasn't been transferred yet
-						B2_ASSERT(contactSim->manifold.pointCount == 0 || (contactSim->simFlags & b2_simStartedTouching) != 0);
-					}
+					B2_ASSERT(contact->setIndex == setIndex);
+					B2_ASSERT(contact->colorIndex == B2_NULL_INDEX);
+					B2_ASSERT(contact->localIndex == i);
+				}
+
+				B2_ASSERT(setIndex < b2_firstSleepingSet || set->nonTouchingContacts.count == 0);
+				totalContactCount += set->nonTouchingContacts.count;
+				for (int i = 0; i < set->nonTouchingContacts.count; ++i)
+				{
+					b2NonTouchingContactSim* contactSim = set->nonTouchingContacts.data + i;
+					b2CheckIndex(contacts, contactSim->contactId);
+					b2Contact* contact = contacts + contactSim->contactId;
 					B2_ASSERT(contact->setIndex == setIndex);
 					B2_ASSERT(contact->colorIndex == B2_NULL_INDEX);
 					B2_ASSERT(contact->localIndex == i);
@@ -2728,6 +3338,7 @@ void b2ValidateSolverSets(b2World* world)
 		{
 			B2_ASSERT(set->sims.count == 0);
 			B2_ASSERT(set->contacts.count == 0);
+			B2_ASSERT(set->nonTouchingContacts.count == 0);
 			B2_ASSERT(set->joints.count == 0);
 			B2_ASSERT(set->islands.count == 0);
 			B2_ASSERT(set->states.count == 0);
@@ -2905,16 +3516,31 @@ void b2ValidateContacts(b2World* world)
 			B2_ASSERT(touching == false && setId == b2_disabledSet);
 		}
 
-		b2ContactSim* contactSim = b2GetContactSim(world, contact);
-		B2_ASSERT(contactSim->contactId == contactIndex);
-		B2_ASSERT(contactSim->bodyIdA == contact->edges[0].bodyId);
-		B2_ASSERT(contactSim->bodyIdB == contact->edges[1].bodyId);
+		if (b2IsContactSimExpanded(contact))
+		{
+			b2ContactSim* contactSim = b2GetContactSim(world, contact);
+			B2_ASSERT(contactSim->contactId == contactIndex);
+			B2_ASSERT(contactSim->bodyIdA == contact->edges[0].bodyId);
+			B2_ASSERT(contactSim->bodyIdB == contact->edges[1].bodyId);
+
+			bool simTouching = (contactSim->simFlags & b2_simTouchingFlag) != 0;
+			B2_ASSERT(touching == simTouching);
 
-		bool simTouching = (contactSim->simFlags & b2_simTouchingFlag) != 0;
-		B2_ASSERT(touching == simTouching);
-		// A touching contact should have contact points unless it is a sensor
-		B2_ASSERT(simTouching == (contactSim->manifold.pointCount > 0) || (contact->flags & b2_contactSensorFlag) != 0);
-		B2_ASSERT(0 <= contactSim->manifold.pointCount && contactSim->manifold.pointCount <= 2);
+			// A contact in the graph or a sleeping set has contact points
+			B2_ASSERT(0 < contactSim->manifold.pointCount && contactSim->manifold.pointCount <= 2);
+		}
+		else
+		{
+			b2NonTouchingContactSim* contactSim = b2GetNonTouchingContactSim(world, contact);
+			B2_ASSERT(contactSim->contactId == contactIndex);
+			B2_ASSERT(contactSim->bodyIdA == contact->edges[0].bodyId);
+			B2_ASSERT(contactSim->bodyIdB == contact->edges[1].bodyId);
+
+			// Only sensors can be touching without contact points
+			bool simTouching = (contactSim->simFlags & b2_simTouchingFlag) != 0;
+			B2_ASSERT(touching == simTouching);
+			B2_ASSERT(simTouching == false || (contact->flags & b2_contactSensorFlag) != 0);
+		}
 	}
 
 	int contactIdCount = b2GetIdCount(&world->contactIdPool);
@@ -3,18 +3,29 @@
 
 #pragma once
 
+#include "arena_allocator.h"
 #include "block_allocator.h"
 #include "bitset.h"
 #include "broad_phase.h"
 #include "constraint_graph.h"
 #include "id_pool.h"
 #include "island.h"
+#include "query_snapshot.h"
 #include "stack_allocator.h"
 
 #include "box2d/callbacks.h"
 
 typedef struct b2ContactSim b2ContactSim;
 
+// Shape geometry is pooled by type so shape records are not sized for polygons.
+// The data is a b2Array of the geometry type for the pool.
+typedef struct b2GeometryPool
+{
+	b2IdPool idPool;
+	void* data;
+	int elementSize;
+} b2GeometryPool;
+
 enum b2SetType
 {
 	b2_staticSet = 0,
@@ -26,19 +37,29 @@ enum b2SetType
 // Per thread task storage
 typedef struct b2TaskContext
 {
-	// These bits align with the b2ConstraintGraph::contactBlocks and signal a change in contact status
-	b2BitSet contactStateBitSet;
+	// Ids of contacts that changed status in collide. Stored in the arena so the cost scales with the number of
+	// changes instead of the contact id capacity.
+	b2ArenaIntArray contactChanges;
 
-	// Used to track bodies with shapes that have enlarged AABBs. This avoids having a bit array
-	// that is very large when there are many static shapes.
-	b2BitSet enlargedSimBitSet;
+	// Awake body sim indices with shapes that have enlarged AABBs. Stored in the arena. Tracking bodies
+	// avoids a list that is very large when there are many static shapes.
+	b2ArenaIntArray enlargedSims;
 
 	// Used to put islands to sleep
 	b2BitSet awakeIslandBitSet;
 
-	// Per worker split island candidate
-	float splitSleepTime;
-	int splitIslandId;
+	// Awake islands that want to sleep but need splitting first
+	b2BitSet splitIslandBitSet;
+
+	// Solver blocks this worker took from other workers in the last time step
+	int stealCount;
+
+	// Scratch memory for tasks running on this worker. Reset at the start of every time step.
+	b2ArenaAllocator arena;
+
+	// Fast and bullet bodies found by this worker when finalizing bodies. Stored in the arena.
+	b2ArenaIntArray fastBodies;
+	b2ArenaIntArray bulletBodies;
 
 } b2TaskContext;
 
@@ -47,6 +68,9 @@ typedef struct b2TaskContext
 /// management facilities.
 typedef struct b2World
 {
+	// Allocation callbacks and byte count for this world
+	b2Allocator allocator;
+
 	b2BlockAllocator blockAllocator;
 	b2StackAllocator stackAllocator;
 	b2BroadPhase broadPhase;
@@ -97,6 +121,9 @@ typedef struct b2World
 	struct b2Shape* shapeArray;
 	struct b2ChainShape* chainArray;
 
+	// Shape geometry indexed by shape type and then b2Shape::geometryIndex
+	b2GeometryPool geometryPools[b2_shapeTypeCount];
+
 	// Per thread storage
 	b2TaskContext* taskContextArray;
 
@@ -122,7 +149,8 @@ typedef struct b2World
 	// - islands that have removed constraints must be put split first because I don't want to wake bodies incorrectly
 	// - otherwise I can use the awake islands that have bodies wanting to sleep as the splitting candidates
 	// - if no bodies want to sleep then there is no reason to perform island splitting
-	int splitIslandId;
+	// Several islands can be split in the same time step.
+	int* splitIslandArray;
 
 	b2Vec2 gravity;
 	float hitEventThreshold;
@@ -143,9 +171,31 @@ typedef struct b2World
 	int workerCount;
 	b2EnqueueTaskCallback* enqueueTaskFcn;
 	b2FinishTaskCallback* finishTaskFcn;
+	b2EnqueueDependentTaskCallback* enqueueDependentTaskFcn;
 	void* userTaskContext;
 	void* userTreeTask;
 
+	// Solve on the calling thread when the awake body and constraint count is below this
+	int serialSolveThreshold;
+
+	// Double buffered state for queries that run concurrently with the time step
+	b2QuerySnapshot querySnapshots[2];
+	_Atomic int querySnapshotIndex;
+
+	// Bodies marked since the last snapshot and the bodies refreshed by the last snapshot. The back buffer
+	// missed both.
+	int* snapshotMovedBodyArray;
+	int* snapshotRefreshedBodyArray;
+
+	// Queries reading the world directly because there is no snapshot yet
+	_Atomic int directQueryCount;
+
+	// Zero for no limit
+	int64_t memoryBudget;
+	b2MemoryBudgetPolicy memoryBudgetPolicy;
+	int failedCreateCount;
+	int refusedContactCount;
+
 	// Remember type step used for reporting forces and torques
 	float inv_h;
 
@@ -158,6 +208,10 @@ typedef struct b2World
 	bool locked;
 	bool enableWarmStarting;
 	bool enableContinuous;
+	bool enableWorkerAffinity;
+	bool enableQuerySnapshot;
+	bool enableTrace;
+	bool traceRetained;
 	bool inUse;
 } b2World;
 
@@ -165,6 +219,18 @@ b2World* b2GetWorldFromId(b2WorldId id);
 b2World* b2GetWorld(int index);
 b2World* b2GetWorldLocked(int index);
 
+void* b2EnqueueDependentTask(b2World* world, b2TaskCallback* task, int itemCount, int minRange, void* taskContext,
+							 void** dependencies, int dependencyCount);
+
+// Bytes held by the world, counted against the memory budget
+int64_t b2GetWorldByteCount(b2World* world);
+
+// Returns true if a create call must fail because of the memory budget. The caller counts the failure.
+bool b2IsOverMemoryBudget(b2World* world);
+
+// Returns true if new contacts must not be created because of the memory budget
+bool b2IsOverContactBudget(b2World* world);
+
 void b2ValidateConnectivity(b2World* world);
 void b2ValidateSolverSets(b2World* world);
 void b2ValidateContacts(b2World* world);
@@ -1,12 +1,15 @@
 // SPDX-FileCopyrightText: 2024 Erin Catto
 // SPDX-License-Identifier: MIT
 
+#include "arena_allocator.h"
 #include "block_allocator.h"
 #include "test_macros.h"
 
+#include <string.h>
+
 int BlockAllocatorTest(void)
 {
-	b2BlockAllocator alloc = b2CreateBlockAllocator();
+	b2BlockAllocator alloc = b2CreateBlockAllocator(NULL);
 	
 	void* data1[64];
 	int size1 = 16;
@@ -54,9 +57,93 @@ int BlockAllocatorTest(void)
 	return 0;
 }
 
+int SlabAllocatorTest(void)
+{
+	b2BlockAllocator alloc = b2CreateBlockAllocator(NULL);
+
+	// 3008 rounds to 3072 instead of 4096
+	void* block = b2AllocBlock(&alloc, 3008);
+	b2BlockAllocatorStats stats = b2GetBlockAllocatorStats(&alloc);
+	ENSURE(stats.requestedBytes == 3008);
+	ENSURE(stats.blockBytes == 3072);
+	ENSURE(stats.slabCount == 1);
+
+	// growing within the size class keeps the block
+	void* grown = b2GrowBlock(&alloc, block, 3008, 3072);
+	ENSURE(grown == block);
+
+	// growing past the size class keeps the contents
+	memset(grown, 7, 3072);
+	grown = b2GrowBlock(&alloc, grown, 3072, 5000);
+	ENSURE(((char*)grown)[3071] == 7);
+
+	// large allocations grow in place or remap
+	int largeSize = 200000;
+	char* large = b2GrowBlock(&alloc, NULL, 0, largeSize);
+	large[largeSize - 1] = 3;
+	large = b2GrowBlock(&alloc, large, largeSize, 2 * largeSize);
+	ENSURE(large[largeSize - 1] == 3);
+	stats = b2GetBlockAllocatorStats(&alloc);
+	ENSURE(stats.largeCount == 1);
+	ENSURE(stats.largeBytes >= 2 * largeSize);
+	b2FreeBlock(&alloc, large, 2 * largeSize);
+
+	// the 3072 slab is empty and gets released, the 5120 slab is still in use
+	ENSURE(b2TrimBlockAllocator(&alloc) > 0);
+	stats = b2GetBlockAllocatorStats(&alloc);
+	ENSURE(stats.slabCount == 1);
+	ENSURE(stats.largeCount == 0);
+	ENSURE(b2ValidateBlockAllocator(&alloc));
+
+	b2FreeBlock(&alloc, grown, 5000);
+	b2TrimBlockAllocator(&alloc);
+	stats = b2GetBlockAllocatorStats(&alloc);
+	ENSURE(stats.slabCount == 0);
+	ENSURE(stats.requestedBytes == 0);
+
+	b2DestroyBlockAllocator(&alloc);
+
+	return 0;
+}
+
+int ArenaAllocatorTest(void)
+{
+	b2ArenaAllocator arena = b2CreateArenaAllocator(NULL, 256);
+
+	// Overflow goes to the heap
+	b2ArenaIntArray array = {0};
+	for (int i = 0; i < 1000; ++i)
+	{
+		b2ArenaIntArray_Push(&arena, &array, i);
+	}
+
+	ENSURE(array.count == 1000);
+	for (int i = 0; i < 1000; ++i)
+	{
+		ENSURE(array.data[i] == i);
+	}
+
+	int maxAllocation = b2GetMaxArenaAllocation(&arena);
+	ENSURE(maxAllocation > 256);
+
+	// The arena grows on reset so the same usage fits
+	b2ResetArena(&arena);
+	ENSURE(b2GetArenaCapacity(&arena) >= maxAllocation);
+
+	char* first = b2AllocateArenaItem(&arena, 100);
+	char* second = b2AllocateArenaItem(&arena, 100);
+	ENSURE(second == first + 128);
+
+	b2DestroyArenaAllocator(&arena);
+
+	return 0;
+}
+
 int AllocatorTest(void)
 {
 	RUN_SUBTEST(BlockAllocatorTest);
+	RUN_SUBTEST(SlabAllocatorTest);
+	RUN_SUBTEST(ArenaAllocatorTest);
 
 	return 0;
 }
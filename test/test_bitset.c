@@ -9,7 +9,7 @@
 
 int BitSetTest(void)
 {
-	b2BitSet bitSet = b2CreateBitSet(COUNT);
+	b2BitSet bitSet = b2CreateBitSet(NULL, COUNT);
 	
 	b2SetBitCountAndClear(&bitSet, COUNT);
 	bool values[COUNT] = {false};
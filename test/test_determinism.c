@@ -9,6 +9,7 @@
 
 #include "TaskScheduler_c.h"
 
+#include <stdatomic.h>
 #include <stdio.h>
 
 #ifdef BOX2D_PROFILE
@@ -23,15 +24,33 @@ enum
 	e_rows = 10,
 	e_count = e_columns * e_rows,
 	e_maxTasks = 128,
+	e_maxDependencies = 4,
+	e_maxDependents = 4,
 };
 
-b2Vec2 finalPositions[2][e_count];
-float finalAngles[2][e_count];
+b2Vec2 finalPositions[4][e_count];
+float finalAngles[4][e_count];
 
 typedef struct TaskData
 {
 	b2TaskCallback* box2dTask;
 	void* box2dContext;
+	enkiTaskSet* task;
+
+	// Items not yet executed. The range that runs the last item starts the dependents.
+	_Atomic int remainingCount;
+
+	// Running dependencies plus one while the task is being enqueued
+	_Atomic int pendingCount;
+
+	// Guards finished and the dependent list
+	atomic_flag lock;
+	bool finished;
+	int dependents[e_maxDependents];
+	int dependentCount;
+
+	enkiTaskSet* dependencies[e_maxDependencies];
+	int dependencyCount;
 } TaskData;
 
 enkiTaskScheduler* scheduler;
@@ -39,53 +58,173 @@ enkiTaskSet* tasks[e_maxTasks];
 TaskData taskData[e_maxTasks];
 int taskCount;
 
+static void LockTask(TaskData* data)
+{
+	while (atomic_flag_test_and_set(&data->lock))
+	{
+	}
+}
+
+static void UnlockTask(TaskData* data)
+{
+	atomic_flag_clear(&data->lock);
+}
+
+static void ReleaseDependent(TaskData* data)
+{
+	if (atomic_fetch_sub(&data->pendingCount, 1) == 1)
+	{
+		enkiAddTaskSet(scheduler, data->task);
+	}
+}
+
+// Called by the range that finishes the task. Dependents whose last dependency this was are started here.
+static void CompleteTask(TaskData* data)
+{
+	LockTask(data);
+	data->finished = true;
+	UnlockTask(data);
+
+	// The dependent list can no longer change
+	for (int i = 0; i < data->dependentCount; ++i)
+	{
+		ReleaseDependent(taskData + data->dependents[i]);
+	}
+}
+
 void ExecuteRangeTask(uint32_t start, uint32_t end, uint32_t threadIndex, void* context)
 {
 	TaskData* data = context;
 	data->box2dTask(start, end, threadIndex, data->box2dContext);
+
+	int count = (int)(end - start);
+	if (atomic_fetch_sub(&data->remainingCount, count) == count)
+	{
+		CompleteTask(data);
+	}
 }
 
-static void* EnqueueTask(b2TaskCallback* box2dTask, int itemCount, int minRange, void* box2dContext, void* userContext)
+static TaskData* GetTaskData(void* userTask)
 {
-	MAYBE_UNUSED(userContext);
+	for (int i = 0; i < taskCount; ++i)
+	{
+		if (tasks[i] == userTask)
+		{
+			return taskData + i;
+		}
+	}
+
+	return NULL;
+}
 
-	if (taskCount < e_maxTasks)
+// Sets up the next task without starting it. Returns NULL if the tasks are used up.
+static TaskData* PrepareTask(b2TaskCallback* box2dTask, int itemCount, int minRange, void* box2dContext)
+{
+	if (taskCount == e_maxTasks)
 	{
-		enkiTaskSet* task = tasks[taskCount];
-		TaskData* data = taskData + taskCount;
-		data->box2dTask = box2dTask;
-		data->box2dContext = box2dContext;
+		return NULL;
+	}
 
-		struct enkiParamsTaskSet params;
-		params.minRange = minRange;
-		params.setSize = itemCount;
-		params.pArgs = data;
-		params.priority = 0;
+	TaskData* data = taskData + taskCount;
+	data->box2dTask = box2dTask;
+	data->box2dContext = box2dContext;
+	data->task = tasks[taskCount];
+	atomic_store(&data->remainingCount, itemCount);
+	atomic_store(&data->pendingCount, 1);
+	atomic_flag_clear(&data->lock);
 
-		enkiSetParamsTaskSet(task, params);
-		enkiAddTaskSet(scheduler, task);
+	// An empty task has no range to complete it
+	data->finished = itemCount == 0;
+	data->dependentCount = 0;
+	data->dependencyCount = 0;
 
-		++taskCount;
+	struct enkiParamsTaskSet params;
+	params.minRange = minRange;
+	params.setSize = itemCount;
+	params.pArgs = data;
+	params.priority = 0;
 
-		return task;
-	}
-	else
+	enkiSetParamsTaskSet(data->task, params);
+
+	++taskCount;
+
+	return data;
+}
+
+static void* EnqueueTask(b2TaskCallback* box2dTask, int itemCount, int minRange, void* box2dContext, void* userContext)
+{
+	MAYBE_UNUSED(userContext);
+
+	TaskData* data = PrepareTask(box2dTask, itemCount, minRange, box2dContext);
+	if (data == NULL)
 	{
 		box2dTask(0, itemCount, 0, box2dContext);
-
 		return NULL;
 	}
+
+	enkiAddTaskSet(scheduler, data->task);
+	return data->task;
 }
 
 static void FinishTask(void* userTask, void* userContext)
 {
-	MAYBE_UNUSED(userContext);
+	// A dependent task is started by its last dependency, so finish those first
+	TaskData* data = GetTaskData(userTask);
+	for (int i = 0; i < data->dependencyCount; ++i)
+	{
+		FinishTask(data->dependencies[i], userContext);
+	}
 
 	enkiTaskSet* task = userTask;
 	enkiWaitForTaskSet(scheduler, task);
 }
 
-void TiltedStacks(int testIndex, int workerCount)
+// Dependent tasks are returned right away. Each dependency that is still running holds back the new task and
+// the dependency that finishes last starts it.
+static void* EnqueueDependentTask(b2TaskCallback* box2dTask, int itemCount, int minRange, void* box2dContext, void** dependencies,
+								  int dependencyCount, void* userContext)
+{
+	TaskData* data = PrepareTask(box2dTask, itemCount, minRange, box2dContext);
+	int index = data == NULL ? -1 : (int)(data - taskData);
+
+	for (int i = 0; i < dependencyCount; ++i)
+	{
+		if (dependencies[i] == NULL)
+		{
+			continue;
+		}
+
+		TaskData* dependency = GetTaskData(dependencies[i]);
+		bool chained = false;
+
+		LockTask(dependency);
+		if (data != NULL && dependency->finished == false && dependency->dependentCount < e_maxDependents &&
+			data->dependencyCount < e_maxDependencies)
+		{
+			atomic_fetch_add(&data->pendingCount, 1);
+			dependency->dependents[dependency->dependentCount++] = index;
+			data->dependencies[data->dependencyCount++] = dependencies[i];
+			chained = true;
+		}
+		UnlockTask(dependency);
+
+		if (chained == false)
+		{
+			FinishTask(dependencies[i], userContext);
+		}
+	}
+
+	if (data == NULL)
+	{
+		box2dTask(0, itemCount, 0, box2dContext);
+		return NULL;
+	}
+
+	ReleaseDependent(data);
+	return data->task;
+}
+
+void TiltedStacks(int testIndex, int workerCount, bool useDependentTasks, bool varyWorkerCount)
 {
 	scheduler = enkiNewTaskScheduler();
 	struct enkiTaskSchedulerConfig config = enkiGetTaskSchedulerConfig(scheduler);
@@ -105,8 +244,15 @@ void TiltedStacks(int testIndex, int workerCount)
 	worldDef.gravity = gravity;
 	worldDef.enqueueTask = EnqueueTask;
 	worldDef.finishTask = FinishTask;
+	worldDef.enqueueDependentTask = useDependentTasks ? EnqueueDependentTask : NULL;
 	worldDef.workerCount = workerCount;
-	worldDef.enableSleep = false;
+
+	// Sleep preparation depends on body finalization, so this gives the dependent task run a dependency that
+	// is still running when the dependent task is enqueued
+	worldDef.enableSleep = true;
+
+	// Always use the staged solver with multiple workers. The single worker run uses the serial solver.
+	worldDef.serialSolveThreshold = 0;
 
 	b2WorldId worldId = b2CreateWorld(&worldDef);
 
@@ -155,6 +301,13 @@ void TiltedStacks(int testIndex, int workerCount)
 
 	for (int i = 0; i < 100; ++i)
 	{
+		if (varyWorkerCount)
+		{
+			// cycle through 1 to workerCount workers and alternate the solver scheduling
+			b2World_SetWorkerCount(worldId, 1 + i % workerCount);
+			b2World_EnableWorkerAffinity(worldId, (i & 1) == 0);
+		}
+
 		b2World_Step(worldId, timeStep, subStepCount);
 		taskCount = 0;
 		TracyCFrameMark;
@@ -180,22 +333,40 @@ void TiltedStacks(int testIndex, int workerCount)
 int DeterminismTest(void)
 {
 	// Test 1 : 4 threads
-	TiltedStacks(0, 4);
+	TiltedStacks(0, 4, false, false);
 
 	// Test 2 : 1 thread
-	TiltedStacks(1, 1);
+	TiltedStacks(1, 1, false, false);
+
+	// Test 3 : 4 threads with dependent tasks
+	TiltedStacks(2, 4, true, false);
+
+	// Test 4 : worker count changes every step
+	TiltedStacks(3, 4, false, true);
 
-	// Both runs should produce identical results
+	// All runs should produce identical results
 	for (int i = 0; i < e_count; ++i)
 	{
 		b2Vec2 p1 = finalPositions[0][i];
 		b2Vec2 p2 = finalPositions[1][i];
+		b2Vec2 p3 = finalPositions[2][i];
 		float a1 = finalAngles[0][i];
 		float a2 = finalAngles[1][i];
+		float a3 = finalAngles[2][i];
+		b2Vec2 p4 = finalPositions[3][i];
+		float a4 = finalAngles[3][i];
 
 		ENSURE(p1.x == p2.x);
 		ENSURE(p1.y == p2.y);
 		ENSURE(a1 == a2);
+
+		ENSURE(p1.x == p3.x);
+		ENSURE(p1.y == p3.y);
+		ENSURE(a1 == a3);
+
+		ENSURE(p1.x == p4.x);
+		ENSURE(p1.y == p4.y);
+		ENSURE(a1 == a4);
 	}
 
 	return 0;
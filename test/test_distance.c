@@ -108,6 +108,7 @@ static int TimeOfImpactTest(void)
 
 	ENSURE(output.state == b2_toiStateHit);
 	ENSURE_SMALL(output.t - 0.5f, 0.005f);
+	ENSURE(output.iterations > 0);
 
 	return 0;
 }
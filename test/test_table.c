@@ -26,7 +26,7 @@ int TableTest(void)
 
 	for (int32_t iter = 0; iter < 1; ++iter)
 	{
-		b2HashSet set = b2CreateSet(16);
+		b2HashSet set = b2CreateSet(NULL, 16);
 
 		// Fill set
 		for (int32_t i = 0; i < N; ++i)
@@ -1,12 +1,24 @@
 // SPDX-FileCopyrightText: 2023 Erin Catto
 // SPDX-License-Identifier: MIT
 
+#include "body.h"
+#include "contact.h"
+#include "shape.h"
+#include "solver_set.h"
+#include "test_macros.h"
+#include "world.h"
+
 #include "box2d/box2d.h"
 #include "box2d/geometry.h"
 #include "box2d/math_functions.h"
-#include "test_macros.h"
 
+#include "TaskScheduler_c.h"
+
+#include <float.h>
+#include <stdatomic.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 
 // This is a simple example of building and running a simulation
 // using Box2D. Here we create a large ground box and a small dynamic
@@ -200,12 +212,1044 @@ static int TestIsValid(void)
 	return 0;
 }
 
+// Queries read the state at the end of the last time step when the world keeps a query snapshot
+static int TestQuerySnapshot(void)
+{
+	b2WorldDef worldDef = b2DefaultWorldDef();
+	worldDef.gravity = b2Vec2_zero;
+	worldDef.enableQuerySnapshot = true;
+	b2WorldId worldId = b2CreateWorld(&worldDef);
+
+	b2BodyDef bodyDef = b2DefaultBodyDef();
+	bodyDef.type = b2_dynamicBody;
+	bodyDef.position = (b2Vec2){0.0f, 10.0f};
+	b2BodyId bodyId = b2CreateBody(worldId, &bodyDef);
+
+	b2ShapeDef shapeDef = b2DefaultShapeDef();
+	b2Polygon box = b2MakeBox(1.0f, 1.0f);
+	b2CreatePolygonShape(bodyId, &shapeDef, &box);
+
+	b2Vec2 origin = {-5.0f, 10.0f};
+	b2Vec2 translation = {10.0f, 0.0f};
+	b2QueryFilter filter = b2DefaultQueryFilter();
+
+	// Before the first step queries read the world directly
+	b2RayResult result = b2World_CastRayClosest(worldId, origin, translation, filter);
+	ENSURE(result.hit == true);
+	ENSURE_SMALL(result.point.x + 1.0f, FLT_EPSILON);
+
+	b2World_Step(worldId, 1.0f / 60.0f, 4);
+
+	result = b2World_CastRayClosest(worldId, origin, translation, filter);
+	ENSURE(result.hit == true);
+	ENSURE_SMALL(result.point.x + 1.0f, FLT_EPSILON);
+
+	// Moving the body is not seen until the next step
+	b2Body_SetTransform(bodyId, (b2Vec2){2.0f, 10.0f}, 0.0f);
+
+	result = b2World_CastRayClosest(worldId, origin, translation, filter);
+	ENSURE(result.hit == true);
+	ENSURE_SMALL(result.point.x + 1.0f, FLT_EPSILON);
+
+	b2World_Step(worldId, 1.0f / 60.0f, 4);
+
+	result = b2World_CastRayClosest(worldId, origin, translation, filter);
+	ENSURE(result.hit == true);
+	ENSURE_SMALL(result.point.x - 1.0f, FLT_EPSILON);
+
+	// The snapshot is double buffered. A moved static body must be seen in both buffers.
+	bodyDef.type = b2_staticBody;
+	bodyDef.position = (b2Vec2){0.0f, -10.0f};
+	b2BodyId staticId = b2CreateBody(worldId, &bodyDef);
+	b2CreatePolygonShape(staticId, &shapeDef, &box);
+
+	b2Vec2 staticOrigin = {-5.0f, -10.0f};
+	b2World_Step(worldId, 1.0f / 60.0f, 4);
+	b2Body_SetTransform(staticId, (b2Vec2){2.0f, -10.0f}, 0.0f);
+
+	for (int i = 0; i < 3; ++i)
+	{
+		b2World_Step(worldId, 1.0f / 60.0f, 4);
+
+		result = b2World_CastRayClosest(worldId, staticOrigin, translation, filter);
+		ENSURE(result.hit == true);
+		ENSURE_SMALL(result.point.x - 1.0f, FLT_EPSILON);
+	}
+
+	// Destroyed shapes are skipped
+	b2DestroyBody(bodyId);
+
+	result = b2World_CastRayClosest(worldId, origin, translation, filter);
+	ENSURE(result.hit == false);
+
+	b2DestroyWorld(worldId);
+
+	return 0;
+}
+
+typedef struct QueryThreadContext
+{
+	b2WorldId worldId;
+	_Atomic int started;
+	_Atomic int done;
+	int queryCount;
+	int missCount;
+} QueryThreadContext;
+
+static bool CountOverlap(b2ShapeId shapeId, void* context)
+{
+	MAYBE_UNUSED(shapeId);
+	int* count = context;
+	*count += 1;
+	return true;
+}
+
+// Query in a loop until the main thread is done stepping. The ray always crosses the ground.
+static void QueryThreadTask(uint32_t startIndex, uint32_t endIndex, uint32_t threadIndex, void* context)
+{
+	MAYBE_UNUSED(startIndex);
+	MAYBE_UNUSED(endIndex);
+	MAYBE_UNUSED(threadIndex);
+
+	QueryThreadContext* queryContext = context;
+	b2QueryFilter filter = b2DefaultQueryFilter();
+	b2AABB aabb = {{-5.0f, -1.0f}, {5.0f, 20.0f}};
+
+	atomic_store(&queryContext->started, 1);
+
+	while (atomic_load(&queryContext->done) == 0)
+	{
+		b2RayResult result = b2World_CastRayClosest(queryContext->worldId, (b2Vec2){0.0f, 50.0f}, (b2Vec2){0.0f, -100.0f}, filter);
+
+		int overlapCount = 0;
+		b2World_OverlapAABB(queryContext->worldId, aabb, filter, CountOverlap, &overlapCount);
+
+		queryContext->queryCount += 1;
+		queryContext->missCount += result.hit && overlapCount > 0 ? 0 : 1;
+	}
+}
+
+// Queries on another thread run while the world steps
+static int TestConcurrentQueries(void)
+{
+	enkiTaskScheduler* taskScheduler = enkiNewTaskScheduler();
+	struct enkiTaskSchedulerConfig config = enkiGetTaskSchedulerConfig(taskScheduler);
+	config.numTaskThreadsToCreate = 1;
+	enkiInitTaskSchedulerWithConfig(taskScheduler, config);
+
+	b2WorldDef worldDef = b2DefaultWorldDef();
+	worldDef.enableQuerySnapshot = true;
+	b2WorldId worldId = b2CreateWorld(&worldDef);
+
+	b2BodyDef bodyDef = b2DefaultBodyDef();
+	b2BodyId groundId = b2CreateBody(worldId, &bodyDef);
+
+	b2ShapeDef shapeDef = b2DefaultShapeDef();
+	b2Segment segment = {{-40.0f, 0.0f}, {40.0f, 0.0f}};
+	b2CreateSegmentShape(groundId, &shapeDef, &segment);
+
+	b2Polygon box = b2MakeSquare(0.5f);
+	bodyDef.type = b2_dynamicBody;
+	for (int i = 0; i < 100; ++i)
+	{
+		bodyDef.position = (b2Vec2){-4.5f + 1.0f * (i % 10), 0.5f + 1.0f * (i / 10)};
+		b2BodyId bodyId = b2CreateBody(worldId, &bodyDef);
+		b2CreatePolygonShape(bodyId, &shapeDef, &box);
+	}
+
+	QueryThreadContext queryContext = {0};
+	queryContext.worldId = worldId;
+
+	enkiTaskSet* queryTask = enkiCreateTaskSet(taskScheduler, QueryThreadTask);
+	struct enkiParamsTaskSet params;
+	params.minRange = 1;
+	params.setSize = 1;
+	params.pArgs = &queryContext;
+	params.priority = 0;
+	enkiSetParamsTaskSet(queryTask, params);
+	enkiAddTaskSet(taskScheduler, queryTask);
+
+	// The task runs on the worker thread
+	while (atomic_load(&queryContext.started) == 0)
+	{
+	}
+
+	for (int i = 0; i < 120; ++i)
+	{
+		b2World_Step(worldId, 1.0f / 60.0f, 4);
+	}
+
+	atomic_store(&queryContext.done, 1);
+	enkiWaitForTaskSet(taskScheduler, queryTask);
+
+	ENSURE(queryContext.queryCount > 0);
+	ENSURE(queryContext.missCount == 0);
+
+	b2DestroyWorld(worldId);
+
+	enkiDeleteTaskSet(taskScheduler, queryTask);
+	enkiDeleteTaskScheduler(taskScheduler);
+
+	return 0;
+}
+
+// The stack is grown before the step so a burst of new bodies does not use the heap for scratch memory
+static int TestStackReserve(void)
+{
+	b2WorldDef worldDef = b2DefaultWorldDef();
+	worldDef.stackAllocatorCapacity = 64;
+	b2WorldId worldId = b2CreateWorld(&worldDef);
+
+	b2BodyDef bodyDef = b2DefaultBodyDef();
+	b2BodyId groundId = b2CreateBody(worldId, &bodyDef);
+
+	b2ShapeDef shapeDef = b2DefaultShapeDef();
+	b2Segment segment = {{-40.0f, 0.0f}, {40.0f, 0.0f}};
+	b2CreateSegmentShape(groundId, &shapeDef, &segment);
+
+	b2Polygon box = b2MakeSquare(0.5f);
+	bodyDef.type = b2_dynamicBody;
+
+	for (int i = 0; i < 20; ++i)
+	{
+		for (int j = 0; j < 20; ++j)
+		{
+			bodyDef.position = (b2Vec2){-20.0f + 1.0f * j, 0.5f + 1.0f * i};
+			b2BodyId bodyId = b2CreateBody(worldId, &bodyDef);
+			b2CreatePolygonShape(bodyId, &shapeDef, &box);
+		}
+	}
+
+	for (int i = 0; i < 10; ++i)
+	{
+		b2World_Step(worldId, 1.0f / 60.0f, 4);
+	}
+
+	b2Counters counters = b2World_GetCounters(worldId);
+	ENSURE(counters.stackUsed > 64);
+	ENSURE(counters.stackHeapAllocationCount == 0);
+
+	b2DestroyWorld(worldId);
+
+	return 0;
+}
+
+// Clusters of boxes that start touching together in one step. The bodies are created in small batches so the
+// pair finding never needs much stack, and the solve of the new touching contacts is the largest use of the stack.
+static int TestStackReserveBeginTouch(void)
+{
+	b2WorldDef worldDef = b2DefaultWorldDef();
+	worldDef.gravity = b2Vec2_zero;
+	worldDef.stackAllocatorCapacity = 64;
+	b2WorldId worldId = b2CreateWorld(&worldDef);
+
+	b2BodyDef bodyDef = b2DefaultBodyDef();
+	bodyDef.type = b2_dynamicBody;
+	b2ShapeDef shapeDef = b2DefaultShapeDef();
+	b2Polygon box = b2MakeSquare(0.5f);
+
+	enum
+	{
+		e_clusterCount = 400,
+		e_batchSize = 20,
+	};
+
+	// the fat AABBs of neighbors overlap across the gap, so the contacts exist before the boxes touch
+	float gap = 0.15f;
+	float spacing = 1.0f + gap;
+	b2BodyId bodyIds[4 * e_clusterCount];
+
+	for (int i = 0; i < e_clusterCount; ++i)
+	{
+		b2Vec2 center = {10.0f * (i % 20), 10.0f * (i / 20)};
+		for (int j = 0; j < 4; ++j)
+		{
+			bodyDef.position = (b2Vec2){center.x + spacing * (j & 1), center.y + spacing * (j >> 1)};
+			bodyIds[4 * i + j] = b2CreateBody(worldId, &bodyDef);
+			b2CreatePolygonShape(bodyIds[4 * i + j], &shapeDef, &box);
+		}
+
+		if ((i + 1) % e_batchSize == 0)
+		{
+			b2World_Step(worldId, 1.0f / 60.0f, 4);
+		}
+	}
+
+	b2Counters counters = b2World_GetCounters(worldId);
+	ENSURE(counters.contactCount == 6 * e_clusterCount);
+
+	// Close the gaps in one step. The boxes stay inside their fat AABBs, so no pairs are found.
+	float speed = 0.5f * gap * 60.0f;
+	for (int i = 0; i < e_clusterCount; ++i)
+	{
+		for (int j = 0; j < 4; ++j)
+		{
+			b2Vec2 v = {(j & 1) ? -speed : speed, (j >> 1) ? -speed : speed};
+			b2Body_SetLinearVelocity(bodyIds[4 * i + j], v);
+		}
+	}
+
+	b2World_Step(worldId, 1.0f / 60.0f, 4);
+	b2World_Step(worldId, 1.0f / 60.0f, 4);
+
+	b2ContactEvents events = b2World_GetContactEvents(worldId);
+	ENSURE(events.beginCount >= 4 * e_clusterCount);
+
+	counters = b2World_GetCounters(worldId);
+	ENSURE(counters.stackHeapAllocationCount == 0);
+
+	b2DestroyWorld(worldId);
+
+	return 0;
+}
+
+// Memory stats follow the world as it grows and shrinks
+static int TestMemoryStats(void)
+{
+	b2WorldDef worldDef = b2DefaultWorldDef();
+	b2WorldId worldId = b2CreateWorld(&worldDef);
+
+	b2BodyDef bodyDef = b2DefaultBodyDef();
+	b2BodyId groundId = b2CreateBody(worldId, &bodyDef);
+
+	b2ShapeDef shapeDef = b2DefaultShapeDef();
+	b2Segment segment = {{-40.0f, 0.0f}, {40.0f, 0.0f}};
+	b2CreateSegmentShape(groundId, &shapeDef, &segment);
+
+	b2MemoryStats before = b2World_GetMemoryStats(worldId);
+	ENSURE(before.awakeSet.bodySimBytes == 0);
+
+	b2Polygon box = b2MakeSquare(0.5f);
+	bodyDef.type = b2_dynamicBody;
+
+	b2BodyId bodyIds[100];
+	for (int i = 0; i < 100; ++i)
+	{
+		bodyDef.position = (b2Vec2){-20.0f + 1.0f * (i % 10), 0.5f + 1.0f * (i / 10)};
+		bodyIds[i] = b2CreateBody(worldId, &bodyDef);
+		b2CreatePolygonShape(bodyIds[i], &shapeDef, &box);
+	}
+
+	b2World_Step(worldId, 1.0f / 60.0f, 4);
+
+	b2MemoryStats stats = b2World_GetMemoryStats(worldId);
+	ENSURE(stats.awakeSet.bodySimBytes > 0);
+	ENSURE(stats.awakeSet.bodyStateBytes > 0);
+	ENSURE(stats.bodyArrayBytes > before.bodyArrayBytes);
+	ENSURE(stats.movableTreeBytes > 0);
+	ENSURE(stats.pairSetBytes > 0);
+	ENSURE(stats.awakeSet.nonTouchingContactBytes > 0);
+	ENSURE(stats.stackHighWater > 0);
+	ENSURE(stats.blockBytes >= stats.blockRequestedBytes);
+	ENSURE(stats.blockSlabBytes + stats.blockLargeBytes > 0);
+	ENSURE(stats.workerCount > 0);
+	ENSURE(stats.workerBitSetBytes > 0);
+
+	int colorBytes = 0;
+	for (int i = 0; i < 12; ++i)
+	{
+		colorBytes += stats.colorBytes[i];
+	}
+	ENSURE(colorBytes > 0);
+
+	for (int i = 0; i < 100; ++i)
+	{
+		b2DestroyBody(bodyIds[i]);
+	}
+
+	// freed ids are kept for reuse
+	stats = b2World_GetMemoryStats(worldId);
+	ENSURE(stats.bodyIdBytes >= 100 * (int)sizeof(int));
+
+	b2DestroyWorld(worldId);
+
+	return 0;
+}
+
+// A world with a few bodies should stay small. Slabs start with a few blocks per size class.
+static int TestSmallWorldMemory(void)
+{
+	b2WorldDef worldDef = b2DefaultWorldDef();
+	b2WorldId worldId = b2CreateWorld(&worldDef);
+
+	b2BodyDef bodyDef = b2DefaultBodyDef();
+	b2BodyId groundId = b2CreateBody(worldId, &bodyDef);
+
+	b2ShapeDef shapeDef = b2DefaultShapeDef();
+	b2Segment segment = {{-20.0f, 0.0f}, {20.0f, 0.0f}};
+	b2CreateSegmentShape(groundId, &shapeDef, &segment);
+
+	bodyDef.type = b2_dynamicBody;
+	bodyDef.position = (b2Vec2){0.0f, 4.0f};
+	b2BodyId bodyId = b2CreateBody(worldId, &bodyDef);
+	b2Polygon box = b2MakeSquare(0.5f);
+	b2CreatePolygonShape(bodyId, &shapeDef, &box);
+
+	for (int i = 0; i < 200; ++i)
+	{
+		b2World_Step(worldId, 1.0f / 60.0f, 4);
+	}
+
+	b2MemoryStats stats = b2World_GetMemoryStats(worldId);
+	ENSURE(stats.blockSlabBytes < 128 * 1024);
+	ENSURE(stats.totalBytes < 256 * 1024);
+
+	b2DestroyWorld(worldId);
+
+	return 0;
+}
+
+// Geometry is pooled by type. Changing the shape type moves the geometry to another pool.
+static int TestShapeGeometry(void)
+{
+	b2WorldDef worldDef = b2DefaultWorldDef();
+	b2WorldId worldId = b2CreateWorld(&worldDef);
+
+	b2BodyDef bodyDef = b2DefaultBodyDef();
+	bodyDef.type = b2_dynamicBody;
+	b2BodyId bodyId = b2CreateBody(worldId, &bodyDef);
+
+	b2ShapeDef shapeDef = b2DefaultShapeDef();
+	b2ShapeId shapeIds[3];
+	for (int i = 0; i < 3; ++i)
+	{
+		b2Circle circle = {{(float)i, 0.0f}, 0.5f};
+		shapeIds[i] = b2CreateCircleShape(bodyId, &shapeDef, &circle);
+	}
+
+	b2Polygon box = b2MakeOffsetBox(0.5f, 0.25f, (b2Vec2){2.0f, 1.0f}, 0.0f);
+	b2Shape_SetPolygon(shapeIds[1], &box);
+	ENSURE(b2Shape_GetType(shapeIds[1]) == b2_polygonShape);
+
+	b2Polygon polygon = b2Shape_GetPolygon(shapeIds[1]);
+	ENSURE(polygon.count == 4);
+	ENSURE(polygon.centroid.x == 2.0f && polygon.centroid.y == 1.0f);
+
+	// the freed circle slot is reused
+	b2Circle circle = {{5.0f, 0.0f}, 0.25f};
+	b2ShapeId shapeId = b2CreateCircleShape(bodyId, &shapeDef, &circle);
+	ENSURE(b2Shape_GetCircle(shapeIds[0]).center.x == 0.0f);
+	ENSURE(b2Shape_GetCircle(shapeIds[2]).center.x == 2.0f);
+	ENSURE(b2Shape_GetCircle(shapeId).center.x == 5.0f);
+
+	b2MemoryStats stats = b2World_GetMemoryStats(worldId);
+	ENSURE(stats.geometryBytes[b2_circleShape] > 0);
+	ENSURE(stats.geometryBytes[b2_polygonShape] > 0);
+
+	b2World_Step(worldId, 1.0f / 60.0f, 4);
+
+	b2DestroyWorld(worldId);
+
+	return 0;
+}
+
+// Trimming after a peak renumbers contacts and islands without changing the simulation state
+static int TestTrimMemory(void)
+{
+	b2WorldDef worldDef = b2DefaultWorldDef();
+	b2WorldId worldId = b2CreateWorld(&worldDef);
+
+	b2BodyDef bodyDef = b2DefaultBodyDef();
+	b2BodyId groundId = b2CreateBody(worldId, &bodyDef);
+
+	b2ShapeDef shapeDef = b2DefaultShapeDef();
+	b2Segment segment = {{-40.0f, 0.0f}, {40.0f, 0.0f}};
+	b2CreateSegmentShape(groundId, &shapeDef, &segment);
+
+	b2Polygon box = b2MakeSquare(0.5f);
+	bodyDef.type = b2_dynamicBody;
+
+	enum
+	{
+		e_count = 200
+	};
+
+	b2BodyId bodyIds[e_count];
+	for (int i = 0; i < e_count; ++i)
+	{
+		bodyDef.position = (b2Vec2){-10.0f + 1.0f * (i % 20), 0.5f + 1.0f * (i / 20)};
+		bodyIds[i] = b2CreateBody(worldId, &bodyDef);
+		b2CreatePolygonShape(bodyIds[i], &shapeDef, &box);
+	}
+
+	for (int i = 0; i < 30; ++i)
+	{
+		b2World_Step(worldId, 1.0f / 60.0f, 4);
+	}
+
+	// keep the top rows so the live contacts have high ids
+	for (int i = 0; i < e_count - 40; ++i)
+	{
+		b2DestroyBody(bodyIds[i]);
+	}
+
+	b2Counters before = b2World_GetCounters(worldId);
+	b2MemoryStats statsBefore = b2World_GetMemoryStats(worldId);
+
+	b2World_TrimMemory(worldId);
+
+	b2Counters after = b2World_GetCounters(worldId);
+	b2MemoryStats statsAfter = b2World_GetMemoryStats(worldId);
+	ENSURE(after.contactCount == before.contactCount);
+	ENSURE(after.islandCount == before.islandCount);
+	ENSURE(statsAfter.contactArrayBytes < statsBefore.contactArrayBytes);
+	ENSURE(statsAfter.contactIdBytes <= statsBefore.contactIdBytes);
+
+	for (int i = 0; i < 60; ++i)
+	{
+		b2World_Step(worldId, 1.0f / 60.0f, 4);
+	}
+
+	b2Counters counters = b2World_GetCounters(worldId);
+	ENSURE(counters.bodyCount == 41);
+	ENSURE(counters.contactCount > 0);
+
+	b2DestroyWorld(worldId);
+
+	return 0;
+}
+
+// Removing a joint leaves its island to be split when the bodies are ready to sleep. The split candidates
+// are found at the end of one step and used in the next, so trimming in between must renumber them.
+static int TestTrimMemoryPendingSplit(void)
+{
+	b2WorldDef worldDef = b2DefaultWorldDef();
+	worldDef.gravity = b2Vec2_zero;
+	b2WorldId worldId = b2CreateWorld(&worldDef);
+
+	b2BodyDef bodyDef = b2DefaultBodyDef();
+	bodyDef.type = b2_dynamicBody;
+	b2ShapeDef shapeDef = b2DefaultShapeDef();
+	b2Circle circle = {{0.0f, 0.0f}, 0.5f};
+
+	b2BodyId extraIds[4];
+	for (int i = 0; i < 4; ++i)
+	{
+		bodyDef.position = (b2Vec2){-10.0f * (i + 1), 0.0f};
+		extraIds[i] = b2CreateBody(worldId, &bodyDef);
+		b2CreateCircleShape(extraIds[i], &shapeDef, &circle);
+	}
+
+	bodyDef.position = (b2Vec2){0.0f, 0.0f};
+	b2BodyId bodyIdA = b2CreateBody(worldId, &bodyDef);
+	b2CreateCircleShape(bodyIdA, &shapeDef, &circle);
+
+	bodyDef.position = (b2Vec2){2.0f, 0.0f};
+	b2BodyId bodyIdB = b2CreateBody(worldId, &bodyDef);
+	b2CreateCircleShape(bodyIdB, &shapeDef, &circle);
+
+	b2DistanceJointDef jointDef = b2DefaultDistanceJointDef();
+	jointDef.bodyIdA = bodyIdA;
+	jointDef.bodyIdB = bodyIdB;
+	jointDef.length = 2.0f;
+	b2JointId jointId = b2CreateDistanceJoint(worldId, &jointDef);
+
+	for (int i = 0; i < 10; ++i)
+	{
+		b2World_Step(worldId, 1.0f / 60.0f, 4);
+	}
+
+	b2DestroyJoint(jointId);
+	for (int i = 0; i < 4; ++i)
+	{
+		b2DestroyBody(extraIds[i]);
+	}
+
+	// Once the bodies are ready to sleep a step flags their island as a split candidate
+	for (int i = 0; i < 60; ++i)
+	{
+		b2World_Step(worldId, 1.0f / 60.0f, 4);
+		b2World_TrimMemory(worldId);
+	}
+
+	b2Counters counters = b2World_GetCounters(worldId);
+	ENSURE(counters.bodyCount == 2);
+	ENSURE(counters.islandCount == 2);
+	ENSURE(b2Body_IsAwake(bodyIdA) == false);
+	ENSURE(b2Body_IsAwake(bodyIdB) == false);
+
+	b2DestroyWorld(worldId);
+
+	return 0;
+}
+
+// Create calls fail with a null id once the world is over its budget
+static int TestMemoryBudget(void)
+{
+	b2WorldDef worldDef = b2DefaultWorldDef();
+	worldDef.memoryBudget = 1 << 20;
+	worldDef.memoryBudgetPolicy = b2_failCreateAndContactsOverBudget;
+	worldDef.gravity = b2Vec2_zero;
+	b2WorldId worldId = b2CreateWorld(&worldDef);
+
+	b2BodyDef bodyDef = b2DefaultBodyDef();
+	bodyDef.type = b2_dynamicBody;
+	b2ShapeDef shapeDef = b2DefaultShapeDef();
+	b2Polygon box = b2MakeSquare(0.5f);
+
+	enum
+	{
+		e_maxCount = 20000
+	};
+
+	b2BodyId* bodyIds = malloc(e_maxCount * sizeof(b2BodyId));
+
+	int createCount = 0;
+	for (int i = 0; i < e_maxCount; ++i)
+	{
+		// overlapping boxes so every pair wants a contact
+		bodyDef.position = (b2Vec2){0.01f * (i % 100), 0.01f * (i / 100)};
+		b2BodyId bodyId = b2CreateBody(worldId, &bodyDef);
+		if (B2_IS_NULL(bodyId))
+		{
+			break;
+		}
+
+		b2ShapeId shapeId = b2CreatePolygonShape(bodyId, &shapeDef, &box);
+		if (B2_IS_NULL(shapeId))
+		{
+			break;
+		}
+
+		bodyIds[createCount] = bodyId;
+		createCount += 1;
+	}
+
+	ENSURE(0 < createCount && createCount < e_maxCount);
+
+	b2MemoryStats stats = b2World_GetMemoryStats(worldId);
+	ENSURE(stats.failedCreateCount == 1);
+	ENSURE(stats.totalBytes >= worldDef.memoryBudget);
+
+	b2World_Step(worldId, 1.0f / 60.0f, 4);
+
+	stats = b2World_GetMemoryStats(worldId);
+	b2Counters counters = b2World_GetCounters(worldId);
+	ENSURE(stats.refusedContactCount > 0);
+	ENSURE(counters.contactCount == 0);
+
+	// Without gravity the bodies don't move, so the refused pairs are only found again because they are retried
+	for (int i = 10; i < createCount; ++i)
+	{
+		b2DestroyBody(bodyIds[i]);
+	}
+
+	b2World_TrimMemory(worldId);
+
+	stats = b2World_GetMemoryStats(worldId);
+	ENSURE(stats.totalBytes < worldDef.memoryBudget);
+
+	b2World_Step(worldId, 1.0f / 60.0f, 4);
+
+	counters = b2World_GetCounters(worldId);
+	ENSURE(counters.contactCount == 10 * 9 / 2);
+
+	free(bodyIds);
+	b2DestroyWorld(worldId);
+
+	return 0;
+}
+
+typedef struct WorldAllocContext
+{
+	int allocCount;
+	int freeCount;
+	int byteCount;
+} WorldAllocContext;
+
+static void* WorldAlloc(unsigned int size, int alignment, void* context)
+{
+	WorldAllocContext* allocContext = context;
+	allocContext->allocCount += 1;
+	allocContext->byteCount += (int)size;
+#ifdef _WIN32
+	return _aligned_malloc(size, alignment);
+#else
+	return aligned_alloc(alignment, size);
+#endif
+}
+
+static void WorldFree(void* mem, unsigned int size, void* context)
+{
+	WorldAllocContext* allocContext = context;
+	allocContext->freeCount += 1;
+	allocContext->byteCount -= (int)size;
+#ifdef _WIN32
+	_aligned_free(mem);
+#else
+	free(mem);
+#endif
+}
+
+// All memory held by the world goes through its own allocator
+static int TestWorldAllocator(void)
+{
+	WorldAllocContext allocContext = {0};
+
+	b2WorldDef worldDef = b2DefaultWorldDef();
+	worldDef.allocFcn = WorldAlloc;
+	worldDef.freeFcn = WorldFree;
+	worldDef.allocContext = &allocContext;
+	worldDef.workerCount = 1;
+	b2WorldId worldId = b2CreateWorld(&worldDef);
+
+	ENSURE(allocContext.allocCount > 0);
+
+	b2BodyDef bodyDef = b2DefaultBodyDef();
+	b2BodyId groundId = b2CreateBody(worldId, &bodyDef);
+
+	b2ShapeDef shapeDef = b2DefaultShapeDef();
+	b2Vec2 points[4] = {{-20.0f, 10.0f}, {-20.0f, 0.0f}, {20.0f, 0.0f}, {20.0f, 10.0f}};
+	b2ChainDef chainDef = b2DefaultChainDef();
+	chainDef.points = points;
+	chainDef.count = 4;
+	b2CreateChain(groundId, &chainDef);
+
+	b2Polygon box = b2MakeSquare(0.5f);
+	bodyDef.type = b2_dynamicBody;
+	for (int i = 0; i < 200; ++i)
+	{
+		bodyDef.position = (b2Vec2){-10.0f + 1.0f * (i % 20), 0.5f + 1.0f * (i / 20)};
+		b2BodyId bodyId = b2CreateBody(worldId, &bodyDef);
+		b2CreatePolygonShape(bodyId, &shapeDef, &box);
+	}
+
+	for (int i = 0; i < 10; ++i)
+	{
+		b2World_Step(worldId, 1.0f / 60.0f, 4);
+	}
+
+	// The world counts requested bytes and the callbacks see them rounded to the alignment
+	b2Counters counters = b2World_GetCounters(worldId);
+	ENSURE(counters.byteCount > 0);
+	ENSURE(counters.byteCount <= allocContext.byteCount);
+
+	b2DestroyWorld(worldId);
+
+	ENSURE(allocContext.allocCount == allocContext.freeCount);
+	ENSURE(allocContext.byteCount == 0);
+
+	return 0;
+}
+
+static b2WorldId CreateTraceWorld(void)
+{
+	b2WorldDef worldDef = b2DefaultWorldDef();
+	b2WorldId worldId = b2CreateWorld(&worldDef);
+
+	b2BodyDef bodyDef = b2DefaultBodyDef();
+	b2BodyId groundId = b2CreateBody(worldId, &bodyDef);
+	b2ShapeDef shapeDef = b2DefaultShapeDef();
+	b2Segment segment = {{-20.0f, 0.0f}, {20.0f, 0.0f}};
+	b2CreateSegmentShape(groundId, &shapeDef, &segment);
+
+	b2Polygon box = b2MakeSquare(0.5f);
+	bodyDef.type = b2_dynamicBody;
+	for (int i = 0; i < 10; ++i)
+	{
+		bodyDef.position = (b2Vec2){0.0f, 0.5f + 1.0f * i};
+		b2BodyId bodyId = b2CreateBody(worldId, &bodyDef);
+		b2CreatePolygonShape(bodyId, &shapeDef, &box);
+	}
+
+	return worldId;
+}
+
+typedef struct StepThreadContext
+{
+	b2WorldId worldId;
+	_Atomic int started;
+	_Atomic int done;
+} StepThreadContext;
+
+// Step in a loop until the main thread is done
+static void StepThreadTask(uint32_t startIndex, uint32_t endIndex, uint32_t threadIndex, void* context)
+{
+	MAYBE_UNUSED(startIndex);
+	MAYBE_UNUSED(endIndex);
+	MAYBE_UNUSED(threadIndex);
+
+	StepThreadContext* stepContext = context;
+	atomic_store(&stepContext->started, 1);
+
+	while (atomic_load(&stepContext->done) == 0)
+	{
+		b2World_Step(stepContext->worldId, 1.0f / 60.0f, 4);
+	}
+}
+
+// Another world steps on a worker thread the whole time. Its zones are recorded while tracing is on, but
+// they are not written to this world's trace, and freeing the buffers waits for it.
+static int TestTrace(void)
+{
+	int startByteCount = b2GetByteCount();
+
+	enkiTaskScheduler* taskScheduler = enkiNewTaskScheduler();
+	struct enkiTaskSchedulerConfig config = enkiGetTaskSchedulerConfig(taskScheduler);
+	config.numTaskThreadsToCreate = 1;
+	enkiInitTaskSchedulerWithConfig(taskScheduler, config);
+
+	b2WorldId worldId = CreateTraceWorld();
+
+	StepThreadContext stepContext = {0};
+	stepContext.worldId = CreateTraceWorld();
+
+	enkiTaskSet* stepTask = enkiCreateTaskSet(taskScheduler, StepThreadTask);
+	struct enkiParamsTaskSet params;
+	params.minRange = 1;
+	params.setSize = 1;
+	params.pArgs = &stepContext;
+	params.priority = 0;
+	enkiSetParamsTaskSet(stepTask, params);
+	enkiAddTaskSet(taskScheduler, stepTask);
+
+	while (atomic_load(&stepContext.started) == 0)
+	{
+	}
+
+	// Steps before tracing is enabled are not recorded
+	b2World_Step(worldId, 1.0f / 60.0f, 4);
+
+	b2World_EnableTrace(worldId, true);
+	for (int i = 0; i < 5; ++i)
+	{
+		b2World_Step(worldId, 1.0f / 60.0f, 4);
+	}
+	b2World_EnableTrace(worldId, false);
+
+	// Disabled tracing keeps the events for writing
+	const char* path = "box2d_trace_test.json";
+	bool success = b2World_WriteTrace(worldId, path);
+	ENSURE(success);
+
+	FILE* file = fopen(path, "r");
+	ENSURE(file != NULL);
+
+	// One event per line, the step zone encloses everything else in a step
+	char line[256];
+	int lineCount = 0;
+	int stepCount = 0;
+	while (fgets(line, sizeof(line), file) != NULL)
+	{
+		if (lineCount == 0)
+		{
+			ENSURE(strcmp(line, "{\"traceEvents\":[\n") == 0);
+		}
+
+		lineCount += 1;
+		stepCount += strstr(line, "\"name\":\"Step\",\"ph\":\"X\"") != NULL ? 1 : 0;
+	}
+
+	fclose(file);
+	remove(path);
+
+	ENSURE(stepCount == 5);
+
+	// The ring buffers are freed with the last world that used them
+	b2DestroyWorld(worldId);
+
+	atomic_store(&stepContext.done, 1);
+	enkiWaitForTaskSet(taskScheduler, stepTask);
+	b2DestroyWorld(stepContext.worldId);
+
+	enkiDeleteTaskSet(taskScheduler, stepTask);
+	enkiDeleteTaskScheduler(taskScheduler);
+
+	ENSURE(b2GetByteCount() == startByteCount);
+
+	return 0;
+}
+
+// The worker change lists are only filled between the task that produces them and the serial code that consumes
+// them. This task system runs each task inline and records the lists whenever the world finishes a task.
+typedef struct ChangeListContext
+{
+	b2World* world;
+
+	// Body ids of the contacts that changed state
+	int contactBodyIds[8][2];
+	int contactChangeCount;
+
+	// Body ids of the awake bodies with enlarged AABBs
+	int enlargedBodyIds[8];
+	int enlargedCount;
+} ChangeListContext;
+
+static void* ChangeListEnqueueTask(b2TaskCallback* task, int32_t itemCount, int32_t minRange, void* taskContext, void* userContext)
+{
+	MAYBE_UNUSED(minRange);
+	task(0, itemCount, 0, taskContext);
+
+	// Not NULL so the world calls finish
+	return userContext;
+}
+
+static void ChangeListFinishTask(void* userTask, void* userContext)
+{
+	MAYBE_UNUSED(userTask);
+	ChangeListContext* context = userContext;
+	b2World* world = context->world;
+	b2SolverSet* awakeSet = world->solverSetArray + b2_awakeSet;
+
+	int contactChangeCount = 0;
+	int enlargedCount = 0;
+	for (int i = 0; i < b2Array(world->taskContextArray).count; ++i)
+	{
+		b2TaskContext* taskContext = world->taskContextArray + i;
+		contactChangeCount += taskContext->contactChanges.count;
+		enlargedCount += taskContext->enlargedSims.count;
+	}
+
+	// The lists only grow until they are consumed, so the last non-empty record is complete
+	if (contactChangeCount > 0)
+	{
+		context->contactChangeCount = 0;
+		for (int i = 0; i < b2Array(world->taskContextArray).count; ++i)
+		{
+			b2ArenaIntArray* changes = &world->taskContextArray[i].contactChanges;
+			for (int j = 0; j < changes->count && context->contactChangeCount < 8; ++j)
+			{
+				b2Contact* contact = world->contactArray + changes->data[j];
+				int index = context->contactChangeCount++;
+				context->contactBodyIds[index][0] = world->shapeArray[contact->shapeIdA].bodyId;
+				context->contactBodyIds[index][1] = world->shapeArray[contact->shapeIdB].bodyId;
+			}
+		}
+	}
+
+	if (enlargedCount > 0)
+	{
+		context->enlargedCount = 0;
+		for (int i = 0; i < b2Array(world->taskContextArray).count; ++i)
+		{
+			b2ArenaIntArray* sims = &world->taskContextArray[i].enlargedSims;
+			for (int j = 0; j < sims->count && context->enlargedCount < 8; ++j)
+			{
+				context->enlargedBodyIds[context->enlargedCount++] = awakeSet->sims.data[sims->data[j]].bodyId;
+			}
+		}
+	}
+}
+
+static bool ChangeListsAreClear(b2World* world)
+{
+	for (int i = 0; i < b2Array(world->taskContextArray).count; ++i)
+	{
+		b2TaskContext* taskContext = world->taskContextArray + i;
+		if (taskContext->contactChanges.count > 0 || taskContext->enlargedSims.count > 0 ||
+			taskContext->fastBodies.count > 0 || taskContext->bulletBodies.count > 0)
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// The sparse change lists hold exactly the contacts and bodies that changed in a step and are empty after it
+static int TestChangeLists(void)
+{
+	ChangeListContext context = {0};
+
+	b2WorldDef worldDef = b2DefaultWorldDef();
+	worldDef.gravity = b2Vec2_zero;
+	worldDef.workerCount = 1;
+	worldDef.enqueueTask = ChangeListEnqueueTask;
+	worldDef.finishTask = ChangeListFinishTask;
+	worldDef.userTaskContext = &context;
+	b2WorldId worldId = b2CreateWorld(&worldDef);
+	context.world = b2GetWorldFromId(worldId);
+
+	b2BodyDef bodyDef = b2DefaultBodyDef();
+	b2BodyId groundId = b2CreateBody(worldId, &bodyDef);
+
+	b2ShapeDef shapeDef = b2DefaultShapeDef();
+	b2Polygon box = b2MakeBox(1.0f, 1.0f);
+	b2CreatePolygonShape(groundId, &shapeDef, &box);
+
+	// Resting on the ground without moving
+	box = b2MakeSquare(0.5f);
+	bodyDef.type = b2_dynamicBody;
+	bodyDef.position = (b2Vec2){0.0f, 1.5f};
+	b2BodyId restingId = b2CreateBody(worldId, &bodyDef);
+	b2CreatePolygonShape(restingId, &shapeDef, &box);
+
+	// Moving alone, far from the ground
+	bodyDef.position = (b2Vec2){20.0f, 0.0f};
+	bodyDef.linearVelocity = (b2Vec2){0.0f, 10.0f};
+	b2BodyId movingId = b2CreateBody(worldId, &bodyDef);
+	b2CreatePolygonShape(movingId, &shapeDef, &box);
+
+	// Asleep until woken
+	bodyDef.position = (b2Vec2){-20.0f, 0.0f};
+	bodyDef.linearVelocity = b2Vec2_zero;
+	bodyDef.isAwake = false;
+	b2BodyId sleepingId = b2CreateBody(worldId, &bodyDef);
+	b2CreatePolygonShape(sleepingId, &shapeDef, &box);
+
+	// The resting box begins touching the ground and the moving box leaves its fat AABB
+	b2World_Step(worldId, 1.0f / 60.0f, 4);
+
+	ENSURE(context.contactChangeCount == 1);
+	ENSURE(context.contactBodyIds[0][0] == groundId.index1 - 1 || context.contactBodyIds[0][1] == groundId.index1 - 1);
+	ENSURE(context.contactBodyIds[0][0] == restingId.index1 - 1 || context.contactBodyIds[0][1] == restingId.index1 - 1);
+	ENSURE(context.enlargedCount == 1);
+	ENSURE(context.enlargedBodyIds[0] == movingId.index1 - 1);
+	ENSURE(ChangeListsAreClear(context.world));
+
+	// Move the resting box off the ground, put the moving box to sleep, and wake the sleeping box with a velocity
+	b2Body_SetTransform(restingId, (b2Vec2){0.0f, 10.0f}, 0.0f);
+	b2Body_SetAwake(movingId, false);
+	b2Body_SetAwake(sleepingId, true);
+	b2Body_SetLinearVelocity(sleepingId, (b2Vec2){10.0f, 0.0f});
+
+	context.contactChangeCount = 0;
+	context.enlargedCount = 0;
+	b2World_Step(worldId, 1.0f / 60.0f, 4);
+
+	ENSURE(context.contactChangeCount == 1);
+	ENSURE(context.contactBodyIds[0][0] == groundId.index1 - 1 || context.contactBodyIds[0][1] == groundId.index1 - 1);
+	ENSURE(context.contactBodyIds[0][0] == restingId.index1 - 1 || context.contactBodyIds[0][1] == restingId.index1 - 1);
+	ENSURE(context.enlargedCount == 1);
+	ENSURE(context.enlargedBodyIds[0] == sleepingId.index1 - 1);
+	ENSURE(ChangeListsAreClear(context.world));
+
+	// Nothing changes
+	b2Body_SetLinearVelocity(sleepingId, b2Vec2_zero);
+	b2World_Step(worldId, 1.0f / 60.0f, 4);
+
+	context.contactChangeCount = 0;
+	context.enlargedCount = 0;
+	b2World_Step(worldId, 1.0f / 60.0f, 4);
+
+	ENSURE(context.contactChangeCount == 0);
+	ENSURE(context.enlargedCount == 0);
+	ENSURE(ChangeListsAreClear(context.world));
+
+	b2DestroyWorld(worldId);
+
+	return 0;
+}
+
 int WorldTest(void)
 {
 	RUN_SUBTEST(HelloWorld);
 	RUN_SUBTEST(EmptyWorld);
 	RUN_SUBTEST(DestroyAllBodiesWorld);
 	RUN_SUBTEST(TestIsValid);
+	RUN_SUBTEST(TestQuerySnapshot);
+	RUN_SUBTEST(TestConcurrentQueries);
+	RUN_SUBTEST(TestStackReserve);
+	RUN_SUBTEST(TestStackReserveBeginTouch);
+	RUN_SUBTEST(TestMemoryStats);
+	RUN_SUBTEST(TestSmallWorldMemory);
+	RUN_SUBTEST(TestShapeGeometry);
+	RUN_SUBTEST(TestTrimMemory);
+	RUN_SUBTEST(TestTrimMemoryPendingSplit);
+	RUN_SUBTEST(TestMemoryBudget);
+	RUN_SUBTEST(TestWorldAllocator);
+	RUN_SUBTEST(TestTrace);
+	RUN_SUBTEST(TestChangeLists);
 
 	return 0;
 }